@@ -98,6 +98,8 @@ struct boot_times {
         usec_t generators_finish_time;
         usec_t unitsload_start_time;
         usec_t unitsload_finish_time;
+        usec_t coldplug_start_time;
+        usec_t coldplug_finish_time;
 
         /*
          * If we're analyzing the user instance, all timestamps will be offset
@@ -289,6 +291,18 @@ static int acquire_boot_times(sd_bus *bus, struct boot_times **bt) {
                                     &times.unitsload_finish_time) < 0)
                 return -EIO;
 
+        /* Older versions of systemd don't expose these, don't fail if they're missing */
+        (void) bus_get_uint64_property(bus,
+                                       "/org/freedesktop/systemd1",
+                                       "org.freedesktop.systemd1.Manager",
+                                       "ColdplugStartTimestampMonotonic",
+                                       &times.coldplug_start_time);
+        (void) bus_get_uint64_property(bus,
+                                       "/org/freedesktop/systemd1",
+                                       "org.freedesktop.systemd1.Manager",
+                                       "ColdplugFinishTimestampMonotonic",
+                                       &times.coldplug_finish_time);
+
         if (times.finish_time <= 0) {
                 log_error("Bootup is not yet finished. Please try again later.");
                 return -EINPROGRESS;
@@ -312,6 +326,9 @@ static int acquire_boot_times(sd_bus *bus, struct boot_times **bt) {
 
                 subtract_timestamp(&times.unitsload_start_time, times.reverse_offset);
                 subtract_timestamp(&times.unitsload_finish_time, times.reverse_offset);
+
+                subtract_timestamp(&times.coldplug_start_time, times.reverse_offset);
+                subtract_timestamp(&times.coldplug_finish_time, times.reverse_offset);
         } else {
                 if (times.initrd_time)
                         times.kernel_done_time = times.initrd_time;
@@ -559,6 +576,14 @@ static int pretty_boot_time(sd_bus *bus, char **_buf) {
         else if (!unit_id)
                 size = strpcpyf(&ptr, size, "\ncould not find default.target");
 
+        if (t->generators_finish_time > t->generators_start_time &&
+            t->unitsload_finish_time > t->unitsload_start_time) {
+                size = strpcpyf(&ptr, size, "\nManager startup took %s (generators)", format_timespan(ts, sizeof(ts), t->generators_finish_time - t->generators_start_time, USEC_PER_MSEC));
+                size = strpcpyf(&ptr, size, " + %s (loading units)", format_timespan(ts, sizeof(ts), t->unitsload_finish_time - t->unitsload_start_time, USEC_PER_MSEC));
+                if (t->coldplug_finish_time > t->coldplug_start_time)
+                        size = strpcpyf(&ptr, size, " + %s (coldplug)", format_timespan(ts, sizeof(ts), t->coldplug_finish_time - t->coldplug_start_time, USEC_PER_MSEC));
+        }
+
 
         ptr = strdup(buf);
         if (!ptr)
@@ -675,7 +700,7 @@ static int analyze_plot(int argc, char *argv[], void *userdata) {
         svg("<svg width=\"%.0fpx\" height=\"%.0fpx\" version=\"1.1\" "
             "xmlns=\"http://www.w3.org/2000/svg\">\n\n",
                         80.0 + width, 150.0 + (m * SCALE_Y) +
-                        5 * SCALE_Y /* legend */);
+                        6 * SCALE_Y /* legend */);
 
         /* write some basic info as a comment, including some help */
         svg("<!-- This file is a systemd-analyze SVG file. It is best rendered in a   -->\n"
@@ -700,6 +725,7 @@ static int analyze_plot(int argc, char *argv[], void *userdata) {
             "      rect.security     { fill: rgb(144,238,144); fill-opacity: 0.7; }\n"
             "      rect.generators   { fill: rgb(102,204,255); fill-opacity: 0.7; }\n"
             "      rect.unitsload    { fill: rgb( 82,184,255); fill-opacity: 0.7; }\n"
+            "      rect.coldplug     { fill: rgb( 62,164,255); fill-opacity: 0.7; }\n"
             "      rect.box   { fill: rgb(240,240,240); stroke: rgb(192,192,192); }\n"
             "      line       { stroke: rgb(64,64,64); stroke-width: 1; }\n"
             "//    line.sec1  { }\n"
@@ -749,6 +775,7 @@ static int analyze_plot(int argc, char *argv[], void *userdata) {
         svg_bar("security", boot->security_start_time, boot->security_finish_time, y);
         svg_bar("generators", boot->generators_start_time, boot->generators_finish_time, y);
         svg_bar("unitsload", boot->unitsload_start_time, boot->unitsload_finish_time, y);
+        svg_bar("coldplug", boot->coldplug_start_time, boot->coldplug_finish_time, y);
         svg_text(true, boot->userspace_time, y, "systemd");
         y++;
 
@@ -796,6 +823,9 @@ static int analyze_plot(int argc, char *argv[], void *userdata) {
         svg_bar("unitsload", 0, 300000, y);
         svg_text(true, 400000, y, "Loading unit files");
         y++;
+        svg_bar("coldplug", 0, 300000, y);
+        svg_text(true, 400000, y, "Restoring unit states");
+        y++;
 
         svg("</g>\n\n");
 
@@ -1070,6 +1100,77 @@ static int analyze_blame(int argc, char *argv[], void *userdata) {
         return 0;
 }
 
+struct generator_time {
+        const char *path;
+        usec_t time;
+        int cached;
+};
+
+static int compare_generator_time(const void *a, const void *b) {
+        return compare(((struct generator_time *)b)->time,
+                       ((struct generator_time *)a)->time);
+}
+
+static int analyze_generator_times(int argc, char *argv[], void *userdata) {
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        _cleanup_free_ struct generator_time *times = NULL;
+        struct generator_time t = {};
+        size_t n = 0, n_allocated = 0, i;
+        int r;
+
+        r = acquire_bus(false, &bus);
+        if (r < 0)
+                return log_error_errno(r, "Failed to create bus connection: %m");
+
+        r = sd_bus_get_property(
+                        bus,
+                        "org.freedesktop.systemd1",
+                        "/org/freedesktop/systemd1",
+                        "org.freedesktop.systemd1.Manager",
+                        "GeneratorTimes",
+                        &error,
+                        &reply,
+                        "a(stb)");
+        if (r < 0) {
+                log_error("Failed to get generator times: %s", bus_error_message(&error, -r));
+                return r;
+        }
+
+        r = sd_bus_message_enter_container(reply, 'a', "(stb)");
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        while ((r = sd_bus_message_read(reply, "(stb)", &t.path, &t.time, &t.cached)) > 0) {
+                if (!GREEDY_REALLOC(times, n_allocated, n + 1))
+                        return log_oom();
+
+                times[n++] = t;
+        }
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        r = sd_bus_message_exit_container(reply);
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        qsort_safe(times, n, sizeof(struct generator_time), compare_generator_time);
+
+        pager_open(arg_no_pager, false);
+
+        for (i = 0; i < n; i++) {
+                char ts[FORMAT_TIMESPAN_MAX];
+
+                if (times[i].cached)
+                        printf("%16s %s\n", "(cached)", times[i].path);
+                else
+                        printf("%16s %s\n", format_timespan(ts, sizeof(ts), times[i].time, USEC_PER_MSEC), times[i].path);
+        }
+
+        return 0;
+}
+
 static int analyze_time(int argc, char *argv[], void *userdata) {
         _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
         _cleanup_free_ char *buf = NULL;
@@ -1614,6 +1715,7 @@ static int help(int argc, char *argv[], void *userdata) {
                "Commands:\n"
                "  time                     Print time spent in the kernel\n"
                "  blame                    Print list of running units ordered by time to init\n"
+               "  generator-times          Print list of generators ordered by time they took\n"
                "  critical-chain [UNIT...] Print a tree of the time critical chain of units\n"
                "  plot                     Output SVG graphic showing service initialization\n"
                "  dot [UNIT...]            Output dependency graph in man:dot(1) format\n"
@@ -1772,6 +1874,7 @@ int main(int argc, char *argv[]) {
                 { "help",              VERB_ANY, VERB_ANY, 0,            help                   },
                 { "time",              VERB_ANY, 1,        VERB_DEFAULT, analyze_time           },
                 { "blame",             VERB_ANY, 1,        0,            analyze_blame          },
+                { "generator-times",   VERB_ANY, 1,        0,            analyze_generator_times },
                 { "critical-chain",    VERB_ANY, VERB_ANY, 0,            analyze_critical_chain },
                 { "plot",              VERB_ANY, 1,        0,            analyze_plot           },
                 { "dot",               VERB_ANY, VERB_ANY, 0,            dot                    },
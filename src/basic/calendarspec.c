@@ -40,8 +40,6 @@
 #include "time-util.h"
 
 #define BITS_WEEKDAYS 127
-#define MIN_YEAR 1970
-#define MAX_YEAR 2199
 
 static void free_chain(CalendarComponent *c) {
         CalendarComponent *n;
@@ -154,6 +152,92 @@ static void fix_year(CalendarComponent *c) {
         }
 }
 
+static void bitmap_set_progression(uint64_t *bits, int from, int to, int start, int stop, int repeat) {
+        int v;
+
+        /* Marks all values start, start + repeat, … up to stop (or without limit if stop is negative) that lie
+         * within [from, to]. Bit 0 corresponds to from. These are exactly the values find_matching_component()
+         * would pick for this component. */
+
+        if (start >= from && start <= to)
+                bits[(start - from) / 64] |= UINT64_C(1) << ((start - from) % 64);
+
+        if (repeat <= 0)
+                return;
+
+        v = start + repeat;
+        if (v < from)
+                v += (from - v + repeat - 1) / repeat * repeat;
+
+        for (; v <= to && (stop < 0 || v <= stop); v += repeat)
+                bits[(v - from) / 64] |= UINT64_C(1) << ((v - from) % 64);
+}
+
+static void compile_chain(const CalendarComponent *c, int from, int to, uint64_t *bits) {
+        int v;
+
+        /* No component means that any value matches */
+        if (!c) {
+                for (v = from; v <= to; v++)
+                        bits[(v - from) / 64] |= UINT64_C(1) << ((v - from) % 64);
+                return;
+        }
+
+        for (; c; c = c->next)
+                bitmap_set_progression(bits, from, to, c->start, c->stop, c->repeat);
+}
+
+static int end_of_month_day(int length, int day) {
+        int d;
+
+        /* For the "~" syntax: day 1 is the last day of the month, day 2 the one before, and so on */
+
+        d = length + 1 - day;
+        return d >= 1 && d <= length ? d : -1;
+}
+
+static void compile_days(CalendarSpec *c) {
+        const CalendarComponent *cc;
+        int length;
+
+        for (length = 28; length <= 31; length++) {
+                uint64_t *bits = c->day_bits + length - 28;
+
+                if (!c->end_of_month) {
+                        compile_chain(c->day, 1, length, bits);
+                        continue;
+                }
+
+                for (cc = c->day; cc; cc = cc->next) {
+                        int start, stop;
+
+                        start = end_of_month_day(length, cc->start);
+                        stop = end_of_month_day(length, cc->stop);
+
+                        if (stop > 0)
+                                SWAP_TWO(start, stop);
+
+                        bitmap_set_progression(bits, 1, length, start, stop, cc->repeat);
+                }
+        }
+}
+
+static void calendar_spec_compile(CalendarSpec *c) {
+        assert(c);
+
+        zero(c->year_bits);
+        zero(c->day_bits);
+        c->month_bits = c->hour_bits = c->minute_bits = 0;
+
+        compile_chain(c->year, CALENDAR_SPEC_YEAR_MIN, CALENDAR_SPEC_YEAR_MAX, c->year_bits);
+        compile_chain(c->month, 1, 12, &c->month_bits);
+        compile_days(c);
+        compile_chain(c->hour, 0, 23, &c->hour_bits);
+        compile_chain(c->minute, 0, 59, &c->minute_bits);
+
+        c->compiled = true;
+}
+
 int calendar_spec_normalize(CalendarSpec *c) {
         assert(c);
 
@@ -177,6 +261,8 @@ int calendar_spec_normalize(CalendarSpec *c) {
         normalize_chain(&c->minute);
         normalize_chain(&c->microsecond);
 
+        calendar_spec_compile(c);
+
         return 0;
 }
 
@@ -223,7 +309,7 @@ _pure_ bool calendar_spec_valid(CalendarSpec *c) {
         if (c->weekdays_bits > BITS_WEEKDAYS)
                 return false;
 
-        if (!chain_valid(c->year, MIN_YEAR, MAX_YEAR, false))
+        if (!chain_valid(c->year, CALENDAR_SPEC_YEAR_MIN, CALENDAR_SPEC_YEAR_MAX, false))
                 return false;
 
         if (!chain_valid(c->month, 1, 12, false))
@@ -1114,22 +1200,7 @@ fail:
         return r;
 }
 
-static int find_end_of_month(struct tm *tm, bool utc, int day) {
-        struct tm t = *tm;
-
-        t.tm_mon++;
-        t.tm_mday = 1 - day;
-
-        if (mktime_or_timegm(&t, utc) < 0 ||
-            t.tm_mon != tm->tm_mon)
-                return -1;
-
-        return t.tm_mday;
-}
-
-static int find_matching_component(const CalendarSpec *spec, const CalendarComponent *c,
-                                   struct tm *tm, int *val) {
-        const CalendarComponent *p = c;
+static int find_matching_component(const CalendarComponent *c, int *val) {
         int start, stop, d = -1;
         bool d_set = false;
         int r;
@@ -1143,14 +1214,6 @@ static int find_matching_component(const CalendarSpec *spec, const CalendarCompo
                 start = c->start;
                 stop = c->stop;
 
-                if (spec->end_of_month && p == spec->day) {
-                        start = find_end_of_month(tm, spec->utc, start);
-                        stop = find_end_of_month(tm, spec->utc, stop);
-
-                        if (stop > 0)
-                                SWAP_TWO(start, stop);
-                }
-
                 if (start >= *val) {
 
                         if (!d_set || start < d) {
@@ -1180,150 +1243,246 @@ static int find_matching_component(const CalendarSpec *spec, const CalendarCompo
         return r;
 }
 
-static bool tm_out_of_bounds(const struct tm *tm, bool utc) {
-        struct tm t;
-        assert(tm);
+static int find_matching_bit(const uint64_t *bits, int from, int to, int *val) {
+        int k;
 
-        t = *tm;
+        /* Like find_matching_component(), but for a bitmap filled by calendar_spec_compile() */
 
-        if (mktime_or_timegm(&t, utc) < 0)
-                return true;
+        assert(bits);
+        assert(val);
 
-        /*
-         * Set an upper bound on the year so impossible dates like "*-02-31"
-         * don't cause find_next() to loop forever. tm_year contains years
-         * since 1900, so adjust it accordingly.
-         */
-        if (tm->tm_year + 1900 > MAX_YEAR)
-                return true;
+        for (k = MAX(*val, from) - from; k <= to - from; k = (k / 64 + 1) * 64) {
+                uint64_t m;
+                int d, r;
+
+                m = bits[k / 64] & (UINT64_MAX << (k % 64));
+                if (m == 0)
+                        continue;
+
+                d = from + k - k % 64 + __builtin_ctzll(m);
+                if (d > to)
+                        break;
 
-        /* Did any normalization take place? If so, it was out of bounds before */
+                r = *val != d;
+                *val = d;
+                return r;
+        }
+
+        return -ENOENT;
+}
+
+static bool is_leap_year(int year) {
+        return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+static int days_in_month(int year, int month) {
+        static const int days[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+        assert(month >= 1 && month <= 12);
+
+        return month == 2 && is_leap_year(year) ? 29 : days[month - 1];
+}
+
+static int day_of_week(int year, int month, int day) {
+        static const int offsets[12] = { 0, 3, 2, 5, 0, 3, 5, 1, 4, 6, 2, 4 };
+        int k;
+
+        /* Returns 0 for Monday, …, 6 for Sunday, as used by weekdays_bits */
+
+        if (month < 3)
+                year--;
+
+        k = (year + year/4 - year/100 + year/400 + offsets[month - 1] + day) % 7; /* 0 is Sunday */
+        return k == 0 ? 6 : k - 1;
+}
+
+static bool tm_equal_fields(const struct tm *a, const struct tm *b) {
         return
-                t.tm_year != tm->tm_year ||
-                t.tm_mon != tm->tm_mon ||
-                t.tm_mday != tm->tm_mday ||
-                t.tm_hour != tm->tm_hour ||
-                t.tm_min != tm->tm_min ||
-                t.tm_sec != tm->tm_sec;
+                a->tm_year == b->tm_year &&
+                a->tm_mon == b->tm_mon &&
+                a->tm_mday == b->tm_mday &&
+                a->tm_hour == b->tm_hour &&
+                a->tm_min == b->tm_min &&
+                a->tm_sec == b->tm_sec;
 }
 
-static bool matches_weekday(int weekdays_bits, const struct tm *tm, bool utc) {
+static int tm_resolve(const struct tm *tm, bool utc, int dst, time_t not_before, time_t *ret) {
+        time_t local, best = (time_t) -1;
+        long prev_gmtoff = 0;
         struct tm t;
-        int k;
+        unsigned k;
 
-        if (weekdays_bits < 0 || weekdays_bits >= BITS_WEEKDAYS)
-                return true;
+        assert(tm);
+        assert(ret);
+
+        /* Checks whether the specified point in time exists at or after not_before, i.e. does not fall into a
+         * DST gap, and returns it as time_t. Points in time that exist twice when DST ends resolve to the earlier
+         * occurrence not before not_before: if we are in the repeated hour already, the first pass through it is
+         * over. Returns > 0 if it exists, 0 if it doesn't.
+         *
+         * Note that we don't use mktime() here: glibc's implementation walks far into the past and future when
+         * asked for a tm_isdst value not in effect, which made it the most expensive part of the search. Instead,
+         * we try the UTC offsets in effect a day before and a day after, and verify each with localtime_r(). */
 
         t = *tm;
-        if (mktime_or_timegm(&t, utc) < 0)
-                return false;
+        local = mktime_or_timegm(&t, true);
+        if (local == (time_t) -1)
+                return 0;
+
+        if (utc) {
+                if (local < not_before)
+                        return 0;
+
+                *ret = local;
+                return 1;
+        }
+
+        for (k = 0; k < 2; k++) {
+                time_t probe, candidate;
+
+                probe = local + (k == 0 ? -1 : 1) * 24 * 60 * 60;
+                if (!localtime_r(&probe, &t))
+                        continue;
+
+                if (k > 0 && t.tm_gmtoff == prev_gmtoff)
+                        continue;
+                prev_gmtoff = t.tm_gmtoff;
+
+                candidate = local - t.tm_gmtoff;
+                if (!localtime_r(&candidate, &t))
+                        continue;
+
+                if (!tm_equal_fields(&t, tm))
+                        continue;
+                if (dst >= 0 && t.tm_isdst != dst)
+                        continue;
+                if (candidate < not_before)
+                        continue;
+
+                if (best == (time_t) -1 || candidate < best)
+                        best = candidate;
+        }
+
+        if (best == (time_t) -1)
+                return 0;
 
-        k = t.tm_wday == 0 ? 6 : t.tm_wday - 1;
-        return (weekdays_bits & (1 << k));
+        *ret = best;
+        return 1;
 }
 
-static int find_next(const CalendarSpec *spec, struct tm *tm, usec_t *usec) {
-        struct tm c;
-        int tm_usec;
-        int r;
+static int find_next(const CalendarSpec *spec, time_t base, const struct tm *tm, usec_t tm_usec, usec_t *ret) {
+        int year, month, day, hour, minute, minute_usec;
+        int n_days, r;
 
         assert(spec);
+        assert(spec->compiled);
         assert(tm);
+        assert(ret);
 
-        c = *tm;
-        tm_usec = *usec;
+        /* Finds the first point in time at or after the one passed in, base broken down into tm, that matches the
+         * spec. All stepping is done on the calendar fields directly; only the final candidate is resolved to a
+         * timestamp, to skip points in time that do not exist in the local timezone, for example because they fall
+         * into a DST gap, or that are before base, because they are in the first pass through a repeated hour. */
 
-        for (;;) {
-                /* Normalize the current date */
-                (void) mktime_or_timegm(&c, spec->utc);
-                c.tm_isdst = spec->dst;
+        year = tm->tm_year + 1900;
+        month = tm->tm_mon + 1;
+        day = tm->tm_mday;
+        hour = tm->tm_hour;
+        minute = tm->tm_min;
+        minute_usec = tm->tm_sec * USEC_PER_SEC + tm_usec;
 
-                c.tm_year += 1900;
-                r = find_matching_component(spec, spec->year, &c, &c.tm_year);
-                c.tm_year -= 1900;
+        for (;;) {
+                struct tm c;
+                time_t t;
 
-                if (r > 0) {
-                        c.tm_mon = 0;
-                        c.tm_mday = 1;
-                        c.tm_hour = c.tm_min = c.tm_sec = tm_usec = 0;
-                }
+                r = find_matching_bit(spec->year_bits, CALENDAR_SPEC_YEAR_MIN, CALENDAR_SPEC_YEAR_MAX, &year);
                 if (r < 0)
                         return r;
-                if (tm_out_of_bounds(&c, spec->utc))
-                        return -ENOENT;
-
-                c.tm_mon += 1;
-                r = find_matching_component(spec, spec->month, &c, &c.tm_mon);
-                c.tm_mon -= 1;
+                if (r > 0) {
+                        month = day = 1;
+                        hour = minute = minute_usec = 0;
+                }
 
+                r = find_matching_bit(&spec->month_bits, 1, 12, &month);
                 if (r > 0) {
-                        c.tm_mday = 1;
-                        c.tm_hour = c.tm_min = c.tm_sec = tm_usec = 0;
+                        day = 1;
+                        hour = minute = minute_usec = 0;
                 }
-                if (r < 0 || tm_out_of_bounds(&c, spec->utc)) {
-                        c.tm_year++;
-                        c.tm_mon = 0;
-                        c.tm_mday = 1;
-                        c.tm_hour = c.tm_min = c.tm_sec = tm_usec = 0;
+                if (r < 0) {
+                        year++;
+                        month = day = 1;
+                        hour = minute = minute_usec = 0;
                         continue;
                 }
 
-                r = find_matching_component(spec, spec->day, &c, &c.tm_mday);
+                n_days = days_in_month(year, month);
+                r = find_matching_bit(spec->day_bits + n_days - 28, 1, n_days, &day);
                 if (r > 0)
-                        c.tm_hour = c.tm_min = c.tm_sec = tm_usec = 0;
-                if (r < 0 || tm_out_of_bounds(&c, spec->utc)) {
-                        c.tm_mon++;
-                        c.tm_mday = 1;
-                        c.tm_hour = c.tm_min = c.tm_sec = tm_usec = 0;
+                        hour = minute = minute_usec = 0;
+                if (r < 0) {
+                        month++;
+                        day = 1;
+                        hour = minute = minute_usec = 0;
                         continue;
                 }
 
-                if (!matches_weekday(spec->weekdays_bits, &c, spec->utc)) {
-                        c.tm_mday++;
-                        c.tm_hour = c.tm_min = c.tm_sec = tm_usec = 0;
+                if (spec->weekdays_bits > 0 && spec->weekdays_bits < BITS_WEEKDAYS &&
+                    !(spec->weekdays_bits & (1 << day_of_week(year, month, day)))) {
+                        day++;
+                        hour = minute = minute_usec = 0;
                         continue;
                 }
 
-                r = find_matching_component(spec, spec->hour, &c, &c.tm_hour);
+                r = find_matching_bit(&spec->hour_bits, 0, 23, &hour);
                 if (r > 0)
-                        c.tm_min = c.tm_sec = tm_usec = 0;
-                if (r < 0 || tm_out_of_bounds(&c, spec->utc)) {
-                        c.tm_mday++;
-                        c.tm_hour = c.tm_min = c.tm_sec = tm_usec = 0;
+                        minute = minute_usec = 0;
+                if (r < 0) {
+                        day++;
+                        hour = minute = minute_usec = 0;
                         continue;
                 }
 
-                r = find_matching_component(spec, spec->minute, &c, &c.tm_min);
+                r = find_matching_bit(&spec->minute_bits, 0, 59, &minute);
                 if (r > 0)
-                        c.tm_sec = tm_usec = 0;
-                if (r < 0 || tm_out_of_bounds(&c, spec->utc)) {
-                        c.tm_hour++;
-                        c.tm_min = c.tm_sec = tm_usec = 0;
+                        minute_usec = 0;
+                if (r < 0) {
+                        hour++;
+                        minute = minute_usec = 0;
                         continue;
                 }
 
-                c.tm_sec = c.tm_sec * USEC_PER_SEC + tm_usec;
-                r = find_matching_component(spec, spec->microsecond, &c, &c.tm_sec);
-                tm_usec = c.tm_sec % USEC_PER_SEC;
-                c.tm_sec /= USEC_PER_SEC;
+                r = find_matching_component(spec->microsecond, &minute_usec);
+                if (r < 0 || minute_usec >= 60 * (int) USEC_PER_SEC) {
+                        minute++;
+                        minute_usec = 0;
+                        continue;
+                }
 
-                if (r < 0 || tm_out_of_bounds(&c, spec->utc)) {
-                        c.tm_min++;
-                        c.tm_sec = tm_usec = 0;
+                c = (struct tm) {
+                        .tm_year = year - 1900,
+                        .tm_mon = month - 1,
+                        .tm_mday = day,
+                        .tm_hour = hour,
+                        .tm_min = minute,
+                        .tm_sec = minute_usec / USEC_PER_SEC,
+                };
+
+                if (tm_resolve(&c, spec->utc, spec->dst, base, &t) == 0) {
+                        /* Continue with the next quarter of an hour, as DST changes happen at such boundaries */
+                        minute = (minute / 15 + 1) * 15;
+                        minute_usec = 0;
                         continue;
                 }
 
-                *tm = c;
-                *usec = tm_usec;
+                *ret = (usec_t) t * USEC_PER_SEC + minute_usec % USEC_PER_SEC;
                 return 0;
         }
 }
 
 static int calendar_spec_next_usec_impl(const CalendarSpec *spec, usec_t usec, usec_t *next) {
+        CalendarSpec compiled;
         struct tm tm;
         time_t t;
-        int r;
-        usec_t tm_usec;
 
         assert(spec);
         assert(next);
@@ -1331,21 +1490,22 @@ static int calendar_spec_next_usec_impl(const CalendarSpec *spec, usec_t usec, u
         if (usec > USEC_TIMESTAMP_FORMATTABLE_MAX)
                 return -EINVAL;
 
+        /* Specs not passed through calendar_spec_normalize() lack the bitmaps, calculate them on a copy */
+        if (!spec->compiled) {
+                compiled = *spec;
+                calendar_spec_compile(&compiled);
+                spec = &compiled;
+        }
+
+        /* localtime_r() doesn't pick up changes of the timezone by itself, unlike mktime() which we used before */
+        if (!spec->utc)
+                tzset();
+
         usec++;
         t = (time_t) (usec / USEC_PER_SEC);
         assert_se(localtime_or_gmtime_r(&t, &tm, spec->utc));
-        tm_usec = usec % USEC_PER_SEC;
-
-        r = find_next(spec, &tm, &tm_usec);
-        if (r < 0)
-                return r;
-
-        t = mktime_or_timegm(&tm, spec->utc);
-        if (t < 0)
-                return -EINVAL;
 
-        *next = (usec_t) t * USEC_PER_SEC + tm_usec;
-        return 0;
+        return find_next(spec, t, &tm, usec % USEC_PER_SEC, next);
 }
 
 typedef struct SpecNextResult {
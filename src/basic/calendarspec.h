@@ -24,10 +24,14 @@
  * time, a la cron */
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "time-util.h"
 #include "util.h"
 
+#define CALENDAR_SPEC_YEAR_MIN 1970
+#define CALENDAR_SPEC_YEAR_MAX 2199
+
 typedef struct CalendarComponent {
         int start;
         int stop;
@@ -50,6 +54,15 @@ typedef struct CalendarSpec {
         CalendarComponent *hour;
         CalendarComponent *minute;
         CalendarComponent *microsecond;
+
+        /* Bitmaps of all values matched by the components above, so that calendar_spec_next_usec() can step
+         * through them without walking the chains. Filled in by calendar_spec_normalize(). */
+        bool compiled;
+        uint64_t year_bits[(CALENDAR_SPEC_YEAR_MAX - CALENDAR_SPEC_YEAR_MIN) / 64 + 1];
+        uint64_t month_bits;
+        uint64_t day_bits[4]; /* indexed by the length of the month minus 28 */
+        uint64_t hour_bits;
+        uint64_t minute_bits;
 } CalendarSpec;
 
 CalendarSpec* calendar_spec_free(CalendarSpec *c);
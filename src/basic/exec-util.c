@@ -22,6 +22,7 @@
 #include <errno.h>
 #include <sys/prctl.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <unistd.h>
 #include <stdio.h>
 
@@ -86,13 +87,49 @@ static int do_spawn(const char *path, char *argv[], int stdout_fd, pid_t *pid) {
         return 1;
 }
 
+typedef struct ExecChild {
+        usec_t start;
+        char path[];
+} ExecChild;
+
+static int reap_child(Hashmap *pids, exec_finish_callback_t finish, void *userdata) {
+        _cleanup_free_ ExecChild *c = NULL;
+        siginfo_t si = {};
+        pid_t pid;
+        int r;
+
+        /* Waits for whichever of our children exits first, without reaping it, so that the actual reaping and
+         * the logging can be left to wait_for_terminate_and_check(). */
+
+        if (waitid(P_ALL, 0, &si, WEXITED|WNOWAIT) < 0)
+                return -errno;
+
+        pid = si.si_pid;
+        c = hashmap_remove(pids, PID_TO_PTR(pid));
+        if (!c) {
+                /* Not one of ours, reap it anyway so that we don't spin on it */
+                (void) wait_for_terminate(pid, NULL);
+                return 0;
+        }
+
+        r = wait_for_terminate_and_check(c->path, pid, WAIT_LOG);
+        if (finish)
+                finish(c->path, r, now(CLOCK_MONOTONIC) - c->start, userdata);
+
+        return 0;
+}
+
 static int do_execute(
                 char **directories,
                 usec_t timeout,
+                unsigned n_parallel,
                 gather_stdout_callback_t const callbacks[_STDOUT_CONSUME_MAX],
                 void* const callback_args[_STDOUT_CONSUME_MAX],
                 int output_fd,
-                char *argv[]) {
+                char *argv[],
+                exec_prepare_callback_t prepare,
+                exec_finish_callback_t finish,
+                void *userdata) {
 
         _cleanup_hashmap_free_free_ Hashmap *pids = NULL;
         _cleanup_strv_free_ char **paths = NULL;
@@ -102,7 +139,8 @@ static int do_execute(
         /* We fork this all off from a child process so that we can somewhat cleanly make
          * use of SIGALRM to set a time limit.
          *
-         * If callbacks is nonnull, execution is serial. Otherwise, we default to parallel.
+         * If callbacks is nonnull, execution is serial. Otherwise, we default to parallel, with at most
+         * n_parallel binaries running at the same time (or no limit if zero).
          */
 
         r = conf_files_list_strv(&paths, NULL, NULL, CONF_FILES_EXECUTABLE, (const char* const*) directories);
@@ -122,13 +160,23 @@ static int do_execute(
                 alarm((timeout + USEC_PER_SEC - 1) / USEC_PER_SEC);
 
         STRV_FOREACH(path, paths) {
-                _cleanup_free_ char *t = NULL;
+                _cleanup_free_ ExecChild *c = NULL;
+                _cleanup_strv_free_ char **a = NULL;
                 _cleanup_close_ int fd = -1;
                 pid_t pid;
 
-                t = strdup(*path);
-                if (!t)
+                if (prepare) {
+                        r = prepare(*path, &a, userdata);
+                        if (r < 0)
+                                log_warning_errno(r, "Failed to prepare execution of %s, ignoring: %m", *path);
+                        if (r <= 0)
+                                continue;
+                }
+
+                c = malloc(offsetof(ExecChild, path) + strlen(*path) + 1);
+                if (!c)
                         return log_oom();
+                strcpy(c->path, *path);
 
                 if (callbacks) {
                         fd = open_serialization_fd(basename(*path));
@@ -136,17 +184,28 @@ static int do_execute(
                                 return log_error_errno(fd, "Failed to open serialization file: %m");
                 }
 
-                r = do_spawn(t, argv, fd, &pid);
+                if (pids)
+                        while (n_parallel > 0 && hashmap_size(pids) >= n_parallel) {
+                                r = reap_child(pids, finish, userdata);
+                                if (r < 0)
+                                        return log_error_errno(r, "Failed to wait for child: %m");
+                        }
+
+                c->start = now(CLOCK_MONOTONIC);
+
+                r = do_spawn(c->path, a ?: argv, fd, &pid);
                 if (r <= 0)
                         continue;
 
                 if (pids) {
-                        r = hashmap_put(pids, PID_TO_PTR(pid), t);
+                        r = hashmap_put(pids, PID_TO_PTR(pid), c);
                         if (r < 0)
                                 return log_oom();
-                        t = NULL;
+                        c = NULL;
                 } else {
-                        r = wait_for_terminate_and_check(t, pid, WAIT_LOG);
+                        r = wait_for_terminate_and_check(c->path, pid, WAIT_LOG);
+                        if (finish)
+                                finish(c->path, r, now(CLOCK_MONOTONIC) - c->start, userdata);
                         if (r < 0)
                                 continue;
 
@@ -167,27 +226,24 @@ static int do_execute(
         }
 
         while (!hashmap_isempty(pids)) {
-                _cleanup_free_ char *t = NULL;
-                pid_t pid;
-
-                pid = PTR_TO_PID(hashmap_first_key(pids));
-                assert(pid > 0);
-
-                t = hashmap_remove(pids, PID_TO_PTR(pid));
-                assert(t);
-
-                (void) wait_for_terminate_and_check(t, pid, WAIT_LOG);
+                r = reap_child(pids, finish, userdata);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to wait for child: %m");
         }
 
         return 0;
 }
 
-int execute_directories(
+int execute_directories_full(
                 const char* const* directories,
                 usec_t timeout,
+                unsigned n_parallel,
                 gather_stdout_callback_t const callbacks[_STDOUT_CONSUME_MAX],
                 void* const callback_args[_STDOUT_CONSUME_MAX],
-                char *argv[]) {
+                char *argv[],
+                exec_prepare_callback_t prepare,
+                exec_finish_callback_t finish,
+                void *userdata) {
 
         char **dirs = (char**) directories;
         _cleanup_close_ int fd = -1;
@@ -212,13 +268,16 @@ int execute_directories(
 
         /* Executes all binaries in the directories serially or in parallel and waits for
          * them to finish. Optionally a timeout is applied. If a file with the same name
-         * exists in more than one directory, the earliest one wins. */
+         * exists in more than one directory, the earliest one wins.
+         *
+         * The prepare and finish hooks are invoked in the forked off executor process, hence
+         * anything they want to pass back to the caller needs to go through a file descriptor. */
 
         r = safe_fork("(sd-executor)", FORK_RESET_SIGNALS|FORK_DEATHSIG|FORK_LOG|FORK_WAIT, NULL);
         if (r < 0)
                 return r;
         if (r == 0) {
-                r = do_execute(dirs, timeout, callbacks, callback_args, fd, argv);
+                r = do_execute(dirs, timeout, n_parallel, callbacks, callback_args, fd, argv, prepare, finish, userdata);
                 _exit(r < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
         }
 
@@ -235,6 +294,16 @@ int execute_directories(
         return 0;
 }
 
+int execute_directories(
+                const char* const* directories,
+                usec_t timeout,
+                gather_stdout_callback_t const callbacks[_STDOUT_CONSUME_MAX],
+                void* const callback_args[_STDOUT_CONSUME_MAX],
+                char *argv[]) {
+
+        return execute_directories_full(directories, timeout, 0, callbacks, callback_args, argv, NULL, NULL, NULL);
+}
+
 static int gather_environment_generate(int fd, void *arg) {
         char ***env = arg, **x, **y;
         _cleanup_fclose_ FILE *f = NULL;
@@ -24,6 +24,13 @@
 
 typedef int (*gather_stdout_callback_t) (int fd, void *arg);
 
+/* Called before each binary is spawned. Return 0 to skip the binary, > 0 to run it. If *ret_argv is set, it is
+ * used as argument list instead of the one passed to execute_directories_full() and freed afterwards. */
+typedef int (*exec_prepare_callback_t) (const char *path, char ***ret_argv, void *userdata);
+
+/* Called after each binary exited, with the result of wait_for_terminate_and_check() and the wallclock runtime. */
+typedef void (*exec_finish_callback_t) (const char *path, int status, usec_t duration, void *userdata);
+
 enum {
         STDOUT_GENERATE,   /* from generators to helper process */
         STDOUT_COLLECT,    /* from helper process to main process */
@@ -38,4 +45,15 @@ int execute_directories(
                 void* const callback_args[_STDOUT_CONSUME_MAX],
                 char *argv[]);
 
+int execute_directories_full(
+                const char* const* directories,
+                usec_t timeout,
+                unsigned n_parallel,
+                gather_stdout_callback_t const callbacks[_STDOUT_CONSUME_MAX],
+                void* const callback_args[_STDOUT_CONSUME_MAX],
+                char *argv[],
+                exec_prepare_callback_t prepare,
+                exec_finish_callback_t finish,
+                void *userdata);
+
 extern const gather_stdout_callback_t gather_environment[_STDOUT_CONSUME_MAX];
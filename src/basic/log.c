@@ -64,6 +64,9 @@ static int log_max_level[] = {LOG_INFO, LOG_INFO};
 assert_cc(ELEMENTSOF(log_max_level) == _LOG_REALM_MAX);
 static int log_facility = LOG_DAEMON;
 
+/* Set on threads which must not log, as logging isn't safe to do from more than one thread */
+static thread_local bool log_thread_quiet = false;
+
 static int console_fd = STDERR_FILENO;
 static int syslog_fd = -1;
 static int kmsg_fd = -1;
@@ -334,6 +337,10 @@ void log_set_max_level_realm(LogRealm realm, int level) {
         log_max_level[realm] = level;
 }
 
+void log_set_thread_quiet(bool b) {
+        log_thread_quiet = b;
+}
+
 void log_set_facility(int facility) {
         log_facility = facility;
 }
@@ -669,7 +676,7 @@ int log_dump_internal(
         if (error < 0)
                 error = -error;
 
-        if (_likely_(LOG_PRI(level) > log_max_level[realm]))
+        if (_likely_(LOG_PRI(level) > log_get_max_level_realm(realm)))
                 return -error;
 
         return log_dispatch_internal(level, error, file, line, func, NULL, NULL, NULL, NULL, buffer);
@@ -691,7 +698,7 @@ int log_internalv_realm(
         if (error < 0)
                 error = -error;
 
-        if (_likely_(LOG_PRI(level) > log_max_level[realm]))
+        if (_likely_(LOG_PRI(level) > log_get_max_level_realm(realm)))
                 return -error;
 
         /* Make sure that %m maps to the specified error */
@@ -740,7 +747,7 @@ int log_object_internalv(
         if (error < 0)
                 error = -error;
 
-        if (_likely_(LOG_PRI(level) > log_max_level[LOG_REALM_SYSTEMD]))
+        if (_likely_(LOG_PRI(level) > log_get_max_level_realm(LOG_REALM_SYSTEMD)))
                 return -error;
 
         /* Make sure that %m maps to the specified error */
@@ -796,7 +803,7 @@ static void log_assert(
         static char buffer[LINE_MAX];
         LogRealm realm = LOG_REALM_REMOVE_LEVEL(level);
 
-        if (_likely_(LOG_PRI(level) > log_max_level[realm]))
+        if (_likely_(LOG_PRI(level) > log_get_max_level_realm(realm)))
                 return;
 
         DISABLE_WARNING_FORMAT_NONLITERAL;
@@ -911,7 +918,7 @@ int log_struct_internal(
         if (error < 0)
                 error = -error;
 
-        if (_likely_(LOG_PRI(level) > log_max_level[realm]))
+        if (_likely_(LOG_PRI(level) > log_get_max_level_realm(realm)))
                 return -error;
 
         if (log_target == LOG_TARGET_NULL)
@@ -1015,7 +1022,7 @@ int log_struct_iovec_internal(
         if (error < 0)
                 error = -error;
 
-        if (_likely_(LOG_PRI(level) > log_max_level[realm]))
+        if (_likely_(LOG_PRI(level) > log_get_max_level_realm(realm)))
                 return -error;
 
         if (log_target == LOG_TARGET_NULL)
@@ -1163,6 +1170,9 @@ LogTarget log_get_target(void) {
 }
 
 int log_get_max_level_realm(LogRealm realm) {
+        if (log_thread_quiet)
+                return -1;
+
         return log_max_level[realm];
 }
 
@@ -1263,7 +1273,7 @@ int log_syntax_internal(
         if (error < 0)
                 error = -error;
 
-        if (_likely_(LOG_PRI(level) > log_max_level[LOG_REALM_SYSTEMD]))
+        if (_likely_(LOG_PRI(level) > log_get_max_level_realm(LOG_REALM_SYSTEMD)))
                 return -error;
 
         if (log_target == LOG_TARGET_NULL)
@@ -66,6 +66,7 @@ void log_set_max_level_realm(LogRealm realm, int level);
         log_set_max_level_realm(LOG_REALM, (level))
 
 void log_set_facility(int facility);
+void log_set_thread_quiet(bool b);
 
 int log_set_target_from_string(const char *e);
 int log_set_max_level_from_string_realm(LogRealm realm, const char *e);
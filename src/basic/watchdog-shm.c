@@ -0,0 +1,81 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "macro.h"
+#include "memfd-util.h"
+#include "missing.h"
+#include "watchdog-shm.h"
+
+/* Maps a page passed by a service, and acknowledges it. The page is written to by an unprivileged process, hence
+ * verify that it can't be truncated under our feet, which would make us die with SIGBUS while accessing it. */
+int watchdog_shm_map(int fd, WatchdogShm **ret) {
+        WatchdogShm *shm;
+        uint64_t size;
+        int r, seals;
+
+        assert(fd >= 0);
+        assert(ret);
+
+        seals = fcntl(fd, F_GET_SEALS);
+        if (seals < 0)
+                return -errno;
+        if (!(seals & F_SEAL_SHRINK))
+                return -EPERM;
+
+        r = memfd_get_size(fd, &size);
+        if (r < 0)
+                return r;
+        if (size < sizeof(WatchdogShm))
+                return -EBADMSG;
+
+        shm = mmap(NULL, sizeof(WatchdogShm), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+        if (shm == MAP_FAILED)
+                return -errno;
+
+        if (shm->magic != WATCHDOG_SHM_MAGIC) {
+                (void) munmap(shm, sizeof(WatchdogShm));
+                return -EBADMSG;
+        }
+
+        watchdog_shm_set_acked(shm, true);
+
+        *ret = shm;
+        return 0;
+}
+
+void watchdog_shm_set_acked(WatchdogShm *shm, bool b) {
+        if (!shm)
+                return;
+
+        __atomic_store_n(&shm->acked, b, __ATOMIC_RELEASE);
+}
+
+/* Tells the service to send datagrams again, and unmaps the page */
+WatchdogShm* watchdog_shm_unmap(WatchdogShm *shm) {
+        if (!shm)
+                return NULL;
+
+        watchdog_shm_set_acked(shm, false);
+        (void) munmap(shm, sizeof(WatchdogShm));
+
+        return NULL;
+}
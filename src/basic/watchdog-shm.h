@@ -0,0 +1,42 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Layout of the shared memory page a service may pass to the service manager along with WATCHDOG_SHM=1, if the
+ * manager indicated support for it by setting $WATCHDOG_SHM=1. Instead of sending WATCHDOG=1 datagrams, the
+ * service then simply stores the CLOCK_MONOTONIC time of its last keep-alive ping in the page, and the manager
+ * looks at it when the watchdog timer elapses. The memfd must be sealed against shrinking, but not against
+ * writing: the manager sets 'acked' once it watches the page, and clears it again when it stops doing so, for
+ * example because it is about to reexecute. As long as 'acked' is not set, the service keeps sending
+ * datagrams too. */
+
+#define WATCHDOG_SHM_MAGIC UINT64_C(0x9a6b3e1f5dc2407b)
+
+typedef struct WatchdogShm {
+        uint64_t magic;
+        uint64_t timestamp;
+        uint64_t acked;
+} WatchdogShm;
+
+int watchdog_shm_map(int fd, WatchdogShm **ret);
+void watchdog_shm_set_acked(WatchdogShm *shm, bool b);
+WatchdogShm* watchdog_shm_unmap(WatchdogShm *shm);
@@ -477,12 +477,97 @@ static uint64_t cgroup_context_cpu_shares(CGroupContext *c, ManagerState state)
                 return CGROUP_CPU_SHARES_DEFAULT;
 }
 
+static void unit_forget_cgroup_attribute(Unit *u, const char *attribute) {
+        char *k = NULL, *v;
+
+        v = hashmap_remove2(u->cgroup_attributes, attribute, (void**) &k);
+        free(k);
+        free(v);
+}
+
+static int unit_set_cgroup_attribute(Unit *u, const char *controller, const char *path, const char *attribute, const char *value) {
+        _cleanup_free_ char *k = NULL, *v = NULL;
+        const char *old;
+        int r;
+
+        assert(u);
+        assert(attribute);
+        assert(value);
+
+        /* Writes a single-valued cgroup attribute, but skips the write if we already wrote the very same value to it
+         * earlier. Realizing a unit's cgroup reapplies all of its attributes, even if only one of them changed, and each
+         * write is a syscall round trip into the cgroup file system. Only use this for attributes whose contents are
+         * fully described by the last value written, i.e. not for the device lists or per-device settings. */
+
+        old = hashmap_get(u->cgroup_attributes, attribute);
+        if (old && streq(old, value)) {
+                u->manager->n_cgroup_attribute_writes_skipped++;
+                return 0;
+        }
+
+        /* Whatever happens, the old value is out of date now */
+        unit_forget_cgroup_attribute(u, attribute);
+
+        u->manager->n_cgroup_attribute_writes++;
+
+        r = cg_set_attribute(controller, path, attribute, value);
+        if (r < 0)
+                return r;
+
+        /* Failing to remember the value is not fatal, we'll just write it again next time */
+        k = strdup(attribute);
+        v = strdup(value);
+        if (!k || !v)
+                return 0;
+
+        if (hashmap_ensure_allocated(&u->cgroup_attributes, &string_hash_ops) < 0)
+                return 0;
+
+        if (hashmap_put(u->cgroup_attributes, k, v) < 0)
+                return 0;
+
+        k = v = NULL;
+        return 0;
+}
+
+static CGroupMask cgroup_attribute_to_mask(const char *attribute) {
+        _cleanup_free_ char *n = NULL;
+        CGroupController c;
+
+        n = strndup(attribute, strcspn(attribute, "."));
+        if (!n)
+                return _CGROUP_MASK_ALL;
+
+        c = cgroup_controller_from_string(n);
+        if (c < 0)
+                return _CGROUP_MASK_ALL;
+
+        return CGROUP_CONTROLLER_TO_MASK(c);
+}
+
+static void unit_flush_cgroup_attributes(Unit *u, CGroupMask mask) {
+        Iterator i;
+        char *k;
+        void *v;
+
+        assert(u);
+
+        /* Forgets what we wrote to the attributes of the specified controllers */
+
+        HASHMAP_FOREACH_KEY(v, k, u->cgroup_attributes, i)
+                if (cgroup_attribute_to_mask(k) & mask)
+                        unit_forget_cgroup_attribute(u, k);
+
+        if (hashmap_isempty(u->cgroup_attributes))
+                u->cgroup_attributes = hashmap_free(u->cgroup_attributes);
+}
+
 static void cgroup_apply_unified_cpu_config(Unit *u, uint64_t weight, uint64_t quota) {
         char buf[MAX(DECIMAL_STR_MAX(uint64_t) + 1, (DECIMAL_STR_MAX(usec_t) + 1) * 2)];
         int r;
 
         xsprintf(buf, "%" PRIu64 "\n", weight);
-        r = cg_set_attribute("cpu", u->cgroup_path, "cpu.weight", buf);
+        r = unit_set_cgroup_attribute(u, "cpu", u->cgroup_path, "cpu.weight", buf);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set cpu.weight: %m");
@@ -493,7 +578,7 @@ static void cgroup_apply_unified_cpu_config(Unit *u, uint64_t weight, uint64_t q
         else
                 xsprintf(buf, "max " USEC_FMT "\n", CGROUP_CPU_QUOTA_PERIOD_USEC);
 
-        r = cg_set_attribute("cpu", u->cgroup_path, "cpu.max", buf);
+        r = unit_set_cgroup_attribute(u, "cpu", u->cgroup_path, "cpu.max", buf);
 
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
@@ -505,22 +590,22 @@ static void cgroup_apply_legacy_cpu_config(Unit *u, uint64_t shares, uint64_t qu
         int r;
 
         xsprintf(buf, "%" PRIu64 "\n", shares);
-        r = cg_set_attribute("cpu", u->cgroup_path, "cpu.shares", buf);
+        r = unit_set_cgroup_attribute(u, "cpu", u->cgroup_path, "cpu.shares", buf);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set cpu.shares: %m");
 
         xsprintf(buf, USEC_FMT "\n", CGROUP_CPU_QUOTA_PERIOD_USEC);
-        r = cg_set_attribute("cpu", u->cgroup_path, "cpu.cfs_period_us", buf);
+        r = unit_set_cgroup_attribute(u, "cpu", u->cgroup_path, "cpu.cfs_period_us", buf);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set cpu.cfs_period_us: %m");
 
         if (quota != USEC_INFINITY) {
                 xsprintf(buf, USEC_FMT "\n", quota * CGROUP_CPU_QUOTA_PERIOD_USEC / USEC_PER_SEC);
-                r = cg_set_attribute("cpu", u->cgroup_path, "cpu.cfs_quota_us", buf);
+                r = unit_set_cgroup_attribute(u, "cpu", u->cgroup_path, "cpu.cfs_quota_us", buf);
         } else
-                r = cg_set_attribute("cpu", u->cgroup_path, "cpu.cfs_quota_us", "-1");
+                r = unit_set_cgroup_attribute(u, "cpu", u->cgroup_path, "cpu.cfs_quota_us", "-1");
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set cpu.cfs_quota_us: %m");
@@ -685,7 +770,7 @@ static void cgroup_apply_unified_memory_limit(Unit *u, const char *file, uint64_
         if (v != CGROUP_LIMIT_MAX)
                 xsprintf(buf, "%" PRIu64 "\n", v);
 
-        r = cg_set_attribute("memory", u->cgroup_path, file, buf);
+        r = unit_set_cgroup_attribute(u, "memory", u->cgroup_path, file, buf);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set %s: %m", file);
@@ -800,7 +885,7 @@ static void cgroup_context_apply(
                                 weight = CGROUP_WEIGHT_DEFAULT;
 
                         xsprintf(buf, "default %" PRIu64 "\n", weight);
-                        r = cg_set_attribute("io", path, "io.weight", buf);
+                        r = unit_set_cgroup_attribute(u, "io", path, "io.weight", buf);
                         if (r < 0)
                                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                                               "Failed to set io.weight: %m");
@@ -877,7 +962,7 @@ static void cgroup_context_apply(
                                 weight = CGROUP_BLKIO_WEIGHT_DEFAULT;
 
                         xsprintf(buf, "%" PRIu64 "\n", weight);
-                        r = cg_set_attribute("blkio", path, "blkio.weight", buf);
+                        r = unit_set_cgroup_attribute(u, "blkio", path, "blkio.weight", buf);
                         if (r < 0)
                                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                                               "Failed to set blkio.weight: %m");
@@ -956,7 +1041,7 @@ static void cgroup_context_apply(
                         else
                                 xsprintf(buf, "%" PRIu64 "\n", val);
 
-                        r = cg_set_attribute("memory", path, "memory.limit_in_bytes", buf);
+                        r = unit_set_cgroup_attribute(u, "memory", path, "memory.limit_in_bytes", buf);
                         if (r < 0)
                                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                                               "Failed to set memory.limit_in_bytes: %m");
@@ -1061,9 +1146,9 @@ static void cgroup_context_apply(
                                 char buf[DECIMAL_STR_MAX(uint64_t) + 2];
 
                                 sprintf(buf, "%" PRIu64 "\n", c->tasks_max);
-                                r = cg_set_attribute("pids", path, "pids.max", buf);
+                                r = unit_set_cgroup_attribute(u, "pids", path, "pids.max", buf);
                         } else
-                                r = cg_set_attribute("pids", path, "pids.max", "max");
+                                r = unit_set_cgroup_attribute(u, "pids", path, "pids.max", "max");
                         if (r < 0)
                                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                                               "Failed to set pids.max: %m");
@@ -1160,7 +1245,7 @@ CGroupMask unit_get_members_mask(Unit *u) {
                 Unit *member;
                 Iterator i;
 
-                HASHMAP_FOREACH_KEY(v, member, u->dependencies[UNIT_BEFORE], i) {
+                UNIT_DEPENDENCY_SET_FOREACH(v, member, u->dependencies[UNIT_BEFORE], i) {
 
                         if (member == u)
                                 continue;
@@ -1490,6 +1575,13 @@ static int unit_create_cgroup(
         if (r < 0)
                 log_unit_warning_errno(u, r, "Failed to enable controllers on cgroup %s, ignoring: %m", u->cgroup_path);
 
+        /* The attribute files of a controller are removed when it is dropped from the cgroup, and come back with
+         * their defaults when it is added again, hence forget what we wrote to the controllers we don't realize
+         * (anymore). Note that cgroup_realized_mask can't tell us which controllers were dropped: invalidation
+         * clears bits in it too, but that only asks for the attributes to be applied again, and the files stay
+         * as they are. The cgroup itself is only removed together with releasing it, which forgets everything. */
+        unit_flush_cgroup_attributes(u, ~target_mask);
+
         /* Keep track that this is now realized */
         u->cgroup_realized = true;
         u->cgroup_realized_mask = target_mask;
@@ -1627,6 +1719,7 @@ static int unit_realize_cgroup_now(Unit *u, ManagerState state) {
 }
 
 unsigned manager_dispatch_cgroup_realize_queue(Manager *m) {
+        uint64_t writes, skipped;
         ManagerState state;
         unsigned n = 0;
         Unit *i;
@@ -1635,6 +1728,8 @@ unsigned manager_dispatch_cgroup_realize_queue(Manager *m) {
         assert(m);
 
         state = manager_state(m);
+        writes = m->n_cgroup_attribute_writes;
+        skipped = m->n_cgroup_attribute_writes_skipped;
 
         while ((i = m->cgroup_realize_queue)) {
                 assert(i->in_cgroup_realize_queue);
@@ -1652,6 +1747,10 @@ unsigned manager_dispatch_cgroup_realize_queue(Manager *m) {
                 n++;
         }
 
+        if (n > 0)
+                log_debug("Realized %u cgroups, wrote %" PRIu64 " cgroup attributes, skipped %" PRIu64 " unchanged ones.",
+                          n, m->n_cgroup_attribute_writes - writes, m->n_cgroup_attribute_writes_skipped - skipped);
+
         return n;
 }
 
@@ -1667,7 +1766,7 @@ static void unit_add_siblings_to_cgroup_realize_queue(Unit *u) {
                 Unit *m;
                 void *v;
 
-                HASHMAP_FOREACH_KEY(v, m, u->dependencies[UNIT_BEFORE], i) {
+                UNIT_DEPENDENCY_SET_FOREACH(v, m, u->dependencies[UNIT_BEFORE], i) {
                         if (m == u)
                                 continue;
 
@@ -1726,6 +1825,8 @@ void unit_release_cgroup(Unit *u) {
 
         /* Forgets all cgroup details for this cgroup */
 
+        unit_flush_cgroup_attributes(u, _CGROUP_MASK_ALL);
+
         if (u->cgroup_path) {
                 (void) hashmap_remove(u->manager->cgroup_unit, u->cgroup_path);
                 u->cgroup_path = mfree(u->cgroup_path);
@@ -1888,6 +1989,22 @@ int unit_synthesize_cgroup_empty_event(Unit *u) {
         return 0;
 }
 
+int unit_rewatch_pids(Unit *u, pid_t except1, pid_t except2) {
+        assert(u);
+
+        /* Called whenever a process we watched exited. Drops the dead PIDs, and on non-unified systems looks for
+         * other processes to watch, as the one that exited was probably their parent, and they are hence our
+         * children now. As long as we learn about the exit of each watched PID right away, this is only needed
+         * once none is left, instead of reading the cgroup again on every single exit. */
+
+        unit_tidy_watch_pids(u, except1, except2);
+
+        if (!set_isempty(u->pids) && manager_watch_pids_reliable(u->manager, u->pids))
+                return 0;
+
+        return unit_watch_all_pids(u);
+}
+
 int unit_watch_all_pids(Unit *u) {
         int r;
 
@@ -2475,6 +2592,15 @@ int unit_get_ip_accounting(
         return r;
 }
 
+static void unit_reset_accounting_samples(Unit *u) {
+        assert(u);
+
+        /* The ring buffer stays around, the client asking for it is likely to do so again */
+        zero(u->accounting_sample);
+        u->n_accounting_samples = 0;
+        u->accounting_samples_next = 0;
+}
+
 int unit_reset_cpu_accounting(Unit *u) {
         nsec_t ns;
         int r;
@@ -2483,6 +2609,9 @@ int unit_reset_cpu_accounting(Unit *u) {
 
         u->cpu_usage_last = NSEC_INFINITY;
 
+        /* Samples of a previous runtime are of no interest anymore */
+        unit_reset_accounting_samples(u);
+
         r = unit_get_cpu_usage_raw(u, &ns);
         if (r < 0) {
                 u->cpu_usage_base = 0;
@@ -2509,6 +2638,167 @@ int unit_reset_ip_accounting(Unit *u) {
         return r < 0 ? r : q;
 }
 
+static bool unit_has_accounting(Unit *u) {
+        CGroupContext *c;
+
+        c = unit_get_cgroup_context(u);
+        if (!c)
+                return false;
+
+        return c->cpu_accounting || c->memory_accounting || c->tasks_accounting || c->ip_accounting;
+}
+
+static void unit_append_accounting_sample(Unit *u, const CGroupAccountingSample *s) {
+        assert(u);
+        assert(s);
+
+        u->accounting_samples[u->accounting_samples_next] = *s;
+
+        u->accounting_samples_next = (u->accounting_samples_next + 1) % CGROUP_ACCOUNTING_SAMPLES_MAX;
+        if (u->n_accounting_samples < CGROUP_ACCOUNTING_SAMPLES_MAX)
+                u->n_accounting_samples++;
+}
+
+void unit_sample_accounting(Unit *u, usec_t ts) {
+        CGroupIPAccountingMetric metric;
+        CGroupAccountingSample *s;
+
+        assert(u);
+
+        s = &u->accounting_sample;
+        *s = (CGroupAccountingSample) {
+                .timestamp = ts,
+                .cpu_usage = NSEC_INFINITY,
+                .memory_current = (uint64_t) -1,
+                .tasks_current = (uint64_t) -1,
+        };
+
+        (void) unit_get_cpu_usage(u, &s->cpu_usage);
+        (void) unit_get_memory_current(u, &s->memory_current);
+        (void) unit_get_tasks_current(u, &s->tasks_current);
+
+        for (metric = 0; metric < _CGROUP_IP_ACCOUNTING_METRIC_MAX; metric++) {
+                s->ip[metric] = (uint64_t) -1;
+                (void) unit_get_ip_accounting(u, metric, s->ip + metric);
+        }
+
+        if (u->accounting_samples)
+                unit_append_accounting_sample(u, s);
+}
+
+int unit_enable_accounting_history(Unit *u) {
+        assert(u);
+
+        /* Keeping the history costs a few KB per unit, which is why we only do so for units somebody asked
+         * about. The history starts with the most recent sample. */
+
+        if (u->accounting_samples)
+                return 0;
+
+        u->accounting_samples = new(CGroupAccountingSample, CGROUP_ACCOUNTING_SAMPLES_MAX);
+        if (!u->accounting_samples)
+                return -ENOMEM;
+
+        u->n_accounting_samples = 0;
+        u->accounting_samples_next = 0;
+
+        if (u->accounting_sample.timestamp > 0)
+                unit_append_accounting_sample(u, &u->accounting_sample);
+
+        return 1;
+}
+
+static int on_accounting_sample(sd_event_source *s, usec_t usec, void *userdata) {
+        Manager *m = userdata;
+        Iterator i;
+        usec_t ts;
+        Unit *u;
+        int r;
+
+        assert(s);
+        assert(m);
+
+        /* Sample all units with a cgroup in one go, so that the cost of resource usage monitoring only depends on
+         * the sampling interval, and not on how often clients ask for the values. */
+
+        ts = now(CLOCK_MONOTONIC);
+
+        HASHMAP_FOREACH(u, m->cgroup_unit, i)
+                if (unit_has_accounting(u))
+                        unit_sample_accounting(u, ts);
+
+        r = sd_event_source_set_time(s, usec_add(ts, m->accounting_sample_interval_usec));
+        if (r < 0)
+                return log_error_errno(r, "Failed to reschedule accounting sampler: %m");
+
+        return sd_event_source_set_enabled(s, SD_EVENT_ONESHOT);
+}
+
+int manager_setup_accounting_sampler(Manager *m) {
+        usec_t next;
+        int r;
+
+        assert(m);
+
+        if (m->accounting_sample_interval_usec <= 0 || m->accounting_sample_interval_usec == USEC_INFINITY) {
+                m->accounting_sample_event_source = sd_event_source_unref(m->accounting_sample_event_source);
+                return 0;
+        }
+
+        next = usec_add(now(CLOCK_MONOTONIC), m->accounting_sample_interval_usec);
+
+        if (m->accounting_sample_event_source) {
+                r = sd_event_source_set_time(m->accounting_sample_event_source, next);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to reschedule accounting sampler: %m");
+
+                return sd_event_source_set_enabled(m->accounting_sample_event_source, SD_EVENT_ONESHOT);
+        }
+
+        r = sd_event_add_time(m->event, &m->accounting_sample_event_source, CLOCK_MONOTONIC, next, 0, on_accounting_sample, m);
+        if (r < 0)
+                return log_error_errno(r, "Failed to allocate accounting sampler: %m");
+
+        /* Sampling is not urgent, let everything else go first */
+        r = sd_event_source_set_priority(m->accounting_sample_event_source, SD_EVENT_PRIORITY_IDLE);
+        if (r < 0)
+                return log_error_errno(r, "Failed to set priority of accounting sampler: %m");
+
+        (void) sd_event_source_set_description(m->accounting_sample_event_source, "manager-accounting-sampler");
+
+        return 0;
+}
+
+const CGroupAccountingSample *unit_get_last_accounting_sample(Unit *u) {
+        const CGroupAccountingSample *s;
+        usec_t interval;
+
+        assert(u);
+
+        /* Returns the most recent accounting sample of the unit, if it is recent enough to be used instead of
+         * reading the values from the cgroup file system. */
+
+        interval = u->manager->accounting_sample_interval_usec;
+        if (interval <= 0 || interval == USEC_INFINITY)
+                return NULL;
+
+        /* Once the cgroup is gone, the live values are the authoritative ones */
+        if (!u->cgroup_path || u->accounting_sample.timestamp == 0)
+                return NULL;
+
+        s = &u->accounting_sample;
+
+        /* Samples taken before the unit was last started describe a previous runtime */
+        if (s->timestamp < u->inactive_exit_timestamp.monotonic)
+                return NULL;
+
+        /* Allow for one missed or delayed iteration of the sampler */
+        if (usec_add(s->timestamp, 2 * interval) < now(CLOCK_MONOTONIC))
+                return NULL;
+
+        return s;
+}
+
 void unit_invalidate_cgroup(Unit *u, CGroupMask m) {
         assert(u);
 
@@ -2551,7 +2841,7 @@ void unit_invalidate_cgroup_bpf(Unit *u) {
                 Iterator i;
                 void *v;
 
-                HASHMAP_FOREACH_KEY(v, member, u->dependencies[UNIT_BEFORE], i) {
+                UNIT_DEPENDENCY_SET_FOREACH(v, member, u->dependencies[UNIT_BEFORE], i) {
                         if (member == u)
                                 continue;
 
@@ -140,6 +140,18 @@ typedef enum CGroupIPAccountingMetric {
         _CGROUP_IP_ACCOUNTING_METRIC_INVALID = -1,
 } CGroupIPAccountingMetric;
 
+/* How many accounting samples we keep per unit, if the accounting sampler is enabled */
+#define CGROUP_ACCOUNTING_SAMPLES_MAX 64U
+
+/* One sample of a unit's resource usage, with (uint64_t) -1 for unavailable values */
+typedef struct CGroupAccountingSample {
+        usec_t timestamp;
+        nsec_t cpu_usage;
+        uint64_t memory_current;
+        uint64_t tasks_current;
+        uint64_t ip[_CGROUP_IP_ACCOUNTING_METRIC_MAX];
+} CGroupAccountingSample;
+
 #include "unit.h"
 
 void cgroup_context_init(CGroupContext *c);
@@ -191,6 +203,7 @@ Unit* manager_get_unit_by_pid(Manager *m, pid_t pid);
 
 int unit_search_main_pid(Unit *u, pid_t *ret);
 int unit_watch_all_pids(Unit *u);
+int unit_rewatch_pids(Unit *u, pid_t except1, pid_t except2);
 
 int unit_synthesize_cgroup_empty_event(Unit *u);
 
@@ -202,6 +215,11 @@ int unit_get_ip_accounting(Unit *u, CGroupIPAccountingMetric metric, uint64_t *r
 int unit_reset_cpu_accounting(Unit *u);
 int unit_reset_ip_accounting(Unit *u);
 
+int manager_setup_accounting_sampler(Manager *m);
+void unit_sample_accounting(Unit *u, usec_t ts);
+int unit_enable_accounting_history(Unit *u);
+const CGroupAccountingSample *unit_get_last_accounting_sample(Unit *u);
+
 #define UNIT_CGROUP_BOOL(u, name)                       \
         ({                                              \
         CGroupContext *cc = unit_get_cgroup_context(u); \
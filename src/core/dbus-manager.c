@@ -255,6 +255,39 @@ static int property_get_n_names(
         return sd_bus_message_append(reply, "u", (uint32_t) hashmap_size(m->units));
 }
 
+static int property_get_generator_times(
+                sd_bus *bus,
+                const char *path,
+                const char *interface,
+                const char *property,
+                sd_bus_message *reply,
+                void *userdata,
+                sd_bus_error *error) {
+
+        Manager *m = userdata;
+        size_t i;
+        int r;
+
+        assert(bus);
+        assert(reply);
+        assert(m);
+
+        r = sd_bus_message_open_container(reply, 'a', "(stb)");
+        if (r < 0)
+                return r;
+
+        for (i = 0; i < m->n_generator_times; i++) {
+                r = sd_bus_message_append(reply, "(stb)",
+                                          m->generator_times[i].path,
+                                          m->generator_times[i].duration,
+                                          m->generator_times[i].cached);
+                if (r < 0)
+                        return r;
+        }
+
+        return sd_bus_message_close_container(reply);
+}
+
 static int property_get_n_failed_units(
                 sd_bus *bus,
                 const char *path,
@@ -846,6 +879,26 @@ static int method_get_unit_processes(sd_bus_message *message, void *userdata, sd
         return bus_unit_method_get_processes(message, u, error);
 }
 
+static int method_get_unit_accounting_history(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        Manager *m = userdata;
+        const char *name;
+        Unit *u;
+        int r;
+
+        assert(message);
+        assert(m);
+
+        r = sd_bus_message_read(message, "s", &name);
+        if (r < 0)
+                return r;
+
+        u = manager_get_unit(m, name);
+        if (!u)
+                return sd_bus_error_setf(error, BUS_ERROR_NO_SUCH_UNIT, "Unit %s not loaded.", name);
+
+        return bus_unit_method_get_accounting_history(message, u, error);
+}
+
 static int transient_unit_from_message(
                 Manager *m,
                 sd_bus_message *message,
@@ -1077,6 +1130,22 @@ static int method_reset_failed(sd_bus_message *message, void *userdata, sd_bus_e
         return sd_bus_reply_method_return(message, NULL);
 }
 
+static bool unit_matches_filter(Unit *u, char **states, char **patterns) {
+        assert(u);
+
+        if (!strv_isempty(states) &&
+            !strv_contains(states, unit_load_state_to_string(u->load_state)) &&
+            !strv_contains(states, unit_active_state_to_string(unit_active_state(u))) &&
+            !strv_contains(states, unit_sub_state_to_string(u)))
+                return false;
+
+        if (!strv_isempty(patterns) &&
+            !strv_fnmatch_or_empty(patterns, u->id, FNM_NOESCAPE))
+                return false;
+
+        return true;
+}
+
 static int list_units_filtered(sd_bus_message *message, void *userdata, sd_bus_error *error, char **states, char **patterns) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
         Manager *m = userdata;
@@ -1106,14 +1175,7 @@ static int list_units_filtered(sd_bus_message *message, void *userdata, sd_bus_e
                 if (k != u->id)
                         continue;
 
-                if (!strv_isempty(states) &&
-                    !strv_contains(states, unit_load_state_to_string(u->load_state)) &&
-                    !strv_contains(states, unit_active_state_to_string(unit_active_state(u))) &&
-                    !strv_contains(states, unit_sub_state_to_string(u)))
-                        continue;
-
-                if (!strv_isempty(patterns) &&
-                    !strv_fnmatch_or_empty(patterns, u->id, FNM_NOESCAPE))
+                if (!unit_matches_filter(u, states, patterns))
                         continue;
 
                 r = reply_unit_info(reply, u);
@@ -1159,6 +1221,154 @@ static int method_list_units_by_patterns(sd_bus_message *message, void *userdata
         return list_units_filtered(message, userdata, error, states, patterns);
 }
 
+static int unit_compare_by_id(const void *a, const void *b) {
+        Unit * const *x = a, * const *y = b;
+
+        return strcmp((*x)->id, (*y)->id);
+}
+
+int bus_manager_list_units_paged(
+                Manager *m,
+                char **states,
+                char **patterns,
+                uint64_t since,
+                const char *after,
+                unsigned max,
+                Unit ***ret,
+                bool *ret_more) {
+
+        _cleanup_free_ Unit **units = NULL;
+        const char *k;
+        unsigned n = 0;
+        Iterator i;
+        Unit *u;
+
+        assert(m);
+        assert(ret);
+        assert(ret_more);
+
+        /* Collects the units ListUnitsPaged() returns: those matching the filters, changed after generation 'since'
+         * unless that's 0, and named after 'after' unless that's empty. They are sorted by name, and if 'max' is
+         * not 0 at most that many are returned, and *ret_more tells whether any were left out. Returns the number
+         * of units in *ret. */
+
+        units = new(Unit*, hashmap_size(m->units));
+        if (!units)
+                return -ENOMEM;
+
+        HASHMAP_FOREACH_KEY(u, k, m->units, i) {
+                if (k != u->id)
+                        continue;
+
+                if (since > 0 && u->change_generation <= since)
+                        continue;
+
+                if (!isempty(after) && strcmp(u->id, after) <= 0)
+                        continue;
+
+                if (!unit_matches_filter(u, states, patterns))
+                        continue;
+
+                units[n++] = u;
+        }
+
+        qsort_safe(units, n, sizeof(Unit*), unit_compare_by_id);
+
+        *ret_more = max > 0 && n > max;
+        if (*ret_more)
+                n = max;
+
+        *ret = units;
+        units = NULL;
+
+        return (int) n;
+}
+
+static int method_list_units_paged(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_strv_free_ char **states = NULL, **patterns = NULL, **properties = NULL;
+        _cleanup_free_ Unit **units = NULL;
+        Manager *m = userdata;
+        uint64_t since;
+        const char *after;
+        uint32_t max;
+        bool more;
+        int r, n, c;
+
+        assert(message);
+        assert(m);
+
+        /* Like ListUnitsByPatterns(), but returns only the requested properties of each unit, sorted by name and
+         * optionally limited to those changed after the specified generation. With a maximum number of units set,
+         * the reply also contains the name to continue after with the next call, or an empty string if there are
+         * no more units. The current generation is returned for use in the next query. Note that units removed
+         * in the meantime are not reported, use the UnitRemoved signal for that. */
+
+        r = sd_bus_message_read_strv(message, &states);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_read_strv(message, &patterns);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_read_strv(message, &properties);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_read(message, "tsu", &since, &after, &max);
+        if (r < 0)
+                return r;
+
+        /* Anyone can call this method */
+
+        r = mac_selinux_access_check(message, "status", error);
+        if (r < 0)
+                return r;
+
+        strv_uniq(properties);
+
+        n = bus_manager_list_units_paged(m, states, patterns, since, after, max, &units, &more);
+        if (n < 0)
+                return n;
+
+        r = sd_bus_message_new_method_return(message, &reply);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(reply, 'a', "(sa{sv})");
+        if (r < 0)
+                return r;
+
+        for (c = 0; c < n; c++) {
+                r = sd_bus_message_open_container(reply, 'r', "sa{sv}");
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_append(reply, "s", units[c]->id);
+                if (r < 0)
+                        return r;
+
+                r = bus_unit_append_properties(units[c], reply, properties, error);
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_close_container(reply);
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_bus_message_close_container(reply);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_append(reply, "st", more ? units[n - 1]->id : "", m->unit_change_generation);
+        if (r < 0)
+                return r;
+
+        return sd_bus_send(NULL, reply, NULL);
+}
+
 static int method_list_jobs(sd_bus_message *message, void *userdata, sd_bus_error *error) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
         Manager *m = userdata;
@@ -1330,7 +1540,7 @@ int verify_run_space_and_log(const char *message) {
         return r;
 }
 
-static int method_reload(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+static int method_reload_generic(sd_bus_message *message, void *userdata, bool only_if_changed, sd_bus_error *error) {
         Manager *m = userdata;
         int r;
 
@@ -1351,6 +1561,24 @@ static int method_reload(sd_bus_message *message, void *userdata, sd_bus_error *
         if (r == 0)
                 return 1; /* No authorization for now, but the async polkit stuff will call us again when it has it */
 
+        if (only_if_changed) {
+                _cleanup_set_free_ Set *units = NULL;
+
+                r = manager_find_changed_units(m, &units);
+                if (r < 0)
+                        log_warning_errno(r, "Failed to determine changed units, reloading everything: %m");
+                else if (r == 0) {
+                        log_debug("No unit files changed, skipping reload.");
+                        return sd_bus_reply_method_return(message, NULL);
+                } else if (units) {
+                        r = manager_reload_units(m, units);
+                        if (r >= 0)
+                                return sd_bus_reply_method_return(message, NULL);
+
+                        log_warning_errno(r, "Failed to reload changed units, reloading everything: %m");
+                }
+        }
+
         /* Instead of sending the reply back right away, we just
          * remember that we need to and then send it after the reload
          * is finished. That way the caller knows when the reload
@@ -1366,6 +1594,14 @@ static int method_reload(sd_bus_message *message, void *userdata, sd_bus_error *
         return 1;
 }
 
+static int method_reload(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        return method_reload_generic(message, userdata, false, error);
+}
+
+static int method_reload_if_changed(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        return method_reload_generic(message, userdata, true, error);
+}
+
 static int method_reexecute(sd_bus_message *message, void *userdata, sd_bus_error *error) {
         Manager *m = userdata;
         int r;
@@ -2398,8 +2634,11 @@ const sd_bus_vtable bus_manager_vtable[] = {
         BUS_PROPERTY_DUAL_TIMESTAMP("SecurityFinishTimestamp", offsetof(Manager, timestamps[MANAGER_TIMESTAMP_SECURITY_FINISH]), SD_BUS_VTABLE_PROPERTY_CONST),
         BUS_PROPERTY_DUAL_TIMESTAMP("GeneratorsStartTimestamp", offsetof(Manager, timestamps[MANAGER_TIMESTAMP_GENERATORS_START]), SD_BUS_VTABLE_PROPERTY_CONST),
         BUS_PROPERTY_DUAL_TIMESTAMP("GeneratorsFinishTimestamp", offsetof(Manager, timestamps[MANAGER_TIMESTAMP_GENERATORS_FINISH]), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("GeneratorTimes", "a(stb)", property_get_generator_times, 0, 0),
         BUS_PROPERTY_DUAL_TIMESTAMP("UnitsLoadStartTimestamp", offsetof(Manager, timestamps[MANAGER_TIMESTAMP_UNITS_LOAD_START]), SD_BUS_VTABLE_PROPERTY_CONST),
         BUS_PROPERTY_DUAL_TIMESTAMP("UnitsLoadFinishTimestamp", offsetof(Manager, timestamps[MANAGER_TIMESTAMP_UNITS_LOAD_FINISH]), SD_BUS_VTABLE_PROPERTY_CONST),
+        BUS_PROPERTY_DUAL_TIMESTAMP("ColdplugStartTimestamp", offsetof(Manager, timestamps[MANAGER_TIMESTAMP_COLDPLUG_START]), SD_BUS_VTABLE_PROPERTY_CONST),
+        BUS_PROPERTY_DUAL_TIMESTAMP("ColdplugFinishTimestamp", offsetof(Manager, timestamps[MANAGER_TIMESTAMP_COLDPLUG_FINISH]), SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_WRITABLE_PROPERTY("LogLevel", "s", property_get_log_level, property_set_log_level, 0, 0),
         SD_BUS_WRITABLE_PROPERTY("LogTarget", "s", property_get_log_target, property_set_log_target, 0, 0),
         SD_BUS_PROPERTY("NNames", "u", property_get_n_names, 0, 0),
@@ -2407,6 +2646,13 @@ const sd_bus_vtable bus_manager_vtable[] = {
         SD_BUS_PROPERTY("NJobs", "u", property_get_n_jobs, 0, 0),
         SD_BUS_PROPERTY("NInstalledJobs", "u", bus_property_get_unsigned, offsetof(Manager, n_installed_jobs), 0),
         SD_BUS_PROPERTY("NFailedJobs", "u", bus_property_get_unsigned, offsetof(Manager, n_failed_jobs), 0),
+        SD_BUS_PROPERTY("NCGroupAttributeWrites", "t", NULL, offsetof(Manager, n_cgroup_attribute_writes), 0),
+        SD_BUS_PROPERTY("NCGroupAttributeWritesSkipped", "t", NULL, offsetof(Manager, n_cgroup_attribute_writes_skipped), 0),
+        SD_BUS_PROPERTY("NGCRuns", "t", NULL, offsetof(Manager, n_gc_runs), 0),
+        SD_BUS_PROPERTY("NGCCollectedUnits", "t", NULL, offsetof(Manager, n_gc_collected), 0),
+        SD_BUS_PROPERTY("NGCCollectedLeafUnits", "t", NULL, offsetof(Manager, n_gc_collected_leaf), 0),
+        SD_BUS_PROPERTY("GCUSec", "t", NULL, offsetof(Manager, gc_usec), 0),
+        SD_BUS_PROPERTY("GCMaxUSec", "t", NULL, offsetof(Manager, gc_usec_max), 0),
         SD_BUS_PROPERTY("Progress", "d", property_get_progress, 0, 0),
         SD_BUS_PROPERTY("Environment", "as", NULL, offsetof(Manager, environment), 0),
         SD_BUS_PROPERTY("ConfirmSpawn", "b", bus_property_get_bool, offsetof(Manager, confirm_spawn), SD_BUS_VTABLE_PROPERTY_CONST),
@@ -2466,6 +2712,7 @@ const sd_bus_vtable bus_manager_vtable[] = {
         SD_BUS_PROPERTY("DefaultLimitRTTIME", "t", bus_property_get_rlimit, offsetof(Manager, rlimit[RLIMIT_RTTIME]), SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("DefaultLimitRTTIMESoft", "t", bus_property_get_rlimit, offsetof(Manager, rlimit[RLIMIT_RTTIME]), SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("DefaultTasksMax", "t", NULL, offsetof(Manager, default_tasks_max), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("AccountingSampleIntervalUSec", "t", bus_property_get_usec, offsetof(Manager, accounting_sample_interval_usec), SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("TimerSlackNSec", "t", property_get_timer_slack_nsec, 0, SD_BUS_VTABLE_PROPERTY_CONST),
 
         SD_BUS_METHOD("GetUnit", "s", "o", method_get_unit, SD_BUS_VTABLE_UNPRIVILEGED),
@@ -2487,6 +2734,7 @@ const sd_bus_vtable bus_manager_vtable[] = {
         SD_BUS_METHOD("UnrefUnit", "s", NULL, method_unref_unit, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("StartTransientUnit", "ssa(sv)a(sa(sv))", "o", method_start_transient_unit, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("GetUnitProcesses", "s", "a(sus)", method_get_unit_processes, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("GetUnitAccountingHistory", "s", "a(tttttttt)", method_get_unit_accounting_history, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("GetJob", "u", "o", method_get_job, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("GetJobAfter", "u", "a(usssoo)", method_get_job_waiting, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("GetJobBefore", "u", "a(usssoo)", method_get_job_waiting, SD_BUS_VTABLE_UNPRIVILEGED),
@@ -2497,6 +2745,7 @@ const sd_bus_vtable bus_manager_vtable[] = {
         SD_BUS_METHOD("ListUnitsFiltered", "as", "a(ssssssouso)", method_list_units_filtered, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("ListUnitsByPatterns", "asas", "a(ssssssouso)", method_list_units_by_patterns, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("ListUnitsByNames", "as", "a(ssssssouso)", method_list_units_by_names, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("ListUnitsPaged", "asasastsu", "a(sa{sv})st", method_list_units_paged, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("ListJobs", NULL, "a(usssoo)", method_list_jobs, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("Subscribe", NULL, NULL, method_subscribe, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("Unsubscribe", NULL, NULL, method_unsubscribe, SD_BUS_VTABLE_UNPRIVILEGED),
@@ -2504,6 +2753,7 @@ const sd_bus_vtable bus_manager_vtable[] = {
         SD_BUS_METHOD("CreateSnapshot", "sb", "o", method_refuse_snapshot, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("RemoveSnapshot", "s", NULL, method_refuse_snapshot, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("Reload", NULL, NULL, method_reload, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("ReloadIfChanged", NULL, NULL, method_reload_if_changed, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("Reexecute", NULL, NULL, method_reexecute, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("Exit", NULL, NULL, method_exit, 0),
         SD_BUS_METHOD("Reboot", NULL, NULL, method_reboot, SD_BUS_VTABLE_CAPABILITY(CAP_SYS_BOOT)),
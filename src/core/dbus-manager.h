@@ -29,3 +29,5 @@ void bus_manager_send_reloading(Manager *m, bool active);
 void bus_manager_send_change_signal(Manager *m);
 
 int verify_run_space_and_log(const char *message);
+
+int bus_manager_list_units_paged(Manager *m, char **states, char **patterns, uint64_t since, const char *after, unsigned max, Unit ***ret, bool *ret_more);
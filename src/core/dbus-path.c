@@ -87,6 +87,8 @@ const sd_bus_vtable bus_path_vtable[] = {
         SD_BUS_PROPERTY("MakeDirectory", "b", bus_property_get_bool, offsetof(Path, make_directory), SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("DirectoryMode", "u", bus_property_get_mode, offsetof(Path, directory_mode), SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("Result", "s", property_get_result, offsetof(Path, result), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+        SD_BUS_PROPERTY("NEvents", "u", bus_property_get_unsigned, offsetof(Path, n_events), 0),
+        SD_BUS_PROPERTY("NTriggers", "u", bus_property_get_unsigned, offsetof(Path, n_triggers), 0),
         SD_BUS_VTABLE_END
 };
 
@@ -25,7 +25,10 @@
 #include "bus-common-errors.h"
 #include "cgroup-util.h"
 #include "condition.h"
+#include "dbus-cgroup.h"
+#include "dbus-execute.h"
 #include "dbus-job.h"
+#include "dbus-kill.h"
 #include "dbus-unit.h"
 #include "dbus-util.h"
 #include "dbus.h"
@@ -106,7 +109,7 @@ static int property_get_dependencies(
                 void *userdata,
                 sd_bus_error *error) {
 
-        Hashmap *h = *(Hashmap**) userdata;
+        UnitDependencySet *h = *(UnitDependencySet**) userdata;
         Iterator j;
         Unit *u;
         void *v;
@@ -119,7 +122,7 @@ static int property_get_dependencies(
         if (r < 0)
                 return r;
 
-        HASHMAP_FOREACH_KEY(v, u, h, j) {
+        UNIT_DEPENDENCY_SET_FOREACH(v, u, h, j) {
                 r = sd_bus_message_append(reply, "s", u->id);
                 if (r < 0)
                         return r;
@@ -858,6 +861,7 @@ static int property_get_current_memory(
                 void *userdata,
                 sd_bus_error *error) {
 
+        const CGroupAccountingSample *s;
         uint64_t sz = (uint64_t) -1;
         Unit *u = userdata;
         int r;
@@ -866,6 +870,10 @@ static int property_get_current_memory(
         assert(reply);
         assert(u);
 
+        s = unit_get_last_accounting_sample(u);
+        if (s)
+                return sd_bus_message_append(reply, "t", s->memory_current);
+
         r = unit_get_memory_current(u, &sz);
         if (r < 0 && r != -ENODATA)
                 log_unit_warning_errno(u, r, "Failed to get memory.usage_in_bytes attribute: %m");
@@ -882,6 +890,7 @@ static int property_get_current_tasks(
                 void *userdata,
                 sd_bus_error *error) {
 
+        const CGroupAccountingSample *s;
         uint64_t cn = (uint64_t) -1;
         Unit *u = userdata;
         int r;
@@ -890,6 +899,10 @@ static int property_get_current_tasks(
         assert(reply);
         assert(u);
 
+        s = unit_get_last_accounting_sample(u);
+        if (s)
+                return sd_bus_message_append(reply, "t", s->tasks_current);
+
         r = unit_get_tasks_current(u, &cn);
         if (r < 0 && r != -ENODATA)
                 log_unit_warning_errno(u, r, "Failed to get pids.current attribute: %m");
@@ -906,6 +919,7 @@ static int property_get_cpu_usage(
                 void *userdata,
                 sd_bus_error *error) {
 
+        const CGroupAccountingSample *s;
         nsec_t ns = (nsec_t) -1;
         Unit *u = userdata;
         int r;
@@ -914,6 +928,10 @@ static int property_get_cpu_usage(
         assert(reply);
         assert(u);
 
+        s = unit_get_last_accounting_sample(u);
+        if (s)
+                return sd_bus_message_append(reply, "t", s->cpu_usage);
+
         r = unit_get_cpu_usage(u, &ns);
         if (r < 0 && r != -ENODATA)
                 log_unit_warning_errno(u, r, "Failed to get cpuacct.usage attribute: %m");
@@ -1094,6 +1112,62 @@ int bus_unit_method_get_processes(sd_bus_message *message, void *userdata, sd_bu
         return sd_bus_send(NULL, reply, NULL);
 }
 
+int bus_unit_method_get_accounting_history(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        Unit *u = userdata;
+        unsigned i;
+        int r;
+
+        assert(message);
+        assert(u);
+
+        r = mac_selinux_unit_access_check(u, message, "status", error);
+        if (r < 0)
+                return r;
+
+        if (u->manager->accounting_sample_interval_usec <= 0 || u->manager->accounting_sample_interval_usec == USEC_INFINITY)
+                return sd_bus_error_setf(error, SD_BUS_ERROR_NOT_SUPPORTED, "Resource accounting sampling is not enabled.");
+
+        /* From now on, keep the history of this unit around */
+        r = unit_enable_accounting_history(u);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_new_method_return(message, &reply);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(reply, 'a', "(tttttttt)");
+        if (r < 0)
+                return r;
+
+        /* Oldest sample first */
+        for (i = 0; i < u->n_accounting_samples; i++) {
+                const CGroupAccountingSample *s;
+
+                s = u->accounting_samples +
+                        (u->accounting_samples_next + CGROUP_ACCOUNTING_SAMPLES_MAX - u->n_accounting_samples + i) % CGROUP_ACCOUNTING_SAMPLES_MAX;
+
+                r = sd_bus_message_append(reply, "(tttttttt)",
+                                          s->timestamp,
+                                          s->cpu_usage,
+                                          s->memory_current,
+                                          s->tasks_current,
+                                          s->ip[CGROUP_IP_INGRESS_BYTES],
+                                          s->ip[CGROUP_IP_INGRESS_PACKETS],
+                                          s->ip[CGROUP_IP_EGRESS_BYTES],
+                                          s->ip[CGROUP_IP_EGRESS_PACKETS]);
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_bus_message_close_container(reply);
+        if (r < 0)
+                return r;
+
+        return sd_bus_send(NULL, reply, NULL);
+}
+
 static int property_get_ip_counter(
                 sd_bus *bus,
                 const char *path,
@@ -1103,6 +1177,7 @@ static int property_get_ip_counter(
                 void *userdata,
                 sd_bus_error *error) {
 
+        const CGroupAccountingSample *s;
         CGroupIPAccountingMetric metric;
         uint64_t value = (uint64_t) -1;
         Unit *u = userdata;
@@ -1123,6 +1198,10 @@ static int property_get_ip_counter(
                 metric = CGROUP_IP_EGRESS_PACKETS;
         }
 
+        s = unit_get_last_accounting_sample(u);
+        if (s)
+                return sd_bus_message_append(reply, "t", s->ip[metric]);
+
         (void) unit_get_ip_accounting(u, metric, &value);
         return sd_bus_message_append(reply, "t", value);
 }
@@ -1139,6 +1218,7 @@ const sd_bus_vtable bus_unit_cgroup_vtable[] = {
         SD_BUS_PROPERTY("IPEgressBytes", "t", property_get_ip_counter, 0, 0),
         SD_BUS_PROPERTY("IPEgressPackets", "t", property_get_ip_counter, 0, 0),
         SD_BUS_METHOD("GetProcesses", NULL, "a(sus)", bus_unit_method_get_processes, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("GetAccountingHistory", NULL, "a(tttttttt)", bus_unit_method_get_accounting_history, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_VTABLE_END
 };
 
@@ -1263,6 +1343,149 @@ void bus_unit_send_removed_signal(Unit *u) {
                 log_unit_debug_errno(u, r, "Failed to send unit remove signal for %s: %m", u->id);
 }
 
+static const sd_bus_vtable *find_property(const sd_bus_vtable *vtable, const char *name) {
+        const sd_bus_vtable *v;
+
+        assert(vtable);
+        assert(name);
+
+        for (v = vtable; v->type != _SD_BUS_VTABLE_END; v++) {
+                if (!IN_SET(v->type, _SD_BUS_VTABLE_PROPERTY, _SD_BUS_VTABLE_WRITABLE_PROPERTY))
+                        continue;
+
+                if (v->flags & SD_BUS_VTABLE_HIDDEN)
+                        continue;
+
+                if (streq(v->x.property.member, name))
+                        return v;
+        }
+
+        return NULL;
+}
+
+static int append_property(
+                sd_bus_message *reply,
+                const char *path,
+                const char *interface,
+                const sd_bus_vtable *v,
+                void *userdata,
+                sd_bus_error *error) {
+
+        const void *p;
+        int r;
+
+        assert(reply);
+        assert(v);
+
+        /* Appends the property the same way sd-bus would when it is read via org.freedesktop.DBus.Properties */
+
+        userdata = (uint8_t*) userdata + v->x.property.offset;
+
+        r = sd_bus_message_open_container(reply, 'e', "sv");
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_append(reply, "s", v->x.property.member);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(reply, 'v', v->x.property.signature);
+        if (r < 0)
+                return r;
+
+        if (v->x.property.get) {
+                r = v->x.property.get(sd_bus_message_get_bus(reply), path, interface, v->x.property.member, reply, userdata, error);
+                if (r >= 0 && sd_bus_error_is_set(error))
+                        r = -sd_bus_error_get_errno(error);
+        } else if (streq(v->x.property.signature, "as"))
+                r = sd_bus_message_append_strv(reply, *(char***) userdata);
+        else {
+                switch (v->x.property.signature[0]) {
+
+                case SD_BUS_TYPE_STRING:
+                case SD_BUS_TYPE_SIGNATURE:
+                        p = strempty(*(char**) userdata);
+                        break;
+
+                case SD_BUS_TYPE_OBJECT_PATH:
+                        p = *(char**) userdata;
+                        break;
+
+                default:
+                        p = userdata;
+                        break;
+                }
+
+                r = sd_bus_message_append_basic(reply, v->x.property.signature[0], p);
+        }
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_close_container(reply);
+        if (r < 0)
+                return r;
+
+        return sd_bus_message_close_container(reply);
+}
+
+int bus_unit_append_properties(Unit *u, sd_bus_message *reply, char **properties, sd_bus_error *error) {
+        _cleanup_free_ char *path = NULL;
+        const char *interface;
+        char **property;
+        int r;
+
+        assert(u);
+        assert(reply);
+
+        /* Appends the listed properties of the unit as a{sv}, looking them up in the same vtables and with the same
+         * userdata as bus_init_api() registers them with. Properties the unit doesn't have are skipped. */
+
+        path = unit_dbus_path(u);
+        if (!path)
+                return -ENOMEM;
+
+        assert_se(interface = unit_dbus_interface_from_type(u->type));
+
+        r = sd_bus_message_open_container(reply, 'a', "{sv}");
+        if (r < 0)
+                return r;
+
+        STRV_FOREACH(property, properties) {
+                const struct {
+                        const char *interface;
+                        const sd_bus_vtable *vtable;
+                        void *userdata;
+                } tables[] = {
+                        { "org.freedesktop.systemd1.Unit", bus_unit_vtable,             u                                     },
+                        { interface,                       UNIT_VTABLE(u)->bus_vtable,  u                                     },
+                        { interface,                       bus_unit_cgroup_vtable,      UNIT_HAS_CGROUP_CONTEXT(u) ? u : NULL },
+                        { interface,                       bus_cgroup_vtable,           unit_get_cgroup_context(u)            },
+                        { interface,                       bus_exec_vtable,             unit_get_exec_context(u)              },
+                        { interface,                       bus_kill_vtable,             unit_get_kill_context(u)              },
+                };
+                unsigned k;
+
+                for (k = 0; k < ELEMENTSOF(tables); k++) {
+                        const sd_bus_vtable *v;
+
+                        if (!tables[k].userdata)
+                                continue;
+
+                        v = find_property(tables[k].vtable, *property);
+                        if (!v)
+                                continue;
+
+                        r = append_property(reply, path, tables[k].interface, v, tables[k].userdata, error);
+                        if (r < 0)
+                                return r;
+
+                        break;
+                }
+        }
+
+        return sd_bus_message_close_container(reply);
+}
+
 int bus_unit_queue_job(
                 sd_bus_message *message,
                 Unit *u,
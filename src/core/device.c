@@ -19,6 +19,8 @@
 ***/
 
 #include <errno.h>
+#include <pthread.h>
+#include <signal.h>
 #include <sys/epoll.h>
 
 #include "libudev.h"
@@ -26,6 +28,7 @@
 #include "alloc-util.h"
 #include "dbus-device.h"
 #include "device.h"
+#include "libudev-private.h"
 #include "log.h"
 #include "parse-util.h"
 #include "path-util.h"
@@ -42,6 +45,15 @@ static const UnitActiveState state_translation_table[_DEVICE_STATE_MAX] = {
         [DEVICE_PLUGGED] = UNIT_ACTIVE,
 };
 
+typedef struct DevicePrefetch {
+        pthread_t thread;
+        struct udev *udev;
+        struct udev_device **devices;
+        size_t n_devices;
+        size_t n_skipped;       /* devices which could not be opened */
+        int error;
+} DevicePrefetch;
+
 static int device_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata);
 
 static void device_unset_sysfs(Device *d) {
@@ -335,7 +347,7 @@ static int device_upgrade_mount_deps(Unit *u) {
 
         /* Let's upgrade Requires= to BindsTo= on us. (Used when SYSTEMD_MOUNT_DEVICE_BOUND is set) */
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_REQUIRED_BY], i) {
+        UNIT_DEPENDENCY_SET_FOREACH(v, other, u->dependencies[UNIT_REQUIRED_BY], i) {
                 if (other->type != UNIT_MOUNT)
                         continue;
 
@@ -654,102 +666,263 @@ fail:
         return r;
 }
 
-static void device_shutdown(Manager *m) {
-        assert(m);
+static DevicePrefetch* device_prefetch_free(DevicePrefetch *d) {
+        size_t i;
 
-        m->udev_event_source = sd_event_source_unref(m->udev_event_source);
+        if (!d)
+                return NULL;
 
-        if (m->udev_monitor) {
-                udev_monitor_unref(m->udev_monitor);
-                m->udev_monitor = NULL;
-        }
+        for (i = 0; i < d->n_devices; i++)
+                udev_device_unref(d->devices[i]);
+        free(d->devices);
 
-        m->devices_by_sysfs = hashmap_free(m->devices_by_sysfs);
+        udev_unref(d->udev);
+        return mfree(d);
 }
 
-static void device_enumerate(Manager *m) {
+DEFINE_TRIVIAL_CLEANUP_FUNC(DevicePrefetch*, device_prefetch_free);
+
+static int device_prefetch_scan(DevicePrefetch *d) {
         _cleanup_udev_enumerate_unref_ struct udev_enumerate *e = NULL;
         struct udev_list_entry *item = NULL, *first = NULL;
+        size_t allocated = 0;
         int r;
 
-        assert(m);
+        assert(d);
 
-        if (!m->udev_monitor) {
-                m->udev_monitor = udev_monitor_new_from_netlink(m->udev, "udev");
-                if (!m->udev_monitor) {
-                        log_oom();
-                        goto fail;
-                }
+        /* Collects all initialized devices tagged for us, with their properties loaded already. This only reads
+         * from sysfs and the udev database and touches no manager state, hence may run on a helper thread. It
+         * doesn't log either, problems are recorded in d and logged by the caller. */
 
-                /* This will fail if we are unprivileged, but that
-                 * should not matter much, as user instances won't run
-                 * during boot. */
-                (void) udev_monitor_set_receive_buffer_size(m->udev_monitor, 128*1024*1024);
+        e = udev_enumerate_new(d->udev);
+        if (!e)
+                return -ENOMEM;
 
-                r = udev_monitor_filter_add_match_tag(m->udev_monitor, "systemd");
-                if (r < 0) {
-                        log_error_errno(r, "Failed to add udev tag match: %m");
-                        goto fail;
-                }
+        r = udev_enumerate_add_match_tag(e, "systemd");
+        if (r < 0)
+                return r;
 
-                r = udev_monitor_enable_receiving(m->udev_monitor);
-                if (r < 0) {
-                        log_error_errno(r, "Failed to enable udev event reception: %m");
-                        goto fail;
+        r = udev_enumerate_add_match_is_initialized(e);
+        if (r < 0)
+                return r;
+
+        /* We run in a thread of our own already, with nothing else to do until the scan is done */
+        r = udev_enumerate_set_n_threads(e, 0);
+        if (r < 0)
+                return r;
+
+        r = udev_enumerate_scan_devices(e);
+        if (r < 0)
+                return r;
+
+        first = udev_enumerate_get_list_entry(e);
+        udev_list_entry_foreach(item, first) {
+                struct udev_device *dev;
+
+                dev = udev_device_new_from_syspath(d->udev, udev_list_entry_get_name(item));
+                if (!dev) {
+                        d->n_skipped++;
+                        continue;
                 }
 
-                r = sd_event_add_io(m->event, &m->udev_event_source, udev_monitor_get_fd(m->udev_monitor), EPOLLIN, device_dispatch_io, m);
-                if (r < 0) {
-                        log_error_errno(r, "Failed to watch udev file descriptor: %m");
-                        goto fail;
+                /* Make sure the udev database entry and uevent file are read here, and not on first access */
+                (void) udev_device_get_properties_list_entry(dev);
+
+                if (!GREEDY_REALLOC(d->devices, allocated, d->n_devices + 1)) {
+                        udev_device_unref(dev);
+                        return -ENOMEM;
                 }
 
-                (void) sd_event_source_set_description(m->udev_event_source, "device");
+                d->devices[d->n_devices++] = dev;
         }
 
-        e = udev_enumerate_new(m->udev);
-        if (!e) {
-                log_oom();
-                goto fail;
-        }
+        return 0;
+}
 
-        r = udev_enumerate_add_match_tag(e, "systemd");
+static void *device_prefetch_thread(void *p) {
+        DevicePrefetch *d = p;
+
+        (void) pthread_setname_np(pthread_self(), "device-enum");
+
+        /* Logging is not thread-safe, and libudev logs while scanning */
+        log_set_thread_quiet(true);
+
+        d->error = device_prefetch_scan(d);
+        return NULL;
+}
+
+static DevicePrefetch *device_prefetch_join(Manager *m) {
+        DevicePrefetch *d;
+
+        assert(m);
+
+        d = m->device_prefetch;
+        if (!d)
+                return NULL;
+
+        m->device_prefetch = NULL;
+        assert_se(pthread_join(d->thread, NULL) == 0);
+
+        return d;
+}
+
+static int device_setup_monitor(Manager *m) {
+        int r;
+
+        assert(m);
+
+        if (m->udev_monitor)
+                return 0;
+
+        m->udev_monitor = udev_monitor_new_from_netlink(m->udev, "udev");
+        if (!m->udev_monitor)
+                return log_oom();
+
+        /* This will fail if we are unprivileged, but that
+         * should not matter much, as user instances won't run
+         * during boot. */
+        (void) udev_monitor_set_receive_buffer_size(m->udev_monitor, 128*1024*1024);
+
+        r = udev_monitor_filter_add_match_tag(m->udev_monitor, "systemd");
         if (r < 0) {
-                log_error_errno(r, "Failed to create udev tag enumeration: %m");
+                log_error_errno(r, "Failed to add udev tag match: %m");
                 goto fail;
         }
 
-        r = udev_enumerate_add_match_is_initialized(e);
+        r = udev_monitor_enable_receiving(m->udev_monitor);
         if (r < 0) {
-                log_error_errno(r, "Failed to install initialization match into enumeration: %m");
+                log_error_errno(r, "Failed to enable udev event reception: %m");
                 goto fail;
         }
 
-        r = udev_enumerate_scan_devices(e);
+        r = sd_event_add_io(m->event, &m->udev_event_source, udev_monitor_get_fd(m->udev_monitor), EPOLLIN, device_dispatch_io, m);
         if (r < 0) {
-                log_error_errno(r, "Failed to enumerate devices: %m");
+                log_error_errno(r, "Failed to watch udev file descriptor: %m");
                 goto fail;
         }
 
-        first = udev_enumerate_get_list_entry(e);
-        udev_list_entry_foreach(item, first) {
-                _cleanup_udev_device_unref_ struct udev_device *dev = NULL;
-                const char *sysfs;
+        (void) sd_event_source_set_description(m->udev_event_source, "device");
 
-                sysfs = udev_list_entry_get_name(item);
+        return 0;
 
-                dev = udev_device_new_from_syspath(m->udev, sysfs);
-                if (!dev) {
+fail:
+        udev_monitor_unref(m->udev_monitor);
+        m->udev_monitor = NULL;
+        return r;
+}
+
+static void device_enumerate_prepare(Manager *m) {
+        _cleanup_(device_prefetch_freep) DevicePrefetch *d = NULL;
+        sigset_t ss, saved_ss;
+        int r, k;
+
+        assert(m);
+
+        /* Scanning sysfs and the udev database for all devices is mostly waiting for I/O, hence start doing it on
+         * a helper thread while the generators run. device_enumerate() picks up the result later. The thread uses
+         * its own udev context, so that nothing is shared with the main thread. */
+
+        if (m->device_prefetch)
+                return;
+
+        /* Listen for uevents before taking the snapshot, so that nothing that happens in between is lost. If
+         * that fails, device_enumerate() will try again, and shut down device handling. */
+        r = device_setup_monitor(m);
+        if (r < 0)
+                return;
+
+        d = new0(DevicePrefetch, 1);
+        if (!d) {
+                log_oom();
+                return;
+        }
+
+        d->udev = udev_new();
+        if (!d->udev) {
+                log_oom();
+                return;
+        }
+
+        /* Start the thread with all signals blocked, so that it doesn't affect signal handling of PID 1 */
+        assert_se(sigfillset(&ss) >= 0);
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0) {
+                log_debug_errno(r, "Failed to block signals, enumerating devices synchronously: %m");
+                return;
+        }
+
+        r = pthread_create(&d->thread, NULL, device_prefetch_thread, d);
+
+        k = pthread_sigmask(SIG_SETMASK, &saved_ss, NULL);
+        if (k > 0)
+                log_warning_errno(k, "Failed to restore signal mask, ignoring: %m");
+
+        if (r > 0) {
+                log_debug_errno(r, "Failed to start device enumeration thread, enumerating synchronously: %m");
+                return;
+        }
+
+        m->device_prefetch = d;
+        d = NULL;
+}
+
+static void device_shutdown(Manager *m) {
+        assert(m);
+
+        device_prefetch_free(device_prefetch_join(m));
+
+        m->udev_event_source = sd_event_source_unref(m->udev_event_source);
+
+        if (m->udev_monitor) {
+                udev_monitor_unref(m->udev_monitor);
+                m->udev_monitor = NULL;
+        }
+
+        m->devices_by_sysfs = hashmap_free(m->devices_by_sysfs);
+}
+
+static void device_enumerate(Manager *m) {
+        _cleanup_(device_prefetch_freep) DevicePrefetch *d = NULL;
+        size_t i;
+        int r;
+
+        assert(m);
+
+        r = device_setup_monitor(m);
+        if (r < 0)
+                goto fail;
+
+        /* Pick up the result of device_enumerate_prepare(), or do the scan now if there is none. Either way the
+         * devices are processed in enumeration order, so the result does not depend on which way we went. */
+        d = device_prefetch_join(m);
+        if (!d) {
+                d = new0(DevicePrefetch, 1);
+                if (!d) {
                         log_oom();
-                        continue;
+                        goto fail;
                 }
 
+                d->udev = udev_ref(m->udev);
+                d->error = device_prefetch_scan(d);
+        }
+
+        if (d->error < 0) {
+                log_error_errno(d->error, "Failed to enumerate devices: %m");
+                goto fail;
+        }
+
+        if (d->n_skipped > 0)
+                log_debug("Failed to open %zu enumerated devices, ignoring.", d->n_skipped);
+
+        for (i = 0; i < d->n_devices; i++) {
+                struct udev_device *dev = d->devices[i];
+
                 if (!device_is_ready(dev))
                         continue;
 
                 (void) device_process_new(m, dev);
 
-                device_update_found_by_sysfs(m, sysfs, true, DEVICE_FOUND_UDEV, false);
+                device_update_found_by_sysfs(m, udev_device_get_syspath(dev), true, DEVICE_FOUND_UDEV, false);
         }
 
         return;
@@ -949,6 +1122,7 @@ const UnitVTable device_vtable = {
         .following = device_following,
         .following_set = device_following_set,
 
+        .enumerate_prepare = device_enumerate_prepare,
         .enumerate = device_enumerate,
         .shutdown = device_shutdown,
         .supported = device_supported,
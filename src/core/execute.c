@@ -1629,7 +1629,7 @@ static int build_environment(
         assert(c);
         assert(ret);
 
-        our_env = new0(char*, 14);
+        our_env = new0(char*, 15);
         if (!our_env)
                 return -ENOMEM;
 
@@ -1662,6 +1662,13 @@ static int build_environment(
                 if (asprintf(&x, "WATCHDOG_USEC="USEC_FMT, p->watchdog_usec) < 0)
                         return -ENOMEM;
                 our_env[n_env++] = x;
+
+                if (p->flags & EXEC_WATCHDOG_SHM) {
+                        x = strdup("WATCHDOG_SHM=1");
+                        if (!x)
+                                return -ENOMEM;
+                        our_env[n_env++] = x;
+                }
         }
 
         /* If this is D-Bus, tell the nss-systemd module, since it relies on being able to use D-Bus look up dynamic
@@ -1735,7 +1742,7 @@ static int build_environment(
         }
 
         our_env[n_env++] = NULL;
-        assert(n_env <= 12);
+        assert(n_env <= 13);
 
         *ret = our_env;
         our_env = NULL;
@@ -3455,7 +3462,9 @@ int exec_spawn(Unit *unit,
         _cleanup_free_ char *line = NULL;
         int socket_fd, r;
         int named_iofds[3] = { -1, -1, -1 };
+        char buf[FORMAT_TIMESPAN_MAX];
         char **argv;
+        usec_t ts;
         pid_t pid;
 
         assert(unit);
@@ -3496,16 +3505,27 @@ int exec_spawn(Unit *unit,
                 return log_unit_error_errno(unit, r, "Failed to load environment files: %m");
 
         argv = params->argv ?: command->argv;
-        line = exec_command_line(argv);
-        if (!line)
-                return log_oom();
 
-        log_struct(LOG_DEBUG,
-                   LOG_UNIT_MESSAGE(unit, "About to execute: %s", line),
-                   "EXECUTABLE=%s", command->path,
-                   LOG_UNIT_ID(unit),
-                   LOG_UNIT_INVOCATION_ID(unit),
-                   NULL);
+        /* Formatting the command line is only needed for the debug message below, hence skip it when debug
+         * logging is off. */
+        if (log_get_max_level() >= LOG_DEBUG) {
+                line = exec_command_line(argv);
+                if (!line)
+                        return log_oom();
+
+                log_struct(LOG_DEBUG,
+                           LOG_UNIT_MESSAGE(unit, "About to execute: %s", line),
+                           "EXECUTABLE=%s", command->path,
+                           LOG_UNIT_ID(unit),
+                           LOG_UNIT_INVOCATION_ID(unit),
+                           NULL);
+        }
+
+        /* This is still a plain fork(), whose cost grows with the size of our address space. A vfork()-style
+         * clone(CLONE_VM|CLONE_VFORK) is not an option, as exec_child() allocates memory and takes locks
+         * which would then be shared with the manager, and handing the setup to a separate executor binary
+         * requires serializing ExecContext and ExecParameters first. Hence, log at least how long it took. */
+        ts = now(CLOCK_MONOTONIC);
 
         pid = fork();
         if (pid < 0)
@@ -3545,7 +3565,8 @@ int exec_spawn(Unit *unit,
                 _exit(exit_status);
         }
 
-        log_unit_debug(unit, "Forked %s as "PID_FMT, command->path, pid);
+        log_unit_debug(unit, "Forked %s as "PID_FMT" in %s.", command->path, pid,
+                       format_timespan(buf, sizeof(buf), usec_sub_unsigned(now(CLOCK_MONOTONIC), ts), 1));
 
         /* We add the new process to the cgroup both in the child (so
          * that we can be sure that no user code is ever executed
@@ -292,12 +292,13 @@ typedef enum ExecFlags {
         EXEC_CHOWN_DIRECTORIES = 1U << 5, /* chown() the runtime/state/cache/log directories to the user we run as, under all conditions */
         EXEC_NSS_BYPASS_BUS    = 1U << 6, /* Set the SYSTEMD_NSS_BYPASS_BUS environment variable, to disable nss-systemd for dbus */
         EXEC_CGROUP_DELEGATE   = 1U << 7,
+        EXEC_WATCHDOG_SHM      = 1U << 8, /* Set $WATCHDOG_SHM along with $WATCHDOG_USEC */
 
         /* The following are not used by execute.c, but by consumers internally */
-        EXEC_PASS_FDS          = 1U << 8,
-        EXEC_IS_CONTROL        = 1U << 9,
-        EXEC_SETENV_RESULT     = 1U << 10,
-        EXEC_SET_WATCHDOG      = 1U << 11,
+        EXEC_PASS_FDS          = 1U << 9,
+        EXEC_IS_CONTROL        = 1U << 10,
+        EXEC_SETENV_RESULT     = 1U << 11,
+        EXEC_SET_WATCHDOG      = 1U << 12,
 } ExecFlags;
 
 struct ExecParameters {
@@ -0,0 +1,278 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <errno.h>
+#include <stdio_ext.h>
+#include <sys/stat.h>
+
+#include "alloc-util.h"
+#include "copy.h"
+#include "def.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "generator-cache.h"
+#include "log.h"
+#include "mkdir.h"
+#include "path-util.h"
+#include "proc-cmdline.h"
+#include "rm-rf.h"
+#include "string-util.h"
+#include "strv.h"
+#include "time-util.h"
+#include "user-util.h"
+
+/* Generators may opt into having their output cached across daemon reloads by shipping a "<generator>.inputs"
+ * file next to the binary, listing the absolute paths of all files the generator reads, one per line. The
+ * fingerprint of a generator covers the generator binary itself, the listed inputs and the kernel command line.
+ * As long as it doesn't change, the generator is not invoked again and its previous output is reused. Cached
+ * generators write into a private directory below the cache root, whose contents are then merged into the real
+ * generator directories. */
+
+static void fingerprint_stat(FILE *f, const char *path, usec_t n, bool *racy) {
+        struct stat st;
+
+        if (stat(path, &st) < 0) {
+                fprintf(f, "%s -\n", path);
+                return;
+        }
+
+        fprintf(f, "%s %lx %lu %lu %" PRIu64 " %" PRIu64 " %o\n",
+                path,
+                (unsigned long) st.st_dev,
+                (unsigned long) st.st_ino,
+                (unsigned long) st.st_size,
+                timespec_load_nsec(&st.st_mtim),
+                timespec_load_nsec(&st.st_ctim),
+                st.st_mode);
+
+        /* If the file was modified within the granularity of the file system timestamps, a later modification
+         * might not be reflected in the fingerprint. Don't cache the output in that case. */
+        if (timespec_load(&st.st_mtim) + USEC_PER_SEC > n ||
+            timespec_load(&st.st_ctim) + USEC_PER_SEC > n)
+                *racy = true;
+}
+
+static int generator_fingerprint(const char *generator, char **ret, bool *ret_racy) {
+        _cleanup_fclose_ FILE *inputs = NULL, *f = NULL;
+        _cleanup_free_ char *buf = NULL, *cmdline = NULL;
+        const char *fn;
+        bool racy = false;
+        size_t sz = 0;
+        usec_t n;
+        int r;
+
+        assert(generator);
+        assert(ret);
+        assert(ret_racy);
+
+        fn = strjoina(generator, ".inputs");
+        inputs = fopen(fn, "re");
+        if (!inputs) {
+                if (errno == ENOENT)
+                        return 0;
+
+                return -errno;
+        }
+
+        f = open_memstream(&buf, &sz);
+        if (!f)
+                return -ENOMEM;
+
+        (void) __fsetlocking(f, FSETLOCKING_BYCALLER);
+
+        n = now(CLOCK_REALTIME);
+
+        fingerprint_stat(f, generator, n, &racy);
+
+        for (;;) {
+                _cleanup_free_ char *line = NULL;
+                const char *p;
+
+                r = read_line(inputs, LONG_LINE_MAX, &line);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        break;
+
+                p = strstrip(line);
+                if (IN_SET(*p, 0, '#'))
+                        continue;
+
+                if (!path_is_absolute(p)) {
+                        log_debug("Ignoring relative path '%s' in %s.", p, fn);
+                        continue;
+                }
+
+                fingerprint_stat(f, p, n, &racy);
+        }
+
+        r = proc_cmdline(&cmdline);
+        if (r < 0)
+                return r;
+
+        fprintf(f, "cmdline %s\n", cmdline);
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                return r;
+
+        f = safe_fclose(f);
+
+        *ret = buf;
+        buf = NULL;
+        *ret_racy = racy;
+
+        return 1;
+}
+
+int generator_cache_prepare(const char *root, const char *generator, char ***ret_argv) {
+        _cleanup_free_ char *dir = NULL, *fingerprint = NULL, *old = NULL;
+        _cleanup_strv_free_ char **argv = NULL;
+        const char *fn, *normal, *early, *late;
+        bool racy;
+        int r;
+
+        assert(root);
+        assert(generator);
+        assert(ret_argv);
+
+        /* Returns > 0 if the cached output of the generator is up-to-date and the generator does not need to
+         * run. Otherwise returns 0, and the argument vector the generator shall be invoked with, which is NULL
+         * if the generator is not cacheable at all. */
+
+        dir = path_join(NULL, root, basename(generator));
+        if (!dir)
+                return -ENOMEM;
+
+        r = generator_fingerprint(generator, &fingerprint, &racy);
+        if (r < 0)
+                return r;
+        if (r == 0) {
+                /* Not (or no longer) cacheable, drop any stale output */
+                (void) rm_rf(dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+                *ret_argv = NULL;
+                return 0;
+        }
+
+        fn = strjoina(dir, "/fingerprint");
+        if (read_full_file(fn, &old, NULL) >= 0 && streq(old, fingerprint)) {
+                log_debug("Output of %s is up-to-date, not running it.", generator);
+                *ret_argv = NULL;
+                return 1;
+        }
+
+        (void) rm_rf(dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+
+        normal = strjoina(dir, "/normal");
+        early = strjoina(dir, "/early");
+        late = strjoina(dir, "/late");
+
+        r = mkdir_p(normal, 0755);
+        if (r < 0)
+                return r;
+        r = mkdir_p(early, 0755);
+        if (r < 0)
+                return r;
+        r = mkdir_p(late, 0755);
+        if (r < 0)
+                return r;
+
+        /* The fingerprint only becomes valid once the generator finished successfully, see
+         * generator_cache_commit(). */
+        if (!racy) {
+                fn = strjoina(dir, "/fingerprint.new");
+                r = write_string_file(fn, fingerprint, WRITE_STRING_FILE_CREATE|WRITE_STRING_FILE_ATOMIC|WRITE_STRING_FILE_AVOID_NEWLINE);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to write fingerprint of %s, not caching its output: %m", generator);
+        }
+
+        argv = strv_new(generator, normal, early, late, NULL);
+        if (!argv)
+                return -ENOMEM;
+
+        *ret_argv = argv;
+        argv = NULL;
+
+        return 0;
+}
+
+int generator_cache_commit(const char *root, const char *generator, bool success) {
+        _cleanup_free_ char *dir = NULL;
+        const char *old, *new;
+
+        assert(root);
+        assert(generator);
+
+        dir = path_join(NULL, root, basename(generator));
+        if (!dir)
+                return -ENOMEM;
+
+        new = strjoina(dir, "/fingerprint.new");
+
+        if (!success) {
+                if (unlink(new) < 0 && errno != ENOENT)
+                        return -errno;
+
+                return 0;
+        }
+
+        old = strjoina(dir, "/fingerprint");
+        if (rename(new, old) < 0 && errno != ENOENT)
+                return -errno;
+
+        return 0;
+}
+
+int generator_cache_merge(const char *root, const char *generator, const char *normal_dir, const char *early_dir, const char *late_dir) {
+        _cleanup_free_ char *dir = NULL;
+        const char *p;
+        int r;
+
+        assert(root);
+        assert(generator);
+        assert(normal_dir);
+        assert(early_dir);
+        assert(late_dir);
+
+        dir = path_join(NULL, root, basename(generator));
+        if (!dir)
+                return -ENOMEM;
+
+        if (access(dir, F_OK) < 0)
+                return errno == ENOENT ? 0 : -errno;
+
+        /* Files another generator already placed in the real directories take precedence, like they would if
+         * the cached generator had run last and failed to create them. */
+
+        p = strjoina(dir, "/normal");
+        r = copy_tree(p, normal_dir, UID_INVALID, GID_INVALID, COPY_MERGE);
+        if (r < 0 && r != -ENOENT)
+                return r;
+
+        p = strjoina(dir, "/early");
+        r = copy_tree(p, early_dir, UID_INVALID, GID_INVALID, COPY_MERGE);
+        if (r < 0 && r != -ENOENT)
+                return r;
+
+        p = strjoina(dir, "/late");
+        r = copy_tree(p, late_dir, UID_INVALID, GID_INVALID, COPY_MERGE);
+        if (r < 0 && r != -ENOENT)
+                return r;
+
+        return 1;
+}
@@ -145,6 +145,7 @@ void job_uninstall(Job *j) {
                 bus_job_send_removed_signal(j);
 
         *pj = NULL;
+        j->unit->change_generation = ++j->manager->unit_change_generation;
 
         unit_add_to_gc_queue(j->unit);
 
@@ -465,7 +466,7 @@ static bool job_is_runnable(Job *j) {
                  * dependencies, regardless whether they are
                  * starting or stopping something. */
 
-                HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_AFTER], i)
+                UNIT_DEPENDENCY_SET_FOREACH(v, other, j->unit->dependencies[UNIT_AFTER], i)
                         if (other->job)
                                 return false;
         }
@@ -473,7 +474,7 @@ static bool job_is_runnable(Job *j) {
         /* Also, if something else is being stopped and we should
          * change state after it, then let's wait. */
 
-        HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_BEFORE], i)
+        UNIT_DEPENDENCY_SET_FOREACH(v, other, j->unit->dependencies[UNIT_BEFORE], i)
                 if (other->job &&
                     IN_SET(other->job->type, JOB_STOP, JOB_RESTART))
                         return false;
@@ -839,7 +840,7 @@ static void job_fail_dependencies(Unit *u, UnitDependency d) {
 
         assert(u);
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[d], i) {
+        UNIT_DEPENDENCY_SET_FOREACH(v, other, u->dependencies[d], i) {
                 Job *j = other->job;
 
                 if (!j)
@@ -924,12 +925,12 @@ int job_finish_and_invalidate(Job *j, JobResult result, bool recursive, bool alr
 
 finish:
         /* Try to start the next jobs that can be started */
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_AFTER], i)
+        UNIT_DEPENDENCY_SET_FOREACH(v, other, u->dependencies[UNIT_AFTER], i)
                 if (other->job) {
                         job_add_to_run_queue(other->job);
                         job_add_to_gc_queue(other->job);
                 }
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_BEFORE], i)
+        UNIT_DEPENDENCY_SET_FOREACH(v, other, u->dependencies[UNIT_BEFORE], i)
                 if (other->job) {
                         job_add_to_run_queue(other->job);
                         job_add_to_gc_queue(other->job);
@@ -1024,6 +1025,9 @@ void job_add_to_dbus_queue(Job *j) {
         assert(j);
         assert(j->installed);
 
+        /* The unit's Job property changes with the job */
+        j->unit->change_generation = ++j->manager->unit_change_generation;
+
         if (j->in_dbus_queue)
                 return;
 
@@ -1307,7 +1311,7 @@ bool job_check_gc(Job *j) {
 
         /* If a job is ordered after ours, and is to be started, then it needs to wait for us, regardless if we stop or
          * start, hence let's not GC in that case. */
-        HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_BEFORE], i) {
+        UNIT_DEPENDENCY_SET_FOREACH(v, other, j->unit->dependencies[UNIT_BEFORE], i) {
                 if (!other->job)
                         continue;
 
@@ -1320,7 +1324,7 @@ bool job_check_gc(Job *j) {
 
         /* If we are going down, but something else is ordered After= us, then it needs to wait for us */
         if (IN_SET(j->type, JOB_STOP, JOB_RESTART))
-                HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_AFTER], i) {
+                UNIT_DEPENDENCY_SET_FOREACH(v, other, j->unit->dependencies[UNIT_AFTER], i) {
                         if (!other->job)
                                 continue;
 
@@ -1412,7 +1416,7 @@ int job_get_before(Job *j, Job*** ret) {
 
         if (IN_SET(j->type, JOB_START, JOB_VERIFY_ACTIVE, JOB_RELOAD)) {
 
-                HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_AFTER], i) {
+                UNIT_DEPENDENCY_SET_FOREACH(v, other, j->unit->dependencies[UNIT_AFTER], i) {
                         if (!other->job)
                                 continue;
 
@@ -1422,7 +1426,7 @@ int job_get_before(Job *j, Job*** ret) {
                 }
         }
 
-        HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_BEFORE], i) {
+        UNIT_DEPENDENCY_SET_FOREACH(v, other, j->unit->dependencies[UNIT_BEFORE], i) {
                 if (!other->job)
                         continue;
 
@@ -1454,7 +1458,7 @@ int job_get_after(Job *j, Job*** ret) {
 
         /* Returns a list of all pending jobs that are waiting for this job to finish. */
 
-        HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_BEFORE], i) {
+        UNIT_DEPENDENCY_SET_FOREACH(v, other, j->unit->dependencies[UNIT_BEFORE], i) {
                 if (!other->job)
                         continue;
 
@@ -1471,7 +1475,7 @@ int job_get_after(Job *j, Job*** ret) {
 
         if (IN_SET(j->type, JOB_STOP, JOB_RESTART)) {
 
-                HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_AFTER], i) {
+                UNIT_DEPENDENCY_SET_FOREACH(v, other, j->unit->dependencies[UNIT_AFTER], i) {
                         if (!other->job)
                                 continue;
 
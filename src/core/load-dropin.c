@@ -61,6 +61,7 @@ static int process_deps(Unit *u, UnitDependency dependency, const char *dir_suff
         r = unit_file_find_dropin_paths(NULL,
                                         u->manager->lookup_paths.search_path,
                                         u->manager->unit_path_cache,
+                                        u->manager->unit_dropin_dir_cache,
                                         dir_suffix,
                                         NULL,
                                         u->names,
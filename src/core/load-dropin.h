@@ -29,6 +29,7 @@ static inline int unit_find_dropin_paths(Unit *u, char ***paths) {
         return unit_file_find_dropin_conf_paths(NULL,
                                                 u->manager->lookup_paths.search_path,
                                                 u->manager->unit_path_cache,
+                                                u->manager->unit_dropin_dir_cache,
                                                 u->names,
                                                 paths);
 }
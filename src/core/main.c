@@ -138,6 +138,7 @@ static bool arg_default_blockio_accounting = false;
 static bool arg_default_memory_accounting = false;
 static bool arg_default_tasks_accounting = true;
 static uint64_t arg_default_tasks_max = UINT64_MAX;
+static usec_t arg_accounting_sample_interval_usec = 0;
 static sd_id128_t arg_machine_id = {};
 static EmergencyAction arg_cad_burst_action = EMERGENCY_ACTION_REBOOT_FORCE;
 
@@ -809,6 +810,7 @@ static int parse_config_file(void) {
                 { "Manager", "DefaultMemoryAccounting",   config_parse_bool,             0, &arg_default_memory_accounting         },
                 { "Manager", "DefaultTasksAccounting",    config_parse_bool,             0, &arg_default_tasks_accounting          },
                 { "Manager", "DefaultTasksMax",           config_parse_tasks_max,        0, &arg_default_tasks_max                 },
+                { "Manager", "AccountingSampleIntervalSec", config_parse_sec,            0, &arg_accounting_sample_interval_usec   },
                 { "Manager", "CtrlAltDelBurstAction",     config_parse_emergency_action, 0, &arg_cad_burst_action                  },
                 {}
         };
@@ -868,6 +870,7 @@ static void set_manager_settings(Manager *m) {
         m->runtime_watchdog = arg_runtime_watchdog;
         m->shutdown_watchdog = arg_shutdown_watchdog;
         m->cad_burst_action = arg_cad_burst_action;
+        m->accounting_sample_interval_usec = arg_accounting_sample_interval_usec;
 
         manager_set_show_status(m, arg_show_status);
 }
@@ -1198,6 +1201,9 @@ static int help(void) {
 static int prepare_reexecute(Manager *m, FILE **_f, FDSet **_fds, bool switching_root) {
         _cleanup_fdset_free_ FDSet *fds = NULL;
         _cleanup_fclose_ FILE *f = NULL;
+        char buf[FORMAT_TIMESPAN_MAX];
+        usec_t ts;
+        off_t size;
         int r;
 
         assert(m);
@@ -1216,10 +1222,21 @@ static int prepare_reexecute(Manager *m, FILE **_f, FDSet **_fds, bool switching
         if (!fds)
                 return log_oom();
 
+        ts = now(CLOCK_MONOTONIC);
+
         r = manager_serialize(m, f, fds, switching_root);
         if (r < 0)
                 return log_error_errno(r, "Failed to serialize state: %m");
 
+        size = ftello(f);
+        if (size < 0)
+                log_debug_errno(errno, "Serialized state in %s, failed to determine its size: %m",
+                                format_timespan(buf, sizeof(buf), now(CLOCK_MONOTONIC) - ts, USEC_PER_MSEC));
+        else
+                log_debug("Serialized state (%" PRIu64 " bytes) in %s.",
+                          (uint64_t) size,
+                          format_timespan(buf, sizeof(buf), now(CLOCK_MONOTONIC) - ts, USEC_PER_MSEC));
+
         if (fseeko(f, 0, SEEK_SET) == (off_t) -1)
                 return log_error_errno(errno, "Failed to rewind serialization fd: %m");
 
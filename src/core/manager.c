@@ -36,6 +36,10 @@
 #include <libaudit.h>
 #endif
 
+#if HAVE_PIDFD_OPEN
+#include <sys/pidfd.h>
+#endif
+
 #include "sd-daemon.h"
 #include "sd-messages.h"
 #include "sd-path.h"
@@ -54,14 +58,17 @@
 #include "dbus-unit.h"
 #include "dbus.h"
 #include "dirent-util.h"
+#include "dropin.h"
 #include "env-util.h"
 #include "escape.h"
 #include "exec-util.h"
 #include "execute.h"
 #include "exit-status.h"
+#include "extract-word.h"
 #include "fd-util.h"
 #include "fileio.h"
 #include "fs-util.h"
+#include "generator-cache.h"
 #include "hashmap.h"
 #include "io-util.h"
 #include "label.h"
@@ -97,6 +104,9 @@
 #define NOTIFY_RCVBUF_SIZE (8*1024*1024)
 #define CGROUPS_AGENT_RCVBUF_SIZE (8*1024*1024)
 
+/* How many notification messages to process per wakeup of the notify fd */
+#define NOTIFY_BATCH_MAX 64U
+
 /* Initial delay and the interval for printing status messages about running jobs */
 #define JOBS_IN_PROGRESS_WAIT_USEC (5*USEC_PER_SEC)
 #define JOBS_IN_PROGRESS_PERIOD_USEC (USEC_PER_SEC / 3)
@@ -113,6 +123,7 @@ static int manager_dispatch_run_queue(sd_event_source *source, void *userdata);
 static int manager_dispatch_sigchld(sd_event_source *source, void *userdata);
 static int manager_run_environment_generators(Manager *m);
 static int manager_run_generators(Manager *m);
+static void generator_times_free(GeneratorTime *t, size_t n);
 
 static void manager_watch_jobs_in_progress(Manager *m) {
         usec_t next;
@@ -705,7 +716,7 @@ int manager_new(UnitFileScope scope, unsigned test_run_flags, Manager **_m) {
 
         m->pin_cgroupfs_fd = m->notify_fd = m->cgroups_agent_fd = m->signal_fd = m->time_change_fd =
                 m->dev_autofs_fd = m->private_listen_fd = m->cgroup_inotify_fd =
-                m->ask_password_inotify_fd = -1;
+                m->ask_password_inotify_fd = m->path_inotify_fd = -1;
 
         m->user_lookup_fds[0] = m->user_lookup_fds[1] = -1;
 
@@ -1021,6 +1032,9 @@ static unsigned manager_dispatch_cleanup_queue(Manager *m) {
         return n;
 }
 
+/* How much time we spend at most on unit garbage collection per main loop iteration */
+#define GC_UNIT_QUEUE_BUDGET_USEC (1*USEC_PER_MSEC)
+
 enum {
         GC_OFFSET_IN_PATH,  /* This one is on the path we were traveling */
         GC_OFFSET_UNSURE,   /* No clue */
@@ -1037,7 +1051,7 @@ static void unit_gc_mark_good(Unit *u, unsigned gc_marker) {
         u->gc_marker = gc_marker + GC_OFFSET_GOOD;
 
         /* Recursively mark referenced units as GOOD as well */
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_REFERENCES], i)
+        UNIT_DEPENDENCY_SET_FOREACH(v, other, u->dependencies[UNIT_REFERENCES], i)
                 if (other->gc_marker == gc_marker + GC_OFFSET_UNSURE)
                         unit_gc_mark_good(other, gc_marker);
 }
@@ -1064,7 +1078,7 @@ static void unit_gc_sweep(Unit *u, unsigned gc_marker) {
 
         is_bad = true;
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_REFERENCED_BY], i) {
+        UNIT_DEPENDENCY_SET_FOREACH(v, other, u->dependencies[UNIT_REFERENCED_BY], i) {
                 unit_gc_sweep(other, gc_marker);
 
                 if (other->gc_marker == gc_marker + GC_OFFSET_GOOD)
@@ -1108,12 +1122,29 @@ good:
         unit_gc_mark_good(u, gc_marker);
 }
 
+static bool unit_gc_is_leaf(Unit *u) {
+        assert(u);
+
+        /* Returns true if no other unit references this one, in which case whether it may be collected only
+         * depends on the unit itself, and there's no need to walk the dependency graph. */
+
+        return unit_dependency_set_isempty(u->dependencies[UNIT_REFERENCED_BY]) && !u->refs_by_target;
+}
+
 static unsigned manager_dispatch_gc_unit_queue(Manager *m) {
         unsigned n = 0, gc_marker;
+        usec_t start, end;
         Unit *u;
 
         assert(m);
 
+        /* Collects the queued units, but spends at most GC_UNIT_QUEUE_BUDGET_USEC on it. If there's more
+         * queued than that, we return to the event loop first and continue in the next iteration, with a
+         * new marker generation, since the dependency graph might have changed in between. */
+
+        if (!m->gc_unit_queue || m->gc_unit_queue_yield)
+                return 0;
+
         /* log_debug("Running GC..."); */
 
         m->gc_marker += _GC_OFFSET_MAX;
@@ -1122,10 +1153,27 @@ static unsigned manager_dispatch_gc_unit_queue(Manager *m) {
 
         gc_marker = m->gc_marker;
 
+        start = end = now(CLOCK_MONOTONIC);
+
         while ((u = m->gc_unit_queue)) {
+                bool leaf;
+
                 assert(u->in_gc_queue);
 
-                unit_gc_sweep(u, gc_marker);
+                if (n > 0 && end - start >= GC_UNIT_QUEUE_BUDGET_USEC) {
+                        m->gc_unit_queue_yield = true;
+                        break;
+                }
+
+                leaf = unit_gc_is_leaf(u);
+                if (leaf) {
+                        /* Fast path: nothing refers to this unit, so it's good if it wants to stay around
+                         * by itself, and bad otherwise. */
+                        if (u->gc_marker - gc_marker >= _GC_OFFSET_MAX)
+                                u->gc_marker = gc_marker +
+                                        (!u->in_cleanup_queue && unit_check_gc(u) ? GC_OFFSET_GOOD : GC_OFFSET_BAD);
+                } else
+                        unit_gc_sweep(u, gc_marker);
 
                 LIST_REMOVE(gc_queue, m->gc_unit_queue, u);
                 u->in_gc_queue = false;
@@ -1138,9 +1186,19 @@ static unsigned manager_dispatch_gc_unit_queue(Manager *m) {
                                 log_unit_debug(u, "Collecting.");
                         u->gc_marker = gc_marker + GC_OFFSET_BAD;
                         unit_add_to_cleanup_queue(u);
+
+                        m->n_gc_collected++;
+                        if (leaf)
+                                m->n_gc_collected_leaf++;
                 }
+
+                end = now(CLOCK_MONOTONIC);
         }
 
+        m->n_gc_runs++;
+        m->gc_usec += end - start;
+        m->gc_usec_max = MAX(m->gc_usec_max, end - start);
+
         return n;
 }
 
@@ -1193,10 +1251,65 @@ static void manager_clear_jobs_and_units(Manager *m) {
         m->n_running_jobs = 0;
 }
 
+/* The listing of one unit search path directory, kept across reloads. Only the listings are cached, not the
+ * parsed unit files: the settings parsers fill in unit type specific structures, add dependencies and create
+ * other units (slices, for example) as a side effect, and there is no representation of the result that
+ * could be stored and applied to a freshly allocated unit again, short of serializing every unit type's
+ * complete configuration. It would not buy much either: the benchmark in test-conf-parser parses the same
+ * unit files and drop-ins from memory more than five times faster than from disk, so it is the file system
+ * accesses that dominate, and those are what this cache and the drop-in directory cache save. */
+typedef struct UnitPathDir {
+        char *path;
+        dev_t dev;
+        ino_t ino;
+        usec_t mtime;
+        bool cacheable;
+        char **entries;
+        size_t n_entries;
+        size_t n_allocated;
+} UnitPathDir;
+
+static UnitPathDir* unit_path_dir_free(UnitPathDir *d) {
+        if (!d)
+                return NULL;
+
+        free(d->path);
+        strv_free(d->entries);
+
+        return mfree(d);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(UnitPathDir*, unit_path_dir_free);
+
+static Hashmap* unit_path_dir_cache_free(Hashmap *h) {
+        UnitPathDir *d;
+
+        while ((d = hashmap_steal_first(h)))
+                unit_path_dir_free(d);
+
+        return hashmap_free(h);
+}
+
+typedef struct PidfdWatch {
+        Manager *manager;
+        pid_t pid;
+        sd_event_source *event_source;
+} PidfdWatch;
+
+static PidfdWatch* pidfd_watch_free(PidfdWatch *w) {
+        if (!w)
+                return NULL;
+
+        /* This closes the pidfd too, as the event source owns it */
+        sd_event_source_unref(w->event_source);
+        return mfree(w);
+}
+
 Manager* manager_free(Manager *m) {
         UnitType c;
         int i;
         ExecDirectoryType dt;
+        PidfdWatch *w;
 
         if (!m)
                 return NULL;
@@ -1223,11 +1336,17 @@ Manager* manager_free(Manager *m) {
         hashmap_free(m->watch_pids);
         hashmap_free(m->watch_bus);
 
+        while ((w = hashmap_steal_first(m->watch_pidfds)))
+                pidfd_watch_free(w);
+        hashmap_free(m->watch_pidfds);
+        set_free(m->watch_pids_unreliable);
+
         set_free(m->startup_units);
         set_free(m->failed_units);
 
         sd_event_source_unref(m->signal_event_source);
         sd_event_source_unref(m->sigchld_event_source);
+        sd_event_source_unref(m->accounting_sample_event_source);
         sd_event_source_unref(m->notify_event_source);
         sd_event_source_unref(m->cgroups_agent_event_source);
         sd_event_source_unref(m->time_change_event_source);
@@ -1252,9 +1371,12 @@ Manager* manager_free(Manager *m) {
 
         lookup_paths_free(&m->lookup_paths);
         strv_free(m->environment);
+        generator_times_free(m->generator_times, m->n_generator_times);
 
         hashmap_free(m->cgroup_unit);
         set_free_free(m->unit_path_cache);
+        unit_path_dir_cache_free(m->unit_path_dir_cache);
+        dropin_dir_cache_free(m->unit_dropin_dir_cache);
 
         free(m->switch_root);
         free(m->switch_root_init);
@@ -1274,6 +1396,23 @@ Manager* manager_free(Manager *m) {
         return mfree(m);
 }
 
+static void manager_enumerate_prepare(Manager *m) {
+        UnitType c;
+
+        assert(m);
+
+        /* Let's ask every type to start collecting what enumerate() will need, in the background */
+        for (c = 0; c < _UNIT_TYPE_MAX; c++) {
+                if (!unit_type_supported(c))
+                        continue;
+
+                if (!unit_vtable[c]->enumerate_prepare)
+                        continue;
+
+                unit_vtable[c]->enumerate_prepare(m);
+        }
+}
+
 void manager_enumerate(Manager *m) {
         UnitType c;
 
@@ -1317,7 +1456,116 @@ static void manager_coldplug(Manager *m) {
         }
 }
 
+static int manager_get_unit_path_dir(Manager *m, const char *path, UnitPathDir **ret) {
+        _cleanup_(unit_path_dir_freep) UnitPathDir *d = NULL;
+        _cleanup_closedir_ DIR *dir = NULL;
+        UnitPathDir *c;
+        struct dirent *de;
+        struct stat st;
+        usec_t ts;
+        int r;
+
+        assert(m);
+        assert(path);
+        assert(ret);
+
+        /* Returns the listing of a unit search path directory. The listing is kept around across reloads, and
+         * reused as long as the directory was not modified since. */
+
+        c = hashmap_get(m->unit_path_dir_cache, path);
+
+        if (stat(path, &st) < 0) {
+                r = -errno;
+
+                if (r == -ENOENT)
+                        unit_path_dir_free(hashmap_remove(m->unit_path_dir_cache, path));
+
+                return r;
+        }
+
+        if (c &&
+            c->cacheable &&
+            c->dev == st.st_dev &&
+            c->ino == st.st_ino &&
+            c->mtime == timespec_load(&st.st_mtim)) {
+                *ret = c;
+                return 1;
+        }
+
+        ts = now(CLOCK_REALTIME);
+
+        dir = opendir(path);
+        if (!dir)
+                return -errno;
+
+        if (fstat(dirfd(dir), &st) < 0)
+                return -errno;
+
+        d = new0(UnitPathDir, 1);
+        if (!d)
+                return -ENOMEM;
+
+        d->path = strdup(path);
+        if (!d->path)
+                return -ENOMEM;
+
+        d->dev = st.st_dev;
+        d->ino = st.st_ino;
+        d->mtime = timespec_load(&st.st_mtim);
+
+        /* The timestamp granularity of the file system might be coarser than the clock, hence only trust the
+         * modification time if it is clearly older than the point in time we started listing the directory. */
+        d->cacheable = d->mtime + USEC_PER_SEC < ts;
+
+        FOREACH_DIRENT(de, dir, return -errno) {
+                if (!GREEDY_REALLOC(d->entries, d->n_allocated, d->n_entries + 2))
+                        return -ENOMEM;
+
+                d->entries[d->n_entries] = strdup(de->d_name);
+                if (!d->entries[d->n_entries])
+                        return -ENOMEM;
+
+                d->entries[++d->n_entries] = NULL;
+        }
+
+        /* Keep the listing sorted, so that manager_unit_path_dir_changed() can look up names quickly */
+        strv_sort(d->entries);
+
+        r = hashmap_ensure_allocated(&m->unit_path_dir_cache, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        unit_path_dir_free(hashmap_remove(m->unit_path_dir_cache, path));
+
+        r = hashmap_put(m->unit_path_dir_cache, d->path, d);
+        if (r < 0)
+                return r;
+
+        *ret = d;
+        d = NULL;
+
+        return 0;
+}
+
+/* Drop-in directories are listed once per load pass, i.e. for startup and each reload, and not trusted afterwards:
+ * there's no telling what changed on disk in between. */
+static void manager_begin_dropin_dir_cache(Manager *m) {
+        assert(m);
+
+        dropin_dir_cache_free(m->unit_dropin_dir_cache);
+
+        /* Without a cache, each unit just lists the directories itself */
+        m->unit_dropin_dir_cache = dropin_dir_cache_new();
+}
+
+static void manager_end_dropin_dir_cache(Manager *m) {
+        assert(m);
+
+        m->unit_dropin_dir_cache = dropin_dir_cache_free(m->unit_dropin_dir_cache);
+}
+
 static void manager_build_unit_path_cache(Manager *m) {
+        unsigned n_cached = 0;
         char **i;
         int r;
 
@@ -1335,20 +1583,25 @@ static void manager_build_unit_path_cache(Manager *m) {
          * we don't always have to go to disk */
 
         STRV_FOREACH(i, m->lookup_paths.search_path) {
-                _cleanup_closedir_ DIR *d = NULL;
-                struct dirent *de;
+                UnitPathDir *d;
+                char **j;
 
-                d = opendir(*i);
-                if (!d) {
-                        if (errno != ENOENT)
-                                log_warning_errno(errno, "Failed to open directory %s, ignoring: %m", *i);
+                r = manager_get_unit_path_dir(m, *i, &d);
+                if (r == -ENOENT)
+                        continue;
+                if (r == -ENOMEM)
+                        goto fail;
+                if (r < 0) {
+                        log_warning_errno(r, "Failed to open directory %s, ignoring: %m", *i);
                         continue;
                 }
+                if (r > 0)
+                        n_cached++;
 
-                FOREACH_DIRENT(de, d, r = -errno; goto fail) {
+                STRV_FOREACH(j, d->entries) {
                         char *p;
 
-                        p = strjoin(streq(*i, "/") ? "" : *i, "/", de->d_name);
+                        p = strjoin(streq(*i, "/") ? "" : *i, "/", *j);
                         if (!p) {
                                 r = -ENOMEM;
                                 goto fail;
@@ -1360,6 +1613,9 @@ static void manager_build_unit_path_cache(Manager *m) {
                 }
         }
 
+        log_debug("Built unit path cache, %u of %u directories unchanged since last time.",
+                  n_cached, strv_length(m->lookup_paths.search_path));
+
         return;
 
 fail:
@@ -1398,6 +1654,9 @@ int manager_startup(Manager *m, FILE *serialization, FDSet *fds) {
         if (r < 0)
                 return r;
 
+        /* Let the I/O heavy parts of enumeration run while the generators do */
+        manager_enumerate_prepare(m);
+
         r = manager_run_environment_generators(m);
         if (r < 0)
                 return r;
@@ -1423,6 +1682,7 @@ int manager_startup(Manager *m, FILE *serialization, FDSet *fds) {
 
         lookup_paths_reduce(&m->lookup_paths);
         manager_build_unit_path_cache(m);
+        manager_begin_dropin_dir_cache(m);
 
         /* If we will deserialize make sure that during enumeration
          * this is already known, so we increase the counter here
@@ -1437,11 +1697,21 @@ int manager_startup(Manager *m, FILE *serialization, FDSet *fds) {
 
         /* Second, deserialize if there is something to deserialize */
         if (serialization) {
+                char buf[FORMAT_TIMESPAN_MAX];
+                usec_t ts;
+
+                ts = now(CLOCK_MONOTONIC);
+
                 r = manager_deserialize(m, serialization, fds);
                 if (r < 0)
                         return log_error_errno(r, "Deserialization failed: %m");
+
+                log_debug("Deserialized state in %s.",
+                          format_timespan(buf, sizeof(buf), now(CLOCK_MONOTONIC) - ts, USEC_PER_MSEC));
         }
 
+        manager_end_dropin_dir_cache(m);
+
         /* Any fds left? Find some unit which wants them. This is
          * useful to allow container managers to pass some file
          * descriptors to us pre-initialized. This enables
@@ -1465,6 +1735,9 @@ int manager_startup(Manager *m, FILE *serialization, FDSet *fds) {
                 /* This shouldn't fail, except if things are really broken. */
                 return r;
 
+        /* Not fatal, resource usage queries will just read from the cgroup file system directly */
+        (void) manager_setup_accounting_sampler(m);
+
         /* Let's connect to the bus now. */
         (void) manager_connect_bus(m, !!serialization);
 
@@ -1472,7 +1745,9 @@ int manager_startup(Manager *m, FILE *serialization, FDSet *fds) {
         m->deserialized_subscribed = strv_free(m->deserialized_subscribed);
 
         /* Third, fire things up! */
+        dual_timestamp_get(m->timestamps + MANAGER_TIMESTAMP_COLDPLUG_START);
         manager_coldplug(m);
+        dual_timestamp_get(m->timestamps + MANAGER_TIMESTAMP_COLDPLUG_FINISH);
 
         /* Release any dynamic users no longer referenced */
         dynamic_user_vacuum(m, true);
@@ -1960,10 +2235,9 @@ static void manager_invoke_notify_message(
         }
 }
 
-static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+static int manager_receive_notify_message(Manager *m) {
 
         _cleanup_fdset_free_ FDSet *fds = NULL;
-        Manager *m = userdata;
         char buf[NOTIFY_BUFFER_MAX+1];
         struct iovec iovec = {
                 .iov_base = buf,
@@ -1991,17 +2265,13 @@ static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t
         ssize_t n;
 
         assert(m);
-        assert(m->notify_fd == fd);
 
-        if (revents != EPOLLIN) {
-                log_warning("Got unexpected poll event for notify fd.");
-                return 0;
-        }
+        /* Returns > 0 if a message was taken off the socket (whether it was valid or not), 0 if there was none. */
 
         n = recvmsg(m->notify_fd, &msghdr, MSG_DONTWAIT|MSG_CMSG_CLOEXEC|MSG_TRUNC);
         if (n < 0) {
                 if (IN_SET(errno, EAGAIN, EINTR))
-                        return 0; /* Spurious wakeup, try again */
+                        return 0; /* Spurious wakeup or queue drained, try again */
 
                 /* If this is any other, real error, then let's stop processing this socket. This of course means we
                  * won't take notification messages anymore, but that's still better than busy looping around this:
@@ -2030,25 +2300,25 @@ static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t
                 if (r < 0) {
                         close_many(fd_array, n_fds);
                         log_oom();
-                        return 0;
+                        return 1;
                 }
         }
 
         if (!ucred || !pid_is_valid(ucred->pid)) {
                 log_warning("Received notify message without valid credentials. Ignoring.");
-                return 0;
+                return 1;
         }
 
         if ((size_t) n >= sizeof(buf) || (msghdr.msg_flags & MSG_TRUNC)) {
                 log_warning("Received notify message exceeded maximum size. Ignoring.");
-                return 0;
+                return 1;
         }
 
         /* As extra safety check, let's make sure the string we get doesn't contain embedded NUL bytes. We permit one
          * trailing NUL byte in the message, but don't expect it. */
         if (n > 1 && memchr(buf, 0, n-1)) {
                 log_warning("Received notify message with embedded NUL bytes. Ignoring.");
-                return 0;
+                return 1;
         }
 
         /* Make sure it's NUL-terminated. */
@@ -2093,6 +2363,30 @@ static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t
         if (fdset_size(fds) > 0)
                 log_warning("Got extra auxiliary fds with notification message, closing them.");
 
+        return 1;
+}
+
+static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+        Manager *m = userdata;
+        unsigned i;
+        int r;
+
+        assert(m);
+        assert(m->notify_fd == fd);
+
+        if (revents != EPOLLIN) {
+                log_warning("Got unexpected poll event for notify fd.");
+                return 0;
+        }
+
+        /* Process a number of queued messages per wakeup, instead of going through the event loop for each of
+         * them. The number is bounded, so that a flood of notifications can't starve other event sources. */
+        for (i = 0; i < NOTIFY_BATCH_MAX; i++) {
+                r = manager_receive_notify_message(m);
+                if (r <= 0)
+                        return r;
+        }
+
         return 0;
 }
 
@@ -2117,6 +2411,48 @@ static void manager_invoke_sigchld_event(
                 UNIT_VTABLE(u)->sigchld_event(u, si->si_pid, si->si_code, si->si_status);
 }
 
+static void manager_invoke_sigchld_events(
+                Manager *m,
+                Unit *u1,
+                const siginfo_t *si) {
+
+        _cleanup_free_ Unit **array_copy = NULL;
+        Unit *u2, **array;
+
+        assert(m);
+        assert(si);
+
+        /* Increase the generation counter used for filtering out duplicate unit invocations */
+        m->sigchldgen++;
+
+        /* And now figure out the unit this belongs to, it might be multiple... */
+        u2 = hashmap_get(m->watch_pids, PID_TO_PTR(si->si_pid));
+        array = hashmap_get(m->watch_pids, PID_TO_PTR(-si->si_pid));
+        if (array) {
+                size_t n = 0;
+
+                /* Cound how many entries the array has */
+                while (array[n])
+                        n++;
+
+                /* Make a copy of the array so that we don't trip up on the array changing beneath us */
+                array_copy = newdup(Unit*, array, n+1);
+                if (!array_copy)
+                        log_oom();
+        }
+
+        /* Finally, execute them all. Note that u1, u2 and the array might contain duplicates, but
+         * that's fine, manager_invoke_sigchld_event() will ensure we only invoke the handlers once for
+         * each iteration. */
+        if (u1)
+                manager_invoke_sigchld_event(m, u1, si);
+        if (u2)
+                manager_invoke_sigchld_event(m, u2, si);
+        if (array_copy)
+                for (size_t i = 0; array_copy[i]; i++)
+                        manager_invoke_sigchld_event(m, array_copy[i], si);
+}
+
 static int manager_dispatch_sigchld(sd_event_source *source, void *userdata) {
         Manager *m = userdata;
         siginfo_t si = {};
@@ -2140,11 +2476,11 @@ static int manager_dispatch_sigchld(sd_event_source *source, void *userdata) {
                 goto turn_off;
 
         if (IN_SET(si.si_code, CLD_EXITED, CLD_KILLED, CLD_DUMPED)) {
-                _cleanup_free_ Unit **array_copy = NULL;
                 _cleanup_free_ char *name = NULL;
-                Unit *u1, *u2, **array;
 
-                (void) get_process_comm(si.si_pid, &name);
+                /* The name is only used for the log message below, don't bother reading it otherwise */
+                if (log_get_max_level() >= LOG_DEBUG)
+                        (void) get_process_comm(si.si_pid, &name);
 
                 log_debug("Child "PID_FMT" (%s) died (code=%s, status=%i/%s)",
                           si.si_pid, strna(name),
@@ -2154,36 +2490,7 @@ static int manager_dispatch_sigchld(sd_event_source *source, void *userdata) {
                                 ? exit_status_to_string(si.si_status, EXIT_STATUS_FULL)
                                 : signal_to_string(si.si_status)));
 
-                /* Increase the generation counter used for filtering out duplicate unit invocations */
-                m->sigchldgen++;
-
-                /* And now figure out the unit this belongs to, it might be multiple... */
-                u1 = manager_get_unit_by_pid_cgroup(m, si.si_pid);
-                u2 = hashmap_get(m->watch_pids, PID_TO_PTR(si.si_pid));
-                array = hashmap_get(m->watch_pids, PID_TO_PTR(-si.si_pid));
-                if (array) {
-                        size_t n = 0;
-
-                        /* Cound how many entries the array has */
-                        while (array[n])
-                                n++;
-
-                        /* Make a copy of the array so that we don't trip up on the array changing beneath us */
-                        array_copy = newdup(Unit*, array, n+1);
-                        if (!array_copy)
-                                log_oom();
-                }
-
-                /* Finally, execute them all. Note that u1, u2 and the array might contain duplicates, but
-                 * that's fine, manager_invoke_sigchld_event() will ensure we only invoke the handlers once for
-                 * each iteration. */
-                if (u1)
-                        manager_invoke_sigchld_event(m, u1, &si);
-                if (u2)
-                        manager_invoke_sigchld_event(m, u2, &si);
-                if (array_copy)
-                        for (size_t i = 0; array_copy[i]; i++)
-                                manager_invoke_sigchld_event(m, array_copy[i], &si);
+                manager_invoke_sigchld_events(m, manager_get_unit_by_pid_cgroup(m, si.si_pid), &si);
         }
 
         /* And now, we actually reap the zombie. */
@@ -2204,63 +2511,260 @@ turn_off:
         return 0;
 }
 
-static void manager_start_target(Manager *m, const char *name, JobMode mode) {
-        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+static void manager_invoke_pid_gone_events(Manager *m, pid_t pid) {
+        _cleanup_free_ Unit **units = NULL;
+        Unit *u, **array;
+        size_t n = 0, k;
+
+        assert(m);
+
+        /* Figure out the units watching the PID first, as unwatching it changes the arrays beneath us */
+        u = hashmap_get(m->watch_pids, PID_TO_PTR(pid));
+        array = hashmap_get(m->watch_pids, PID_TO_PTR(-pid));
+
+        while (array && array[n])
+                n++;
+
+        units = new(Unit*, n + 2);
+        if (!units) {
+                log_oom();
+                return;
+        }
+
+        if (array)
+                memcpy(units, array, sizeof(Unit*) * n);
+        if (u)
+                units[n++] = u;
+        units[n] = NULL;
+
+        m->sigchldgen++;
+
+        for (k = 0; k < n; k++) {
+                u = units[k];
+
+                if (u->sigchldgen == m->sigchldgen)
+                        continue;
+                u->sigchldgen = m->sigchldgen;
+
+                log_unit_debug(u, "Process "PID_FMT" of %s exited, status unknown.", pid, u->id);
+                unit_unwatch_pid(u, pid);
+
+                if (UNIT_VTABLE(u)->pid_gone_event)
+                        UNIT_VTABLE(u)->pid_gone_event(u, pid);
+                else {
+                        (void) unit_rewatch_pids(u, 0, 0);
+                        (void) unit_synthesize_cgroup_empty_event(u);
+                }
+        }
+}
+
+static int manager_dispatch_pidfd(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+        PidfdWatch *w = userdata;
+        Manager *m;
+        siginfo_t si = {};
+        pid_t pid;
+
+        assert(w);
+
+        m = w->manager;
+        pid = w->pid;
+
+        /* The pidfd is readable, hence the process is gone. We don't need to watch it anymore either way. */
+        manager_unwatch_pidfd(m, pid);
+
+        /* If the process got reparented to us in the meantime, its zombie will be handled by the SIGCHLD logic,
+         * which can report the actual exit status. */
+        if (waitid(P_PID, pid, &si, WEXITED|WNOHANG|WNOWAIT) >= 0)
+                return 0;
+        if (errno != ECHILD)
+                return log_error_errno(errno, "Failed to check whether "PID_FMT" is our child, ignoring: %m", pid);
+
+        /* The process was reaped by somebody else, and we have no way to learn how it exited. */
+        manager_invoke_pid_gone_events(m, pid);
+        return 0;
+}
+
+static int manager_watch_pid_unreliable(Manager *m, pid_t pid) {
         int r;
 
-        log_debug("Activating special unit %s", name);
+        assert(m);
 
-        r = manager_add_job_by_name(m, JOB_START, name, mode, &error, NULL);
+        r = set_ensure_allocated(&m->watch_pids_unreliable, NULL);
         if (r < 0)
-                log_error("Failed to enqueue %s job: %s", name, bus_error_message(&error, r));
-}
+                return r;
 
-static void manager_handle_ctrl_alt_del(Manager *m) {
-        /* If the user presses C-A-D more than
-         * 7 times within 2s, we reboot/shutdown immediately,
-         * unless it was disabled in system.conf */
+        r = set_put(m->watch_pids_unreliable, PID_TO_PTR(pid));
+        if (r < 0)
+                return r;
 
-        if (ratelimit_test(&m->ctrl_alt_del_ratelimit) || m->cad_burst_action == EMERGENCY_ACTION_NONE)
-                manager_start_target(m, SPECIAL_CTRL_ALT_DEL_TARGET, JOB_REPLACE_IRREVERSIBLY);
-        else
-                emergency_action(m, m->cad_burst_action, NULL,
-                                "Ctrl-Alt-Del was pressed more than 7 times within 2s");
+        return 0;
 }
 
-static int manager_dispatch_signal_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
-        Manager *m = userdata;
-        ssize_t n;
-        struct signalfd_siginfo sfsi;
+int manager_watch_pidfd(Manager *m, pid_t pid) {
+        static bool pidfd_unsupported = false;
+        _cleanup_close_ int fd = -1;
+        siginfo_t si = {};
+        PidfdWatch *w;
         int r;
 
         assert(m);
-        assert(m->signal_fd == fd);
+        assert(pid_is_valid(pid));
 
-        if (revents != EPOLLIN) {
-                log_warning("Got unexpected events from signal file descriptor.");
+        /* Makes sure we learn about the exit of pid, if it is not our child. Returns 1 if a pidfd is watched for
+         * it now, 0 if it is our child, in which case SIGCHLD tells us about its exit, with its status, or if it
+         * was watched already. If neither is possible, the PID is recorded in watch_pids_unreliable, for
+         * unit_tidy_watch_pids() to poll it, and an error is returned. */
+
+        if (hashmap_contains(m->watch_pidfds, PID_TO_PTR(pid)) ||
+            set_contains(m->watch_pids_unreliable, PID_TO_PTR(pid)))
+                return 0;
+
+        if (waitid(P_PID, pid, &si, WEXITED|WNOHANG|WNOWAIT) >= 0)
                 return 0;
+        if (errno != ECHILD)
+                return -errno;
+
+        /* Each pidfd costs us a file descriptor and an epoll registration, hence let's not go overboard */
+        if (pidfd_unsupported || hashmap_size(m->watch_pidfds) >= PIDFD_WATCH_MAX) {
+                r = manager_watch_pid_unreliable(m, pid);
+                return r < 0 ? r : -EOPNOTSUPP;
         }
 
-        n = read(m->signal_fd, &sfsi, sizeof(sfsi));
-        if (n != sizeof(sfsi)) {
-                if (n >= 0) {
-                        log_warning("Truncated read from signal fd (%zu bytes), ignoring!", n);
-                        return 0;
+        fd = pidfd_open(pid, 0);
+        if (fd < 0) {
+                r = -errno;
+
+                if (r == -ENOSYS) {
+                        log_debug("Kernel does not support pidfds, not watching foreign processes for exit.");
+                        pidfd_unsupported = true;
                 }
 
-                if (IN_SET(errno, EINTR, EAGAIN))
-                        return 0;
+                if (manager_watch_pid_unreliable(m, pid) < 0)
+                        return -ENOMEM;
 
-                /* We return an error here, which will kill this handler,
-                 * to avoid a busy loop on read error. */
-                return log_error_errno(errno, "Reading from signal fd failed: %m");
+                return r;
         }
 
-        log_received_signal(sfsi.ssi_signo == SIGCHLD ||
-                            (sfsi.ssi_signo == SIGTERM && MANAGER_IS_USER(m))
-                            ? LOG_DEBUG : LOG_INFO,
-                            &sfsi);
-
+        r = hashmap_ensure_allocated(&m->watch_pidfds, NULL);
+        if (r < 0)
+                return r;
+
+        w = new0(PidfdWatch, 1);
+        if (!w)
+                return -ENOMEM;
+
+        w->manager = m;
+        w->pid = pid;
+
+        r = sd_event_add_io(m->event, &w->event_source, fd, EPOLLIN, manager_dispatch_pidfd, w);
+        if (r < 0)
+                goto fail;
+
+        r = sd_event_source_set_io_fd_own(w->event_source, true);
+        if (r < 0)
+                goto fail;
+        fd = -1;
+
+        /* Process exits of foreign processes with the same priority as those of our children */
+        r = sd_event_source_set_priority(w->event_source, SD_EVENT_PRIORITY_NORMAL-7);
+        if (r < 0)
+                goto fail;
+
+        (void) sd_event_source_set_description(w->event_source, "manager-pidfd");
+
+        r = hashmap_put(m->watch_pidfds, PID_TO_PTR(pid), w);
+        if (r < 0)
+                goto fail;
+
+        return 1;
+
+fail:
+        pidfd_watch_free(w);
+        return r;
+}
+
+void manager_unwatch_pidfd(Manager *m, pid_t pid) {
+        assert(m);
+
+        pidfd_watch_free(hashmap_remove(m->watch_pidfds, PID_TO_PTR(pid)));
+        (void) set_remove(m->watch_pids_unreliable, PID_TO_PTR(pid));
+}
+
+bool manager_watch_pids_reliable(Manager *m, Set *pids) {
+        Iterator i;
+        void *e;
+
+        assert(m);
+
+        /* Returns true if we learn about the exit of each of the PIDs right away, be it via SIGCHLD or a pidfd */
+
+        if (set_isempty(m->watch_pids_unreliable))
+                return true;
+
+        SET_FOREACH(e, pids, i)
+                if (set_contains(m->watch_pids_unreliable, e))
+                        return false;
+
+        return true;
+}
+
+static void manager_start_target(Manager *m, const char *name, JobMode mode) {
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        int r;
+
+        log_debug("Activating special unit %s", name);
+
+        r = manager_add_job_by_name(m, JOB_START, name, mode, &error, NULL);
+        if (r < 0)
+                log_error("Failed to enqueue %s job: %s", name, bus_error_message(&error, r));
+}
+
+static void manager_handle_ctrl_alt_del(Manager *m) {
+        /* If the user presses C-A-D more than
+         * 7 times within 2s, we reboot/shutdown immediately,
+         * unless it was disabled in system.conf */
+
+        if (ratelimit_test(&m->ctrl_alt_del_ratelimit) || m->cad_burst_action == EMERGENCY_ACTION_NONE)
+                manager_start_target(m, SPECIAL_CTRL_ALT_DEL_TARGET, JOB_REPLACE_IRREVERSIBLY);
+        else
+                emergency_action(m, m->cad_burst_action, NULL,
+                                "Ctrl-Alt-Del was pressed more than 7 times within 2s");
+}
+
+static int manager_dispatch_signal_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+        Manager *m = userdata;
+        ssize_t n;
+        struct signalfd_siginfo sfsi;
+        int r;
+
+        assert(m);
+        assert(m->signal_fd == fd);
+
+        if (revents != EPOLLIN) {
+                log_warning("Got unexpected events from signal file descriptor.");
+                return 0;
+        }
+
+        n = read(m->signal_fd, &sfsi, sizeof(sfsi));
+        if (n != sizeof(sfsi)) {
+                if (n >= 0) {
+                        log_warning("Truncated read from signal fd (%zu bytes), ignoring!", n);
+                        return 0;
+                }
+
+                if (IN_SET(errno, EINTR, EAGAIN))
+                        return 0;
+
+                /* We return an error here, which will kill this handler,
+                 * to avoid a busy loop on read error. */
+                return log_error_errno(errno, "Reading from signal fd failed: %m");
+        }
+
+        log_received_signal(sfsi.ssi_signo == SIGCHLD ||
+                            (sfsi.ssi_signo == SIGTERM && MANAGER_IS_USER(m))
+                            ? LOG_DEBUG : LOG_INFO,
+                            &sfsi);
+
         switch (sfsi.ssi_signo) {
 
         case SIGCHLD:
@@ -2551,9 +3055,15 @@ int manager_loop(Manager *m) {
                 } else
                         wait_usec = USEC_INFINITY;
 
+                /* Unit GC ran out of its budget, dispatch what's pending but don't sleep */
+                if (m->gc_unit_queue_yield)
+                        wait_usec = 0;
+
                 r = sd_event_run(m->event, wait_usec);
                 if (r < 0)
                         return log_error_errno(r, "Failed to run event loop: %m");
+
+                m->gc_unit_queue_yield = false;
         }
 
         return m->exit_code;
@@ -2748,6 +3258,7 @@ int manager_serialize(Manager *m, FILE *f, FDSet *fds, bool switching_root) {
         fprintf(f, "current-job-id=%"PRIu32"\n", m->current_job_id);
         fprintf(f, "n-installed-jobs=%u\n", m->n_installed_jobs);
         fprintf(f, "n-failed-jobs=%u\n", m->n_failed_jobs);
+        fprintf(f, "unit-change-generation=%" PRIu64 "\n", m->unit_change_generation);
         fprintf(f, "taint-usr=%s\n", yes_no(m->taint_usr));
         fprintf(f, "ready-sent=%s\n", yes_no(m->ready_sent));
         fprintf(f, "taint-logged=%s\n", yes_no(m->taint_logged));
@@ -2896,6 +3407,27 @@ int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
                         else
                                 m->n_failed_jobs += n;
 
+                } else if ((val = startswith(l, "unit-change-generation="))) {
+                        uint64_t g;
+
+                        if (safe_atou64(val, &g) < 0)
+                                log_notice("Failed to parse unit change generation %s", val);
+                        else {
+                                Iterator i;
+                                Unit *u;
+                                char *k;
+
+                                /* Clients may hold change tokens from before, hence never go back. The
+                                 * per-unit generations are not carried over, as unit files may have changed
+                                 * in the meantime: all units loaded so far count as changed, as will all
+                                 * units loaded from here on. */
+                                m->unit_change_generation = MAX(m->unit_change_generation, g);
+
+                                HASHMAP_FOREACH_KEY(u, k, m->units, i)
+                                        if (u->id == k)
+                                                u->change_generation = ++m->unit_change_generation;
+                        }
+
                 } else if ((val = startswith(l, "taint-usr="))) {
                         int b;
 
@@ -3060,13 +3592,480 @@ finish:
         return r;
 }
 
+static int unit_path_entry_compare(const void *a, const void *b) {
+        return strcmp(*(const char* const*) a, *(const char* const*) b);
+}
+
+static bool manager_unit_path_dir_changed(Manager *m, const char *path) {
+        _cleanup_closedir_ DIR *dir = NULL;
+        struct dirent *de;
+        UnitPathDir *d;
+        struct stat st;
+        size_t n = 0;
+
+        assert(m);
+        assert(path);
+
+        /* Checks whether files were added to or removed from a unit search path directory since we last listed
+         * it. A modification time that moved is not sufficient for that, as editors and package managers replace
+         * files by renaming a new version over them, which touches the directory but leaves the listing as it
+         * was. */
+
+        d = hashmap_get(m->unit_path_dir_cache, path);
+
+        if (stat(path, &st) < 0)
+                return errno != ENOENT || d;
+
+        if (!d || d->dev != st.st_dev || d->ino != st.st_ino)
+                return true;
+
+        if (d->cacheable && d->mtime == timespec_load(&st.st_mtim))
+                return false;
+
+        dir = opendir(path);
+        if (!dir)
+                return true;
+
+        FOREACH_DIRENT(de, dir, return true) {
+                const char *name = de->d_name;
+
+                if (n >= d->n_entries ||
+                    !bsearch(&name, d->entries, d->n_entries, sizeof(char*), unit_path_entry_compare))
+                        return true;
+
+                n++;
+        }
+
+        return n != d->n_entries;
+}
+
+static bool manager_unit_path_is_internal(Manager *m, const char *path) {
+        assert(m);
+        assert(path);
+
+        /* The directories only generators and we ourselves write to */
+        return path_equal_ptr(path, m->lookup_paths.generator) ||
+                path_equal_ptr(path, m->lookup_paths.generator_early) ||
+                path_equal_ptr(path, m->lookup_paths.generator_late) ||
+                path_equal_ptr(path, m->lookup_paths.transient) ||
+                path_equal_ptr(path, m->lookup_paths.persistent_control) ||
+                path_equal_ptr(path, m->lookup_paths.runtime_control);
+}
+
+static bool unit_can_reload_individually(Unit *u) {
+        Iterator i;
+        Unit *other;
+        void *v;
+
+        assert(u);
+
+        /* Device, mount and swap units are (also) set up from what the kernel tells us, and scope units only
+         * exist transiently, hence reloading them from their files alone would lose state. Pending jobs and
+         * aliases are not dealt with by manager_reload_units(), and neither are units sharing their
+         * namespaces and runtime with others. */
+
+        if (u->transient || u->perpetual)
+                return false;
+
+        if (IN_SET(u->type, UNIT_DEVICE, UNIT_MOUNT, UNIT_SWAP, UNIT_SCOPE))
+                return false;
+
+        if (u->job || u->nop_job)
+                return false;
+
+        if (set_size(u->names) != 1)
+                return false;
+
+        if (!unit_dependency_set_isempty(u->dependencies[UNIT_JOINS_NAMESPACE_OF]))
+                return false;
+
+        UNIT_DEPENDENCY_SET_FOREACH(v, other, u->dependencies[UNIT_REFERENCED_BY], i)
+                if (unit_dependency_set_contains(other->dependencies[UNIT_JOINS_NAMESPACE_OF], u))
+                        return false;
+
+        return true;
+}
+
+int manager_find_changed_units(Manager *m, Set **ret) {
+        _cleanup_set_free_ Set *units = NULL;
+        const char *k;
+        char **i;
+        Iterator j;
+        Unit *u;
+        int r;
+
+        assert(m);
+        assert(ret);
+
+        /* Checks whether a daemon-reload would pick up anything new. Returns 0 if not. Otherwise returns > 0 and
+         * sets *ret to the set of units whose fragments, source files or drop-ins changed on disk, if all of them
+         * may be reloaded on their own with manager_reload_units(), or to NULL if files were added to or removed
+         * from the unit search path, or some changed unit can't be reloaded on its own, and hence a full reload
+         * is needed. Generators are not rerun for this, so changes to their inputs are not detected, and neither
+         * their output directories nor the other directories only we write to are checked: these change with
+         * every reload and every transient unit, respectively. */
+
+        STRV_FOREACH(i, m->lookup_paths.search_path) {
+                if (manager_unit_path_is_internal(m, *i))
+                        continue;
+
+                if (manager_unit_path_dir_changed(m, *i)) {
+                        log_debug("Unit directory %s changed.", *i);
+                        *ret = NULL;
+                        return 1;
+                }
+        }
+
+        HASHMAP_FOREACH_KEY(u, k, m->units, j) {
+                if (k != u->id) /* skip aliases */
+                        continue;
+
+                if (!unit_need_daemon_reload(u))
+                        continue;
+
+                if (!unit_can_reload_individually(u)) {
+                        log_debug("Unit %s changed on disk and cannot be reloaded on its own.", u->id);
+                        *ret = NULL;
+                        return 1;
+                }
+
+                log_debug("Unit %s changed on disk.", u->id);
+
+                r = set_ensure_allocated(&units, NULL);
+                if (r < 0)
+                        return r;
+
+                r = set_put(units, u);
+                if (r < 0)
+                        return r;
+        }
+
+        if (set_isempty(units)) {
+                *ret = NULL;
+                return 0;
+        }
+
+        *ret = units;
+        units = NULL;
+
+        return 1;
+}
+
+/* A dependency some other unit has on a unit we reload, or a reference it holds to it */
+typedef struct ReloadDependency {
+        Unit *other;
+        UnitDependency dependency;
+        UnitDependencyMask mask;
+        const char *id;
+} ReloadDependency;
+
+typedef struct ReloadRef {
+        UnitRef *ref;
+        Unit *source;
+        const char *id;
+} ReloadRef;
+
+typedef struct ReloadInbound {
+        ReloadDependency *dependencies;
+        size_t n_dependencies, n_dependencies_allocated;
+        ReloadRef *refs;
+        size_t n_refs, n_refs_allocated;
+        Set *neighbours;
+} ReloadInbound;
+
+static void reload_inbound_done(ReloadInbound *in) {
+        assert(in);
+
+        in->dependencies = mfree(in->dependencies);
+        in->refs = mfree(in->refs);
+        in->neighbours = set_free(in->neighbours);
+}
+
+static int reload_inbound_collect(ReloadInbound *in, Set *units, Unit *u, const char *id) {
+        _cleanup_set_free_ Set *seen = NULL;
+        UnitDependency d;
+        UnitRef *ref;
+        int r;
+
+        assert(in);
+        assert(u);
+        assert(id);
+
+        /* Records what the units not reloaded have configured towards u, i.e. what freeing u would drop and
+         * loading it again would not restore. All dependencies are recorded on both ends, except for those
+         * without inverse, whose origin holds a reference to u instead, hence it is sufficient to look at the
+         * units u knows about. Of these, only the dependencies the other units' own loading created are
+         * recorded, as told by their origin masks: what u's configuration asked for only has u as origin,
+         * and is set up again, or not, when u is loaded. The one exception are the ordering dependencies
+         * unit_add_default_target_dependency() puts on the targets pulling in u, which both sides' loading
+         * may create, hence these are left out here, and derived again once everything else is restored. */
+
+        seen = set_new(NULL);
+        if (!seen)
+                return -ENOMEM;
+
+        r = set_ensure_allocated(&in->neighbours, NULL);
+        if (r < 0)
+                return r;
+
+        for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++) {
+                Unit *other;
+                Iterator i;
+                void *v;
+
+                UNIT_DEPENDENCY_SET_FOREACH(v, other, u->dependencies[d], i) {
+                        UnitDependency e;
+
+                        if (other == u || set_contains(units, other))
+                                continue;
+
+                        r = set_put(seen, other);
+                        if (r < 0)
+                                return r;
+                        if (r == 0)
+                                continue;
+
+                        r = set_put(in->neighbours, other);
+                        if (r < 0)
+                                return r;
+
+                        for (e = 0; e < _UNIT_DEPENDENCY_MAX; e++) {
+                                UnitDependencyMask mask;
+                                UnitDependencyInfo di;
+
+                                di.data = unit_dependency_set_get(other->dependencies[e], u);
+                                mask = di.origin_mask;
+
+                                if (e == UNIT_AFTER && other->type == UNIT_TARGET)
+                                        mask &= ~UNIT_DEPENDENCY_DEFAULT;
+
+                                if (mask == 0)
+                                        continue;
+
+                                if (!GREEDY_REALLOC(in->dependencies, in->n_dependencies_allocated, in->n_dependencies + 1))
+                                        return -ENOMEM;
+
+                                in->dependencies[in->n_dependencies++] = (ReloadDependency) {
+                                        .other = other,
+                                        .dependency = e,
+                                        .mask = mask,
+                                        .id = id,
+                                };
+                        }
+                }
+        }
+
+        LIST_FOREACH(refs_by_target, ref, u->refs_by_target) {
+                if (ref->source == u || set_contains(units, ref->source))
+                        continue;
+
+                if (!GREEDY_REALLOC(in->refs, in->n_refs_allocated, in->n_refs + 1))
+                        return -ENOMEM;
+
+                in->refs[in->n_refs++] = (ReloadRef) {
+                        .ref = ref,
+                        .source = ref->source,
+                        .id = id,
+                };
+        }
+
+        return 0;
+}
+
+static int reload_add_default_target_dependencies(Unit *u) {
+
+        /* The inverses of what target_add_default_dependencies() and unit_add_target_dependencies() look at */
+        static const UnitDependency deps[] = {
+                UNIT_REQUIRED_BY,
+                UNIT_REQUISITE_OF,
+                UNIT_WANTED_BY,
+                UNIT_BOUND_BY,
+                UNIT_CONSISTS_OF,
+        };
+
+        unsigned k;
+        int r;
+
+        assert(u);
+
+        for (k = 0; k < ELEMENTSOF(deps); k++) {
+                Unit *target;
+                Iterator i;
+                void *v;
+
+                UNIT_DEPENDENCY_SET_FOREACH(v, target, u->dependencies[deps[k]], i) {
+                        r = unit_add_default_target_dependency(u, target);
+                        if (r < 0)
+                                return r;
+                }
+        }
+
+        return 0;
+}
+
+int manager_reload_units(Manager *m, Set *units) {
+        _cleanup_(reload_inbound_done) ReloadInbound in = {};
+        _cleanup_strv_free_ char **ids = NULL;
+        _cleanup_fdset_free_ FDSet *fds = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        size_t n = 0, k;
+        char **id;
+        Iterator i;
+        Unit *u;
+        int r;
+
+        assert(m);
+
+        /* Reloads the specified units from disk, and leaves all others alone. This follows manager_reload(): the
+         * units are serialized, freed, loaded again and then deserialized, except that whatever the other units
+         * have configured towards them, dependencies and references, is recorded first and put back in place
+         * after loading. Dependencies the units' old configuration asked for are dropped with them, and the
+         * units on the other end are queued for garbage collection and bus notification, just like after a
+         * full reload. The units in the set are freed. */
+
+        r = manager_open_serialization(m, &f);
+        if (r < 0)
+                return r;
+
+        fds = fdset_new();
+        if (!fds)
+                return -ENOMEM;
+
+        ids = new0(char*, set_size(units) + 1);
+        if (!ids)
+                return -ENOMEM;
+
+        m->n_reloading++;
+
+        /* No manager state, just the units */
+        fputc('\n', f);
+
+        SET_FOREACH(u, units, i) {
+                ids[n] = strdup(u->id);
+                if (!ids[n]) {
+                        r = -ENOMEM;
+                        goto fail;
+                }
+
+                r = reload_inbound_collect(&in, units, u, ids[n++]);
+                if (r < 0)
+                        goto fail;
+
+                fputs(u->id, f);
+                fputc('\n', f);
+
+                r = unit_serialize(u, f, fds, true);
+                if (r < 0)
+                        goto fail;
+        }
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                goto fail;
+
+        if (fseeko(f, 0, SEEK_SET) < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        bus_manager_send_reloading(m, true);
+
+        /* From here on there is no way back. */
+        SET_FOREACH(u, units, i)
+                unit_free(u);
+
+        manager_begin_dropin_dir_cache(m);
+
+        STRV_FOREACH(id, ids) {
+                r = manager_load_unit(m, *id, NULL, NULL, &u);
+                if (r < 0)
+                        log_warning_errno(r, "Failed to load unit %s again, ignoring: %m", *id);
+        }
+
+        for (k = 0; k < in.n_dependencies; k++) {
+                ReloadDependency *dep = in.dependencies + k;
+
+                u = manager_get_unit(m, dep->id);
+                if (!u)
+                        continue;
+
+                r = unit_add_dependency(dep->other, dep->dependency, u, false, dep->mask);
+                if (r < 0)
+                        log_unit_warning_errno(dep->other, r, "Failed to restore dependency on %s, ignoring: %m", dep->id);
+        }
+
+        for (k = 0; k < in.n_refs; k++) {
+                u = manager_get_unit(m, in.refs[k].id);
+                if (u)
+                        unit_ref_set(in.refs[k].ref, in.refs[k].source, u);
+        }
+
+        STRV_FOREACH(id, ids) {
+                u = manager_get_unit(m, *id);
+                if (!u)
+                        continue;
+
+                r = reload_add_default_target_dependencies(u);
+                if (r < 0)
+                        log_unit_warning_errno(u, r, "Failed to add default target dependencies, ignoring: %m");
+        }
+
+        SET_FOREACH(u, in.neighbours, i) {
+                unit_add_to_dbus_queue(u);
+                unit_add_to_gc_queue(u);
+        }
+
+        r = manager_deserialize(m, f, fds);
+        if (r < 0)
+                log_error_errno(r, "Deserialization failed: %m");
+
+        manager_end_dropin_dir_cache(m);
+
+        STRV_FOREACH(id, ids) {
+                u = manager_get_unit(m, *id);
+                if (!u)
+                        continue;
+
+                r = unit_coldplug(u);
+                if (r < 0)
+                        log_unit_warning_errno(u, r, "Failed to coldplug, proceeding anyway: %m");
+        }
+
+        dynamic_user_vacuum(m, true);
+        manager_vacuum_uid_refs(m);
+        manager_vacuum_gid_refs(m);
+
+        if (m->api_bus)
+                manager_sync_bus_names(m, m->api_bus);
+
+        assert(m->n_reloading > 0);
+        m->n_reloading--;
+
+        m->send_reloading_done = true;
+
+        log_debug("Reloaded %zu changed units.", n);
+
+        return 0;
+
+fail:
+        assert(m->n_reloading > 0);
+        m->n_reloading--;
+
+        return r;
+}
+
 int manager_reload(Manager *m) {
+        char ts_serialize[FORMAT_TIMESPAN_MAX], ts_generators[FORMAT_TIMESPAN_MAX], ts_load[FORMAT_TIMESPAN_MAX],
+                ts_deserialize[FORMAT_TIMESPAN_MAX], ts_coldplug[FORMAT_TIMESPAN_MAX];
+        usec_t t_start, t_serialized, t_generated, t_loaded, t_deserialized, t_finish;
         int r, q;
         _cleanup_fclose_ FILE *f = NULL;
         _cleanup_fdset_free_ FDSet *fds = NULL;
 
         assert(m);
 
+        t_start = now(CLOCK_MONOTONIC);
+
         r = manager_open_serialization(m, &f);
         if (r < 0)
                 return r;
@@ -3091,6 +4090,8 @@ int manager_reload(Manager *m) {
                 return -errno;
         }
 
+        t_serialized = now(CLOCK_MONOTONIC);
+
         /* From here on there is no way back. */
         manager_clear_jobs_and_units(m);
         lookup_paths_flush_generator(&m->lookup_paths);
@@ -3103,6 +4104,8 @@ int manager_reload(Manager *m) {
         if (q < 0 && r >= 0)
                 r = q;
 
+        manager_enumerate_prepare(m);
+
         q = manager_run_environment_generators(m);
         if (q < 0 && r >= 0)
                 r = q;
@@ -3114,10 +4117,15 @@ int manager_reload(Manager *m) {
 
         lookup_paths_reduce(&m->lookup_paths);
         manager_build_unit_path_cache(m);
+        manager_begin_dropin_dir_cache(m);
+
+        t_generated = now(CLOCK_MONOTONIC);
 
         /* First, enumerate what we can from all config files */
         manager_enumerate(m);
 
+        t_loaded = now(CLOCK_MONOTONIC);
+
         /* Second, deserialize our stored data */
         q = manager_deserialize(m, f, fds);
         if (q < 0) {
@@ -3127,6 +4135,10 @@ int manager_reload(Manager *m) {
                         r = q;
         }
 
+        manager_end_dropin_dir_cache(m);
+
+        t_deserialized = now(CLOCK_MONOTONIC);
+
         fclose(f);
         f = NULL;
 
@@ -3146,6 +4158,8 @@ int manager_reload(Manager *m) {
         /* Third, fire things up! */
         manager_coldplug(m);
 
+        t_finish = now(CLOCK_MONOTONIC);
+
         /* Release any dynamic users no longer referenced */
         dynamic_user_vacuum(m, true);
 
@@ -3165,6 +4179,13 @@ int manager_reload(Manager *m) {
 
         m->send_reloading_done = true;
 
+        log_debug("Reload phases: serialization %s, generators %s, loading %s, deserialization %s, coldplug %s.",
+                  format_timespan(ts_serialize, sizeof(ts_serialize), t_serialized - t_start, USEC_PER_MSEC),
+                  format_timespan(ts_generators, sizeof(ts_generators), t_generated - t_serialized, USEC_PER_MSEC),
+                  format_timespan(ts_load, sizeof(ts_load), t_loaded - t_generated, USEC_PER_MSEC),
+                  format_timespan(ts_deserialize, sizeof(ts_deserialize), t_deserialized - t_loaded, USEC_PER_MSEC),
+                  format_timespan(ts_coldplug, sizeof(ts_coldplug), t_finish - t_deserialized, USEC_PER_MSEC));
+
         return r;
 }
 
@@ -3426,8 +4447,147 @@ static int manager_run_environment_generators(Manager *m) {
         return execute_directories(paths, DEFAULT_TIMEOUT_USEC, gather_environment, args, NULL);
 }
 
+static void generator_times_free(GeneratorTime *t, size_t n) {
+        size_t i;
+
+        for (i = 0; i < n; i++)
+                free(t[i].path);
+
+        free(t);
+}
+
+typedef struct GeneratorRun {
+        const char *cache_root;
+        int report_fd;
+} GeneratorRun;
+
+static int generator_prepare(const char *path, char ***ret_argv, void *userdata) {
+        GeneratorRun *run = userdata;
+        int r;
+
+        /* Note that this and generator_finish() are called in the (sd-executor) process, hence we report back
+         * through a file descriptor. */
+
+        if (!run->cache_root)
+                return 1;
+
+        r = generator_cache_prepare(run->cache_root, path, ret_argv);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to look up cached output of %s, running it: %m", path);
+                return 1;
+        }
+        if (r > 0) {
+                (void) dprintf(run->report_fd, "0 1 %s\n", path);
+                return 0;
+        }
+
+        return 1;
+}
+
+static void generator_finish(const char *path, int status, usec_t duration, void *userdata) {
+        GeneratorRun *run = userdata;
+
+        if (run->cache_root)
+                (void) generator_cache_commit(run->cache_root, path, status == EXIT_SUCCESS);
+
+        (void) dprintf(run->report_fd, USEC_FMT " 0 %s\n", duration, path);
+}
+
+static int manager_read_generator_report(Manager *m, int fd, const char *cache_root) {
+        _cleanup_fclose_ FILE *f = NULL;
+        GeneratorTime *times = NULL;
+        size_t n_times = 0, n_allocated = 0;
+        int r;
+
+        assert(m);
+        assert(fd >= 0);
+
+        if (lseek(fd, 0, SEEK_SET) < 0) {
+                r = -errno;
+                safe_close(fd);
+                return r;
+        }
+
+        f = fdopen(fd, "re");
+        if (!f) {
+                r = -errno;
+                safe_close(fd);
+                return r;
+        }
+
+        for (;;) {
+                _cleanup_free_ char *line = NULL, *duration = NULL, *cached = NULL;
+                const char *p;
+                usec_t u;
+
+                r = read_line(f, LONG_LINE_MAX, &line);
+                if (r < 0)
+                        goto fail;
+                if (r == 0)
+                        break;
+
+                p = line;
+                r = extract_many_words(&p, NULL, 0, &duration, &cached, NULL);
+                if (r < 0)
+                        goto fail;
+                if (r < 2 || isempty(p) || safe_atou64(duration, &u) < 0) {
+                        log_debug("Failed to parse generator report line, ignoring: %s", line);
+                        continue;
+                }
+
+                if (cache_root) {
+                        r = generator_cache_merge(cache_root, p,
+                                                  m->lookup_paths.generator,
+                                                  m->lookup_paths.generator_early,
+                                                  m->lookup_paths.generator_late);
+                        if (r < 0)
+                                log_warning_errno(r, "Failed to merge cached output of %s, ignoring: %m", p);
+                }
+
+                if (!GREEDY_REALLOC(times, n_allocated, n_times + 1)) {
+                        r = -ENOMEM;
+                        goto fail;
+                }
+
+                times[n_times].path = strdup(p);
+                if (!times[n_times].path) {
+                        r = -ENOMEM;
+                        goto fail;
+                }
+                times[n_times].duration = u;
+                times[n_times].cached = streq(cached, "1");
+                n_times++;
+        }
+
+        generator_times_free(m->generator_times, m->n_generator_times);
+        m->generator_times = times;
+        m->n_generator_times = n_times;
+
+        return 0;
+
+fail:
+        generator_times_free(times, n_times);
+        return r;
+}
+
+static unsigned generator_concurrency(void) {
+        long n;
+
+        /* Most generators spend their time waiting for the disk rather than the CPU, so allow some overcommit,
+         * but don't fork off an unbounded number of processes at once. */
+
+        n = sysconf(_SC_NPROCESSORS_ONLN);
+        if (n <= 0)
+                return 4;
+
+        return MAX(4U, 2U * (unsigned) MIN(n, 1024L));
+}
+
 static int manager_run_generators(Manager *m) {
         _cleanup_strv_free_ char **paths = NULL;
+        _cleanup_free_ char *cache_root = NULL;
+        _cleanup_close_ int fd = -1;
+        GeneratorRun run = {};
         const char *argv[5];
         int r;
 
@@ -3447,15 +4607,45 @@ static int manager_run_generators(Manager *m) {
         if (r < 0)
                 goto finish;
 
+        /* The cache lives in the runtime directory, hence it only survives reloads and reexecutions, but never a
+         * reboot. Don't bother with it when running in a test environment with temporary generator
+         * directories. */
+        if (!m->test_run_flags && !m->lookup_paths.temporary_dir && m->prefix[EXEC_DIRECTORY_RUNTIME]) {
+                cache_root = strappend(m->prefix[EXEC_DIRECTORY_RUNTIME], "/systemd/generator-cache");
+                if (!cache_root) {
+                        r = log_oom();
+                        goto finish;
+                }
+        }
+
+        fd = open_serialization_fd("generator-report");
+        if (fd < 0) {
+                r = log_error_errno(fd, "Failed to open generator report file: %m");
+                goto finish;
+        }
+
+        run = (GeneratorRun) {
+                .cache_root = cache_root,
+                .report_fd = fd,
+        };
+
         argv[0] = NULL; /* Leave this empty, execute_directory() will fill something in */
         argv[1] = m->lookup_paths.generator;
         argv[2] = m->lookup_paths.generator_early;
         argv[3] = m->lookup_paths.generator_late;
         argv[4] = NULL;
 
-        RUN_WITH_UMASK(0022)
-                execute_directories((const char* const*) paths, DEFAULT_TIMEOUT_USEC,
-                                    NULL, NULL, (char**) argv);
+        RUN_WITH_UMASK(0022) {
+                execute_directories_full((const char* const*) paths, DEFAULT_TIMEOUT_USEC, generator_concurrency(),
+                                         NULL, NULL, (char**) argv,
+                                         generator_prepare, generator_finish, &run);
+
+                r = manager_read_generator_report(m, fd, cache_root);
+                fd = -1;
+                if (r < 0)
+                        log_warning_errno(r, "Failed to read generator report, ignoring: %m");
+                r = 0;
+        }
 
 finish:
         lookup_paths_trim_generator(&m->lookup_paths);
@@ -4162,6 +5352,8 @@ static const char *const manager_timestamp_table[_MANAGER_TIMESTAMP_MAX] = {
         [MANAGER_TIMESTAMP_GENERATORS_FINISH] = "generators-finish",
         [MANAGER_TIMESTAMP_UNITS_LOAD_START] = "units-load-start",
         [MANAGER_TIMESTAMP_UNITS_LOAD_FINISH] = "units-load-finish",
+        [MANAGER_TIMESTAMP_COLDPLUG_START] = "coldplug-start",
+        [MANAGER_TIMESTAMP_COLDPLUG_FINISH] = "coldplug-finish",
 };
 
 DEFINE_STRING_TABLE_LOOKUP(manager_timestamp, ManagerTimestamp);
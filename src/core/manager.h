@@ -34,10 +34,14 @@
 #include "ratelimit.h"
 
 struct libmnt_monitor;
+struct DevicePrefetch;
 
 /* Enforce upper limit how many names we allow */
 #define MANAGER_MAX_NAMES 131072 /* 128K */
 
+/* Upper limit for how many foreign processes we watch via pidfds at the same time */
+#define PIDFD_WATCH_MAX 4096U
+
 typedef struct Manager Manager;
 
 typedef enum ManagerState {
@@ -85,10 +89,18 @@ typedef enum ManagerTimestamp {
         MANAGER_TIMESTAMP_GENERATORS_FINISH,
         MANAGER_TIMESTAMP_UNITS_LOAD_START,
         MANAGER_TIMESTAMP_UNITS_LOAD_FINISH,
+        MANAGER_TIMESTAMP_COLDPLUG_START,
+        MANAGER_TIMESTAMP_COLDPLUG_FINISH,
         _MANAGER_TIMESTAMP_MAX,
         _MANAGER_TIMESTAMP_INVALID = -1,
 } ManagerTimestamp;
 
+typedef struct GeneratorTime {
+        char *path;
+        usec_t duration;
+        bool cached;
+} GeneratorTime;
+
 #include "execute.h"
 #include "job.h"
 #include "path-lookup.h"
@@ -131,6 +143,10 @@ struct Manager {
         LIST_HEAD(Unit, dbus_unit_queue);
         LIST_HEAD(Job, dbus_job_queue);
 
+        /* Bumped whenever a unit or its job changes, so that clients can ask for the units changed since a
+         * previous query, see ListUnitsPaged() */
+        uint64_t unit_change_generation;
+
         /* Units to remove */
         LIST_HEAD(Unit, cleanup_queue);
 
@@ -155,6 +171,13 @@ struct Manager {
          * context, but this allows us to use the negative range for our own purposes. */
         Hashmap *watch_pids;  /* pid => unit as well as -pid => array of units */
 
+        /* Processes we watch that are not our children won't result in SIGCHLD for us. Where the kernel supports it
+         * we hence watch a pidfd for each of them, so that we learn about their exit right-away, instead of having to
+         * poll for them. Those we couldn't get a pidfd for, or would exceed PIDFD_WATCH_MAX, are kept in
+         * watch_pids_unreliable instead, and still need to be polled. */
+        Hashmap *watch_pidfds; /* pid => PidfdWatch */
+        Set *watch_pids_unreliable;
+
         /* A set contains all units which cgroup should be refreshed after startup */
         Set *startup_units;
 
@@ -186,6 +209,9 @@ struct Manager {
         UnitFileScope unit_file_scope;
         LookupPaths lookup_paths;
         Set *unit_path_cache;
+        Hashmap *unit_path_dir_cache;
+        /* Drop-in directory listings, shared by all units loaded during one startup or reload */
+        Hashmap *unit_dropin_dir_cache;
 
         char **environment;
 
@@ -194,16 +220,22 @@ struct Manager {
 
         dual_timestamp timestamps[_MANAGER_TIMESTAMP_MAX];
 
+        /* Runtime of each unit generator during the last generator run */
+        GeneratorTime *generator_times;
+        size_t n_generator_times;
+
         struct udev* udev;
 
         /* Data specific to the device subsystem */
         struct udev_monitor* udev_monitor;
         sd_event_source *udev_event_source;
         Hashmap *devices_by_sysfs;
+        struct DevicePrefetch *device_prefetch;
 
         /* Data specific to the mount subsystem */
         struct libmnt_monitor *mount_monitor;
         sd_event_source *mount_event_source;
+        struct MountInfoSnapshot *mount_info_snapshot;
 
         /* Data specific to the swap filesystem */
         FILE *proc_swaps;
@@ -237,6 +269,14 @@ struct Manager {
         /* Data specific to the Automount subsystem */
         int dev_autofs_fd;
 
+        /* Data specific to the path subsystem: all path units share one inotify object, watch descriptors
+         * are indexed in path_watches, and units with pending events are processed after a short delay */
+        int path_inotify_fd;
+        sd_event_source *path_inotify_event_source;
+        Hashmap *path_watches;
+        Set *paths_pending;
+        sd_event_source *path_coalesce_event_source;
+
         /* Data specific to the cgroup subsystem */
         Hashmap *cgroup_unit;
         CGroupMask cgroup_supported;
@@ -250,18 +290,33 @@ struct Manager {
         /* A defer event for handling cgroup empty events and processing them after SIGCHLD in all cases. */
         sd_event_source *cgroup_empty_event_source;
 
+        /* How many cgroup attribute writes we issued, and how many we skipped because the value was unchanged */
+        uint64_t n_cgroup_attribute_writes;
+        uint64_t n_cgroup_attribute_writes_skipped;
+
         /* Make sure the user cannot accidentally unmount our cgroup
          * file system */
         int pin_cgroupfs_fd;
 
         unsigned gc_marker;
 
+        /* Unit garbage collection statistics: how many passes we ran, how many units we collected (and how
+         * many of those took the fast path, since nothing referenced them), and how long it all took */
+        uint64_t n_gc_runs;
+        uint64_t n_gc_collected;
+        uint64_t n_gc_collected_leaf;
+        usec_t gc_usec;
+        usec_t gc_usec_max;
+
         /* Flags */
         ManagerExitCode exit_code:5;
 
         bool dispatching_load_queue:1;
         bool dispatching_dbus_queue:1;
 
+        /* Set when unit GC ran out of its time budget, cleared after the event loop ran once */
+        bool gc_unit_queue_yield:1;
+
         bool taint_usr:1;
 
         /* Have we already sent out the READY=1 notification? */
@@ -302,6 +357,10 @@ struct Manager {
         uint64_t default_tasks_max;
         usec_t default_timer_accuracy_usec;
 
+        /* Periodically sample resource accounting of all units, so that queries can be answered from memory */
+        usec_t accounting_sample_interval_usec;
+        sd_event_source *accounting_sample_event_source;
+
         struct rlimit *rlimit[_RLIMIT_MAX];
 
         /* non-zero if we are reloading or reexecuting, */
@@ -382,6 +441,10 @@ int manager_startup(Manager *m, FILE *serialization, FDSet *fds);
 Job *manager_get_job(Manager *m, uint32_t id);
 Unit *manager_get_unit(Manager *m, const char *name);
 
+int manager_watch_pidfd(Manager *m, pid_t pid);
+void manager_unwatch_pidfd(Manager *m, pid_t pid);
+bool manager_watch_pids_reliable(Manager *m, Set *pids);
+
 int manager_get_job_from_dbus_path(Manager *m, const char *s, Job **_j);
 
 int manager_load_unit_prepare(Manager *m, const char *name, const char *path, sd_bus_error *e, Unit **_ret);
@@ -413,6 +476,8 @@ int manager_serialize(Manager *m, FILE *f, FDSet *fds, bool switching_root);
 int manager_deserialize(Manager *m, FILE *f, FDSet *fds);
 
 int manager_reload(Manager *m);
+int manager_find_changed_units(Manager *m, Set **ret);
+int manager_reload_units(Manager *m, Set *units);
 
 void manager_reset_failed(Manager *m);
 
@@ -0,0 +1,246 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <errno.h>
+
+#include "alloc-util.h"
+#include "escape.h"
+#include "mount-snapshot.h"
+#include "string-util.h"
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(struct libmnt_iter*, mnt_free_iter);
+
+static MountInfoEntry* mount_info_entry_free(MountInfoEntry *e) {
+        if (!e)
+                return NULL;
+
+        free(e->source);
+        free(e->target);
+        free(e->options);
+        free(e->fstype);
+        free(e->what);
+        free(e->where);
+
+        return mfree(e);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(MountInfoEntry*, mount_info_entry_free);
+
+static bool mount_info_entry_matches(
+                const MountInfoEntry *e,
+                const char *source,
+                const char *target,
+                const char *options,
+                const char *fstype) {
+
+        assert(e);
+
+        return streq(e->source, source) &&
+                streq(e->target, target) &&
+                streq_ptr(e->options, options) &&
+                streq_ptr(e->fstype, fstype);
+}
+
+static int mount_info_entry_new(
+                int id,
+                const char *source,
+                const char *target,
+                const char *options,
+                const char *fstype,
+                MountInfoEntry **ret) {
+
+        _cleanup_(mount_info_entry_freep) MountInfoEntry *e = NULL;
+
+        assert(source);
+        assert(target);
+        assert(ret);
+
+        e = new0(MountInfoEntry, 1);
+        if (!e)
+                return -ENOMEM;
+
+        e->id = id;
+
+        e->source = strdup(source);
+        e->target = strdup(target);
+        if (!e->source || !e->target)
+                return -ENOMEM;
+
+        if (options) {
+                e->options = strdup(options);
+                if (!e->options)
+                        return -ENOMEM;
+        }
+
+        if (fstype) {
+                e->fstype = strdup(fstype);
+                if (!e->fstype)
+                        return -ENOMEM;
+        }
+
+        if (cunescape(source, UNESCAPE_RELAX, &e->what) < 0)
+                return -ENOMEM;
+
+        if (cunescape(target, UNESCAPE_RELAX, &e->where) < 0)
+                return -ENOMEM;
+
+        *ret = e;
+        e = NULL;
+
+        return 0;
+}
+
+MountInfoSnapshot* mount_info_snapshot_free(MountInfoSnapshot *s) {
+        MountInfoEntry *e;
+
+        if (!s)
+                return NULL;
+
+        /* The index only points into the entries, hence drop it first */
+        set_free(s->whats);
+
+        while ((e = hashmap_steal_first(s->entries)))
+                mount_info_entry_free(e);
+        hashmap_free(s->entries);
+
+        return mfree(s);
+}
+
+/* Builds a snapshot of the mount table t. If old is non-NULL, the new table is compared with it, and the
+ * unescaped paths of all mount points whose entries were added, removed or changed since are returned in
+ * *ret_changed. Unchanged entries are moved over from old, which is left with the entries that are gone. If
+ * old is NULL, *ret_changed is set to NULL. */
+int mount_info_snapshot_new(struct libmnt_table *t, MountInfoSnapshot *old, MountInfoSnapshot **ret, Set **ret_changed) {
+        _cleanup_(mount_info_snapshot_freep) MountInfoSnapshot *s = NULL;
+        _cleanup_(mnt_free_iterp) struct libmnt_iter *i = NULL;
+        _cleanup_set_free_free_ Set *changed = NULL;
+        MountInfoEntry *e;
+        Iterator j;
+        int r;
+
+        assert(t);
+        assert(ret);
+        assert(ret_changed);
+
+        s = new0(MountInfoSnapshot, 1);
+        if (!s)
+                return -ENOMEM;
+
+        s->entries = hashmap_new(NULL);
+        s->whats = set_new(&string_hash_ops);
+        if (!s->entries || !s->whats)
+                return -ENOMEM;
+
+        if (old) {
+                changed = set_new(&string_hash_ops);
+                if (!changed)
+                        return -ENOMEM;
+        }
+
+        i = mnt_new_iter(MNT_ITER_FORWARD);
+        if (!i)
+                return -ENOMEM;
+
+        for (;;) {
+                const char *device, *path, *options, *fstype;
+                struct libmnt_fs *fs;
+                int id;
+
+                r = mnt_table_next_fs(t, i, &fs);
+                if (r == 1)
+                        break;
+                if (r < 0)
+                        return r;
+
+                device = mnt_fs_get_source(fs);
+                path = mnt_fs_get_target(fs);
+                options = mnt_fs_get_options(fs);
+                fstype = mnt_fs_get_fstype(fs);
+                id = mnt_fs_get_id(fs);
+
+                if (!device || !path)
+                        continue;
+
+                e = old ? hashmap_remove(old->entries, INT_TO_PTR(id)) : NULL;
+                if (e && !mount_info_entry_matches(e, device, path, options, fstype)) {
+                        r = set_put_strdup(changed, e->where);
+                        mount_info_entry_free(e);
+                        if (r < 0)
+                                return r;
+
+                        e = NULL;
+                }
+
+                if (!e) {
+                        r = mount_info_entry_new(id, device, path, options, fstype, &e);
+                        if (r < 0)
+                                return r;
+
+                        if (changed) {
+                                r = set_put_strdup(changed, e->where);
+                                if (r < 0) {
+                                        mount_info_entry_free(e);
+                                        return r;
+                                }
+                        }
+                }
+
+                r = hashmap_put(s->entries, INT_TO_PTR(id), e);
+                if (r < 0) {
+                        mount_info_entry_free(e);
+                        return r;
+                }
+
+                /* Several mounts may share a source, the first one is as good as any other as key */
+                r = set_put(s->whats, e->what);
+                if (r < 0)
+                        return r;
+        }
+
+        /* Whatever is left in the old snapshot is gone now */
+        if (old)
+                HASHMAP_FOREACH(e, old->entries, j) {
+                        r = set_put_strdup(changed, e->where);
+                        if (r < 0)
+                                return r;
+                }
+
+        *ret = s;
+        s = NULL;
+
+        *ret_changed = changed;
+        changed = NULL;
+
+        return 0;
+}
+
+MountInfoEntry* mount_info_snapshot_get(MountInfoSnapshot *s, int id) {
+        if (!s)
+                return NULL;
+
+        return hashmap_get(s->entries, INT_TO_PTR(id));
+}
+
+bool mount_info_snapshot_has_what(MountInfoSnapshot *s, const char *what) {
+        assert(what);
+
+        if (!s)
+                return false;
+
+        return set_contains(s->whats, what);
+}
@@ -0,0 +1,52 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdbool.h>
+
+#include <libmount.h>
+
+#include "hashmap.h"
+#include "macro.h"
+#include "set.h"
+
+/* One entry of /proc/self/mountinfo as we saw it the last time we processed the table. The raw strings are
+ * used to detect changes, the unescaped ones are what the units are set up from. */
+typedef struct MountInfoEntry {
+        int id;
+        char *source;
+        char *target;
+        char *options;
+        char *fstype;
+        char *what;
+        char *where;
+} MountInfoEntry;
+
+typedef struct MountInfoSnapshot {
+        Hashmap *entries;       /* mount ID → MountInfoEntry */
+        Set *whats;             /* unescaped sources, pointing into the entries */
+} MountInfoSnapshot;
+
+MountInfoSnapshot* mount_info_snapshot_free(MountInfoSnapshot *s);
+DEFINE_TRIVIAL_CLEANUP_FUNC(MountInfoSnapshot*, mount_info_snapshot_free);
+
+int mount_info_snapshot_new(struct libmnt_table *t, MountInfoSnapshot *old, MountInfoSnapshot **ret, Set **ret_changed);
+
+MountInfoEntry* mount_info_snapshot_get(MountInfoSnapshot *s, int id);
+bool mount_info_snapshot_has_what(MountInfoSnapshot *s, const char *what);
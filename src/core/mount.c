@@ -37,6 +37,7 @@
 #include "manager.h"
 #include "mkdir.h"
 #include "mount-setup.h"
+#include "mount-snapshot.h"
 #include "mount-util.h"
 #include "mount.h"
 #include "parse-util.h"
@@ -1596,13 +1597,24 @@ fail:
         return r;
 }
 
-static int mount_load_proc_self_mountinfo(Manager *m, bool set_flags) {
+static int mount_load_proc_self_mountinfo(Manager *m, bool set_flags, Set **ret_changed) {
+        _cleanup_(mount_info_snapshot_freep) MountInfoSnapshot *old = NULL, *snapshot = NULL;
         _cleanup_(mnt_free_tablep) struct libmnt_table *t = NULL;
         _cleanup_(mnt_free_iterp) struct libmnt_iter *i = NULL;
+        _cleanup_set_free_free_ Set *changed = NULL;
+        MountInfoEntry *e;
         int r = 0;
 
         assert(m);
 
+        /* If ret_changed is non-NULL we keep a snapshot of the table around, and compare the new table with it,
+         * so that only the mount points that actually changed need to be looked at. The paths of those are
+         * returned in *ret_changed. If there was no previous snapshot to compare with, all mount points are
+         * processed and *ret_changed is set to NULL. */
+
+        old = m->mount_info_snapshot;
+        m->mount_info_snapshot = NULL;
+
         t = mnt_new_table();
         if (!t)
                 return log_oom();
@@ -1615,10 +1627,17 @@ static int mount_load_proc_self_mountinfo(Manager *m, bool set_flags) {
         if (r < 0)
                 return log_error_errno(r, "Failed to parse /proc/self/mountinfo: %m");
 
+        if (ret_changed) {
+                r = mount_info_snapshot_new(t, old, &snapshot, &changed);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to compare /proc/self/mountinfo with its last snapshot: %m");
+        }
+
+        /* Set up the units in the order of the table, so that for stacked mounts the top-most one wins */
         r = 0;
         for (;;) {
-                const char *device, *path, *options, *fstype;
                 _cleanup_free_ char *d = NULL, *p = NULL;
+                const char *options, *fstype;
                 struct libmnt_fs *fs;
                 int k;
 
@@ -1628,27 +1647,51 @@ static int mount_load_proc_self_mountinfo(Manager *m, bool set_flags) {
                 if (k < 0)
                         return log_error_errno(k, "Failed to get next entry from /proc/self/mountinfo: %m");
 
-                device = mnt_fs_get_source(fs);
-                path = mnt_fs_get_target(fs);
                 options = mnt_fs_get_options(fs);
                 fstype = mnt_fs_get_fstype(fs);
 
-                if (!device || !path)
-                        continue;
+                if (snapshot) {
+                        e = mount_info_snapshot_get(snapshot, mnt_fs_get_id(fs));
+                        if (!e)
+                                continue;
+
+                        if (changed && !set_contains(changed, e->where))
+                                continue;
+
+                        (void) device_found_node(m, e->what, true, DEVICE_FOUND_MOUNT, set_flags);
+
+                        k = mount_setup_unit(m, e->what, e->where, options, fstype, set_flags);
+                } else {
+                        const char *device, *path;
 
-                if (cunescape(device, UNESCAPE_RELAX, &d) < 0)
-                        return log_oom();
+                        device = mnt_fs_get_source(fs);
+                        path = mnt_fs_get_target(fs);
 
-                if (cunescape(path, UNESCAPE_RELAX, &p) < 0)
-                        return log_oom();
+                        if (!device || !path)
+                                continue;
 
-                (void) device_found_node(m, d, true, DEVICE_FOUND_MOUNT, set_flags);
+                        if (cunescape(device, UNESCAPE_RELAX, &d) < 0)
+                                return log_oom();
 
-                k = mount_setup_unit(m, d, p, options, fstype, set_flags);
+                        if (cunescape(path, UNESCAPE_RELAX, &p) < 0)
+                                return log_oom();
+
+                        (void) device_found_node(m, d, true, DEVICE_FOUND_MOUNT, set_flags);
+
+                        k = mount_setup_unit(m, d, p, options, fstype, set_flags);
+                }
                 if (r == 0 && k < 0)
                         r = k;
         }
 
+        if (ret_changed) {
+                m->mount_info_snapshot = snapshot;
+                snapshot = NULL;
+
+                *ret_changed = changed;
+                changed = NULL;
+        }
+
         return r;
 }
 
@@ -1659,6 +1702,8 @@ static void mount_shutdown(Manager *m) {
 
         mnt_unref_monitor(m->mount_monitor);
         m->mount_monitor = NULL;
+
+        m->mount_info_snapshot = mount_info_snapshot_free(m->mount_info_snapshot);
 }
 
 static int mount_get_timeout(Unit *u, usec_t *timeout) {
@@ -1764,7 +1809,11 @@ static void mount_enumerate(Manager *m) {
                 (void) sd_event_source_set_description(m->mount_event_source, "mount-monitor-dispatch");
         }
 
-        r = mount_load_proc_self_mountinfo(m, false);
+        /* The units have been (re-)created from scratch, hence forget the last snapshot, so that the next change
+         * notification processes all mount points again. */
+        m->mount_info_snapshot = mount_info_snapshot_free(m->mount_info_snapshot);
+
+        r = mount_load_proc_self_mountinfo(m, false, NULL);
         if (r < 0)
                 goto fail;
 
@@ -1774,10 +1823,90 @@ fail:
         mount_shutdown(m);
 }
 
+static void mount_process_proc_self_mountinfo(Mount *mount, Set **around, Set **gone) {
+        assert(mount);
+        assert(around);
+        assert(gone);
+
+        if (!mount_is_mounted(mount)) {
+
+                /* A mount point is not around right now. It
+                 * might be gone, or might never have
+                 * existed. */
+
+                if (mount->from_proc_self_mountinfo &&
+                    mount->parameters_proc_self_mountinfo.what) {
+
+                        /* Remember that this device might just have disappeared */
+                        if (set_ensure_allocated(gone, &string_hash_ops) < 0 ||
+                            set_put(*gone, mount->parameters_proc_self_mountinfo.what) < 0)
+                                log_oom(); /* we don't care too much about OOM here... */
+                }
+
+                mount->from_proc_self_mountinfo = false;
+
+                switch (mount->state) {
+
+                case MOUNT_MOUNTED:
+                        /* This has just been unmounted by
+                         * somebody else, follow the state
+                         * change. */
+                        mount->result = MOUNT_SUCCESS; /* make sure we forget any earlier umount failures */
+                        mount_enter_dead(mount, MOUNT_SUCCESS);
+                        break;
+
+                default:
+                        break;
+                }
+
+        } else if (mount->just_mounted || mount->just_changed) {
+
+                /* A mount point was added or changed */
+
+                switch (mount->state) {
+
+                case MOUNT_DEAD:
+                case MOUNT_FAILED:
+
+                        /* This has just been mounted by somebody else, follow the state change, but let's
+                         * generate a new invocation ID for this implicitly and automatically. */
+                        (void) unit_acquire_invocation_id(UNIT(mount));
+                        mount_enter_mounted(mount, MOUNT_SUCCESS);
+                        break;
+
+                case MOUNT_MOUNTING:
+                        mount_set_state(mount, MOUNT_MOUNTING_DONE);
+                        break;
+
+                default:
+                        /* Nothing really changed, but let's
+                         * issue an notification call
+                         * nonetheless, in case somebody is
+                         * waiting for this. (e.g. file system
+                         * ro/rw remounts.) */
+                        mount_set_state(mount, mount->state);
+                        break;
+                }
+        }
+
+        if (mount_is_mounted(mount) &&
+            mount->from_proc_self_mountinfo &&
+            mount->parameters_proc_self_mountinfo.what) {
+
+                if (set_ensure_allocated(around, &string_hash_ops) < 0 ||
+                    set_put(*around, mount->parameters_proc_self_mountinfo.what) < 0)
+                        log_oom();
+        }
+
+        /* Reset the flags for later calls */
+        mount->is_mounted = mount->just_mounted = mount->just_changed = false;
+}
+
 static int mount_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
         _cleanup_set_free_ Set *around = NULL, *gone = NULL;
+        _cleanup_set_free_free_ Set *changed = NULL;
         Manager *m = userdata;
-        const char *what;
+        const char *what, *where;
         Iterator i;
         Unit *u;
         int r;
@@ -1808,7 +1937,7 @@ static int mount_dispatch_io(sd_event_source *source, int fd, uint32_t revents,
                         return 0;
         }
 
-        r = mount_load_proc_self_mountinfo(m, true);
+        r = mount_load_proc_self_mountinfo(m, true, &changed);
         if (r < 0) {
                 /* Reset flags, just in case, for later calls */
                 LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_MOUNT]) {
@@ -1822,87 +1951,35 @@ static int mount_dispatch_io(sd_event_source *source, int fd, uint32_t revents,
 
         manager_dispatch_load_queue(m);
 
-        LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_MOUNT]) {
-                Mount *mount = MOUNT(u);
-
-                if (!mount_is_mounted(mount)) {
-
-                        /* A mount point is not around right now. It
-                         * might be gone, or might never have
-                         * existed. */
-
-                        if (mount->from_proc_self_mountinfo &&
-                            mount->parameters_proc_self_mountinfo.what) {
-
-                                /* Remember that this device might just have disappeared */
-                                if (set_ensure_allocated(&gone, &string_hash_ops) < 0 ||
-                                    set_put(gone, mount->parameters_proc_self_mountinfo.what) < 0)
-                                        log_oom(); /* we don't care too much about OOM here... */
-                        }
-
-                        mount->from_proc_self_mountinfo = false;
-
-                        switch (mount->state) {
-
-                        case MOUNT_MOUNTED:
-                                /* This has just been unmounted by
-                                 * somebody else, follow the state
-                                 * change. */
-                                mount->result = MOUNT_SUCCESS; /* make sure we forget any earlier umount failures */
-                                mount_enter_dead(mount, MOUNT_SUCCESS);
-                                break;
-
-                        default:
-                                break;
-                        }
-
-                } else if (mount->just_mounted || mount->just_changed) {
-
-                        /* A mount point was added or changed */
-
-                        switch (mount->state) {
-
-                        case MOUNT_DEAD:
-                        case MOUNT_FAILED:
+        if (changed) {
+                /* We have a previous snapshot to compare with, hence only look at the mount points that were
+                 * added, removed or changed since then. */
+                log_debug("%u mount points changed.", set_size(changed));
 
-                                /* This has just been mounted by somebody else, follow the state change, but let's
-                                 * generate a new invocation ID for this implicitly and automatically. */
-                                (void) unit_acquire_invocation_id(UNIT(mount));
-                                mount_enter_mounted(mount, MOUNT_SUCCESS);
-                                break;
+                SET_FOREACH(where, changed, i) {
+                        _cleanup_free_ char *e = NULL;
 
-                        case MOUNT_MOUNTING:
-                                mount_set_state(mount, MOUNT_MOUNTING_DONE);
-                                break;
+                        if (unit_name_from_path(where, ".mount", &e) < 0)
+                                continue;
 
-                        default:
-                                /* Nothing really changed, but let's
-                                 * issue an notification call
-                                 * nonetheless, in case somebody is
-                                 * waiting for this. (e.g. file system
-                                 * ro/rw remounts.) */
-                                mount_set_state(mount, mount->state);
-                                break;
-                        }
-                }
+                        u = manager_get_unit(m, e);
+                        if (!u || u->type != UNIT_MOUNT)
+                                continue;
 
-                if (mount_is_mounted(mount) &&
-                    mount->from_proc_self_mountinfo &&
-                    mount->parameters_proc_self_mountinfo.what) {
-
-                        if (set_ensure_allocated(&around, &string_hash_ops) < 0 ||
-                            set_put(around, mount->parameters_proc_self_mountinfo.what) < 0)
-                                log_oom();
+                        mount_process_proc_self_mountinfo(MOUNT(u), &around, &gone);
                 }
-
-                /* Reset the flags for later calls */
-                mount->is_mounted = mount->just_mounted = mount->just_changed = false;
-        }
+        } else
+                LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_MOUNT])
+                        mount_process_proc_self_mountinfo(MOUNT(u), &around, &gone);
 
         SET_FOREACH(what, gone, i) {
                 if (set_contains(around, what))
                         continue;
 
+                /* Units we didn't look at this time might still have the device mounted */
+                if (changed && mount_info_snapshot_has_what(m->mount_info_snapshot, what))
+                        continue;
+
                 /* Let the device units know that the device is no longer mounted */
                 (void) device_found_node(m, what, false, DEVICE_FOUND_MOUNT, true);
         }
@@ -31,6 +31,7 @@
 #include "glob-util.h"
 #include "macro.h"
 #include "mkdir.h"
+#include "parse-util.h"
 #include "path.h"
 #include "special.h"
 #include "stat-util.h"
@@ -46,11 +47,34 @@ static const UnitActiveState state_translation_table[_PATH_STATE_MAX] = {
         [PATH_FAILED] = UNIT_FAILED
 };
 
-static int path_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata);
+/* All path units share a single inotify instance owned by the manager. Every kernel watch descriptor is
+ * indexed in m->path_watches, together with the specs that asked for it and the event mask each of them
+ * is interested in, so that a directory watched by many units costs one kernel watch, and events are
+ * only delivered to the specs that care about them. Watches are added with IN_MASK_ADD, hence the kernel
+ * mask of a watch is the union of what its users requested. */
+typedef struct PathWatcher {
+        PathSpec *spec;
+        uint32_t mask;
+} PathWatcher;
 
-int path_spec_watch(PathSpec *s, sd_event_io_handler_t handler) {
+typedef struct PathWatch {
+        int wd;
+        PathWatcher *watchers;
+        size_t n_watchers, n_allocated;
+} PathWatch;
+
+/* Events arriving within this window after the first one are folded into a single re-evaluation of
+ * each affected unit, so that a burst of changes in a watched directory doesn't make us re-check and
+ * re-arm the watches for every single event. */
+#define PATH_COALESCE_USEC (10*USEC_PER_MSEC)
+
+typedef int (*path_spec_add_watch_t)(PathSpec *s, uint32_t mask);
+
+static int path_dispatch_inotify(sd_event_source *source, int fd, uint32_t revents, void *userdata);
 
-        static const int flags_table[_PATH_TYPE_MAX] = {
+static int path_spec_add_watches(PathSpec *s, path_spec_add_watch_t add_watch) {
+
+        static const uint32_t flags_table[_PATH_TYPE_MAX] = {
                 [PATH_EXISTS] = IN_DELETE_SELF|IN_MOVE_SELF|IN_ATTRIB,
                 [PATH_EXISTS_GLOB] = IN_DELETE_SELF|IN_MOVE_SELF|IN_ATTRIB,
                 [PATH_CHANGED] = IN_DELETE_SELF|IN_MOVE_SELF|IN_ATTRIB|IN_CLOSE_WRITE|IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO,
@@ -63,28 +87,14 @@ int path_spec_watch(PathSpec *s, sd_event_io_handler_t handler) {
         int r;
 
         assert(s);
-        assert(s->unit);
-        assert(handler);
-
-        path_spec_unwatch(s);
-
-        s->inotify_fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
-        if (s->inotify_fd < 0) {
-                r = -errno;
-                goto fail;
-        }
-
-        r = sd_event_add_io(s->unit->manager->event, &s->event_source, s->inotify_fd, EPOLLIN, handler, s);
-        if (r < 0)
-                goto fail;
-
-        (void) sd_event_source_set_description(s->event_source, "path");
+        assert(add_watch);
 
-        /* This assumes the path was passed through path_kill_slashes()! */
+        /* This assumes the path was passed through path_kill_slashes()! The add_watch() callback is
+         * invoked with s->path temporarily truncated to the component to watch. */
 
         for (slash = strchr(s->path, '/'); ; slash = strchr(slash+1, '/')) {
                 char *cut = NULL;
-                int flags;
+                uint32_t flags;
                 char tmp;
 
                 if (slash) {
@@ -96,18 +106,18 @@ int path_spec_watch(PathSpec *s, sd_event_io_handler_t handler) {
                 } else
                         flags = flags_table[s->type];
 
-                r = inotify_add_watch(s->inotify_fd, s->path, flags);
+                r = add_watch(s, flags);
                 if (r < 0) {
-                        if (IN_SET(errno, EACCES, ENOENT)) {
+                        if (IN_SET(r, -EACCES, -ENOENT)) {
                                 if (cut)
                                         *cut = tmp;
                                 break;
                         }
 
-                        r = log_warning_errno(errno, "Failed to add watch on %s: %s", s->path, errno == ENOSPC ? "too many watches" : strerror(-r));
+                        r = log_warning_errno(r, "Failed to add watch on %s: %s", s->path, r == -ENOSPC ? "too many watches" : strerror(-r));
                         if (cut)
                                 *cut = tmp;
-                        goto fail;
+                        return r;
                 } else {
                         exists = true;
 
@@ -117,7 +127,7 @@ int path_spec_watch(PathSpec *s, sd_event_io_handler_t handler) {
                                 char tmp2 = *cut2;
                                 *cut2 = '\0';
 
-                                (void) inotify_add_watch(s->inotify_fd, s->path, IN_MOVE_SELF);
+                                (void) add_watch(s, IN_MOVE_SELF);
                                 /* Error is ignored, the worst can happen is we get spurious events. */
 
                                 *cut2 = tmp2;
@@ -136,12 +146,48 @@ int path_spec_watch(PathSpec *s, sd_event_io_handler_t handler) {
                 }
         }
 
-        if (!exists) {
-                r = log_error_errno(errno, "Failed to add watch on any of the components of %s: %m", s->path);
+        if (!exists)
                 /* either EACCESS or ENOENT */
+                return log_error_errno(r, "Failed to add watch on any of the components of %s: %m", s->path);
+
+        return 0;
+}
+
+static int path_spec_add_private_watch(PathSpec *s, uint32_t mask) {
+        int wd;
+
+        wd = inotify_add_watch(s->inotify_fd, s->path, mask);
+        if (wd < 0)
+                return -errno;
+
+        return wd;
+}
+
+int path_spec_watch(PathSpec *s, sd_event_io_handler_t handler) {
+        int r;
+
+        assert(s);
+        assert(s->unit);
+        assert(handler);
+
+        path_spec_unwatch(s);
+
+        s->inotify_fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+        if (s->inotify_fd < 0) {
+                r = -errno;
                 goto fail;
         }
 
+        r = sd_event_add_io(s->unit->manager->event, &s->event_source, s->inotify_fd, EPOLLIN, handler, s);
+        if (r < 0)
+                goto fail;
+
+        (void) sd_event_source_set_description(s->event_source, "path");
+
+        r = path_spec_add_watches(s, path_spec_add_private_watch);
+        if (r < 0)
+                goto fail;
+
         return 0;
 
 fail:
@@ -149,11 +195,165 @@ fail:
         return r;
 }
 
+static PathWatch* path_watch_free(PathWatch *w) {
+        if (!w)
+                return NULL;
+
+        free(w->watchers);
+        return mfree(w);
+}
+
+static void path_watch_release_if_unused(Manager *m, PathWatch *w) {
+        assert(m);
+        assert(w);
+
+        if (w->n_watchers > 0)
+                return;
+
+        if (inotify_rm_watch(m->path_inotify_fd, w->wd) < 0)
+                log_debug_errno(errno, "Failed to remove path inotify watch %i, ignoring: %m", w->wd);
+
+        assert_se(hashmap_remove(m->path_watches, INT_TO_PTR(w->wd)) == w);
+        path_watch_free(w);
+}
+
+static int path_spec_add_shared_watch(PathSpec *s, uint32_t mask) {
+        Manager *m;
+        PathWatch *w;
+        int wd, r;
+
+        assert(s);
+        assert(s->unit);
+
+        m = s->unit->manager;
+
+        if (!GREEDY_REALLOC(s->wds, s->n_wds_allocated, s->n_wds + 1))
+                return -ENOMEM;
+
+        wd = inotify_add_watch(m->path_inotify_fd, s->path, mask|IN_MASK_ADD);
+        if (wd < 0)
+                return -errno;
+
+        w = hashmap_get(m->path_watches, INT_TO_PTR(wd));
+        if (!w) {
+                w = new0(PathWatch, 1);
+                if (!w) {
+                        (void) inotify_rm_watch(m->path_inotify_fd, wd);
+                        return -ENOMEM;
+                }
+
+                w->wd = wd;
+
+                r = hashmap_put(m->path_watches, INT_TO_PTR(wd), w);
+                if (r < 0) {
+                        (void) inotify_rm_watch(m->path_inotify_fd, wd);
+                        path_watch_free(w);
+                        return r;
+                }
+        }
+
+        if (!GREEDY_REALLOC(w->watchers, w->n_allocated, w->n_watchers + 1)) {
+                path_watch_release_if_unused(m, w);
+                return -ENOMEM;
+        }
+
+        w->watchers[w->n_watchers++] = (PathWatcher) {
+                .spec = s,
+                .mask = mask,
+        };
+
+        s->wds[s->n_wds++] = wd;
+
+        return wd;
+}
+
+static void path_spec_release_shared_watches(PathSpec *s) {
+        Manager *m;
+        size_t i;
+
+        assert(s);
+        assert(s->unit);
+
+        m = s->unit->manager;
+
+        for (i = 0; i < s->n_wds; i++) {
+                PathWatch *w;
+                size_t j;
+
+                /* The watch might be gone already, if the kernel dropped it and told us via IN_IGNORED */
+                w = hashmap_get(m->path_watches, INT_TO_PTR(s->wds[i]));
+                if (!w)
+                        continue;
+
+                for (j = 0; j < w->n_watchers; )
+                        if (w->watchers[j].spec == s)
+                                w->watchers[j] = w->watchers[--w->n_watchers];
+                        else
+                                j++;
+
+                path_watch_release_if_unused(m, w);
+        }
+
+        s->wds = mfree(s->wds);
+        s->n_wds = s->n_wds_allocated = 0;
+}
+
+static int path_setup_inotify(Manager *m) {
+        int r;
+
+        assert(m);
+
+        if (m->path_inotify_fd >= 0)
+                return 0;
+
+        r = hashmap_ensure_allocated(&m->path_watches, &trivial_hash_ops);
+        if (r < 0)
+                return log_oom();
+
+        r = set_ensure_allocated(&m->paths_pending, NULL);
+        if (r < 0)
+                return log_oom();
+
+        m->path_inotify_fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+        if (m->path_inotify_fd < 0)
+                return log_error_errno(errno, "Failed to create path inotify object: %m");
+
+        r = sd_event_add_io(m->event, &m->path_inotify_event_source, m->path_inotify_fd, EPOLLIN, path_dispatch_inotify, m);
+        if (r < 0) {
+                m->path_inotify_fd = safe_close(m->path_inotify_fd);
+                return log_error_errno(r, "Failed to watch path inotify object: %m");
+        }
+
+        (void) sd_event_source_set_description(m->path_inotify_event_source, "path-inotify");
+
+        return 0;
+}
+
+static int path_spec_watch_shared(PathSpec *s) {
+        int r;
+
+        assert(s);
+        assert(s->unit);
+
+        path_spec_unwatch(s);
+
+        r = path_spec_add_watches(s, path_spec_add_shared_watch);
+        if (r < 0) {
+                path_spec_unwatch(s);
+                return r;
+        }
+
+        return 0;
+}
+
 void path_spec_unwatch(PathSpec *s) {
         assert(s);
 
         s->event_source = sd_event_source_unref(s->event_source);
         s->inotify_fd = safe_close(s->inotify_fd);
+
+        if (s->wds)
+                path_spec_release_shared_watches(s);
 }
 
 int path_spec_fd_event(PathSpec *s, uint32_t revents) {
@@ -244,6 +444,7 @@ static void path_spec_dump(PathSpec *s, FILE *f, const char *prefix) {
 void path_spec_done(PathSpec *s) {
         assert(s);
         assert(s->inotify_fd == -1);
+        assert(!s->wds);
 
         free(s->path);
 }
@@ -275,6 +476,9 @@ static void path_done(Unit *u) {
 
         assert(p);
 
+        (void) set_remove(u->manager->paths_pending, p);
+        p->pending_changed = false;
+
         path_free_specs(p);
 }
 
@@ -334,7 +538,7 @@ static int path_add_trigger_dependencies(Path *p) {
 
         assert(p);
 
-        if (!hashmap_isempty(UNIT(p)->dependencies[UNIT_TRIGGERS]))
+        if (!unit_dependency_set_isempty(UNIT(p)->dependencies[UNIT_TRIGGERS]))
                 return 0;
 
         r = unit_load_related_unit(UNIT(p), ".service", &x);
@@ -388,12 +592,16 @@ static void path_dump(Unit *u, FILE *f, const char *prefix) {
                 "%sResult: %s\n"
                 "%sUnit: %s\n"
                 "%sMakeDirectory: %s\n"
-                "%sDirectoryMode: %04o\n",
+                "%sDirectoryMode: %04o\n"
+                "%sNEvents: %u\n"
+                "%sNTriggers: %u\n",
                 prefix, path_state_to_string(p->state),
                 prefix, path_result_to_string(p->result),
                 prefix, trigger ? trigger->id : "n/a",
                 prefix, yes_no(p->make_directory),
-                prefix, p->directory_mode);
+                prefix, p->directory_mode,
+                prefix, p->n_events,
+                prefix, p->n_triggers);
 
         LIST_FOREACH(spec, s, p->specs)
                 path_spec_dump(s, f, prefix);
@@ -414,8 +622,12 @@ static int path_watch(Path *p) {
 
         assert(p);
 
+        r = path_setup_inotify(UNIT(p)->manager);
+        if (r < 0)
+                return r;
+
         LIST_FOREACH(spec, s, p->specs) {
-                r = path_spec_watch(s, path_dispatch_io);
+                r = path_spec_watch_shared(s);
                 if (r < 0)
                         return r;
         }
@@ -493,6 +705,7 @@ static void path_enter_running(Path *p) {
         if (r < 0)
                 goto fail;
 
+        p->n_triggers++;
         p->inotify_triggered = false;
 
         r = path_watch(p);
@@ -619,6 +832,8 @@ static int path_serialize(Unit *u, FILE *f, FDSet *fds) {
 
         unit_serialize_item(u, f, "state", path_state_to_string(p->state));
         unit_serialize_item(u, f, "result", path_result_to_string(p->result));
+        unit_serialize_item_format(u, f, "n-events", "%u", p->n_events);
+        unit_serialize_item_format(u, f, "n-triggers", "%u", p->n_triggers);
 
         return 0;
 }
@@ -649,6 +864,22 @@ static int path_deserialize_item(Unit *u, const char *key, const char *value, FD
                 else if (f != PATH_SUCCESS)
                         p->result = f;
 
+        } else if (streq(key, "n-events")) {
+                unsigned k;
+
+                if (safe_atou(value, &k) < 0)
+                        log_unit_debug(u, "Failed to parse n-events value: %s", value);
+                else
+                        p->n_events += k;
+
+        } else if (streq(key, "n-triggers")) {
+                unsigned k;
+
+                if (safe_atou(value, &k) < 0)
+                        log_unit_debug(u, "Failed to parse n-triggers value: %s", value);
+                else
+                        p->n_triggers += k;
+
         } else
                 log_unit_debug(u, "Unknown serialization key: %s", key);
 
@@ -667,34 +898,16 @@ _pure_ static const char *path_sub_state_to_string(Unit *u) {
         return path_state_to_string(PATH(u)->state);
 }
 
-static int path_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
-        PathSpec *s = userdata;
-        Path *p;
-        int changed;
+static void path_process_events(Path *p) {
+        bool changed;
 
-        assert(s);
-        assert(s->unit);
-        assert(fd >= 0);
+        assert(p);
 
-        p = PATH(s->unit);
+        changed = p->pending_changed;
+        p->pending_changed = false;
 
         if (!IN_SET(p->state, PATH_WAITING, PATH_RUNNING))
-                return 0;
-
-        /* log_debug("inotify wakeup on %s.", u->id); */
-
-        LIST_FOREACH(spec, s, p->specs)
-                if (path_spec_owns_inotify_fd(s, fd))
-                        break;
-
-        if (!s) {
-                log_error("Got event on unknown fd.");
-                goto fail;
-        }
-
-        changed = path_spec_fd_event(s, revents);
-        if (changed < 0)
-                goto fail;
+                return;
 
         /* If we are already running, then remember that one event was
          * dispatched so that we restart the service only if something
@@ -705,14 +918,156 @@ static int path_dispatch_io(sd_event_source *source, int fd, uint32_t revents, v
                 path_enter_running(p);
         else
                 path_enter_waiting(p, false, true);
+}
+
+static int path_dispatch_coalesced(sd_event_source *source, usec_t usec, void *userdata) {
+        Manager *m = userdata;
+        Path *p;
+
+        assert(m);
+
+        while ((p = set_steal_first(m->paths_pending)))
+                path_process_events(p);
 
         return 0;
+}
+
+static void path_arm_coalesce_timer(Manager *m) {
+        usec_t until;
+        int r;
+
+        assert(m);
+
+        if (set_isempty(m->paths_pending))
+                return;
+
+        if (m->path_coalesce_event_source) {
+                int enabled;
+
+                /* Already armed? Then keep the window anchored at the first event */
+                r = sd_event_source_get_enabled(m->path_coalesce_event_source, &enabled);
+                if (r >= 0 && enabled != SD_EVENT_OFF)
+                        return;
+        }
+
+        until = usec_add(now(CLOCK_MONOTONIC), PATH_COALESCE_USEC);
+
+        if (m->path_coalesce_event_source) {
+                r = sd_event_source_set_time(m->path_coalesce_event_source, until);
+                if (r >= 0)
+                        r = sd_event_source_set_enabled(m->path_coalesce_event_source, SD_EVENT_ONESHOT);
+        } else {
+                r = sd_event_add_time(m->event, &m->path_coalesce_event_source, CLOCK_MONOTONIC, until, USEC_PER_MSEC, path_dispatch_coalesced, m);
+                if (r >= 0)
+                        (void) sd_event_source_set_description(m->path_coalesce_event_source, "path-coalesce");
+        }
+        if (r < 0) {
+                log_warning_errno(r, "Failed to arm path event coalescing timer, processing events right away: %m");
+                (void) path_dispatch_coalesced(NULL, 0, m);
+        }
+}
+
+static void path_spec_queue_event(PathSpec *s, bool changed) {
+        Manager *m;
+        Path *p;
+
+        assert(s);
+        assert(s->unit);
+
+        p = PATH(s->unit);
+        m = s->unit->manager;
+
+        p->n_events++;
+
+        if (changed)
+                p->pending_changed = true;
+
+        if (set_put(m->paths_pending, p) < 0)
+                log_oom();
+}
+
+static int path_dispatch_inotify(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+        Manager *m = userdata;
+
+        assert(m);
+        assert(fd >= 0);
+
+        /* Drain everything queued on the shared inotify object, only mark the affected units here, and
+         * process them once the coalescing window is over. */
+
+        for (;;) {
+                union inotify_event_buffer buffer;
+                struct inotify_event *e;
+                ssize_t l;
+
+                l = read(fd, &buffer, sizeof(buffer));
+                if (l < 0) {
+                        if (!IN_SET(errno, EINTR, EAGAIN))
+                                log_error_errno(errno, "Failed to read path inotify events: %m");
+
+                        break;
+                }
+
+                FOREACH_INOTIFY_EVENT(e, buffer, l) {
+                        PathWatch *w;
+                        size_t i;
+
+                        if (e->mask & IN_Q_OVERFLOW) {
+                                Iterator j;
+
+                                /* We lost events, recheck everything we watch */
+                                log_debug("Path inotify queue overflow, rechecking all watched paths.");
+
+                                HASHMAP_FOREACH(w, m->path_watches, j)
+                                        for (i = 0; i < w->n_watchers; i++)
+                                                path_spec_queue_event(w->watchers[i].spec, false);
+                                continue;
+                        }
+
+                        w = hashmap_get(m->path_watches, INT_TO_PTR(e->wd));
+                        if (!w) /* Event was queued before we removed the watch, ignore */
+                                continue;
+
+                        for (i = 0; i < w->n_watchers; i++) {
+                                PathSpec *s = w->watchers[i].spec;
+
+                                if (!(e->mask & (w->watchers[i].mask|IN_IGNORED|IN_UNMOUNT)))
+                                        continue;
+
+                                path_spec_queue_event(s, IN_SET(s->type, PATH_CHANGED, PATH_MODIFIED) && s->primary_wd == e->wd);
+                        }
+
+                        if (e->mask & IN_IGNORED) {
+                                /* The kernel dropped the watch, because the inode went away or its file
+                                 * system got unmounted. Forget about it, the units will re-add what they
+                                 * need when they are processed. */
+                                assert_se(hashmap_remove(m->path_watches, INT_TO_PTR(e->wd)) == w);
+                                path_watch_free(w);
+                        }
+                }
+        }
+
+        path_arm_coalesce_timer(m);
 
-fail:
-        path_enter_dead(p, PATH_FAILURE_RESOURCES);
         return 0;
 }
 
+static void path_shutdown(Manager *m) {
+        PathWatch *w;
+
+        assert(m);
+
+        m->path_coalesce_event_source = sd_event_source_unref(m->path_coalesce_event_source);
+        m->path_inotify_event_source = sd_event_source_unref(m->path_inotify_event_source);
+        m->path_inotify_fd = safe_close(m->path_inotify_fd);
+
+        while ((w = hashmap_steal_first(m->path_watches)))
+                path_watch_free(w);
+
+        m->path_watches = hashmap_free(m->path_watches);
+        m->paths_pending = set_free(m->paths_pending);
+}
+
 static void path_trigger_notify(Unit *u, Unit *other) {
         Path *p = PATH(u);
 
@@ -797,6 +1152,8 @@ const UnitVTable path_vtable = {
 
         .reset_failed = path_reset_failed,
 
+        .shutdown = path_shutdown,
+
         .bus_vtable = bus_path_vtable,
         .bus_set_property = bus_path_set_property,
 };
@@ -48,6 +48,10 @@ typedef struct PathSpec {
         int inotify_fd;
         int primary_wd;
 
+        /* Watch descriptors on the manager's shared path inotify object */
+        int *wds;
+        size_t n_wds, n_wds_allocated;
+
         bool previous_exists;
 } PathSpec;
 
@@ -76,6 +80,10 @@ struct Path {
         PathState state, deserialized_state;
 
         bool inotify_triggered;
+        bool pending_changed;
+
+        unsigned n_events;
+        unsigned n_triggers;
 
         bool make_directory;
         mode_t directory_mode;
@@ -117,6 +117,7 @@ static void service_init(Unit *u) {
         s->type = _SERVICE_TYPE_INVALID;
         s->socket_fd = -1;
         s->stdin_fd = s->stdout_fd = s->stderr_fd = -1;
+        s->watchdog_shm_fd = -1;
         s->guess_main_pid = true;
 
         s->control_command_id = _SERVICE_EXEC_COMMAND_INVALID;
@@ -196,11 +197,65 @@ void service_close_socket_fd(Service *s) {
         }
 }
 
+static void service_release_watchdog_shm(Service *s) {
+        assert(s);
+
+        s->watchdog_shm_page = watchdog_shm_unmap(s->watchdog_shm_page);
+        s->watchdog_shm_fd = safe_close(s->watchdog_shm_fd);
+}
+
+static int service_add_watchdog_shm(Service *s, int fd) {
+        WatchdogShm *page;
+        int r;
+
+        assert(s);
+        assert(fd >= 0);
+
+        /* Takes possession of the fd. Once the page is mapped, the service sees it acknowledged, and stops
+         * sending datagrams. */
+
+        r = watchdog_shm_map(fd, &page);
+        if (r < 0) {
+                safe_close(fd);
+                return r;
+        }
+
+        service_release_watchdog_shm(s);
+        s->watchdog_shm_fd = fd;
+        s->watchdog_shm_page = page;
+
+        return 0;
+}
+
+static bool service_watchdog_shm_pinged(Service *s) {
+        usec_t t, n;
+
+        assert(s);
+
+        /* Checks whether the service stored a keep-alive ping in the shared page since the last one we know
+         * about, and if so updates the watchdog timestamp accordingly. */
+
+        if (!s->watchdog_shm_page)
+                return false;
+
+        t = __atomic_load_n(&s->watchdog_shm_page->timestamp, __ATOMIC_ACQUIRE);
+        if (t <= s->watchdog_timestamp.monotonic)
+                return false;
+
+        /* Don't let the service push the deadline into the future */
+        n = now(CLOCK_MONOTONIC);
+        dual_timestamp_from_monotonic(&s->watchdog_timestamp, MIN(t, n));
+
+        return true;
+}
+
 static void service_stop_watchdog(Service *s) {
         assert(s);
 
         s->watchdog_event_source = sd_event_source_unref(s->watchdog_event_source);
         s->watchdog_timestamp = DUAL_TIMESTAMP_NULL;
+
+        service_release_watchdog_shm(s);
 }
 
 static usec_t service_get_watchdog_usec(Service *s) {
@@ -791,6 +846,7 @@ static void service_dump(Unit *u, FILE *f, const char *prefix) {
                 "%sRootDirectoryStartOnly: %s\n"
                 "%sRemainAfterExit: %s\n"
                 "%sGuessMainPID: %s\n"
+                "%sWatchdogSharedMemory: %s\n"
                 "%sType: %s\n"
                 "%sRestart: %s\n"
                 "%sNotifyAccess: %s\n"
@@ -802,6 +858,7 @@ static void service_dump(Unit *u, FILE *f, const char *prefix) {
                 prefix, yes_no(s->root_directory_start_only),
                 prefix, yes_no(s->remain_after_exit),
                 prefix, yes_no(s->guess_main_pid),
+                prefix, yes_no(s->watchdog_shm),
                 prefix, service_type_to_string(s->type),
                 prefix, service_restart_to_string(s->restart),
                 prefix, notify_access_to_string(s->notify_access),
@@ -1210,7 +1267,7 @@ static int service_collect_fds(Service *s,
 
                 /* Pass all our configured sockets for singleton services */
 
-                HASHMAP_FOREACH_KEY(v, u, UNIT(s)->dependencies[UNIT_TRIGGERED_BY], i) {
+                UNIT_DEPENDENCY_SET_FOREACH(v, u, UNIT(s)->dependencies[UNIT_TRIGGERED_BY], i) {
                         _cleanup_free_ int *cfds = NULL;
                         Socket *sock;
                         int cn_fds;
@@ -1454,6 +1511,7 @@ static int service_spawn(
         exec_params.n_storage_fds = n_storage_fds;
         exec_params.n_socket_fds = n_socket_fds;
         exec_params.watchdog_usec = s->watchdog_usec;
+        SET_FLAG(exec_params.flags, EXEC_WATCHDOG_SHM, s->watchdog_shm);
         exec_params.selinux_context_net = s->socket_fd_selinux_context_net;
         if (s->type == SERVICE_IDLE)
                 exec_params.idle_pipe = UNIT(s)->manager->idle_pipe;
@@ -2448,6 +2506,13 @@ static int service_serialize(Unit *u, FILE *f, FDSet *fds) {
         if (r < 0)
                 return r;
 
+        /* Until we picked the page up again, possibly as a binary which doesn't know about it, the service shall
+         * send datagrams */
+        watchdog_shm_set_acked(s->watchdog_shm_page, false);
+        r = unit_serialize_item_fd(u, f, fds, "watchdog-shm-fd", s->watchdog_shm_fd);
+        if (r < 0)
+                return r;
+
         LIST_FOREACH(fd_store, fs, s->fd_store) {
                 _cleanup_free_ char *c = NULL;
                 int copy;
@@ -2682,6 +2747,16 @@ static int service_deserialize_item(Unit *u, const char *key, const char *value,
                         asynchronous_close(s->socket_fd);
                         s->socket_fd = fdset_remove(fds, fd);
                 }
+        } else if (streq(key, "watchdog-shm-fd")) {
+                int fd;
+
+                if (safe_atoi(value, &fd) < 0 || fd < 0 || !fdset_contains(fds, fd))
+                        log_unit_warning(u, "Failed to parse watchdog-shm-fd value, service will fall back to datagrams: %s", value);
+                else {
+                        r = service_add_watchdog_shm(s, fdset_remove(fds, fd));
+                        if (r < 0)
+                                log_unit_warning_errno(u, r, "Failed to map watchdog page, service will fall back to datagrams: %m");
+                }
         } else if (streq(key, "fd-store-fd")) {
                 const char *fdv;
                 size_t pf;
@@ -2932,12 +3007,8 @@ fail:
         return 0;
 }
 
-static void service_notify_cgroup_empty_event(Unit *u) {
-        Service *s = SERVICE(u);
-
-        assert(u);
-
-        log_unit_debug(u, "cgroup is empty");
+static void service_notify_processes_gone(Service *s) {
+        assert(s);
 
         switch (s->state) {
 
@@ -2963,7 +3034,7 @@ static void service_notify_cgroup_empty_event(Unit *u) {
                     control_pid_good(s) == 0) {
 
                         /* Give up hoping for the daemon to write its PID file */
-                        log_unit_warning(u, "Daemon never wrote its PID file. Failing.");
+                        log_unit_warning(UNIT(s), "Daemon never wrote its PID file. Failing.");
 
                         service_unwatch_pid_file(s);
                         if (s->state == SERVICE_START)
@@ -3000,6 +3071,32 @@ static void service_notify_cgroup_empty_event(Unit *u) {
         }
 }
 
+static void service_notify_cgroup_empty_event(Unit *u) {
+        assert(u);
+
+        log_unit_debug(u, "cgroup is empty");
+        service_notify_processes_gone(SERVICE(u));
+}
+
+static void service_pid_gone_event(Unit *u, pid_t pid) {
+        Service *s = SERVICE(u);
+
+        assert(s);
+
+        /* A process we are not the parent of exited, hence we don't know how. Only the main PID may be such a
+         * process, our control processes are always our children. Without a status, there's nothing more to
+         * go by than there is when the cgroup runs empty, hence let's handle it the same way. */
+
+        if (pid == s->main_pid) {
+                log_unit_debug(u, "Main process exited, status unknown.");
+                service_unwatch_main_pid(s);
+                service_notify_processes_gone(s);
+        }
+
+        (void) unit_rewatch_pids(u, s->main_pid, s->control_pid);
+        (void) unit_synthesize_cgroup_empty_event(u);
+}
+
 static void service_sigchld_event(Unit *u, pid_t pid, int code, int status) {
         bool notify_dbus = true;
         Service *s = SERVICE(u);
@@ -3290,8 +3387,7 @@ static void service_sigchld_event(Unit *u, pid_t pid, int code, int status) {
         /* If we get a SIGCHLD event for one of the processes we were interested in, then we look for others to watch,
          * under the assumption that we'll sooner or later get a SIGCHLD for them, as the original process we watched
          * was probably the parent of them, and they are hence now our children. */
-        unit_tidy_watch_pids(u, s->main_pid, s->control_pid);
-        unit_watch_all_pids(u);
+        (void) unit_rewatch_pids(u, s->main_pid, s->control_pid);
 
         /* If the PID set is empty now, then let's check if the cgroup is empty too and finish off the unit. */
         unit_synthesize_cgroup_empty_event(u);
@@ -3402,6 +3498,12 @@ static int service_dispatch_watchdog(sd_event_source *source, usec_t usec, void
         assert(s);
         assert(source == s->watchdog_event_source);
 
+        /* If the service pings us through shared memory, this is the only place we notice */
+        if (service_watchdog_shm_pinged(s)) {
+                service_start_watchdog(s);
+                return 0;
+        }
+
         watchdog_usec = service_get_watchdog_usec(s);
 
         if (UNIT(s)->manager->service_watchdogs) {
@@ -3587,6 +3689,25 @@ static void service_notify_message(
                         service_extend_timeout(s, extend_timeout_usec);
         }
 
+        /* Interpret WATCHDOG_SHM= */
+        if (strv_find(tags, "WATCHDOG_SHM=1")) {
+                int fd;
+
+                fd = fdset_steal_first(fds);
+                if (!s->watchdog_shm || s->watchdog_usec == 0 || ucred->pid != s->main_pid)
+                        log_unit_warning(u, "Got WATCHDOG_SHM=1, but shared memory watchdog is not enabled or sender is not the main process, ignoring.");
+                else if (fd < 0)
+                        log_unit_warning(u, "Got WATCHDOG_SHM=1, but no file descriptor was passed, ignoring.");
+                else {
+                        r = service_add_watchdog_shm(s, fd);
+                        if (r < 0)
+                                log_unit_warning_errno(u, r, "Failed to map watchdog page, ignoring: %m");
+                        fd = -1;
+                }
+
+                safe_close(fd);
+        }
+
         /* Interpret WATCHDOG= */
         if (strv_find(tags, "WATCHDOG=1"))
                 service_reset_watchdog(s);
@@ -3922,6 +4043,7 @@ const UnitVTable service_vtable = {
         .check_gc = service_check_gc,
 
         .sigchld_event = service_sigchld_event,
+        .pid_gone_event = service_pid_gone_event,
 
         .reset_failed = service_reset_failed,
 
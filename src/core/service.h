@@ -27,6 +27,7 @@ typedef struct ServiceFDStore ServiceFDStore;
 #include "kill.h"
 #include "path.h"
 #include "ratelimit.h"
+#include "watchdog-shm.h"
 
 typedef enum ServiceRestart {
         SERVICE_RESTART_NO,
@@ -120,6 +121,11 @@ struct Service {
         bool watchdog_override_enable;
         sd_event_source *watchdog_event_source;
 
+        /* Keep-alive page passed in by the main process with WATCHDOG_SHM=1, if WatchdogSharedMemory= is on */
+        bool watchdog_shm;
+        int watchdog_shm_fd;
+        WatchdogShm *watchdog_shm_page;
+
         ExecCommand* exec_command[_SERVICE_EXEC_COMMAND_MAX];
 
         ExecContext exec_context;
@@ -62,6 +62,9 @@
 #include "unit.h"
 #include "user-util.h"
 
+/* How many pending connections of an Accept=yes socket to accept per wake-up */
+#define SOCKET_ACCEPT_BATCH_MAX 16U
+
 struct SocketPeer {
         unsigned n_ref;
 
@@ -189,6 +192,7 @@ static void socket_done(Unit *u) {
         s->fdname = mfree(s->fdname);
 
         s->timer_event_source = sd_event_source_unref(s->timer_event_source);
+        s->instantiate_event_source = sd_event_source_unref(s->instantiate_event_source);
 }
 
 static int socket_arm_timer(Socket *s, usec_t usec) {
@@ -255,6 +259,81 @@ int socket_instantiate_service(Socket *s) {
         return unit_add_two_dependencies(UNIT(s), UNIT_BEFORE, UNIT_TRIGGERS, u, false, UNIT_DEPENDENCY_IMPLICIT);
 }
 
+static int socket_dispatch_instantiate_service(sd_event_source *source, void *userdata) {
+        Socket *s = userdata;
+        int r;
+
+        assert(s);
+
+        if (s->state != SOCKET_LISTENING)
+                return 0;
+
+        r = socket_instantiate_service(s);
+        if (r < 0)
+                log_unit_debug_errno(UNIT(s), r, "Failed to prepare service for next connection, will retry when it comes in: %m");
+
+        return 0;
+}
+
+static void socket_schedule_instantiate_service(Socket *s) {
+        int r;
+
+        assert(s);
+
+        /* Loading the instance of the template service is the most expensive part of handling a new connection
+         * for Accept=yes sockets. Do it ahead of time for the next connection, but only when there's nothing more
+         * important to do, so that bursts of connections are not slowed down further. If the connection comes in
+         * before that happened, socket_enter_running() simply loads the service synchronously. */
+
+        if (s->instantiate_event_source) {
+                r = sd_event_source_set_enabled(s->instantiate_event_source, SD_EVENT_ONESHOT);
+                if (r < 0)
+                        log_unit_debug_errno(UNIT(s), r, "Failed to enable service preparation event source, ignoring: %m");
+                return;
+        }
+
+        r = sd_event_add_defer(UNIT(s)->manager->event, &s->instantiate_event_source, socket_dispatch_instantiate_service, s);
+        if (r < 0) {
+                log_unit_debug_errno(UNIT(s), r, "Failed to add service preparation event source, ignoring: %m");
+                return;
+        }
+
+        r = sd_event_source_set_priority(s->instantiate_event_source, SD_EVENT_PRIORITY_IDLE);
+        if (r < 0)
+                log_unit_debug_errno(UNIT(s), r, "Failed to adjust service preparation event source priority, ignoring: %m");
+
+        (void) sd_event_source_set_description(s->instantiate_event_source, "socket-instantiate-service");
+}
+
+unsigned socket_get_backlog(Socket *s) {
+        SocketPort *p;
+        unsigned n = 0;
+
+        assert(s);
+
+        /* Returns the number of connections currently waiting to be accepted on the TCP listening sockets. For
+         * sockets in LISTEN state the kernel reports the accept queue length in tcpi_unacked. */
+
+        LIST_FOREACH(port, p, s->ports) {
+                struct tcp_info info = {};
+                socklen_t l = sizeof(info);
+
+                if (p->fd < 0 || p->type != SOCKET_SOCKET)
+                        continue;
+
+                if (!IN_SET(socket_address_family(&p->address), AF_INET, AF_INET6) ||
+                    p->address.type != SOCK_STREAM)
+                        continue;
+
+                if (getsockopt(p->fd, IPPROTO_TCP, TCP_INFO, &info, &l) < 0)
+                        continue;
+
+                n += info.tcpi_unacked;
+        }
+
+        return n;
+}
+
 static bool have_non_accept_socket(Socket *s) {
         SocketPort *p;
 
@@ -712,16 +791,24 @@ static void socket_dump(Unit *u, FILE *f, const char *prefix) {
                         "%sBindToDevice: %s\n",
                         prefix, s->bind_to_device);
 
-        if (s->accept)
+        if (s->accept) {
+                char latency[FORMAT_TIMESPAN_MAX], latency_max[FORMAT_TIMESPAN_MAX];
+
                 fprintf(f,
                         "%sAccepted: %u\n"
                         "%sNConnections: %u\n"
+                        "%sNRefused: %u\n"
                         "%sMaxConnections: %u\n"
-                        "%sMaxConnectionsPerSource: %u\n",
+                        "%sMaxConnectionsPerSource: %u\n"
+                        "%sAcceptLatency: %s (max %s)\n",
                         prefix, s->n_accepted,
                         prefix, s->n_connections,
+                        prefix, s->n_refused,
                         prefix, s->max_connections,
-                        prefix, s->max_connections_per_source);
+                        prefix, s->max_connections_per_source,
+                        prefix, format_timespan(latency, sizeof(latency), s->accept_latency_usec, 1),
+                        format_timespan(latency_max, sizeof(latency_max), s->accept_latency_max_usec, 1));
+        }
 
         if (s->priority >= 0)
                 fprintf(f,
@@ -2283,7 +2370,7 @@ static void socket_enter_running(Socket *s, int cfd) {
 
                 /* If there's already a start pending don't bother to
                  * do anything */
-                HASHMAP_FOREACH_KEY(v, other, UNIT(s)->dependencies[UNIT_TRIGGERS], i)
+                UNIT_DEPENDENCY_SET_FOREACH(v, other, UNIT(s)->dependencies[UNIT_TRIGGERS], i)
                         if (unit_active_or_pending(other)) {
                                 pending = true;
                                 break;
@@ -2310,6 +2397,7 @@ static void socket_enter_running(Socket *s, int cfd) {
                 if (s->n_connections >= s->max_connections) {
                         log_unit_warning(UNIT(s), "Too many incoming connections (%u), dropping connection.",
                                          s->n_connections);
+                        s->n_refused++;
                         safe_close(cfd);
                         return;
                 }
@@ -2327,6 +2415,7 @@ static void socket_enter_running(Socket *s, int cfd) {
                                 log_unit_warning(UNIT(s),
                                                  "Too many incoming connections (%u) from source %s, dropping connection.",
                                                  p->n_ref, strnull(t));
+                                s->n_refused++;
                                 safe_close(cfd);
                                 return;
                         }
@@ -2384,6 +2473,10 @@ static void socket_enter_running(Socket *s, int cfd) {
                         goto fail;
                 }
 
+                /* Load the service for the next connection once things calmed down, so that it is ready when
+                 * that connection comes in. */
+                socket_schedule_instantiate_service(s);
+
                 /* Notify clients about changed counters */
                 unit_add_to_dbus_queue(UNIT(s));
         }
@@ -2533,6 +2626,7 @@ static int socket_serialize(Unit *u, FILE *f, FDSet *fds) {
         unit_serialize_item(u, f, "state", socket_state_to_string(s->state));
         unit_serialize_item(u, f, "result", socket_result_to_string(s->result));
         unit_serialize_item_format(u, f, "n-accepted", "%u", s->n_accepted);
+        unit_serialize_item_format(u, f, "n-refused", "%u", s->n_refused);
 
         if (s->control_pid > 0)
                 unit_serialize_item_format(u, f, "control-pid", PID_FMT, s->control_pid);
@@ -2613,6 +2707,13 @@ static int socket_deserialize_item(Unit *u, const char *key, const char *value,
                         log_unit_debug(u, "Failed to parse n-accepted value: %s", value);
                 else
                         s->n_accepted += k;
+        } else if (streq(key, "n-refused")) {
+                unsigned k;
+
+                if (safe_atou(value, &k) < 0)
+                        log_unit_debug(u, "Failed to parse n-refused value: %s", value);
+                else
+                        s->n_refused += k;
         } else if (streq(key, "control-pid")) {
                 pid_t pid;
 
@@ -2847,17 +2948,53 @@ static int socket_accept_do(Socket *s, int fd) {
         return cfd;
 }
 
-static int socket_accept_in_cgroup(Socket *s, SocketPort *p, int fd) {
+static int socket_accept_many(Socket *s, int fd, int *cfds, unsigned n_max) {
+        unsigned n;
+        int cfd;
+
+        assert(s);
+        assert(fd >= 0);
+        assert(cfds);
+        assert(n_max > 0);
+
+        /* Accepts up to n_max pending connections in one go. Failing to accept the first one is an error, after that
+         * we simply stop once the backlog is drained. Returns the number of connection sockets stored in cfds. */
+
+        cfd = socket_accept_do(s, fd);
+        if (cfd < 0)
+                return cfd;
+
+        cfds[0] = cfd;
+
+        for (n = 1; n < n_max; n++) {
+                cfd = socket_accept_do(s, fd);
+                if (cfd < 0) {
+                        if (cfd != -EAGAIN)
+                                log_unit_debug_errno(UNIT(s), cfd, "Failed to accept further connection socket, ignoring: %m");
+                        break;
+                }
+
+                cfds[n] = cfd;
+        }
+
+        return (int) n;
+}
+
+static int socket_accept_in_cgroup(Socket *s, SocketPort *p, int fd, int *cfds, unsigned n_max) {
         _cleanup_close_pair_ int pair[2] = { -1, -1 };
+        unsigned n, k;
         int cfd, r;
         pid_t pid;
 
         assert(s);
         assert(p);
         assert(fd >= 0);
+        assert(cfds);
+        assert(n_max > 0);
 
         /* Similar to socket_address_listen_in_cgroup(), but for accept() rathern than socket(): make sure that any
-         * connection socket is also properly associated with the cgroup. */
+         * connection socket is also properly associated with the cgroup. Up to n_max pending connections are
+         * accepted at once, so that a burst of connections does not cost a helper process each. */
 
         if (!IN_SET(p->address.sockaddr.sa.sa_family, AF_INET, AF_INET6))
                 goto shortcut;
@@ -2879,42 +3016,62 @@ static int socket_accept_in_cgroup(Socket *s, SocketPort *p, int fd) {
 
                 pair[0] = safe_close(pair[0]);
 
-                cfd = socket_accept_do(s, fd);
-                if (cfd < 0) {
-                        log_unit_error_errno(UNIT(s), cfd, "Failed to accept connection socket: %m");
+                r = socket_accept_many(s, fd, cfds, n_max);
+                if (r < 0) {
+                        log_unit_error_errno(UNIT(s), r, "Failed to accept connection socket: %m");
                         _exit(EXIT_FAILURE);
                 }
 
-                r = send_one_fd(pair[1], cfd, 0);
-                if (r < 0) {
-                        log_unit_error_errno(UNIT(s), r, "Failed to send connection socket to parent: %m");
-                        _exit(EXIT_FAILURE);
+                for (k = 0; k < (unsigned) r; k++) {
+                        r = send_one_fd(pair[1], cfds[k], 0);
+                        if (r < 0) {
+                                log_unit_error_errno(UNIT(s), r, "Failed to send connection socket to parent: %m");
+                                _exit(EXIT_FAILURE);
+                        }
                 }
 
                 _exit(EXIT_SUCCESS);
         }
 
         pair[1] = safe_close(pair[1]);
-        cfd = receive_one_fd(pair[0], 0);
+
+        /* Collect connection sockets until the helper closes its end */
+        for (n = 0; n < n_max; n++) {
+                cfd = receive_one_fd(pair[0], 0);
+                if (cfd < 0)
+                        break;
+
+                cfds[n] = cfd;
+        }
 
         /* We synchronously wait for the helper, as it shouldn't be slow */
         r = wait_for_terminate_and_check("(sd-accept)", pid, WAIT_LOG_ABNORMAL);
         if (r < 0) {
-                safe_close(cfd);
+                close_many(cfds, n);
                 return r;
         }
 
-        if (cfd < 0)
+        if (n == 0)
                 return log_unit_error_errno(UNIT(s), cfd, "Failed to receive connection socket: %m");
 
-        return cfd;
+        return (int) n;
 
 shortcut:
-        cfd = socket_accept_do(s, fd);
-        if (cfd < 0)
-                return log_unit_error_errno(UNIT(s), cfd, "Failed to accept connection socket: %m");
+        r = socket_accept_many(s, fd, cfds, n_max);
+        if (r < 0)
+                return log_unit_error_errno(UNIT(s), r, "Failed to accept connection socket: %m");
 
-        return cfd;
+        return r;
+}
+
+static void socket_update_accept_latency(Socket *s, usec_t wakeup) {
+        usec_t n;
+
+        assert(s);
+
+        n = now(CLOCK_MONOTONIC);
+        s->accept_latency_usec = n > wakeup ? n - wakeup : 0;
+        s->accept_latency_max_usec = MAX(s->accept_latency_max_usec, s->accept_latency_usec);
 }
 
 static int socket_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
@@ -2942,11 +3099,41 @@ static int socket_dispatch_io(sd_event_source *source, int fd, uint32_t revents,
             p->type == SOCKET_SOCKET &&
             socket_address_can_accept(&p->address)) {
 
-                cfd = socket_accept_in_cgroup(p->socket, p, fd);
-                if (cfd < 0)
+                Socket *s = p->socket;
+                int cfds[SOCKET_ACCEPT_BATCH_MAX];
+                unsigned n, n_max, k;
+                usec_t wakeup;
+                int r;
+
+                /* Drain as much of the backlog as we may start services for in one wake-up, but at least one
+                 * connection, so that excess connections are refused as before. */
+                n_max = s->max_connections > s->n_connections ? s->max_connections - s->n_connections : 1;
+                n_max = MIN(n_max, SOCKET_ACCEPT_BATCH_MAX);
+
+                if (sd_event_now(UNIT(s)->manager->event, CLOCK_MONOTONIC, &wakeup) < 0)
+                        wakeup = now(CLOCK_MONOTONIC);
+
+                r = socket_accept_in_cgroup(s, p, fd, cfds, n_max);
+                if (r < 0)
                         goto fail;
+                n = r;
+
+                if (n > 1)
+                        log_unit_debug(UNIT(s), "Accepted %u connections at once.", n);
 
-                socket_apply_socket_options(p->socket, cfd);
+                for (k = 0; k < n; k++) {
+                        /* Starting a service for a previous connection might have failed and stopped us */
+                        if (s->state != SOCKET_LISTENING) {
+                                close_many(cfds + k, n - k);
+                                break;
+                        }
+
+                        socket_apply_socket_options(s, cfds[k]);
+                        socket_enter_running(s, cfds[k]);
+                        socket_update_accept_latency(s, wakeup);
+                }
+
+                return 0;
         }
 
         socket_enter_running(p->socket, cfd);
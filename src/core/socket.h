@@ -85,6 +85,7 @@ struct Socket {
 
         unsigned n_accepted;
         unsigned n_connections;
+        unsigned n_refused;
         unsigned max_connections;
         unsigned max_connections_per_source;
 
@@ -112,6 +113,14 @@ struct Socket {
 
         sd_event_source *timer_event_source;
 
+        /* For Accept=yes sockets, prepares the next connection service while we are idle */
+        sd_event_source *instantiate_event_source;
+
+        /* How long it took from wake-up until the start job for the last and the slowest accepted connection
+         * was queued */
+        usec_t accept_latency_usec;
+        usec_t accept_latency_max_usec;
+
         ExecCommand* control_command;
         SocketExecCommand control_command_id;
         pid_t control_pid;
@@ -183,6 +192,8 @@ void socket_free_ports(Socket *s);
 
 int socket_instantiate_service(Socket *s);
 
+unsigned socket_get_backlog(Socket *s);
+
 char *socket_fdname(Socket *s);
 
 extern const UnitVTable socket_vtable;
@@ -73,7 +73,7 @@ static int target_add_default_dependencies(Target *t) {
                 Iterator i;
                 void *v;
 
-                HASHMAP_FOREACH_KEY(v, other, UNIT(t)->dependencies[deps[k]], i) {
+                UNIT_DEPENDENCY_SET_FOREACH(v, other, UNIT(t)->dependencies[deps[k]], i) {
                         r = unit_add_default_target_dependency(other, UNIT(t));
                         if (r < 0)
                                 return r;
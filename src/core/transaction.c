@@ -302,12 +302,17 @@ static void transaction_drop_redundant(Transaction *tr) {
 
         /* Goes through the transaction and removes all jobs of the units
          * whose jobs are all noops. If not all of a unit's jobs are
-         * redundant, they are kept. */
+         * redundant, they are kept.
+         *
+         * Whether a job is redundant does not depend on any other job in
+         * the transaction, and deleting jobs without their dependencies
+         * only touches the entry of the unit we are looking at, hence a
+         * single pass is enough. */
 
         assert(tr);
 
-rescan:
         HASHMAP_FOREACH(j, tr->jobs, i) {
+                Unit *u = j->unit;
                 Job *k;
 
                 LIST_FOREACH(transaction, k, j) {
@@ -319,8 +324,8 @@ rescan:
                 }
 
                 /* log_debug("Found redundant job %s/%s, dropping.", j->unit->id, job_type_to_string(j->type)); */
-                transaction_delete_job(tr, j, false);
-                goto rescan;
+                while ((k = hashmap_get(tr->jobs, u)))
+                        transaction_delete_job(tr, k, false);
         next_unit:;
         }
 }
@@ -453,7 +458,7 @@ static int transaction_verify_order_one(Transaction *tr, Job *j, Job *from, unsi
 
         /* We assume that the dependencies are bidirectional, and
          * hence can ignore UNIT_AFTER */
-        HASHMAP_FOREACH_KEY(v, u, j->unit->dependencies[UNIT_BEFORE], i) {
+        UNIT_DEPENDENCY_SET_FOREACH(v, u, j->unit->dependencies[UNIT_BEFORE], i) {
                 Job *o;
 
                 /* Is there a job for this unit? */
@@ -502,16 +507,34 @@ static int transaction_verify_order(Transaction *tr, unsigned *generation, sd_bu
         return 0;
 }
 
-static void transaction_collect_garbage(Transaction *tr) {
+static int transaction_collect_garbage(Transaction *tr) {
+        _cleanup_set_free_ Set *todo = NULL;
         Iterator i;
         Job *j;
 
         assert(tr);
 
-        /* Drop jobs that are not required by any other job */
+        /* Drop jobs that are not required by any other job. Dropping a
+         * job might leave the jobs it required unneeded too, hence
+         * instead of rescanning the whole transaction after each
+         * deletion we keep a work set of the jobs that need to be
+         * (re-)checked. Like the scan over tr->jobs, only the first
+         * job of each unit is considered. */
+
+        todo = set_new(NULL);
+        if (!todo)
+                return -ENOMEM;
+
+        HASHMAP_FOREACH(j, tr->jobs, i)
+                if (set_put(todo, j) < 0)
+                        return -ENOMEM;
+
+        while ((j = set_steal_first(todo))) {
+                JobDependency *l;
+
+                if (j->transaction_prev)
+                        continue;
 
-rescan:
-        HASHMAP_FOREACH(j, tr->jobs, i) {
                 if (tr->anchor_job == j || j->object_list) {
                         /* log_debug("Keeping job %s/%s because of %s/%s", */
                         /*           j->unit->id, job_type_to_string(j->type), */
@@ -520,10 +543,20 @@ rescan:
                         continue;
                 }
 
+                /* The jobs this one requires, and the job that becomes the first one of the unit, need to be
+                 * looked at again. Since the job has no object list, deleting it frees no other job. */
+                LIST_FOREACH(subject, l, j->subject_list)
+                        if (set_put(todo, l->object) < 0)
+                                return -ENOMEM;
+
+                if (j->transaction_next && set_put(todo, j->transaction_next) < 0)
+                        return -ENOMEM;
+
                 /* log_debug("Garbage collecting job %s/%s", j->unit->id, job_type_to_string(j->type)); */
                 transaction_delete_job(tr, j, true);
-                goto rescan;
         }
+
+        return 0;
 }
 
 static int transaction_is_destructive(Transaction *tr, JobMode mode, sd_bus_error *e) {
@@ -704,8 +737,11 @@ int transaction_activate(Transaction *tr, Manager *m, JobMode mode, sd_bus_error
         for (;;) {
                 /* Fourth step: Let's remove unneeded jobs that might
                  * be lurking. */
-                if (mode != JOB_ISOLATE)
-                        transaction_collect_garbage(tr);
+                if (mode != JOB_ISOLATE) {
+                        r = transaction_collect_garbage(tr);
+                        if (r < 0)
+                                return r;
+                }
 
                 /* Fifth step: verify order makes sense and correct
                  * cycles if necessary and possible */
@@ -737,8 +773,11 @@ int transaction_activate(Transaction *tr, Manager *m, JobMode mode, sd_bus_error
 
                 /* Seventh step: an entry got dropped, let's garbage
                  * collect its dependencies. */
-                if (mode != JOB_ISOLATE)
-                        transaction_collect_garbage(tr);
+                if (mode != JOB_ISOLATE) {
+                        r = transaction_collect_garbage(tr);
+                        if (r < 0)
+                                return r;
+                }
 
                 /* Let's see if the resulting transaction still has
                  * unmergeable entries ... */
@@ -869,7 +908,7 @@ void transaction_add_propagate_reload_jobs(Transaction *tr, Unit *unit, Job *by,
         assert(tr);
         assert(unit);
 
-        HASHMAP_FOREACH_KEY(v, dep, unit->dependencies[UNIT_PROPAGATES_RELOAD_TO], i) {
+        UNIT_DEPENDENCY_SET_FOREACH(v, dep, unit->dependencies[UNIT_PROPAGATES_RELOAD_TO], i) {
                 nt = job_type_collapse(JOB_TRY_RELOAD, dep);
                 if (nt == JOB_NOP)
                         continue;
@@ -973,7 +1012,7 @@ int transaction_add_job_and_dependencies(
 
                 /* Finally, recursively add in all dependencies. */
                 if (IN_SET(type, JOB_START, JOB_RESTART)) {
-                        HASHMAP_FOREACH_KEY(v, dep, ret->unit->dependencies[UNIT_REQUIRES], i) {
+                        UNIT_DEPENDENCY_SET_FOREACH(v, dep, ret->unit->dependencies[UNIT_REQUIRES], i) {
                                 r = transaction_add_job_and_dependencies(tr, JOB_START, dep, ret, true, false, false, ignore_order, e);
                                 if (r < 0) {
                                         if (r != -EBADR) /* job type not applicable */
@@ -983,7 +1022,7 @@ int transaction_add_job_and_dependencies(
                                 }
                         }
 
-                        HASHMAP_FOREACH_KEY(v, dep, ret->unit->dependencies[UNIT_BINDS_TO], i) {
+                        UNIT_DEPENDENCY_SET_FOREACH(v, dep, ret->unit->dependencies[UNIT_BINDS_TO], i) {
                                 r = transaction_add_job_and_dependencies(tr, JOB_START, dep, ret, true, false, false, ignore_order, e);
                                 if (r < 0) {
                                         if (r != -EBADR) /* job type not applicable */
@@ -993,7 +1032,7 @@ int transaction_add_job_and_dependencies(
                                 }
                         }
 
-                        HASHMAP_FOREACH_KEY(v, dep, ret->unit->dependencies[UNIT_WANTS], i) {
+                        UNIT_DEPENDENCY_SET_FOREACH(v, dep, ret->unit->dependencies[UNIT_WANTS], i) {
                                 r = transaction_add_job_and_dependencies(tr, JOB_START, dep, ret, false, false, false, ignore_order, e);
                                 if (r < 0) {
                                         /* unit masked, job type not applicable and unit not found are not considered as errors. */
@@ -1005,7 +1044,7 @@ int transaction_add_job_and_dependencies(
                                 }
                         }
 
-                        HASHMAP_FOREACH_KEY(v, dep, ret->unit->dependencies[UNIT_REQUISITE], i) {
+                        UNIT_DEPENDENCY_SET_FOREACH(v, dep, ret->unit->dependencies[UNIT_REQUISITE], i) {
                                 r = transaction_add_job_and_dependencies(tr, JOB_VERIFY_ACTIVE, dep, ret, true, false, false, ignore_order, e);
                                 if (r < 0) {
                                         if (r != -EBADR) /* job type not applicable */
@@ -1015,7 +1054,7 @@ int transaction_add_job_and_dependencies(
                                 }
                         }
 
-                        HASHMAP_FOREACH_KEY(v, dep, ret->unit->dependencies[UNIT_CONFLICTS], i) {
+                        UNIT_DEPENDENCY_SET_FOREACH(v, dep, ret->unit->dependencies[UNIT_CONFLICTS], i) {
                                 r = transaction_add_job_and_dependencies(tr, JOB_STOP, dep, ret, true, true, false, ignore_order, e);
                                 if (r < 0) {
                                         if (r != -EBADR) /* job type not applicable */
@@ -1025,7 +1064,7 @@ int transaction_add_job_and_dependencies(
                                 }
                         }
 
-                        HASHMAP_FOREACH_KEY(v, dep, ret->unit->dependencies[UNIT_CONFLICTED_BY], i) {
+                        UNIT_DEPENDENCY_SET_FOREACH(v, dep, ret->unit->dependencies[UNIT_CONFLICTED_BY], i) {
                                 r = transaction_add_job_and_dependencies(tr, JOB_STOP, dep, ret, false, false, false, ignore_order, e);
                                 if (r < 0) {
                                         log_unit_warning(dep,
@@ -1054,7 +1093,7 @@ int transaction_add_job_and_dependencies(
                         ptype = type == JOB_RESTART ? JOB_TRY_RESTART : type;
 
                         for (j = 0; j < ELEMENTSOF(propagate_deps); j++)
-                                HASHMAP_FOREACH_KEY(v, dep, ret->unit->dependencies[propagate_deps[j]], i) {
+                                UNIT_DEPENDENCY_SET_FOREACH(v, dep, ret->unit->dependencies[propagate_deps[j]], i) {
                                         JobType nt;
 
                                         nt = job_type_collapse(ptype, dep);
@@ -0,0 +1,330 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "alloc-util.h"
+#include "unit-dependency-set.h"
+
+UnitDependencySet* unit_dependency_set_free(UnitDependencySet *s) {
+        if (!s)
+                return NULL;
+
+        hashmap_free(s->index);
+        return mfree(s);
+}
+
+static int unit_dependency_set_find(const UnitDependencySet *s, Unit *u) {
+        unsigned k;
+
+        assert(u);
+
+        if (!s)
+                return -ENOENT;
+
+        if (s->index) {
+                void *p;
+
+                p = hashmap_get(s->index, u);
+                if (!p)
+                        return -ENOENT;
+
+                return PTR_TO_UINT(p) - 1;
+        }
+
+        for (k = 0; k < s->n_entries; k++)
+                if (s->entries[k].unit == u)
+                        return (int) k;
+
+        return -ENOENT;
+}
+
+void *unit_dependency_set_get(const UnitDependencySet *s, Unit *u) {
+        int r;
+
+        assert(u);
+
+        r = unit_dependency_set_find(s, u);
+        if (r < 0)
+                return NULL;
+
+        return s->entries[r].info.data;
+}
+
+static int unit_dependency_set_build_index(UnitDependencySet *s, unsigned n_add) {
+        unsigned k;
+        int r;
+
+        assert(s);
+
+        if (s->index)
+                return hashmap_reserve(s->index, n_add);
+
+        if (s->n_entries + n_add < UNIT_DEPENDENCY_SET_INDEX_MIN)
+                return 0;
+
+        s->index = hashmap_new(NULL);
+        if (!s->index)
+                return -ENOMEM;
+
+        r = hashmap_reserve(s->index, s->n_entries + n_add);
+        if (r < 0)
+                goto fail;
+
+        for (k = 0; k < s->n_entries; k++) {
+                r = hashmap_put(s->index, s->entries[k].unit, UINT_TO_PTR(k + 1));
+                if (r < 0)
+                        goto fail;
+        }
+
+        return 0;
+
+fail:
+        s->index = hashmap_free(s->index);
+        return r;
+}
+
+int unit_dependency_set_reserve(UnitDependencySet **s, unsigned n_add) {
+        UnitDependencySet *n;
+        unsigned n_entries, need, a;
+
+        /* Makes sure that up to n_add new entries may be added to the set via unit_dependency_set_put() without
+         * that failing. */
+
+        assert(s);
+
+        if (n_add == 0)
+                return 0;
+
+        n_entries = unit_dependency_set_size(*s);
+        if (n_entries > UINT_MAX - n_add)
+                return -ENOMEM;
+        need = n_entries + n_add;
+
+        if (!*s || (*s)->n_allocated < need) {
+                a = MAX(need, *s ? (*s)->n_allocated * 2 : 1U);
+
+                n = realloc(*s, offsetof(UnitDependencySet, entries) + a * sizeof(UnitDependencyEntry));
+                if (!n)
+                        return -ENOMEM;
+
+                if (!*s)
+                        *n = (UnitDependencySet) {};
+
+                n->n_allocated = a;
+                *s = n;
+        }
+
+        return unit_dependency_set_build_index(*s, n_add);
+}
+
+int unit_dependency_set_put(UnitDependencySet **s, Unit *u, void *data) {
+        UnitDependencySet *t;
+        int r;
+
+        /* Adds a new entry, mirroring hashmap_put(): returns -EEXIST if the unit is already in the set with a
+         * different value, 0 if it is with the same value and 1 if it was added. */
+
+        assert(s);
+        assert(u);
+
+        r = unit_dependency_set_find(*s, u);
+        if (r >= 0)
+                return (*s)->entries[r].info.data == data ? 0 : -EEXIST;
+
+        r = unit_dependency_set_reserve(s, 1);
+        if (r < 0)
+                return r;
+
+        t = *s;
+        if (t->index)
+                assert_se(hashmap_put(t->index, u, UINT_TO_PTR(t->n_entries + 1)) > 0);
+
+        t->entries[t->n_entries++] = (UnitDependencyEntry) {
+                .unit = u,
+                .info.data = data,
+        };
+
+        return 1;
+}
+
+int unit_dependency_set_update(UnitDependencySet *s, Unit *u, void *data) {
+        int r;
+
+        assert(u);
+
+        r = unit_dependency_set_find(s, u);
+        if (r < 0)
+                return r;
+
+        s->entries[r].info.data = data;
+        return 0;
+}
+
+static void unit_dependency_set_remove_at(UnitDependencySet **s, unsigned k) {
+        UnitDependencySet *t = *s;
+        unsigned last;
+
+        assert(k < t->n_entries);
+
+        if (t->index)
+                assert_se(hashmap_remove(t->index, t->entries[k].unit));
+
+        /* Fill the gap with the last entry. Since iteration goes backwards, that entry has already been visited by
+         * anyone currently iterating through the set and removing the current entry. */
+        last = --t->n_entries;
+        if (k != last) {
+                t->entries[k] = t->entries[last];
+
+                if (t->index)
+                        assert_se(hashmap_update(t->index, t->entries[k].unit, UINT_TO_PTR(k + 1)) == 0);
+        }
+
+        if (t->n_entries == 0)
+                *s = unit_dependency_set_free(t);
+}
+
+void *unit_dependency_set_remove(UnitDependencySet **s, Unit *u) {
+        void *data;
+        int r;
+
+        assert(s);
+        assert(u);
+
+        r = unit_dependency_set_find(*s, u);
+        if (r < 0)
+                return NULL;
+
+        data = (*s)->entries[r].info.data;
+        unit_dependency_set_remove_at(s, r);
+
+        return data;
+}
+
+int unit_dependency_set_remove_and_replace(UnitDependencySet **s, Unit *old_unit, Unit *new_unit, void *data) {
+        UnitDependencySet *t;
+        int r, k;
+
+        /* Like hashmap_remove_and_replace(): removes old_unit and stores data under new_unit instead, dropping
+         * any entry new_unit might have had. Never needs to allocate. */
+
+        assert(s);
+        assert(old_unit);
+        assert(new_unit);
+
+        k = unit_dependency_set_find(*s, old_unit);
+        if (k < 0)
+                return k;
+
+        if (new_unit != old_unit) {
+                r = unit_dependency_set_find(*s, new_unit);
+                if (r >= 0) {
+                        /* The set keeps at least old_unit, hence is not freed here. */
+                        unit_dependency_set_remove_at(s, r);
+
+                        k = unit_dependency_set_find(*s, old_unit);
+                        assert(k >= 0);
+                }
+        }
+
+        t = *s;
+        t->entries[k] = (UnitDependencyEntry) {
+                .unit = new_unit,
+                .info.data = data,
+        };
+
+        if (t->index && new_unit != old_unit)
+                assert_se(hashmap_remove_and_replace(t->index, old_unit, new_unit, UINT_TO_PTR(k + 1)) >= 0);
+
+        return 0;
+}
+
+int unit_dependency_set_complete_move(UnitDependencySet **s, UnitDependencySet **other) {
+        unsigned k;
+        int r;
+
+        /* Moves all entries of other into s, and frees other. If s already has an entry for a unit, the dependency
+         * masks of both entries are combined in it. This cannot fail if room for all entries of other was
+         * reserved in s before. */
+
+        assert(s);
+        assert(other);
+
+        if (!*other)
+                return 0;
+
+        if (!*s) {
+                *s = *other;
+                *other = NULL;
+                return 0;
+        }
+
+        r = unit_dependency_set_reserve(s, (*other)->n_entries);
+        if (r < 0)
+                return r;
+
+        for (k = 0; k < (*other)->n_entries; k++) {
+                const UnitDependencyEntry *e = (*other)->entries + k;
+                UnitDependencyInfo di;
+
+                di.data = unit_dependency_set_get(*s, e->unit);
+                if (di.data) {
+                        di.origin_mask |= e->info.origin_mask;
+                        di.destination_mask |= e->info.destination_mask;
+
+                        assert_se(unit_dependency_set_update(*s, e->unit, di.data) >= 0);
+                } else
+                        assert_se(unit_dependency_set_put(s, e->unit, e->info.data) > 0);
+        }
+
+        *other = unit_dependency_set_free(*other);
+        return 0;
+}
+
+bool unit_dependency_set_iterate(const UnitDependencySet *s, Iterator *i, void **data, Unit **u) {
+        const UnitDependencyEntry *e;
+
+        assert(i);
+
+        if (!s)
+                goto finish;
+
+        /* The set might have shrunk since the last call, if the loop body removed entries. */
+        i->idx = MIN(i->idx, s->n_entries);
+        if (i->idx == 0)
+                goto finish;
+
+        e = s->entries + --i->idx;
+
+        if (data)
+                *data = e->info.data;
+        if (u)
+                *u = e->unit;
+
+        return true;
+
+finish:
+        if (data)
+                *data = NULL;
+        if (u)
+                *u = NULL;
+
+        return false;
+}
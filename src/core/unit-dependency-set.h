@@ -0,0 +1,126 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdbool.h>
+
+#include "hashmap.h"
+#include "macro.h"
+
+typedef struct Unit Unit;
+
+/* Stores the 'reason' a dependency was created as a bit mask, i.e. due to which configuration source it came to be. We
+ * use this so that we can selectively flush out parts of dependencies again. Note that the same dependency might be
+ * created as a result of multiple "reasons", hence the bitmask. */
+typedef enum UnitDependencyMask {
+        /* Configured directly by the unit file, .wants/.requries symlink or drop-in, or as an immediate result of a
+         * non-dependency option configured that way.  */
+        UNIT_DEPENDENCY_FILE               = 1 << 0,
+
+        /* As unconditional implicit dependency (not affected by unit configuration — except by the unit name and
+         * type) */
+        UNIT_DEPENDENCY_IMPLICIT           = 1 << 1,
+
+        /* A dependency effected by DefaultDependencies=yes. Note that dependencies marked this way are conceptually
+         * just a subset of UNIT_DEPENDENCY_FILE, as DefaultDependencies= is itself a unit file setting that can only
+         * be set in unit files. We make this two separate bits only to help debugging how dependencies came to be. */
+        UNIT_DEPENDENCY_DEFAULT            = 1 << 2,
+
+        /* A dependency created from udev rules */
+        UNIT_DEPENDENCY_UDEV               = 1 << 3,
+
+        /* A dependency created because of some unit's RequiresMountsFor= setting */
+        UNIT_DEPENDENCY_PATH               = 1 << 4,
+
+        /* A dependency created because of data read from /proc/self/mountinfo and no other configuration source */
+        UNIT_DEPENDENCY_MOUNTINFO_IMPLICIT = 1 << 5,
+
+        /* A dependency created because of data read from /proc/self/mountinfo, but conditionalized by
+         * DefaultDependencies= and thus also involving configuration from UNIT_DEPENDENCY_FILE sources */
+        UNIT_DEPENDENCY_MOUNTINFO_DEFAULT  = 1 << 6,
+
+        /* A dependency created because of data read from /proc/swaps and no other configuration source */
+        UNIT_DEPENDENCY_PROC_SWAP          = 1 << 7,
+
+        _UNIT_DEPENDENCY_MASK_FULL = (1 << 8) - 1,
+} UnitDependencyMask;
+
+/* The Unit's dependency sets and the requires_mounts_for hashmap use this structure as value. It has the same size as a
+ * void pointer, and thus can be stored directly as hashmap value, without any indirection. Note that this stores two masks, as both the origin
+ * and the destination of a dependency might have created it. */
+typedef union UnitDependencyInfo {
+        void *data;
+        struct {
+                UnitDependencyMask origin_mask:16;
+                UnitDependencyMask destination_mask:16;
+        } _packed_;
+} UnitDependencyInfo;
+
+/* For each dependency type a unit keeps one of these sets, keyed by the Unit* object it points to. Most units only have
+ * a handful of dependencies of each type, hence entries are kept in a flat, unordered array which is cheap to allocate
+ * and to walk. Only once a set grows beyond UNIT_DEPENDENCY_SET_INDEX_MIN entries (think multi-user.target's
+ * Wants= or basic.target's Before=) a hashmap index from Unit* to array position is added to keep lookups O(1). A set
+ * without entries is always represented by NULL. */
+typedef struct UnitDependencyEntry {
+        Unit *unit;
+        UnitDependencyInfo info;
+} UnitDependencyEntry;
+
+typedef struct UnitDependencySet {
+        unsigned n_entries;
+        unsigned n_allocated;
+        Hashmap *index;
+        UnitDependencyEntry entries[];
+} UnitDependencySet;
+
+#define UNIT_DEPENDENCY_SET_INDEX_MIN 16U
+
+UnitDependencySet* unit_dependency_set_free(UnitDependencySet *s);
+
+static inline unsigned unit_dependency_set_size(const UnitDependencySet *s) {
+        return s ? s->n_entries : 0;
+}
+
+static inline bool unit_dependency_set_isempty(const UnitDependencySet *s) {
+        return unit_dependency_set_size(s) == 0;
+}
+
+void *unit_dependency_set_get(const UnitDependencySet *s, Unit *u);
+
+static inline bool unit_dependency_set_contains(const UnitDependencySet *s, Unit *u) {
+        return !!unit_dependency_set_get(s, u);
+}
+
+static inline Unit *unit_dependency_set_first(const UnitDependencySet *s) {
+        return unit_dependency_set_isempty(s) ? NULL : s->entries[0].unit;
+}
+
+int unit_dependency_set_reserve(UnitDependencySet **s, unsigned n_add);
+int unit_dependency_set_put(UnitDependencySet **s, Unit *u, void *data);
+int unit_dependency_set_update(UnitDependencySet *s, Unit *u, void *data);
+void *unit_dependency_set_remove(UnitDependencySet **s, Unit *u);
+int unit_dependency_set_remove_and_replace(UnitDependencySet **s, Unit *old_unit, Unit *new_unit, void *data);
+int unit_dependency_set_complete_move(UnitDependencySet **s, UnitDependencySet **other);
+
+bool unit_dependency_set_iterate(const UnitDependencySet *s, Iterator *i, void **data, Unit **u);
+
+/* Iterates backwards through the set, so that removing the current entry from within the loop body (which moves the
+ * last entry into its place) is safe, in the same way it is for HASHMAP_FOREACH_KEY(). */
+#define UNIT_DEPENDENCY_SET_FOREACH(e, k, s, i) \
+        for ((i) = ITERATOR_FIRST; unit_dependency_set_iterate((s), &(i), (void**)&(e), &(k)); )
@@ -443,6 +443,9 @@ void unit_add_to_dbus_queue(Unit *u) {
         assert(u);
         assert(u->type != _UNIT_TYPE_INVALID);
 
+        /* Always bump the generation, even if the unit is queued already or nobody is subscribed */
+        u->change_generation = ++u->manager->unit_change_generation;
+
         if (u->load_state == UNIT_STUB || u->in_dbus_queue)
                 return;
 
@@ -458,25 +461,25 @@ void unit_add_to_dbus_queue(Unit *u) {
         u->in_dbus_queue = true;
 }
 
-static void bidi_set_free(Unit *u, Hashmap *h) {
+static void bidi_set_free(Unit *u, UnitDependencySet *h) {
         Unit *other;
         Iterator i;
         void *v;
 
         assert(u);
 
-        /* Frees the hashmap and makes sure we are dropped from the inverse pointers */
+        /* Frees the set and makes sure we are dropped from the inverse pointers */
 
-        HASHMAP_FOREACH_KEY(v, other, h, i) {
+        UNIT_DEPENDENCY_SET_FOREACH(v, other, h, i) {
                 UnitDependency d;
 
                 for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++)
-                        hashmap_remove(other->dependencies[d], u);
+                        unit_dependency_set_remove(other->dependencies + d, u);
 
                 unit_add_to_gc_queue(other);
         }
 
-        hashmap_free(h);
+        unit_dependency_set_free(h);
 }
 
 static void unit_remove_transient(Unit *u) {
@@ -661,6 +664,8 @@ void unit_free(Unit *u) {
         bpf_program_unref(u->ip_bpf_ingress);
         bpf_program_unref(u->ip_bpf_egress);
 
+        free(u->accounting_samples);
+
         condition_free_list(u->conditions);
         condition_free_list(u->asserts);
 
@@ -771,9 +776,9 @@ static int reserve_dependencies(Unit *u, Unit *other, UnitDependency d) {
                 return 0;
 
         /* merge_dependencies() will skip a u-on-u dependency */
-        n_reserve = hashmap_size(other->dependencies[d]) - !!hashmap_get(other->dependencies[d], u);
+        n_reserve = unit_dependency_set_size(other->dependencies[d]) - !!unit_dependency_set_get(other->dependencies[d], u);
 
-        return hashmap_reserve(u->dependencies[d], n_reserve);
+        return unit_dependency_set_reserve(u->dependencies + d, n_reserve);
 }
 
 static void merge_dependencies(Unit *u, Unit *other, const char *other_id, UnitDependency d) {
@@ -789,7 +794,7 @@ static void merge_dependencies(Unit *u, Unit *other, const char *other_id, UnitD
         assert(d < _UNIT_DEPENDENCY_MAX);
 
         /* Fix backwards pointers. Let's iterate through all dependendent units of the other unit. */
-        HASHMAP_FOREACH_KEY(v, back, other->dependencies[d], i) {
+        UNIT_DEPENDENCY_SET_FOREACH(v, back, other->dependencies[d], i) {
                 UnitDependency k;
 
                 /* Let's now iterate through the dependencies of that dependencies of the other units, looking for
@@ -798,7 +803,7 @@ static void merge_dependencies(Unit *u, Unit *other, const char *other_id, UnitD
                 for (k = 0; k < _UNIT_DEPENDENCY_MAX; k++) {
                         if (back == u) {
                                 /* Do not add dependencies between u and itself. */
-                                if (hashmap_remove(back->dependencies[k], other))
+                                if (unit_dependency_set_remove(back->dependencies + k, other))
                                         maybe_warn_about_dependency(u, other_id, k);
                         } else {
                                 UnitDependencyInfo di_u, di_other, di_merged;
@@ -807,37 +812,36 @@ static void merge_dependencies(Unit *u, Unit *other, const char *other_id, UnitD
                                  * "back" and "u" instead. Let's merge the bit masks of the dependency we are moving,
                                  * and any such dependency which might already exist */
 
-                                di_other.data = hashmap_get(back->dependencies[k], other);
+                                di_other.data = unit_dependency_set_get(back->dependencies[k], other);
                                 if (!di_other.data)
                                         continue; /* dependency isn't set, let's try the next one */
 
-                                di_u.data = hashmap_get(back->dependencies[k], u);
+                                di_u.data = unit_dependency_set_get(back->dependencies[k], u);
 
                                 di_merged = (UnitDependencyInfo) {
                                         .origin_mask = di_u.origin_mask | di_other.origin_mask,
                                         .destination_mask = di_u.destination_mask | di_other.destination_mask,
                                 };
 
-                                r = hashmap_remove_and_replace(back->dependencies[k], other, u, di_merged.data);
+                                r = unit_dependency_set_remove_and_replace(back->dependencies + k, other, u, di_merged.data);
                                 if (r < 0)
                                         log_warning_errno(r, "Failed to remove/replace: back=%s other=%s u=%s: %m", back->id, other_id, u->id);
                                 assert(r >= 0);
 
-                                /* assert_se(hashmap_remove_and_replace(back->dependencies[k], other, u, di_merged.data) >= 0); */
                         }
                 }
 
         }
 
         /* Also do not move dependencies on u to itself */
-        back = hashmap_remove(other->dependencies[d], u);
+        back = unit_dependency_set_remove(other->dependencies + d, u);
         if (back)
                 maybe_warn_about_dependency(u, other_id, d);
 
         /* The move cannot fail. The caller must have performed a reservation. */
-        assert_se(hashmap_complete_move(&u->dependencies[d], &other->dependencies[d]) == 0);
+        assert_se(unit_dependency_set_complete_move(u->dependencies + d, other->dependencies + d) == 0);
 
-        other->dependencies[d] = hashmap_free(other->dependencies[d]);
+        other->dependencies[d] = unit_dependency_set_free(other->dependencies[d]);
 }
 
 int unit_merge(Unit *u, Unit *other) {
@@ -1235,7 +1239,7 @@ void unit_dump(Unit *u, FILE *f, const char *prefix) {
                 UnitDependencyInfo di;
                 Unit *other;
 
-                HASHMAP_FOREACH_KEY(di.data, other, u->dependencies[d], i) {
+                UNIT_DEPENDENCY_SET_FOREACH(di.data, other, u->dependencies[d], i) {
                         bool space = false;
 
                         fprintf(f, "%s\t%s: %s (", prefix, unit_dependency_to_string(d), other->id);
@@ -1361,7 +1365,7 @@ int unit_add_default_target_dependency(Unit *u, Unit *target) {
                 return 0;
 
         /* Don't create loops */
-        if (hashmap_get(target->dependencies[UNIT_BEFORE], u))
+        if (unit_dependency_set_get(target->dependencies[UNIT_BEFORE], u))
                 return 0;
 
         return unit_add_dependency(target, UNIT_AFTER, u, true, UNIT_DEPENDENCY_DEFAULT);
@@ -1386,7 +1390,7 @@ static int unit_add_target_dependencies(Unit *u) {
                 Iterator i;
                 void *v;
 
-                HASHMAP_FOREACH_KEY(v, target, u->dependencies[deps[k]], i) {
+                UNIT_DEPENDENCY_SET_FOREACH(v, target, u->dependencies[deps[k]], i) {
                         r = unit_add_default_target_dependency(u, target);
                         if (r < 0)
                                 return r;
@@ -1541,7 +1545,7 @@ int unit_load(Unit *u) {
                 if (r < 0)
                         goto fail;
 
-                if (u->on_failure_job_mode == JOB_ISOLATE && hashmap_size(u->dependencies[UNIT_ON_FAILURE]) > 1) {
+                if (u->on_failure_job_mode == JOB_ISOLATE && unit_dependency_set_size(u->dependencies[UNIT_ON_FAILURE]) > 1) {
                         log_unit_error(u, "More than one OnFailure= dependencies specified but OnFailureJobMode=isolate set. Refusing.");
                         r = -EINVAL;
                         goto fail;
@@ -1765,9 +1769,9 @@ static bool unit_verify_deps(Unit *u) {
          * processing, but do not have any effect afterwards. We don't check BindsTo= dependencies that are not used in
          * conjunction with After= as for them any such check would make things entirely racy. */
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_BINDS_TO], j) {
+        UNIT_DEPENDENCY_SET_FOREACH(v, other, u->dependencies[UNIT_BINDS_TO], j) {
 
-                if (!hashmap_contains(u->dependencies[UNIT_AFTER], other))
+                if (!unit_dependency_set_contains(u->dependencies[UNIT_AFTER], other))
                         continue;
 
                 if (!UNIT_IS_ACTIVE_OR_RELOADING(unit_active_state(other))) {
@@ -1970,7 +1974,7 @@ bool unit_can_reload(Unit *u) {
         if (UNIT_VTABLE(u)->can_reload)
                 return UNIT_VTABLE(u)->can_reload(u);
 
-        if (!hashmap_isempty(u->dependencies[UNIT_PROPAGATES_RELOAD_TO]))
+        if (!unit_dependency_set_isempty(u->dependencies[UNIT_PROPAGATES_RELOAD_TO]))
                 return true;
 
         return UNIT_VTABLE(u)->reload;
@@ -2006,7 +2010,7 @@ static void unit_check_unneeded(Unit *u) {
                 Iterator i;
                 void *v;
 
-                HASHMAP_FOREACH_KEY(v, other, u->dependencies[needed_dependencies[j]], i)
+                UNIT_DEPENDENCY_SET_FOREACH(v, other, u->dependencies[needed_dependencies[j]], i)
                         if (unit_active_or_pending(other) || unit_will_restart(other))
                                 return;
         }
@@ -2043,7 +2047,7 @@ static void unit_check_binds_to(Unit *u) {
         if (unit_active_state(u) != UNIT_ACTIVE)
                 return;
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_BINDS_TO], i) {
+        UNIT_DEPENDENCY_SET_FOREACH(v, other, u->dependencies[UNIT_BINDS_TO], i) {
                 if (other->job)
                         continue;
 
@@ -2086,26 +2090,26 @@ static void retroactively_start_dependencies(Unit *u) {
         assert(u);
         assert(UNIT_IS_ACTIVE_OR_ACTIVATING(unit_active_state(u)));
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_REQUIRES], i)
-                if (!hashmap_get(u->dependencies[UNIT_AFTER], other) &&
+        UNIT_DEPENDENCY_SET_FOREACH(v, other, u->dependencies[UNIT_REQUIRES], i)
+                if (!unit_dependency_set_get(u->dependencies[UNIT_AFTER], other) &&
                     !UNIT_IS_ACTIVE_OR_ACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_START, other, JOB_REPLACE, NULL, NULL);
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_BINDS_TO], i)
-                if (!hashmap_get(u->dependencies[UNIT_AFTER], other) &&
+        UNIT_DEPENDENCY_SET_FOREACH(v, other, u->dependencies[UNIT_BINDS_TO], i)
+                if (!unit_dependency_set_get(u->dependencies[UNIT_AFTER], other) &&
                     !UNIT_IS_ACTIVE_OR_ACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_START, other, JOB_REPLACE, NULL, NULL);
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_WANTS], i)
-                if (!hashmap_get(u->dependencies[UNIT_AFTER], other) &&
+        UNIT_DEPENDENCY_SET_FOREACH(v, other, u->dependencies[UNIT_WANTS], i)
+                if (!unit_dependency_set_get(u->dependencies[UNIT_AFTER], other) &&
                     !UNIT_IS_ACTIVE_OR_ACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_START, other, JOB_FAIL, NULL, NULL);
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_CONFLICTS], i)
+        UNIT_DEPENDENCY_SET_FOREACH(v, other, u->dependencies[UNIT_CONFLICTS], i)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_STOP, other, JOB_REPLACE, NULL, NULL);
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_CONFLICTED_BY], i)
+        UNIT_DEPENDENCY_SET_FOREACH(v, other, u->dependencies[UNIT_CONFLICTED_BY], i)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_STOP, other, JOB_REPLACE, NULL, NULL);
 }
@@ -2119,7 +2123,7 @@ static void retroactively_stop_dependencies(Unit *u) {
         assert(UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(u)));
 
         /* Pull down units which are bound to us recursively if enabled */
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_BOUND_BY], i)
+        UNIT_DEPENDENCY_SET_FOREACH(v, other, u->dependencies[UNIT_BOUND_BY], i)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_STOP, other, JOB_REPLACE, NULL, NULL);
 }
@@ -2133,16 +2137,16 @@ static void check_unneeded_dependencies(Unit *u) {
         assert(UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(u)));
 
         /* Garbage collect services that might not be needed anymore, if enabled */
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_REQUIRES], i)
+        UNIT_DEPENDENCY_SET_FOREACH(v, other, u->dependencies[UNIT_REQUIRES], i)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         unit_check_unneeded(other);
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_WANTS], i)
+        UNIT_DEPENDENCY_SET_FOREACH(v, other, u->dependencies[UNIT_WANTS], i)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         unit_check_unneeded(other);
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_REQUISITE], i)
+        UNIT_DEPENDENCY_SET_FOREACH(v, other, u->dependencies[UNIT_REQUISITE], i)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         unit_check_unneeded(other);
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_BINDS_TO], i)
+        UNIT_DEPENDENCY_SET_FOREACH(v, other, u->dependencies[UNIT_BINDS_TO], i)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         unit_check_unneeded(other);
 }
@@ -2154,12 +2158,12 @@ void unit_start_on_failure(Unit *u) {
 
         assert(u);
 
-        if (hashmap_size(u->dependencies[UNIT_ON_FAILURE]) <= 0)
+        if (unit_dependency_set_size(u->dependencies[UNIT_ON_FAILURE]) <= 0)
                 return;
 
         log_unit_info(u, "Triggering OnFailure= dependencies.");
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_ON_FAILURE], i) {
+        UNIT_DEPENDENCY_SET_FOREACH(v, other, u->dependencies[UNIT_ON_FAILURE], i) {
                 int r;
 
                 r = manager_add_job(u->manager, JOB_START, other, u->on_failure_job_mode, NULL, NULL);
@@ -2175,7 +2179,7 @@ void unit_trigger_notify(Unit *u) {
 
         assert(u);
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_TRIGGERED_BY], i)
+        UNIT_DEPENDENCY_SET_FOREACH(v, other, u->dependencies[UNIT_TRIGGERED_BY], i)
                 if (UNIT_VTABLE(other)->trigger_notify)
                         UNIT_VTABLE(other)->trigger_notify(other, u);
 }
@@ -2598,6 +2602,11 @@ int unit_watch_pid(Unit *u, pid_t pid) {
         if (r < 0)
                 return r;
 
+        /* If this is not our child we won't get SIGCHLD for it, hence try to watch it via a pidfd. If that doesn't
+         * work we'll notice its disappearance as before, when the cgroup runs empty or the next time we tidy up the
+         * watched PIDs. */
+        (void) manager_watch_pidfd(u->manager, pid);
+
         return 0;
 }
 
@@ -2629,6 +2638,11 @@ void unit_unwatch_pid(Unit *u, pid_t pid) {
         }
 
         (void) set_remove(u->pids, PID_TO_PTR(pid));
+
+        /* Was this the last unit interested in the PID? */
+        if (!hashmap_contains(u->manager->watch_pids, PID_TO_PTR(pid)) &&
+            !hashmap_contains(u->manager->watch_pids, PID_TO_PTR(-pid)))
+                manager_unwatch_pidfd(u->manager, pid);
 }
 
 void unit_unwatch_all_pids(Unit *u) {
@@ -2654,6 +2668,11 @@ void unit_tidy_watch_pids(Unit *u, pid_t except1, pid_t except2) {
                 if (pid == except1 || pid == except2)
                         continue;
 
+                /* Our children and PIDs watched via a pidfd are dropped the moment they exit, only the others
+                 * need to be checked */
+                if (!set_contains(u->manager->watch_pids_unreliable, e))
+                        continue;
+
                 if (!pid_is_unwaited(pid))
                         unit_unwatch_pid(u, pid);
         }
@@ -2707,8 +2726,8 @@ static void maybe_warn_about_dependency(Unit *u, const char *other, UnitDependen
                 log_unit_warning(u, "Dependency %s=%s dropped, merged into %s", unit_dependency_to_string(dependency), strna(other), u->id);
 }
 
-static int unit_add_dependency_hashmap(
-                Hashmap **h,
+static int unit_add_dependency_set(
+                UnitDependencySet **h,
                 Unit *other,
                 UnitDependencyMask origin_mask,
                 UnitDependencyMask destination_mask) {
@@ -2722,13 +2741,9 @@ static int unit_add_dependency_hashmap(
         assert(destination_mask < _UNIT_DEPENDENCY_MASK_FULL);
         assert(origin_mask > 0 || destination_mask > 0);
 
-        r = hashmap_ensure_allocated(h, NULL);
-        if (r < 0)
-                return r;
-
         assert_cc(sizeof(void*) == sizeof(info));
 
-        info.data = hashmap_get(*h, other);
+        info.data = unit_dependency_set_get(*h, other);
         if (info.data) {
                 /* Entry already exists. Add in our mask. */
 
@@ -2739,14 +2754,14 @@ static int unit_add_dependency_hashmap(
                 info.origin_mask |= origin_mask;
                 info.destination_mask |= destination_mask;
 
-                r = hashmap_update(*h, other, info.data);
+                r = unit_dependency_set_update(*h, other, info.data);
         } else {
                 info = (UnitDependencyInfo) {
                         .origin_mask = origin_mask,
                         .destination_mask = destination_mask,
                 };
 
-                r = hashmap_put(*h, other, info.data);
+                r = unit_dependency_set_put(h, other, info.data);
         }
         if (r < 0)
                 return r;
@@ -2808,22 +2823,22 @@ int unit_add_dependency(
                 return 0;
         }
 
-        r = unit_add_dependency_hashmap(u->dependencies + d, other, mask, 0);
+        r = unit_add_dependency_set(u->dependencies + d, other, mask, 0);
         if (r < 0)
                 return r;
 
         if (inverse_table[d] != _UNIT_DEPENDENCY_INVALID && inverse_table[d] != d) {
-                r = unit_add_dependency_hashmap(other->dependencies + inverse_table[d], u, 0, mask);
+                r = unit_add_dependency_set(other->dependencies + inverse_table[d], u, 0, mask);
                 if (r < 0)
                         return r;
         }
 
         if (add_reference) {
-                r = unit_add_dependency_hashmap(u->dependencies + UNIT_REFERENCES, other, mask, 0);
+                r = unit_add_dependency_set(u->dependencies + UNIT_REFERENCES, other, mask, 0);
                 if (r < 0)
                         return r;
 
-                r = unit_add_dependency_hashmap(other->dependencies + UNIT_REFERENCED_BY, u, 0, mask);
+                r = unit_add_dependency_set(other->dependencies + UNIT_REFERENCED_BY, u, 0, mask);
                 if (r < 0)
                         return r;
         }
@@ -4695,7 +4710,7 @@ int unit_setup_exec_runtime(Unit *u) {
                 return 0;
 
         /* Try to get it from somebody else */
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_JOINS_NAMESPACE_OF], i) {
+        UNIT_DEPENDENCY_SET_FOREACH(v, other, u->dependencies[UNIT_JOINS_NAMESPACE_OF], i) {
 
                 *rt = unit_get_exec_runtime(other);
                 if (*rt) {
@@ -5069,11 +5084,11 @@ static void unit_update_dependency_mask(Unit *u, UnitDependency d, Unit *other,
 
         if (di.origin_mask == 0 && di.destination_mask == 0) {
                 /* No bit set anymore, let's drop the whole entry */
-                assert_se(hashmap_remove(u->dependencies[d], other));
+                assert_se(unit_dependency_set_remove(u->dependencies + d, other));
                 log_unit_debug(u, "%s lost dependency %s=%s", u->id, unit_dependency_to_string(d), other->id);
         } else
                 /* Mask was reduced, let's update the entry */
-                assert_se(hashmap_update(u->dependencies[d], other, di.data) == 0);
+                assert_se(unit_dependency_set_update(u->dependencies[d], other, di.data) == 0);
 }
 
 void unit_remove_dependencies(Unit *u, UnitDependencyMask mask) {
@@ -5087,46 +5102,38 @@ void unit_remove_dependencies(Unit *u, UnitDependencyMask mask) {
                 return;
 
         for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++) {
-                bool done;
-
-                do {
-                        UnitDependencyInfo di;
-                        Unit *other;
-                        Iterator i;
-
-                        done = true;
-
-                        HASHMAP_FOREACH_KEY(di.data, other, u->dependencies[d], i) {
-                                UnitDependency q;
-
-                                if ((di.origin_mask & ~mask) == di.origin_mask)
-                                        continue;
-                                di.origin_mask &= ~mask;
-                                unit_update_dependency_mask(u, d, other, di);
+                UnitDependencyInfo di;
+                Unit *other;
+                Iterator i;
 
-                                /* We updated the dependency from our unit to the other unit now. But most dependencies
-                                 * imply a reverse dependency. Hence, let's delete that one too. For that we go through
-                                 * all dependency types on the other unit and delete all those which point to us and
-                                 * have the right mask set. */
+                /* Dropping the current entry from within the loop is safe for dependency sets, hence a single pass
+                 * suffices. */
+                UNIT_DEPENDENCY_SET_FOREACH(di.data, other, u->dependencies[d], i) {
+                        UnitDependency q;
 
-                                for (q = 0; q < _UNIT_DEPENDENCY_MAX; q++) {
-                                        UnitDependencyInfo dj;
+                        if ((di.origin_mask & ~mask) == di.origin_mask)
+                                continue;
+                        di.origin_mask &= ~mask;
+                        unit_update_dependency_mask(u, d, other, di);
 
-                                        dj.data = hashmap_get(other->dependencies[q], u);
-                                        if ((dj.destination_mask & ~mask) == dj.destination_mask)
-                                                continue;
-                                        dj.destination_mask &= ~mask;
+                        /* We updated the dependency from our unit to the other unit now. But most dependencies
+                         * imply a reverse dependency. Hence, let's delete that one too. For that we go through
+                         * all dependency types on the other unit and delete all those which point to us and
+                         * have the right mask set. */
 
-                                        unit_update_dependency_mask(other, q, u, dj);
-                                }
+                        for (q = 0; q < _UNIT_DEPENDENCY_MAX; q++) {
+                                UnitDependencyInfo dj;
 
-                                unit_add_to_gc_queue(other);
+                                dj.data = unit_dependency_set_get(other->dependencies[q], u);
+                                if ((dj.destination_mask & ~mask) == dj.destination_mask)
+                                        continue;
+                                dj.destination_mask &= ~mask;
 
-                                done = false;
-                                break;
+                                unit_update_dependency_mask(other, q, u, dj);
                         }
 
-                } while (!done);
+                        unit_add_to_gc_queue(other);
+                }
         }
 }
 
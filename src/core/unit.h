@@ -69,53 +69,7 @@ static inline bool UNIT_IS_INACTIVE_OR_FAILED(UnitActiveState t) {
         return IN_SET(t, UNIT_INACTIVE, UNIT_FAILED);
 }
 
-/* Stores the 'reason' a dependency was created as a bit mask, i.e. due to which configuration source it came to be. We
- * use this so that we can selectively flush out parts of dependencies again. Note that the same dependency might be
- * created as a result of multiple "reasons", hence the bitmask. */
-typedef enum UnitDependencyMask {
-        /* Configured directly by the unit file, .wants/.requries symlink or drop-in, or as an immediate result of a
-         * non-dependency option configured that way.  */
-        UNIT_DEPENDENCY_FILE               = 1 << 0,
-
-        /* As unconditional implicit dependency (not affected by unit configuration — except by the unit name and
-         * type) */
-        UNIT_DEPENDENCY_IMPLICIT           = 1 << 1,
-
-        /* A dependency effected by DefaultDependencies=yes. Note that dependencies marked this way are conceptually
-         * just a subset of UNIT_DEPENDENCY_FILE, as DefaultDependencies= is itself a unit file setting that can only
-         * be set in unit files. We make this two separate bits only to help debugging how dependencies came to be. */
-        UNIT_DEPENDENCY_DEFAULT            = 1 << 2,
-
-        /* A dependency created from udev rules */
-        UNIT_DEPENDENCY_UDEV               = 1 << 3,
-
-        /* A dependency created because of some unit's RequiresMountsFor= setting */
-        UNIT_DEPENDENCY_PATH               = 1 << 4,
-
-        /* A dependency created because of data read from /proc/self/mountinfo and no other configuration source */
-        UNIT_DEPENDENCY_MOUNTINFO_IMPLICIT = 1 << 5,
-
-        /* A dependency created because of data read from /proc/self/mountinfo, but conditionalized by
-         * DefaultDependencies= and thus also involving configuration from UNIT_DEPENDENCY_FILE sources */
-        UNIT_DEPENDENCY_MOUNTINFO_DEFAULT  = 1 << 6,
-
-        /* A dependency created because of data read from /proc/swaps and no other configuration source */
-        UNIT_DEPENDENCY_PROC_SWAP          = 1 << 7,
-
-        _UNIT_DEPENDENCY_MASK_FULL = (1 << 8) - 1,
-} UnitDependencyMask;
-
-/* The Unit's dependencies[] hashmaps use this structure as value. It has the same size as a void pointer, and thus can
- * be stored directly as hashmap value, without any indirection. Note that this stores two masks, as both the origin
- * and the destination of a dependency might have created it. */
-typedef union UnitDependencyInfo {
-        void *data;
-        struct {
-                UnitDependencyMask origin_mask:16;
-                UnitDependencyMask destination_mask:16;
-        } _packed_;
-} UnitDependencyInfo;
-
+#include "unit-dependency-set.h"
 #include "job.h"
 
 struct UnitRef {
@@ -145,9 +99,9 @@ struct Unit {
 
         Set *names;
 
-        /* For each dependency type we maintain a Hashmap whose key is the Unit* object, and the value encodes why the
+        /* For each dependency type we maintain a set whose key is the Unit* object, and the value encodes why the
          * dependency exists, using the UnitDependencyInfo type */
-        Hashmap *dependencies[_UNIT_DEPENDENCY_MAX];
+        UnitDependencySet *dependencies[_UNIT_DEPENDENCY_MAX];
 
         /* Similar, for RequiresMountsFor= path dependencies. The key is the path, the value the UnitDependencyInfo type */
         Hashmap *requires_mounts_for;
@@ -219,6 +173,9 @@ struct Unit {
         /* D-Bus queue */
         LIST_FIELDS(Unit, dbus_queue);
 
+        /* Value of the manager's unit_change_generation when this unit was last added to the D-Bus queue */
+        uint64_t change_generation;
+
         /* Cleanup queue */
         LIST_FIELDS(Unit, cleanup_queue);
 
@@ -278,6 +235,9 @@ struct Unit {
         CGroupMask cgroup_members_mask;
         int cgroup_inotify_wd;
 
+        /* The values we last successfully wrote to the cgroup attributes, indexed by attribute name */
+        Hashmap *cgroup_attributes;
+
         /* IP BPF Firewalling/accounting */
         int ip_accounting_ingress_map_fd;
         int ip_accounting_egress_map_fd;
@@ -292,6 +252,15 @@ struct Unit {
 
         uint64_t ip_accounting_extra[_CGROUP_IP_ACCOUNTING_METRIC_MAX];
 
+        /* The most recent sample taken by the accounting sampler, with a zero timestamp if there is none */
+        CGroupAccountingSample accounting_sample;
+
+        /* Ring buffer of the most recent samples, oldest first starting at accounting_samples_next once it
+         * filled up. Only allocated once a client asked for the history of this unit. */
+        CGroupAccountingSample *accounting_samples;
+        unsigned n_accounting_samples;
+        unsigned accounting_samples_next;
+
         /* How to start OnFailure units */
         JobMode on_failure_job_mode;
 
@@ -501,6 +470,10 @@ struct UnitVTable {
         /* Invoked on every child that died */
         void (*sigchld_event)(Unit *u, pid_t pid, int code, int status);
 
+        /* Invoked on every watched process that died and was not our child, hence without exit status. If
+         * not set, the remaining processes are checked, and the unit is told if none is left. */
+        void (*pid_gone_event)(Unit *u, pid_t pid);
+
         /* Reset failed state if we are in failed state */
         void (*reset_failed)(Unit *u);
 
@@ -552,6 +525,11 @@ struct UnitVTable {
          * to put the units into the initial state.  */
         void (*enumerate)(Manager *m);
 
+        /* Called before the generators are run and enumerate() is called. May be used to start collecting the
+         * data enumerate() needs on a helper thread, so that the I/O overlaps with the generators. This must not
+         * touch any manager or unit state. enumerate() has to work without it too. */
+        void (*enumerate_prepare)(Manager *m);
+
         /* Type specific cleanups. */
         void (*shutdown)(Manager *m);
 
@@ -592,7 +570,7 @@ extern const UnitVTable * const unit_vtable[_UNIT_TYPE_MAX];
 #define UNIT_HAS_CGROUP_CONTEXT(u) (UNIT_VTABLE(u)->cgroup_context_offset > 0)
 #define UNIT_HAS_KILL_CONTEXT(u) (UNIT_VTABLE(u)->kill_context_offset > 0)
 
-#define UNIT_TRIGGER(u) ((Unit*) hashmap_first_key((u)->dependencies[UNIT_TRIGGERS]))
+#define UNIT_TRIGGER(u) unit_dependency_set_first((u)->dependencies[UNIT_TRIGGERS])
 
 DEFINE_CAST(SERVICE, Service);
 DEFINE_CAST(SOCKET, Socket);
@@ -27,6 +27,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/un.h>
@@ -37,12 +38,15 @@
 #include "alloc-util.h"
 #include "fd-util.h"
 #include "fs-util.h"
+#include "memfd-util.h"
+#include "missing.h"
 #include "parse-util.h"
 #include "path-util.h"
 #include "process-util.h"
 #include "socket-util.h"
 #include "strv.h"
 #include "util.h"
+#include "watchdog-shm.h"
 
 #define SNDBUF_SIZE (8*1024*1024)
 
@@ -456,6 +460,76 @@ _public_ int sd_is_mq(int fd, const char *path) {
         return 1;
 }
 
+static WatchdogShm *watchdog_shm = NULL;
+static pid_t watchdog_shm_pid = 0;
+
+static int watchdog_shm_ping(void) {
+        _cleanup_close_ int fd = -1;
+        WatchdogShm *shm, *old = NULL;
+        const char *e;
+        void *p;
+        int r;
+
+        /* Returns > 0 if the keep-alive ping was stored in the shared memory page registered with the service
+         * manager, and the manager watches it, 0 if a WATCHDOG=1 datagram shall be sent (too). */
+
+        shm = __atomic_load_n(&watchdog_shm, __ATOMIC_ACQUIRE);
+        if (shm) {
+                /* After fork() the page is still mapped, but the manager only cares for the original process */
+                if (watchdog_shm_pid != getpid_cached())
+                        return 0;
+
+                __atomic_store_n(&shm->timestamp, now(CLOCK_MONOTONIC), __ATOMIC_RELEASE);
+
+                /* The manager might have refused the page, or not picked it up again after reexecution */
+                return __atomic_load_n(&shm->acked, __ATOMIC_ACQUIRE) ? 1 : 0;
+        }
+
+        e = getenv("WATCHDOG_SHM");
+        if (!e || parse_boolean(e) <= 0)
+                return 0;
+
+        if (sd_watchdog_enabled(false, NULL) <= 0)
+                return 0;
+
+        /* Failing to set up the page is not fatal, we'll just keep sending datagrams */
+        fd = memfd_new("sd-watchdog");
+        if (fd < 0)
+                return 0;
+
+        if (memfd_set_size(fd, page_size()) < 0)
+                return 0;
+
+        if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK|F_SEAL_GROW|F_SEAL_SEAL) < 0)
+                return 0;
+
+        p = mmap(NULL, page_size(), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+                return 0;
+
+        shm = p;
+        shm->magic = WATCHDOG_SHM_MAGIC;
+        shm->timestamp = now(CLOCK_MONOTONIC);
+
+        watchdog_shm_pid = getpid_cached();
+        if (!__atomic_compare_exchange_n(&watchdog_shm, &old, shm, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                /* Another thread registered a page in the meantime, use that one */
+                (void) munmap(p, page_size());
+                __atomic_store_n(&old->timestamp, now(CLOCK_MONOTONIC), __ATOMIC_RELEASE);
+                return __atomic_load_n(&old->acked, __ATOMIC_ACQUIRE) ? 1 : 0;
+        }
+
+        r = sd_pid_notify_with_fds(0, false, "WATCHDOG=1\nWATCHDOG_SHM=1", &fd, 1);
+        if (r <= 0) {
+                /* Other threads might already be writing to the page, hence leave it mapped, but don't use it
+                 * anymore. */
+                __atomic_store_n(&watchdog_shm, NULL, __ATOMIC_RELEASE);
+                return r;
+        }
+
+        return 1;
+}
+
 _public_ int sd_pid_notify_with_fds(
                 pid_t pid,
                 int unset_environment,
@@ -494,6 +568,14 @@ _public_ int sd_pid_notify_with_fds(
         if (!e)
                 return 0;
 
+        /* Keep-alive pings are by far the most frequent message, hand them over through shared memory if the
+         * service manager supports that. */
+        if (n_fds == 0 && (pid == 0 || pid == getpid_cached()) && streq(state, "WATCHDOG=1")) {
+                r = watchdog_shm_ping();
+                if (r != 0)
+                        goto finish;
+        }
+
         /* Must be an abstract socket, or an absolute path */
         if (!IN_SET(e[0], '@', '/') || e[1] == 0) {
                 r = -EINVAL;
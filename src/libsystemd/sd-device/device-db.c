@@ -0,0 +1,539 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "device-db.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "hashmap.h"
+#include "io-util.h"
+#include "macro.h"
+#include "mkdir.h"
+#include "string-util.h"
+#include "util.h"
+
+/*
+ * Instead of one file per device in /run/udev/data/, the database entries may be kept in a single
+ * file. Writers append a record for each updated or removed entry under an exclusive lock, and mark
+ * it as committed only once it is complete. Readers map the file, index it once, and afterwards only
+ * index the records appended since, so looking up an entry costs a stat() instead of reading a file.
+ * When most of the file is taken by outdated records, a writer writes the current ones to a new file
+ * and renames it over the old one; readers notice the new inode and start over.
+ *
+ * Entries which are not in the file are looked up in /run/udev/data/, so both formats can be read at
+ * any time, and only writers need to know which one is in use.
+ */
+
+#define DEVICE_DB_SIGNATURE "UDEVDB\0\1"
+
+enum {
+        DEVICE_DB_RECORD_COMMITTED = 1 << 0,
+        DEVICE_DB_RECORD_PERSIST   = 1 << 1,
+        DEVICE_DB_RECORD_REMOVED   = 1 << 2,
+};
+
+typedef struct DeviceDBHeader {
+        uint8_t signature[8];
+} DeviceDBHeader;
+
+typedef struct DeviceDBRecord {
+        uint32_t size;          /* of the whole record, a multiple of 8 */
+        uint32_t id_size;       /* including the trailing NUL */
+        uint32_t data_size;
+        uint32_t flags;
+        /* followed by the id and the data */
+} DeviceDBRecord;
+
+typedef struct DeviceDBEntry {
+        uint64_t offset;        /* of the latest record for the id */
+        char id[];
+} DeviceDBEntry;
+
+typedef struct DeviceDB {
+        void *map;
+        size_t size;
+        dev_t st_dev;
+        ino_t st_ino;
+
+        uint64_t indexed;       /* all records before this offset are in the index */
+        uint64_t live;          /* bytes taken by the latest records of all entries */
+        Hashmap *index;
+} DeviceDB;
+
+/* One mapping and index for the whole process: the threads of a parallel enumeration share it, and
+ * take turns through the mutex */
+static DeviceDB cache = {};
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static bool binary = false;
+
+void device_db_set_binary(bool b) {
+        binary = b;
+}
+
+bool device_db_get_binary(void) {
+        return binary;
+}
+
+static void device_db_reset(DeviceDB *db) {
+        assert(db);
+
+        if (db->map)
+                (void) munmap(db->map, db->size);
+
+        hashmap_free_free(db->index);
+
+        *db = (DeviceDB) {};
+}
+
+static const DeviceDBRecord *device_db_record(DeviceDB *db, uint64_t offset) {
+        return (const DeviceDBRecord*) ((const uint8_t*) db->map + offset);
+}
+
+/* Indexes the records appended since the last call, up to the first one which is not complete */
+static int device_db_index(DeviceDB *db) {
+        int r;
+
+        assert(db);
+
+        r = hashmap_ensure_allocated(&db->index, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        while (db->indexed + sizeof(DeviceDBRecord) <= db->size) {
+                const DeviceDBRecord *rec = device_db_record(db, db->indexed);
+                DeviceDBEntry *e;
+                const char *id;
+
+                if (rec->size < sizeof(DeviceDBRecord) || rec->size % 8 != 0 ||
+                    rec->size > db->size - db->indexed ||
+                    rec->id_size == 0 || (uint64_t) rec->id_size + rec->data_size > rec->size - sizeof(DeviceDBRecord) ||
+                    !(rec->flags & DEVICE_DB_RECORD_COMMITTED))
+                        break;
+
+                id = (const char*) (rec + 1);
+                if (id[rec->id_size - 1] != '\0')
+                        break;
+
+                e = hashmap_get(db->index, id);
+                if (e)
+                        db->live -= device_db_record(db, e->offset)->size;
+
+                if (rec->flags & DEVICE_DB_RECORD_REMOVED)
+                        free(hashmap_remove(db->index, id));
+                else {
+                        if (!e) {
+                                e = malloc(offsetof(DeviceDBEntry, id) + rec->id_size);
+                                if (!e)
+                                        return -ENOMEM;
+                                memcpy(e->id, id, rec->id_size);
+
+                                r = hashmap_put(db->index, e->id, e);
+                                if (r < 0) {
+                                        free(e);
+                                        return r;
+                                }
+                        }
+
+                        e->offset = db->indexed;
+                        db->live += rec->size;
+                }
+
+                db->indexed += rec->size;
+        }
+
+        return 0;
+}
+
+/* Brings the mapping and the index up to date. Returns 0 if there is no database file */
+static int device_db_refresh(DeviceDB *db) {
+        _cleanup_close_ int fd = -1;
+        struct stat st;
+        void *p;
+        int r;
+
+        assert(db);
+
+        if (stat(DEVICE_DB_PATH, &st) < 0) {
+                device_db_reset(db);
+                return errno == ENOENT ? 0 : -errno;
+        }
+
+        if (db->map && st.st_dev == db->st_dev && st.st_ino == db->st_ino && (uint64_t) st.st_size == db->size) {
+                /* the mapping is shared, a record which was committed since shows up in place */
+                if (db->indexed < db->size) {
+                        r = device_db_index(db);
+                        if (r < 0) {
+                                device_db_reset(db);
+                                return r;
+                        }
+                }
+
+                return 1;
+        }
+
+        fd = open(DEVICE_DB_PATH, O_RDONLY|O_CLOEXEC);
+        if (fd < 0) {
+                device_db_reset(db);
+                return errno == ENOENT ? 0 : -errno;
+        }
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        /* a new file, start over */
+        if (db->map && (st.st_dev != db->st_dev || st.st_ino != db->st_ino || (uint64_t) st.st_size < db->size))
+                device_db_reset(db);
+
+        if ((uint64_t) st.st_size < sizeof(DeviceDBHeader))
+                return 0;
+
+        p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+                return -errno;
+
+        if (memcmp(p, DEVICE_DB_SIGNATURE, sizeof(((DeviceDBHeader*) NULL)->signature)) != 0) {
+                (void) munmap(p, st.st_size);
+                device_db_reset(db);
+                return -EBADMSG;
+        }
+
+        if (db->map)
+                (void) munmap(db->map, db->size);
+        else
+                db->indexed = sizeof(DeviceDBHeader);
+
+        db->map = p;
+        db->size = st.st_size;
+        db->st_dev = st.st_dev;
+        db->st_ino = st.st_ino;
+
+        r = device_db_index(db);
+        if (r < 0) {
+                device_db_reset(db);
+                return r;
+        }
+
+        return 1;
+}
+
+/* Returns -ENOENT if the id is not in the database file, and the caller should look elsewhere */
+static int device_db_read_cached(const char *id, char **ret, size_t *ret_size) {
+        const DeviceDBRecord *rec;
+        DeviceDBEntry *e;
+        char *data;
+        int r;
+
+        r = device_db_refresh(&cache);
+        if (r < 0) {
+                log_debug_errno(r, "sd-device: failed to read '%s', ignoring: %m", DEVICE_DB_PATH);
+                return -ENOENT;
+        }
+        if (r == 0)
+                return -ENOENT;
+
+        e = hashmap_get(cache.index, id);
+        if (!e)
+                return -ENOENT;
+
+        rec = device_db_record(&cache, e->offset);
+
+        data = memdup_suffix0((const uint8_t*) (rec + 1) + rec->id_size, rec->data_size);
+        if (!data)
+                return -ENOMEM;
+
+        *ret = data;
+        if (ret_size)
+                *ret_size = rec->data_size;
+
+        return 0;
+}
+
+int device_db_read(const char *id, char **ret, size_t *ret_size) {
+        char *path;
+        int r;
+
+        assert(id);
+        assert(ret);
+
+        assert_se(pthread_mutex_lock(&cache_mutex) == 0);
+        r = device_db_read_cached(id, ret, ret_size);
+        assert_se(pthread_mutex_unlock(&cache_mutex) == 0);
+        if (r != -ENOENT)
+                return r;
+
+        path = strjoina("/run/udev/data/", id);
+
+        return read_full_file(path, ret, ret_size);
+}
+
+/* Opens the database file and takes the lock, making sure it was not replaced in the meantime */
+static int device_db_open_locked(bool create) {
+        int r;
+
+        for (;;) {
+                _cleanup_close_ int fd = -1;
+                struct stat a, b;
+
+                fd = open(DEVICE_DB_PATH, O_RDWR|O_CLOEXEC|(create ? O_CREAT : 0), 0644);
+                if (fd < 0)
+                        return -errno;
+
+                if (flock(fd, LOCK_EX) < 0)
+                        return -errno;
+
+                if (fstat(fd, &a) < 0)
+                        return -errno;
+
+                if (stat(DEVICE_DB_PATH, &b) < 0) {
+                        if (errno != ENOENT)
+                                return -errno;
+
+                        continue;
+                }
+
+                if (a.st_dev != b.st_dev || a.st_ino != b.st_ino)
+                        continue;
+
+                if (a.st_size == 0) {
+                        DeviceDBHeader h = {
+                                .signature = DEVICE_DB_SIGNATURE,
+                        };
+
+                        if (pwrite(fd, &h, sizeof(h), 0) != sizeof(h))
+                                return errno > 0 ? -errno : -EIO;
+                }
+
+                r = fd;
+                fd = -1;
+                return r;
+        }
+}
+
+/* Writes the latest records, optionally only those which survive the transition from the initramfs,
+ * to a new file, and replaces the old one with it. The index must be up to date, and the lock held. */
+static int device_db_compact(DeviceDB *db, int *fd, bool persist_only) {
+        DeviceDBHeader h = {
+                .signature = DEVICE_DB_SIGNATURE,
+        };
+        _cleanup_free_ char *t = NULL;
+        _cleanup_close_ int nfd = -1;
+        DeviceDBEntry *e;
+        Iterator i;
+        int r;
+
+        assert(db);
+        assert(fd);
+
+        r = tempfn_random(DEVICE_DB_PATH, NULL, &t);
+        if (r < 0)
+                return r;
+
+        nfd = open(t, O_RDWR|O_CREAT|O_EXCL|O_CLOEXEC, 0644);
+        if (nfd < 0)
+                return -errno;
+
+        /* writers which open the new file wait until we are done */
+        if (flock(nfd, LOCK_EX) < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        r = loop_write(nfd, &h, sizeof(h), false);
+        if (r < 0)
+                goto fail;
+
+        HASHMAP_FOREACH(e, db->index, i) {
+                const DeviceDBRecord *rec = device_db_record(db, e->offset);
+
+                if (persist_only && !(rec->flags & DEVICE_DB_RECORD_PERSIST))
+                        continue;
+
+                r = loop_write(nfd, rec, rec->size, false);
+                if (r < 0)
+                        goto fail;
+        }
+
+        if (rename(t, DEVICE_DB_PATH) < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        safe_close(*fd);
+        *fd = nfd;
+        nfd = -1;
+
+        device_db_reset(db);
+
+        return 0;
+
+fail:
+        (void) unlink(t);
+        return r;
+}
+
+static int device_db_append(int *fd, const char *id, const char *data, size_t size, uint32_t flags) {
+        _cleanup_free_ DeviceDBRecord *rec = NULL;
+        size_t id_size, rec_size;
+        uint32_t committed;
+        struct stat st;
+        int r;
+
+        assert(fd);
+        assert(id);
+
+        /* nobody else writes while we hold the lock, so this sees all complete records */
+        r = device_db_refresh(&cache);
+        if (r < 0)
+                return r;
+
+        if (fstat(*fd, &st) < 0)
+                return -errno;
+
+        /* a writer died half way through its record, get rid of it */
+        if (r > 0 && cache.indexed != (uint64_t) st.st_size) {
+                r = device_db_compact(&cache, fd, false);
+                if (r < 0)
+                        return r;
+
+                if (fstat(*fd, &st) < 0)
+                        return -errno;
+        }
+
+        id_size = strlen(id) + 1;
+        rec_size = ALIGN8(sizeof(DeviceDBRecord) + id_size + size);
+        if (rec_size > UINT32_MAX)
+                return -E2BIG;
+
+        rec = malloc0(rec_size);
+        if (!rec)
+                return -ENOMEM;
+
+        rec->size = rec_size;
+        rec->id_size = id_size;
+        rec->data_size = size;
+        rec->flags = flags;
+        memcpy(rec + 1, id, id_size);
+        memcpy_safe((uint8_t*) (rec + 1) + id_size, data, size);
+
+        if (pwrite(*fd, rec, rec_size, st.st_size) != (ssize_t) rec_size)
+                return errno > 0 ? -errno : -EIO;
+
+        committed = flags | DEVICE_DB_RECORD_COMMITTED;
+        if (pwrite(*fd, &committed, sizeof(committed), st.st_size + offsetof(DeviceDBRecord, flags)) != sizeof(committed))
+                return errno > 0 ? -errno : -EIO;
+
+        /* do not let outdated records pile up */
+        r = device_db_refresh(&cache);
+        if (r > 0 && cache.size >= DEVICE_DB_COMPACT_MIN && cache.live < cache.size / 2) {
+                r = device_db_compact(&cache, fd, false);
+                if (r < 0)
+                        log_debug_errno(r, "sd-device: failed to compact '%s', ignoring: %m", DEVICE_DB_PATH);
+        }
+
+        return 0;
+}
+
+int device_db_write(const char *id, const char *data, size_t size, bool persist) {
+        _cleanup_close_ int fd = -1;
+        int r;
+
+        assert(id);
+
+        r = mkdir_parents(DEVICE_DB_PATH, 0755);
+        if (r < 0)
+                return r;
+
+        assert_se(pthread_mutex_lock(&cache_mutex) == 0);
+
+        fd = device_db_open_locked(true);
+        if (fd < 0)
+                r = fd;
+        else
+                r = device_db_append(&fd, id, data, size, persist ? DEVICE_DB_RECORD_PERSIST : 0);
+
+        assert_se(pthread_mutex_unlock(&cache_mutex) == 0);
+
+        return r;
+}
+
+static int device_db_remove_cached(const char *id) {
+        _cleanup_close_ int fd = -1;
+        int r;
+
+        /* nothing to do, if there is no record for the id, events for a device are never handled in parallel */
+        r = device_db_refresh(&cache);
+        if (r <= 0)
+                return r;
+        if (!hashmap_get(cache.index, id))
+                return 0;
+
+        fd = device_db_open_locked(false);
+        if (fd == -ENOENT)
+                return 0;
+        if (fd < 0)
+                return fd;
+
+        return device_db_append(&fd, id, NULL, 0, DEVICE_DB_RECORD_REMOVED);
+}
+
+int device_db_remove(const char *id) {
+        int r;
+
+        assert(id);
+
+        assert_se(pthread_mutex_lock(&cache_mutex) == 0);
+        r = device_db_remove_cached(id);
+        assert_se(pthread_mutex_unlock(&cache_mutex) == 0);
+
+        return r;
+}
+
+static int device_db_cleanup_cached(void) {
+        _cleanup_close_ int fd = -1;
+        int r;
+
+        fd = device_db_open_locked(false);
+        if (fd == -ENOENT)
+                return 0;
+        if (fd < 0)
+                return fd;
+
+        r = device_db_refresh(&cache);
+        if (r <= 0)
+                return r;
+
+        return device_db_compact(&cache, &fd, true);
+}
+
+int device_db_cleanup(void) {
+        int r;
+
+        assert_se(pthread_mutex_lock(&cache_mutex) == 0);
+        r = device_db_cleanup_cached();
+        assert_se(pthread_mutex_unlock(&cache_mutex) == 0);
+
+        return r;
+}
@@ -0,0 +1,37 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifndef DEVICE_DB_PATH
+#define DEVICE_DB_PATH "/run/udev/data.db"
+#endif
+
+/* compact the file only once it is this large, and more than half of it is outdated */
+#define DEVICE_DB_COMPACT_MIN (1024U * 1024U)
+
+void device_db_set_binary(bool b);
+bool device_db_get_binary(void);
+
+int device_db_read(const char *id, char **ret, size_t *ret_size);
+int device_db_write(const char *id, const char *data, size_t size, bool persist);
+int device_db_remove(const char *id);
+int device_db_cleanup(void);
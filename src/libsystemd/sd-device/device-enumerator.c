@@ -19,6 +19,9 @@
   along with systemd; If not, see <http://www.gnu.org/licenses/>.
 ***/
 
+#include <pthread.h>
+#include <signal.h>
+
 #include "sd-device.h"
 
 #include "alloc-util.h"
@@ -33,6 +36,7 @@
 #include "util.h"
 
 #define DEVICE_ENUMERATE_MAX_DEPTH 256
+#define DEVICE_ENUMERATE_MAX_THREADS 16
 
 typedef enum DeviceEnumerationType {
         DEVICE_ENUMERATION_TYPE_DEVICES,
@@ -57,8 +61,28 @@ struct sd_device_enumerator {
         Set *match_tag;
         sd_device *match_parent;
         bool match_allow_uninitialized;
+
+        unsigned n_threads;
 };
 
+/* One directory of devices, e.g. /sys/bus/pci/devices/, scanned on its own so that several of them can be
+ * read concurrently. The matching devices are collected in the job, and added to the enumerator once all
+ * jobs are done, in the order the jobs were created. */
+typedef struct DeviceScanJob {
+        char *path;
+        sd_device **devices;
+        size_t n_devices;
+        size_t n_allocated;
+        int r;
+} DeviceScanJob;
+
+typedef struct DeviceScanPool {
+        sd_device_enumerator *enumerator;
+        DeviceScanJob *jobs;
+        size_t n_jobs;
+        size_t next_job;
+} DeviceScanPool;
+
 _public_ int sd_device_enumerator_new(sd_device_enumerator **ret) {
         _cleanup_(sd_device_enumerator_unrefp) sd_device_enumerator *enumerator = NULL;
 
@@ -70,6 +94,7 @@ _public_ int sd_device_enumerator_new(sd_device_enumerator **ret) {
 
         enumerator->n_ref = 1;
         enumerator->type = _DEVICE_ENUMERATION_TYPE_INVALID;
+        enumerator->n_threads = 1;
 
         *ret = enumerator;
         enumerator = NULL;
@@ -266,6 +291,16 @@ _public_ int sd_device_enumerator_allow_uninitialized(sd_device_enumerator *enum
         return 0;
 }
 
+int device_enumerator_set_n_threads(sd_device_enumerator *enumerator, unsigned n_threads) {
+        assert_return(enumerator, -EINVAL);
+
+        /* 0 picks the number of CPUs, 1 scans from the calling thread only, which is what everybody gets
+         * unless they ask for more, as callers of the public API might not expect us to start threads */
+        enumerator->n_threads = MIN(n_threads, DEVICE_ENUMERATE_MAX_THREADS);
+
+        return 0;
+}
+
 int device_enumerator_add_match_is_initialized(sd_device_enumerator *enumerator) {
         assert_return(enumerator, -EINVAL);
 
@@ -466,30 +501,23 @@ static bool match_sysname(sd_device_enumerator *enumerator, const char *sysname)
         return false;
 }
 
-static int enumerator_scan_dir_and_add_devices(sd_device_enumerator *enumerator, const char *basedir, const char *subdir1, const char *subdir2) {
+static int device_scan_job_run(sd_device_enumerator *enumerator, DeviceScanJob *job) {
         _cleanup_closedir_ DIR *dir = NULL;
-        char *path;
         struct dirent *dent;
         int r = 0;
 
         assert(enumerator);
-        assert(basedir);
-
-        path = strjoina("/sys/", basedir, "/");
-
-        if (subdir1)
-                path = strjoina(path, subdir1, "/");
-
-        if (subdir2)
-                path = strjoina(path, subdir2, "/");
+        assert(job);
+        assert(job->path);
 
-        dir = opendir(path);
+        dir = opendir(job->path);
         if (!dir)
                 return -errno;
 
         FOREACH_DIRENT_ALL(dent, dir, return -errno) {
                 _cleanup_(sd_device_unrefp) sd_device *device = NULL;
-                char syspath[strlen(path) + 1 + strlen(dent->d_name) + 1];
+                char syspath[strlen(job->path) + 1 + strlen(dent->d_name) + 1];
+                const char *subsystem;
                 dev_t devnum;
                 int ifindex, initialized, k;
 
@@ -499,7 +527,7 @@ static int enumerator_scan_dir_and_add_devices(sd_device_enumerator *enumerator,
                 if (!match_sysname(enumerator, dent->d_name))
                         continue;
 
-                (void)sprintf(syspath, "%s%s", path, dent->d_name);
+                (void)sprintf(syspath, "%s%s", job->path, dent->d_name);
 
                 k = sd_device_new_from_syspath(&device, syspath);
                 if (k < 0) {
@@ -555,7 +583,44 @@ static int enumerator_scan_dir_and_add_devices(sd_device_enumerator *enumerator,
                 if (!match_sysattr(enumerator, device))
                         continue;
 
-                k = device_enumerator_add_device(enumerator, device);
+                /* The uevent file and the database have been read above already, resolve the subsystem
+                 * too while we are at it, nearly everybody iterating over the devices asks for it. */
+                (void) sd_device_get_subsystem(device, &subsystem);
+
+                if (!GREEDY_REALLOC(job->devices, job->n_allocated, job->n_devices + 1))
+                        return -ENOMEM;
+
+                job->devices[job->n_devices++] = device;
+                device = NULL;
+        }
+
+        return r;
+}
+
+static void device_scan_job_done(DeviceScanJob *job) {
+        size_t i;
+
+        assert(job);
+
+        for (i = 0; i < job->n_devices; i++)
+                sd_device_unref(job->devices[i]);
+
+        job->devices = mfree(job->devices);
+        job->n_devices = job->n_allocated = 0;
+        job->path = mfree(job->path);
+}
+
+static int device_scan_job_add_devices(sd_device_enumerator *enumerator, DeviceScanJob *job) {
+        size_t i;
+        int r = job->r;
+
+        assert(enumerator);
+        assert(job);
+
+        for (i = 0; i < job->n_devices; i++) {
+                int k;
+
+                k = device_enumerator_add_device(enumerator, job->devices[i]);
                 if (k < 0)
                         r = k;
         }
@@ -563,6 +628,96 @@ static int enumerator_scan_dir_and_add_devices(sd_device_enumerator *enumerator,
         return r;
 }
 
+static void *device_scan_pool_thread(void *p) {
+        DeviceScanPool *pool = p;
+
+        for (;;) {
+                size_t i;
+
+                i = __sync_fetch_and_add(&pool->next_job, 1);
+                if (i >= pool->n_jobs)
+                        break;
+
+                pool->jobs[i].r = device_scan_job_run(pool->enumerator, pool->jobs + i);
+        }
+
+        return NULL;
+}
+
+static unsigned enumerator_get_n_threads(sd_device_enumerator *enumerator, size_t n_jobs) {
+        unsigned n;
+
+        assert(enumerator);
+
+        n = enumerator->n_threads;
+        if (n == 0) {
+                long ncpus;
+
+                ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+                n = ncpus > 0 ? MIN((unsigned) ncpus, DEVICE_ENUMERATE_MAX_THREADS) : 1;
+        }
+
+        return MIN(n, n_jobs);
+}
+
+static void enumerator_run_scan_jobs(sd_device_enumerator *enumerator, DeviceScanJob *jobs, size_t n_jobs) {
+        DeviceScanPool pool = {
+                .enumerator = enumerator,
+                .jobs = jobs,
+                .n_jobs = n_jobs,
+        };
+        pthread_t threads[DEVICE_ENUMERATE_MAX_THREADS];
+        sigset_t ss, saved_ss;
+        unsigned n_threads, n_started = 0, i;
+
+        assert(enumerator);
+        assert(jobs || n_jobs == 0);
+
+        /* Reading sysfs is mostly spent in syscalls and in building the device objects, which parallelizes
+         * well. Each job is only ever touched by the thread which picked it, and the devices are handed
+         * over to us after the threads have been joined. If no thread can be started, the calling thread
+         * simply does all the work itself. */
+
+        n_threads = enumerator_get_n_threads(enumerator, n_jobs);
+        if (n_threads > 1 &&
+            sigfillset(&ss) >= 0 &&
+            pthread_sigmask(SIG_BLOCK, &ss, &saved_ss) == 0) {
+
+                /* Start the threads with all signals blocked, so that they don't affect signal handling */
+                for (; n_started < n_threads - 1; n_started++)
+                        if (pthread_create(threads + n_started, NULL, device_scan_pool_thread, &pool) != 0)
+                                break;
+
+                (void) pthread_sigmask(SIG_SETMASK, &saved_ss, NULL);
+        }
+
+        (void) device_scan_pool_thread(&pool);
+
+        for (i = 0; i < n_started; i++)
+                (void) pthread_join(threads[i], NULL);
+}
+
+static int enumerator_scan_dir_and_add_devices(sd_device_enumerator *enumerator, const char *basedir, const char *subdir1, const char *subdir2) {
+        DeviceScanJob job = {};
+        int r;
+
+        assert(enumerator);
+        assert(basedir);
+
+        job.path = strjoin("/sys/", basedir, "/",
+                           strempty(subdir1), subdir1 ? "/" : "",
+                           strempty(subdir2), subdir2 ? "/" : "");
+        if (!job.path)
+                return -ENOMEM;
+
+        job.r = device_scan_job_run(enumerator, &job);
+        r = device_scan_job_add_devices(enumerator, &job);
+
+        device_scan_job_done(&job);
+
+        return r;
+}
+
 static bool match_subsystem(sd_device_enumerator *enumerator, const char *subsystem) {
         const char *subsystem_match;
         Iterator i;
@@ -588,6 +743,8 @@ static bool match_subsystem(sd_device_enumerator *enumerator, const char *subsys
 
 static int enumerator_scan_dir(sd_device_enumerator *enumerator, const char *basedir, const char *subdir, const char *subsystem) {
         _cleanup_closedir_ DIR *dir = NULL;
+        DeviceScanJob *jobs = NULL;
+        size_t n_jobs = 0, n_allocated = 0, i;
         char *path;
         struct dirent *dent;
         int r = 0;
@@ -600,8 +757,9 @@ static int enumerator_scan_dir(sd_device_enumerator *enumerator, const char *bas
 
         log_debug("  device-enumerator: scanning %s", path);
 
-        FOREACH_DIRENT_ALL(dent, dir, return -errno) {
-                int k;
+        /* First collect the directories of all matching subsystems, then read them in parallel */
+        FOREACH_DIRENT_ALL(dent, dir, r = -errno; goto finish) {
+                DeviceScanJob *job;
 
                 if (dent->d_name[0] == '.')
                         continue;
@@ -609,11 +767,36 @@ static int enumerator_scan_dir(sd_device_enumerator *enumerator, const char *bas
                 if (!match_subsystem(enumerator, subsystem ? : dent->d_name))
                         continue;
 
-                k = enumerator_scan_dir_and_add_devices(enumerator, basedir, dent->d_name, subdir);
+                if (!GREEDY_REALLOC0(jobs, n_allocated, n_jobs + 1)) {
+                        r = -ENOMEM;
+                        goto finish;
+                }
+
+                job = jobs + n_jobs;
+                job->path = strjoin(path, "/", dent->d_name, "/", strempty(subdir), subdir ? "/" : "");
+                if (!job->path) {
+                        r = -ENOMEM;
+                        goto finish;
+                }
+
+                n_jobs++;
+        }
+
+        enumerator_run_scan_jobs(enumerator, jobs, n_jobs);
+
+        for (i = 0; i < n_jobs; i++) {
+                int k;
+
+                k = device_scan_job_add_devices(enumerator, jobs + i);
                 if (k < 0)
                         r = k;
         }
 
+finish:
+        for (i = 0; i < n_jobs; i++)
+                device_scan_job_done(jobs + i);
+        free(jobs);
+
         return r;
 }
 
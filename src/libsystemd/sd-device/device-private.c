@@ -26,6 +26,7 @@
 #include "sd-device.h"
 
 #include "alloc-util.h"
+#include "device-db.h"
 #include "device-internal.h"
 #include "device-private.h"
 #include "device-util.h"
@@ -177,7 +178,6 @@ int device_ensure_usec_initialized(sd_device *device, sd_device *device_old) {
 
 static int device_read_db(sd_device *device) {
         _cleanup_free_ char *db = NULL;
-        char *path;
         const char *id, *value;
         char key;
         size_t db_len;
@@ -201,14 +201,12 @@ static int device_read_db(sd_device *device) {
         if (r < 0)
                 return r;
 
-        path = strjoina("/run/udev/data/", id);
-
-        r = read_full_file(path, &db, &db_len);
+        r = device_db_read(id, &db, &db_len);
         if (r < 0) {
                 if (r == -ENOENT)
                         return 0;
                 else
-                        return log_debug_errno(r, "sd-device: failed to read db '%s': %m", path);
+                        return log_debug_errno(r, "sd-device: failed to read db '%s': %m", id);
         }
 
         /* devices with a database entry are initialized */
@@ -988,6 +986,66 @@ void device_set_db_persist(sd_device *device) {
         device->db_persist = true;
 }
 
+static void device_write_db_entries(sd_device *device, FILE *f) {
+        const char *property, *value, *tag;
+        Iterator i;
+
+        if (major(device->devnum) > 0) {
+                const char *devlink;
+
+                FOREACH_DEVICE_DEVLINK(device, devlink)
+                        fprintf(f, "S:%s\n", devlink + STRLEN("/dev/"));
+
+                if (device->devlink_priority != 0)
+                        fprintf(f, "L:%i\n", device->devlink_priority);
+
+                if (device->watch_handle >= 0)
+                        fprintf(f, "W:%i\n", device->watch_handle);
+        }
+
+        if (device->usec_initialized > 0)
+                fprintf(f, "I:"USEC_FMT"\n", device->usec_initialized);
+
+        ORDERED_HASHMAP_FOREACH_KEY(value, property, device->properties_db, i)
+                fprintf(f, "E:%s=%s\n", property, value);
+
+        FOREACH_DEVICE_TAG(device, tag)
+                fprintf(f, "G:%s\n", tag);
+}
+
+static int device_update_db_binary(sd_device *device, const char *id, bool has_info) {
+        _cleanup_free_ char *data = NULL;
+        size_t size = 0;
+        char *path;
+        int r;
+
+        if (has_info) {
+                _cleanup_fclose_ FILE *f = NULL;
+
+                f = open_memstream(&data, &size);
+                if (!f)
+                        return -ENOMEM;
+
+                device_write_db_entries(device, f);
+
+                r = fflush_and_check(f);
+                if (r < 0)
+                        return r;
+        }
+
+        r = device_db_write(id, data, size, device->db_persist);
+        if (r < 0)
+                return log_error_errno(r, "failed to update %s entry '%s' for '%s': %m", DEVICE_DB_PATH, id, device->devpath);
+
+        /* the record shadows the file anyway, but do not leave outdated data around */
+        path = strjoina("/run/udev/data/", id);
+        (void) unlink(path);
+
+        log_debug("updated %s entry '%s' for '%s'", has_info ? "db" : "empty", id, device->devpath);
+
+        return 0;
+}
+
 int device_update_db(sd_device *device) {
         const char *id;
         char *path;
@@ -1012,9 +1070,17 @@ int device_update_db(sd_device *device) {
                 if (r < 0 && errno != ENOENT)
                         return -errno;
 
-                return 0;
+                return device_db_remove(id);
         }
 
+        if (device_db_get_binary())
+                return device_update_db_binary(device, id, has_info);
+
+        /* a record in the binary database would shadow the file */
+        r = device_db_remove(id);
+        if (r < 0)
+                return log_error_errno(r, "failed to remove %s entry '%s' for '%s': %m", DEVICE_DB_PATH, id, device->devpath);
+
         /* write a database file */
         r = mkdir_parents(path, 0755);
         if (r < 0)
@@ -1042,32 +1108,8 @@ int device_update_db(sd_device *device) {
                 }
         }
 
-        if (has_info) {
-                const char *property, *value, *tag;
-                Iterator i;
-
-                if (major(device->devnum) > 0) {
-                        const char *devlink;
-
-                        FOREACH_DEVICE_DEVLINK(device, devlink)
-                                fprintf(f, "S:%s\n", devlink + STRLEN("/dev/"));
-
-                        if (device->devlink_priority != 0)
-                                fprintf(f, "L:%i\n", device->devlink_priority);
-
-                        if (device->watch_handle >= 0)
-                                fprintf(f, "W:%i\n", device->watch_handle);
-                }
-
-                if (device->usec_initialized > 0)
-                        fprintf(f, "I:"USEC_FMT"\n", device->usec_initialized);
-
-                ORDERED_HASHMAP_FOREACH_KEY(value, property, device->properties_db, i)
-                        fprintf(f, "E:%s=%s\n", property, value);
-
-                FOREACH_DEVICE_TAG(device, tag)
-                        fprintf(f, "G:%s\n", tag);
-        }
+        if (has_info)
+                device_write_db_entries(device, f);
 
         r = fflush_and_check(f);
         if (r < 0)
@@ -1108,7 +1150,7 @@ int device_delete_db(sd_device *device) {
         if (r < 0 && errno != ENOENT)
                 return -errno;
 
-        return 0;
+        return device_db_remove(id);
 }
 
 int device_read_db_force(sd_device *device) {
@@ -0,0 +1,156 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "device-db.h"
+#include "fd-util.h"
+#include "log.h"
+#include "string-util.h"
+#include "util.h"
+
+/* None of these exist in /run/udev/data/, where entries missing from the file are looked up */
+#define ID_A "+test-device-db:a"
+#define ID_B "+test-device-db:b"
+#define ID_HALF "+test-device-db:half"
+
+static void assert_entry(const char *id, const char *data) {
+        _cleanup_free_ char *p = NULL;
+        size_t size;
+        int r;
+
+        r = device_db_read(id, &p, &size);
+        if (!data) {
+                assert_se(r == -ENOENT);
+                return;
+        }
+
+        assert_se(r >= 0);
+        assert_se(size == strlen(data));
+        assert_se(streq(p, data));
+}
+
+static void test_update_remove(void) {
+        assert_entry(ID_A, NULL);
+
+        assert_se(device_db_write(ID_A, "E:FOO=1\n", STRLEN("E:FOO=1\n"), false) >= 0);
+        assert_se(device_db_write(ID_B, "E:BAR=1\n", STRLEN("E:BAR=1\n"), true) >= 0);
+        assert_entry(ID_A, "E:FOO=1\n");
+        assert_entry(ID_B, "E:BAR=1\n");
+
+        /* the latest record wins */
+        assert_se(device_db_write(ID_A, "E:FOO=2\n", STRLEN("E:FOO=2\n"), false) >= 0);
+        assert_entry(ID_A, "E:FOO=2\n");
+
+        assert_se(device_db_remove(ID_A) >= 0);
+        assert_entry(ID_A, NULL);
+        assert_entry(ID_B, "E:BAR=1\n");
+
+        /* removing what is not there is fine */
+        assert_se(device_db_remove(ID_A) >= 0);
+}
+
+static void test_compact(void) {
+        _cleanup_free_ char *p = NULL;
+        unsigned i, n_compacted = 0;
+        off_t last_size = 0;
+        char data[4096];
+        size_t size;
+
+        /* Rewriting one entry over and over leaves only outdated records behind, hence once the file is
+         * large enough, it is replaced by one with the latest records only */
+        memset(data, 'x', sizeof(data));
+        for (i = 0; i < 2 * DEVICE_DB_COMPACT_MIN / sizeof(data); i++) {
+                struct stat st;
+
+                data[0] = 'a' + i % 26;
+                assert_se(device_db_write(ID_A, data, sizeof(data), false) >= 0);
+
+                assert_se(stat(DEVICE_DB_PATH, &st) >= 0);
+                assert_se((uint64_t) st.st_size < DEVICE_DB_COMPACT_MIN);
+                if (st.st_size < last_size)
+                        n_compacted++;
+                last_size = st.st_size;
+        }
+
+        assert_se(n_compacted > 0);
+
+        assert_se(device_db_read(ID_A, &p, &size) >= 0);
+        assert_se(size == sizeof(data));
+        assert_se(memcmp(p, data, size) == 0);
+        assert_entry(ID_B, "E:BAR=1\n");
+}
+
+static void test_truncated(void) {
+        /* A record which claims more than the file holds, and was never marked committed, like a writer
+         * which died half way through it leaves behind */
+        const uint32_t rec[4] = { 64, sizeof(ID_HALF), 16, 0 };
+        _cleanup_close_ int fd = -1;
+        struct stat st;
+        ino_t ino;
+
+        fd = open(DEVICE_DB_PATH, O_WRONLY|O_APPEND|O_CLOEXEC);
+        assert_se(fd >= 0);
+        assert_se(write(fd, rec, sizeof(rec)) == sizeof(rec));
+        assert_se(write(fd, ID_HALF, sizeof(ID_HALF)) == sizeof(ID_HALF));
+        fd = safe_close(fd);
+
+        assert_se(stat(DEVICE_DB_PATH, &st) >= 0);
+        ino = st.st_ino;
+
+        /* readers ignore it */
+        assert_entry(ID_HALF, NULL);
+        assert_entry(ID_B, "E:BAR=1\n");
+
+        /* and the next writer gets rid of it */
+        assert_se(device_db_write(ID_HALF, "E:HALF=0\n", STRLEN("E:HALF=0\n"), false) >= 0);
+        assert_se(stat(DEVICE_DB_PATH, &st) >= 0);
+        assert_se(st.st_ino != ino);
+        assert_entry(ID_HALF, "E:HALF=0\n");
+        assert_entry(ID_B, "E:BAR=1\n");
+}
+
+static void test_cleanup(void) {
+        /* only the entries which are meant to survive leaving the initramfs are kept */
+        assert_se(device_db_cleanup() >= 0);
+        assert_entry(ID_A, NULL);
+        assert_entry(ID_HALF, NULL);
+        assert_entry(ID_B, "E:BAR=1\n");
+
+        assert_se(unlink(DEVICE_DB_PATH) >= 0);
+        assert_se(device_db_cleanup() >= 0);
+        assert_entry(ID_B, NULL);
+}
+
+int main(int argc, char *argv[]) {
+        log_parse_environment();
+        log_open();
+
+        if (unlink(DEVICE_DB_PATH) < 0)
+                assert_se(errno == ENOENT);
+
+        test_update_remove();
+        test_compact();
+        test_truncated();
+        test_cleanup();
+
+        return 0;
+}
@@ -0,0 +1,238 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <sched.h>
+#include <sys/mount.h>
+#include <unistd.h>
+
+#include "sd-device.h"
+
+#include "alloc-util.h"
+#include "device-enumerator-private.h"
+#include "device-util.h"
+#include "env-util.h"
+#include "fileio.h"
+#include "fs-util.h"
+#include "log.h"
+#include "mkdir.h"
+#include "rm-rf.h"
+#include "string-util.h"
+#include "strv.h"
+#include "time-util.h"
+#include "util.h"
+
+#define N_CLASSES 32
+#define N_BUSES 8
+#define N_DEVICES 256
+
+static void make_device(const char *root, const char *devpath, const char *uevent, const char *subsystem_link) {
+        char *path;
+
+        path = strjoina(root, "/sys", devpath);
+        assert_se(mkdir_p(path, 0755) >= 0);
+
+        path = strjoina(root, "/sys", devpath, "/uevent");
+        assert_se(write_string_file(path, uevent, WRITE_STRING_FILE_CREATE) >= 0);
+
+        path = strjoina(root, "/sys", devpath, "/subsystem");
+        assert_se(symlink(subsystem_link, path) >= 0);
+}
+
+/* Builds something looking like sysfs: N_CLASSES classes of virtual devices with device nodes, and
+ * N_BUSES buses of devices without, each with N_DEVICES devices. Nothing has a udev database entry. */
+static void make_sysfs(const char *root) {
+        unsigned i, j;
+
+        for (i = 0; i < N_CLASSES; i++) {
+                _cleanup_free_ char *dir = NULL;
+
+                assert_se(asprintf(&dir, "%s/sys/class/synth%u", root, i) >= 0);
+                assert_se(mkdir_p(dir, 0755) >= 0);
+
+                for (j = 0; j < N_DEVICES; j++) {
+                        _cleanup_free_ char *devpath = NULL, *uevent = NULL, *subsystem = NULL, *link = NULL, *target = NULL;
+
+                        assert_se(asprintf(&devpath, "/devices/virtual/synth%u/synth%u-%u", i, i, j) >= 0);
+                        assert_se(asprintf(&uevent, "MAJOR=%u\nMINOR=%u\nDEVNAME=synth%u-%u\n", 4000 + i, j, i, j) >= 0);
+                        assert_se(asprintf(&subsystem, "../../../../class/synth%u", i) >= 0);
+                        make_device(root, devpath, uevent, subsystem);
+
+                        assert_se(asprintf(&link, "%s/synth%u-%u", dir, i, j) >= 0);
+                        assert_se(target = strappend("../../devices/virtual/", devpath + STRLEN("/devices/virtual/")));
+                        assert_se(symlink(target, link) >= 0);
+                }
+        }
+
+        for (i = 0; i < N_BUSES; i++) {
+                _cleanup_free_ char *dir = NULL;
+
+                assert_se(asprintf(&dir, "%s/sys/bus/sbus%u/devices", root, i) >= 0);
+                assert_se(mkdir_p(dir, 0755) >= 0);
+
+                for (j = 0; j < N_DEVICES; j++) {
+                        _cleanup_free_ char *devpath = NULL, *subsystem = NULL, *link = NULL, *target = NULL;
+
+                        assert_se(asprintf(&devpath, "/devices/sbus%u/sbus%u-%u", i, i, j) >= 0);
+                        assert_se(asprintf(&subsystem, "../../../bus/sbus%u", i) >= 0);
+                        make_device(root, devpath, "DRIVER=synth\n", subsystem);
+
+                        assert_se(asprintf(&link, "%s/sbus%u-%u", dir, i, j) >= 0);
+                        assert_se(asprintf(&target, "../../../devices/sbus%u/sbus%u-%u", i, i, j) >= 0);
+                        assert_se(symlink(target, link) >= 0);
+                }
+        }
+}
+
+static char **enumerate(unsigned n_threads, bool allow_uninitialized, const char *subsystem) {
+        _cleanup_(sd_device_enumerator_unrefp) sd_device_enumerator *e = NULL;
+        _cleanup_strv_free_ char **l = NULL;
+        sd_device *d;
+        char **ret;
+
+        assert_se(sd_device_enumerator_new(&e) >= 0);
+        assert_se(device_enumerator_set_n_threads(e, n_threads) >= 0);
+        if (allow_uninitialized)
+                assert_se(sd_device_enumerator_allow_uninitialized(e) >= 0);
+        if (subsystem)
+                assert_se(sd_device_enumerator_add_match_subsystem(e, subsystem, true) >= 0);
+
+        FOREACH_DEVICE(e, d) {
+                const char *syspath, *s;
+
+                assert_se(sd_device_get_syspath(d, &syspath) >= 0);
+                assert_se(sd_device_get_subsystem(d, &s) >= 0);
+                assert_se(startswith(s, "synth") || startswith(s, "sbus"));
+
+                assert_se(strv_extend(&l, syspath) >= 0);
+        }
+
+        ret = l;
+        l = NULL;
+        return ret;
+}
+
+static void test_enumerate(void) {
+        _cleanup_strv_free_ char **serial = NULL, **parallel = NULL;
+
+        /* Devices with device nodes but without database entry are not initialized yet. The threads go
+         * first, so that they are the ones creating the first hashmaps of this process. */
+        parallel = enumerate(4, false, NULL);
+        serial = enumerate(1, false, NULL);
+        assert_se(strv_length(serial) == N_BUSES * N_DEVICES);
+        assert_se(strv_equal(serial, parallel));
+        serial = strv_free(serial);
+        parallel = strv_free(parallel);
+
+        /* The order does not depend on the number of threads */
+        serial = enumerate(1, true, NULL);
+        parallel = enumerate(4, true, NULL);
+        assert_se(strv_length(serial) == (N_CLASSES + N_BUSES) * N_DEVICES);
+        assert_se(strv_equal(serial, parallel));
+        assert_se(streq(serial[0], "/sys/devices/sbus0/sbus0-0"));
+        serial = strv_free(serial);
+        parallel = strv_free(parallel);
+
+        serial = enumerate(1, true, "synth1*");
+        parallel = enumerate(4, true, "synth1*");
+        assert_se(strv_length(serial) == 11 * N_DEVICES);
+        assert_se(strv_equal(serial, parallel));
+}
+
+static usec_t benchmark_one(unsigned n_threads) {
+        usec_t best = USEC_INFINITY;
+        unsigned i;
+
+        for (i = 0; i < 5; i++) {
+                _cleanup_strv_free_ char **l = NULL;
+                usec_t ts, elapsed;
+
+                ts = now(CLOCK_MONOTONIC);
+                l = enumerate(n_threads, true, NULL);
+                elapsed = usec_sub_unsigned(now(CLOCK_MONOTONIC), ts);
+
+                assert_se(strv_length(l) == (N_CLASSES + N_BUSES) * N_DEVICES);
+                best = MIN(best, elapsed);
+        }
+
+        return best;
+}
+
+static void test_enumerate_benchmark(void) {
+        char buf[FORMAT_TIMESPAN_MAX];
+        unsigned n = (N_CLASSES + N_BUSES) * N_DEVICES;
+        usec_t serial, parallel;
+        int r;
+
+        /* Compares the calling thread on its own with one thread per CPU, best of five each. The tree is
+         * the same as test_enumerate() checked, so this only adds timing, which is left to slow runs. */
+
+        r = getenv_bool("SYSTEMD_SLOW_TESTS");
+        if (!(r >= 0 ? r : SYSTEMD_SLOW_TESTS_DEFAULT)) {
+                log_info("Skipping %s, set SYSTEMD_SLOW_TESTS=1 to run it.", __func__);
+                return;
+        }
+
+        serial = benchmark_one(1);
+        log_info("Enumerated %u devices serially in %s, %.1f devices/s",
+                 n, format_timespan(buf, sizeof(buf), serial, USEC_PER_MSEC),
+                 serial > 0 ? (double) n * USEC_PER_SEC / serial : 0.0);
+
+        parallel = benchmark_one(0);
+        log_info("Enumerated %u devices in parallel in %s, %.1f devices/s",
+                 n, format_timespan(buf, sizeof(buf), parallel, USEC_PER_MSEC),
+                 parallel > 0 ? (double) n * USEC_PER_SEC / parallel : 0.0);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *root = NULL;
+        char *path;
+
+        log_parse_environment();
+        log_open();
+
+        if (getuid() != 0) {
+                log_info("Skipping test: not root");
+                return EXIT_TEST_SKIP;
+        }
+
+        assert_se(mkdtemp_malloc("/tmp/test-device-enumerator-XXXXXX", &root) >= 0);
+        make_sysfs(root);
+
+        path = strjoina(root, "/run");
+        assert_se(mkdir(path, 0755) >= 0);
+
+        /* Replace /sys and /run in a private mount namespace, so that sd-device sees our tree and no
+         * udev database at all */
+        if (unshare(CLONE_NEWNS) < 0) {
+                log_info_errno(errno, "Skipping test: failed to create mount namespace: %m");
+                return EXIT_TEST_SKIP;
+        }
+
+        assert_se(mount(NULL, "/", NULL, MS_PRIVATE|MS_REC, NULL) >= 0);
+
+        path = strjoina(root, "/sys");
+        assert_se(mount(path, "/sys", NULL, MS_BIND, NULL) >= 0);
+
+        path = strjoina(root, "/run");
+        assert_se(mount(path, "/run", NULL, MS_BIND, NULL) >= 0);
+
+        test_enumerate();
+        test_enumerate_benchmark();
+
+        return 0;
+}
@@ -21,6 +21,7 @@
 
 #include "libudev.h"
 
+#include "device-db.h"
 #include "device-private.h"
 #include "libudev-device-internal.h"
 #include "libudev-private.h"
@@ -65,6 +66,14 @@ int udev_device_delete_db(struct udev_device *udev_device) {
         return 0;
 }
 
+void udev_device_set_db_binary(bool b) {
+        device_db_set_binary(b);
+}
+
+int udev_device_cleanup_db_binary(void) {
+        return device_db_cleanup();
+}
+
 int udev_device_get_ifindex(struct udev_device *udev_device) {
         int r, ifindex;
 
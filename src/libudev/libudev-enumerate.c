@@ -349,6 +349,12 @@ _public_ int udev_enumerate_add_match_is_initialized(struct udev_enumerate *udev
         return device_enumerator_add_match_is_initialized(udev_enumerate->enumerator);
 }
 
+int udev_enumerate_set_n_threads(struct udev_enumerate *udev_enumerate, unsigned n_threads) {
+        assert_return(udev_enumerate, -EINVAL);
+
+        return device_enumerator_set_n_threads(udev_enumerate->enumerator, n_threads);
+}
+
 /**
  * udev_enumerate_add_match_sysname:
  * @udev_enumerate: context
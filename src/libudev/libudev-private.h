@@ -74,6 +74,8 @@ void udev_device_read_db(struct udev_device *udev_device);
 /* libudev-device-private.c */
 int udev_device_update_db(struct udev_device *udev_device);
 int udev_device_delete_db(struct udev_device *udev_device);
+void udev_device_set_db_binary(bool b);
+int udev_device_cleanup_db_binary(void);
 int udev_device_tag_index(struct udev_device *dev, struct udev_device *dev_old, bool add);
 
 /* libudev-monitor.c - netlink/unix socket communication  */
@@ -83,6 +85,9 @@ int udev_monitor_send_device(struct udev_monitor *udev_monitor,
                              struct udev_monitor *destination, struct udev_device *udev_device);
 struct udev_monitor *udev_monitor_new_from_netlink_fd(struct udev *udev, const char *name, int fd);
 
+/* libudev-enumerate.c */
+int udev_enumerate_set_n_threads(struct udev_enumerate *udev_enumerate, unsigned n_threads);
+
 /* libudev-list.c */
 struct udev_list_node {
         struct udev_list_node *next, *prev;
@@ -1213,7 +1213,8 @@ static int bus_append_service_property(sd_bus_message *m, const char *field, con
 
                 return bus_append_string(m, field, eq);
 
-        if (STR_IN_SET(field, "PermissionsStartOnly", "RootDirectoryStartOnly", "RemainAfterExit", "GuessMainPID"))
+        if (STR_IN_SET(field, "PermissionsStartOnly", "RootDirectoryStartOnly", "RemainAfterExit", "GuessMainPID",
+                       "WatchdogSharedMemory"))
 
                 return bus_append_parse_boolean(m, field, eq);
 
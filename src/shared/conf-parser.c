@@ -293,10 +293,12 @@ int config_parse(const char *unit,
                  ConfigParseFlags flags,
                  void *userdata) {
 
-        _cleanup_free_ char *section = NULL, *continuation = NULL;
+        _cleanup_free_ char *section = NULL, *continuation = NULL, *contents = NULL;
+        size_t continuation_size = 0, continuation_allocated = 0, size;
         _cleanup_fclose_ FILE *ours = NULL;
         unsigned line = 0, section_line = 0;
-        bool section_ignored = false;
+        bool section_ignored = false, continued = false;
+        char *next, *end;
         int r;
 
         assert(filename);
@@ -316,56 +318,71 @@ int config_parse(const char *unit,
 
         fd_warn_permissions(filename, fileno(f));
 
-        for (;;) {
-                _cleanup_free_ char *buf = NULL;
+        r = read_full_stream(f, &contents, &size);
+        if (r < 0) {
+                if (flags & CONFIG_PARSE_WARN)
+                        log_error_errno(r, "%s: Error while reading configuration file: %m", filename);
+
+                return r;
+        }
+
+        /* The file is split into lines in place, by overwriting the delimiters (\n and \0, like read_line()
+         * uses them) with NUL bytes. Lines are only copied when they are continued on the next one, and the
+         * continuation buffer is reused for all continued lines of the file. */
+
+        for (next = contents, end = contents + size; next < end; ) {
                 bool escaped = false;
-                char *l, *p, *e;
+                char *l, *p, *e, *eol;
+                size_t n;
 
-                r = read_line(f, LONG_LINE_MAX, &buf);
-                if (r == 0)
-                        break;
-                if (r == -ENOBUFS) {
+                eol = memchr(next, '\n', end - next);
+                n = strnlen(next, (eol ?: end) - next);
+
+                if (n >= LONG_LINE_MAX) {
                         if (flags & CONFIG_PARSE_WARN)
-                                log_error_errno(r, "%s:%u: Line too long", filename, line);
+                                log_error("%s:%u: Line too long", filename, line);
 
-                        return r;
+                        return -ENOBUFS;
                 }
-                if (r < 0) {
-                        if (CONFIG_PARSE_WARN)
-                                log_error_errno(r, "%s:%u: Error while reading configuration file: %m", filename, line);
 
-                        return r;
-                }
+                l = next;
+                l[n] = 0;
+                next += n + 1;
 
-                l = buf;
                 if (!(flags & CONFIG_PARSE_REFUSE_BOM)) {
                         char *q;
 
-                        q = startswith(buf, UTF8_BYTE_ORDER_MARK);
+                        q = startswith(l, UTF8_BYTE_ORDER_MARK);
                         if (q) {
+                                n -= q - l;
                                 l = q;
                                 flags |= CONFIG_PARSE_REFUSE_BOM;
                         }
                 }
 
-                if (continuation) {
-                        if (strlen(continuation) + strlen(l) > LONG_LINE_MAX) {
+                if (continued) {
+                        if (continuation_size + n > LONG_LINE_MAX) {
                                 if (flags & CONFIG_PARSE_WARN)
                                         log_error("%s:%u: Continuation line too long", filename, line);
                                 return -ENOBUFS;
                         }
 
-                        if (!strextend(&continuation, l, NULL)) {
+                        if (!GREEDY_REALLOC(continuation, continuation_allocated, continuation_size + n + 1)) {
                                 if (flags & CONFIG_PARSE_WARN)
                                         log_oom();
                                 return -ENOMEM;
                         }
 
+                        /* The trailing backslash of the previous part was replaced by a space already, hence
+                         * only the part we append needs to be checked for another one. */
+                        e = memcpy(continuation + continuation_size, l, n + 1);
+                        continuation_size += n;
+
                         p = continuation;
                 } else
-                        p = l;
+                        p = e = l;
 
-                for (e = p; *e; e++) {
+                for (; *e; e++) {
                         if (escaped)
                                 escaped = false;
                         else if (*e == '\\')
@@ -375,13 +392,16 @@ int config_parse(const char *unit,
                 if (escaped) {
                         *(e-1) = ' ';
 
-                        if (!continuation) {
-                                continuation = strdup(l);
-                                if (!continuation) {
+                        if (!continued) {
+                                if (!GREEDY_REALLOC(continuation, continuation_allocated, n + 1)) {
                                         if (flags & CONFIG_PARSE_WARN)
                                                 log_oom();
                                         return -ENOMEM;
                                 }
+
+                                memcpy(continuation, l, n + 1);
+                                continuation_size = n;
+                                continued = true;
                         }
 
                         continue;
@@ -406,7 +426,8 @@ int config_parse(const char *unit,
 
                 }
 
-                continuation = mfree(continuation);
+                continued = false;
+                continuation_size = 0;
         }
 
         return 0;
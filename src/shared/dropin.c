@@ -117,41 +117,137 @@ int write_drop_in_format(const char *dir, const char *unit, unsigned level,
         return write_drop_in(dir, unit, level, name, p);
 }
 
+typedef struct DropinDir {
+        char *path;
+        char *chased;     /* NULL if the directory doesn't exist */
+        char **files;     /* Names of all regular files and symlinks in it, once listed */
+        bool listed;
+} DropinDir;
+
+static DropinDir* dropin_dir_free(DropinDir *d) {
+        if (!d)
+                return NULL;
+
+        free(d->path);
+        free(d->chased);
+        strv_free(d->files);
+
+        return mfree(d);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(DropinDir*, dropin_dir_free);
+
+Hashmap* dropin_dir_cache_new(void) {
+        return hashmap_new(&string_hash_ops);
+}
+
+Hashmap* dropin_dir_cache_free(Hashmap *h) {
+        DropinDir *d;
+
+        while ((d = hashmap_steal_first(h)))
+                dropin_dir_free(d);
+
+        return hashmap_free(h);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(Hashmap*, dropin_dir_cache_free);
+
+static int dropin_dir_list(DropinDir *d) {
+        _cleanup_closedir_ DIR *dir = NULL;
+        struct dirent *de;
+
+        assert(d);
+        assert(d->chased);
+
+        if (d->listed)
+                return 0;
+
+        dir = opendir(d->chased);
+        if (!dir) {
+                if (errno != ENOENT)
+                        return -errno;
+        } else
+                FOREACH_DIRENT(de, dir, return -errno) {
+                        if (!dirent_is_file_with_suffix(de, NULL)) {
+                                log_debug("Ignoring %s/%s, because it's not a regular file.", d->chased, de->d_name);
+                                continue;
+                        }
+
+                        if (strv_extend(&d->files, de->d_name) < 0)
+                                return -ENOMEM;
+                }
+
+        d->listed = true;
+        return 0;
+}
+
 static int unit_file_find_dir(
                 const char *original_root,
+                Hashmap *dir_cache,
                 const char *path,
-                char ***dirs) {
+                DropinDir ***dirs,
+                size_t *n_dirs,
+                size_t *n_allocated) {
 
-        _cleanup_free_ char *chased = NULL;
+        _cleanup_(dropin_dir_freep) DropinDir *n = NULL;
+        DropinDir *d;
+        size_t i;
         int r;
 
+        assert(dir_cache);
         assert(path);
 
-        r = chase_symlinks(path, original_root, 0, &chased);
-        /* Ignore -ENOENT, after all most units won't have a drop-in dir.
-         * Also ignore -ENAMETOOLONG, users are not even able to create
-         * the drop-in dir in such case. This mostly happens for device units with long /sys path.
-         * */
-        if (IN_SET(r, -ENOENT, -ENAMETOOLONG))
+        d = hashmap_get(dir_cache, path);
+        if (!d) {
+                n = new0(DropinDir, 1);
+                if (!n)
+                        return log_oom();
+
+                n->path = strdup(path);
+                if (!n->path)
+                        return log_oom();
+
+                r = chase_symlinks(path, original_root, 0, &n->chased);
+                /* Ignore -ENOENT, after all most units won't have a drop-in dir.
+                 * Also ignore -ENAMETOOLONG, users are not even able to create
+                 * the drop-in dir in such case. This mostly happens for device units with long /sys path.
+                 * */
+                if (r < 0 && !IN_SET(r, -ENOENT, -ENAMETOOLONG))
+                        return log_full_errno(LOG_WARNING, r, "Failed to canonicalize path %s: %m", path);
+
+                r = hashmap_put(dir_cache, n->path, n);
+                if (r < 0)
+                        return log_oom();
+
+                d = n;
+                n = NULL;
+        }
+
+        if (!d->chased)
                 return 0;
-        if (r < 0)
-                return log_full_errno(LOG_WARNING, r, "Failed to canonicalize path %s: %m", path);
 
-        r = strv_push(dirs, chased);
-        if (r < 0)
+        /* Different paths might resolve to the same directory, only list it once */
+        for (i = 0; i < *n_dirs; i++)
+                if (path_equal((*dirs)[i]->chased, d->chased))
+                        return 0;
+
+        if (!GREEDY_REALLOC(*dirs, *n_allocated, *n_dirs + 1))
                 return log_oom();
 
-        chased = NULL;
+        (*dirs)[(*n_dirs)++] = d;
         return 0;
 }
 
 static int unit_file_find_dirs(
                 const char *original_root,
                 Set *unit_path_cache,
+                Hashmap *dir_cache,
                 const char *unit_path,
                 const char *name,
                 const char *suffix,
-                char ***dirs) {
+                DropinDir ***dirs,
+                size_t *n_dirs,
+                size_t *n_allocated) {
 
         char *path;
         int r;
@@ -163,7 +259,7 @@ static int unit_file_find_dirs(
         path = strjoina(unit_path, "/", name, suffix);
 
         if (!unit_path_cache || set_get(unit_path_cache, path)) {
-                r = unit_file_find_dir(original_root, path, dirs);
+                r = unit_file_find_dir(original_root, dir_cache, path, dirs, n_dirs, n_allocated);
                 if (r < 0)
                         return r;
         }
@@ -177,38 +273,118 @@ static int unit_file_find_dirs(
                 if (r < 0)
                         return log_error_errno(r, "Failed to generate template from unit name: %m");
 
-                return unit_file_find_dirs(original_root, unit_path_cache, unit_path, template, suffix, dirs);
+                return unit_file_find_dirs(original_root, unit_path_cache, dir_cache, unit_path, template, suffix, dirs, n_dirs, n_allocated);
         }
 
         return 0;
 }
 
+static int base_cmp(const void *a, const void *b) {
+        const char *s1, *s2;
+
+        s1 = *(char * const *)a;
+        s2 = *(char * const *)b;
+        return strcmp(basename(s1), basename(s2));
+}
+
+static int dropin_dirs_list_files(DropinDir **dirs, size_t n_dirs, const char *suffix, char ***ret) {
+        _cleanup_hashmap_free_free_ Hashmap *fh = NULL;
+        char **files;
+        size_t i;
+        int r;
+
+        assert(ret);
+
+        /* Like conf_files_list_strv(), but uses the cached listings: files in earlier directories override
+         * files by the same name in later ones, and the result is sorted by file name. */
+
+        fh = hashmap_new(&string_hash_ops);
+        if (!fh)
+                return -ENOMEM;
+
+        for (i = 0; i < n_dirs; i++) {
+                char **f;
+
+                r = dropin_dir_list(dirs[i]);
+                if (r == -ENOMEM)
+                        return r;
+                if (r < 0) {
+                        log_debug_errno(r, "Failed to search for files in %s, ignoring: %m", dirs[i]->chased);
+                        continue;
+                }
+
+                STRV_FOREACH(f, dirs[i]->files) {
+                        char *p;
+
+                        if (suffix && !endswith(*f, suffix)) {
+                                log_debug("Ignoring %s/%s, because it doesn't have suffix %s.", dirs[i]->chased, *f, suffix);
+                                continue;
+                        }
+
+                        p = strjoin(dirs[i]->chased, "/", *f);
+                        if (!p)
+                                return -ENOMEM;
+
+                        r = hashmap_put(fh, basename(p), p);
+                        if (r == -EEXIST) {
+                                log_debug("Skipping overridden file: %s.", p);
+                                free(p);
+                        } else if (r < 0) {
+                                free(p);
+                                return r;
+                        }
+                }
+        }
+
+        files = hashmap_get_strv(fh);
+        if (!files)
+                return -ENOMEM;
+
+        qsort_safe(files, hashmap_size(fh), sizeof(char *), base_cmp);
+
+        /* The strings are owned by the array now */
+        fh = hashmap_free(fh);
+
+        *ret = files;
+        return 0;
+}
+
 int unit_file_find_dropin_paths(
                 const char *original_root,
                 char **lookup_path,
                 Set *unit_path_cache,
+                Hashmap *dir_cache,
                 const char *dir_suffix,
                 const char *file_suffix,
                 Set *names,
                 char ***ret) {
 
-        _cleanup_strv_free_ char **dirs = NULL;
+        _cleanup_(dropin_dir_cache_freep) Hashmap *local_cache = NULL;
+        _cleanup_free_ DropinDir **dirs = NULL;
+        size_t n_dirs = 0, n_allocated = 0;
         Iterator i;
         char *t, **p;
         int r;
 
         assert(ret);
 
+        /* Without a cache shared across units, use one for this invocation only */
+        if (!dir_cache) {
+                dir_cache = local_cache = dropin_dir_cache_new();
+                if (!dir_cache)
+                        return log_oom();
+        }
+
         SET_FOREACH(t, names, i)
                 STRV_FOREACH(p, lookup_path)
-                        unit_file_find_dirs(original_root, unit_path_cache, *p, t, dir_suffix, &dirs);
+                        unit_file_find_dirs(original_root, unit_path_cache, dir_cache, *p, t, dir_suffix, &dirs, &n_dirs, &n_allocated);
 
-        if (strv_isempty(dirs)) {
+        if (n_dirs == 0) {
                 *ret = NULL;
                 return 0;
         }
 
-        r = conf_files_list_strv(ret, file_suffix, NULL, 0, (const char**) dirs);
+        r = dropin_dirs_list_files(dirs, n_dirs, file_suffix, ret);
         if (r < 0)
                 return log_warning_errno(r, "Failed to create the list of configuration files: %m");
 
@@ -34,10 +34,18 @@ int write_drop_in(const char *dir, const char *unit, unsigned level,
 int write_drop_in_format(const char *dir, const char *unit, unsigned level,
                          const char *name, const char *format, ...) _printf_(5, 6);
 
+/* A drop-in directory cache maps drop-in directory paths to their canonicalized path and their listing, so
+ * that units sharing drop-in directories (e.g. all instances of a template) don't look at the same
+ * directories over and over again. It may only be used while the file system is not expected to change,
+ * i.e. for the duration of a single load cycle. */
+Hashmap* dropin_dir_cache_new(void);
+Hashmap* dropin_dir_cache_free(Hashmap *h);
+
 int unit_file_find_dropin_paths(
                 const char *original_root,
                 char **lookup_path,
                 Set *unit_path_cache,
+                Hashmap *dir_cache,
                 const char *dir_suffix,
                 const char *file_suffix,
                 Set *names,
@@ -47,11 +55,13 @@ static inline int unit_file_find_dropin_conf_paths(
                 const char *original_root,
                 char **lookup_path,
                 Set *unit_path_cache,
+                Hashmap *dir_cache,
                 Set *names,
                 char ***paths) {
         return unit_file_find_dropin_paths(original_root,
                                            lookup_path,
                                            unit_path_cache,
+                                           dir_cache,
                                            ".d", ".conf",
                                            names, paths);
 }
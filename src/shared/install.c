@@ -112,6 +112,7 @@ static inline void presets_freep(Presets *p) {
 }
 
 static int unit_file_lookup_state(UnitFileScope scope, const LookupPaths *paths, const char *name, UnitFileState *ret);
+static void symlink_index_flush(void);
 
 bool unit_type_may_alias(UnitType type) {
         return IN_SET(type,
@@ -455,6 +456,8 @@ static int create_symlink(
         assert(old_path);
         assert(new_path);
 
+        symlink_index_flush();
+
         rp = skip_root(paths, old_path);
         if (rp)
                 old_path = rp;
@@ -679,6 +682,9 @@ static int remove_marked_symlinks(
         if (set_size(remove_symlinks_to) <= 0)
                 return 0;
 
+        if (!dry_run)
+                symlink_index_flush();
+
         fd = open(config_path, O_RDONLY|O_NONBLOCK|O_DIRECTORY|O_CLOEXEC);
         if (fd < 0)
                 return errno == ENOENT ? 0 : -errno;
@@ -725,24 +731,112 @@ static bool is_symlink_with_known_name(const UnitFileInstallInfo *i, const char
         return false;
 }
 
-static int find_symlinks_fd(
-                const char *root_dir,
-                UnitFileInstallInfo *i,
-                bool match_aliases,
-                int fd,
-                const char *path,
-                const char *config_path,
-                bool *same_name_link) {
+/* Finding the symlinks pointing to a unit file requires walking the whole directory tree below each directory of the
+ * search path and reading all symlinks in it, which is repeated for every single unit file when all of them are
+ * listed. Hence, we remember what we found, together with the identity and modification time of each directory
+ * walked, which change whenever symlinks are added to or removed from it. */
+typedef struct SymlinkIndexLink {
+        char *path;     /* absolute path of the symlink */
+        char *dest;     /* what it points to, made absolute */
+} SymlinkIndexLink;
+
+typedef struct SymlinkIndexDir {
+        char *path;
+        dev_t dev;
+        ino_t ino;
+        struct timespec mtime;
+} SymlinkIndexDir;
+
+typedef struct SymlinkIndex {
+        char *config_path;
+        char *root_dir;
+
+        SymlinkIndexDir *dirs;
+        size_t n_dirs, n_allocated_dirs;
+
+        SymlinkIndexLink *links;
+        size_t n_links, n_allocated_links;
+
+        /* The first error encountered while walking the tree, returned if no symlink matches */
+        int error;
+
+        /* If a directory was modified right before we walked it, further modifications might not change its
+         * timestamp anymore. Don't rely on it in that case. */
+        bool racy;
+
+        unsigned validated_epoch;
+} SymlinkIndex;
+
+static Hashmap *symlink_indexes = NULL;
+
+/* While listing all unit files, each index is validated only once */
+static unsigned symlink_index_epoch = 0;
+static bool symlink_index_batch = false;
+
+static SymlinkIndex *symlink_index_free(SymlinkIndex *x) {
+        size_t k;
+
+        if (!x)
+                return NULL;
+
+        for (k = 0; k < x->n_dirs; k++)
+                free(x->dirs[k].path);
+        free(x->dirs);
+
+        for (k = 0; k < x->n_links; k++) {
+                free(x->links[k].path);
+                free(x->links[k].dest);
+        }
+        free(x->links);
+
+        free(x->config_path);
+        free(x->root_dir);
+        return mfree(x);
+}
 
+static void symlink_index_flush(void) {
+        symlink_indexes = hashmap_free_with_destructor(symlink_indexes, symlink_index_free);
+}
+
+static int symlink_index_add_dir(SymlinkIndex *x, const char *path, int fd, usec_t now) {
+        struct stat st;
+        char *p;
+
+        assert(x);
+        assert(path);
+        assert(fd >= 0);
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        if (!GREEDY_REALLOC(x->dirs, x->n_allocated_dirs, x->n_dirs + 1))
+                return -ENOMEM;
+
+        p = strdup(path);
+        if (!p)
+                return -ENOMEM;
+
+        x->dirs[x->n_dirs++] = (SymlinkIndexDir) {
+                .path = p,
+                .dev = st.st_dev,
+                .ino = st.st_ino,
+                .mtime = st.st_mtim,
+        };
+
+        if (timespec_load(&st.st_mtim) + USEC_PER_SEC > now)
+                x->racy = true;
+
+        return 0;
+}
+
+static int symlink_index_walk(SymlinkIndex *x, const char *root_dir, int fd, const char *path, usec_t now) {
         _cleanup_closedir_ DIR *d = NULL;
         struct dirent *de;
-        int r = 0;
+        int r;
 
-        assert(i);
+        assert(x);
         assert(fd >= 0);
         assert(path);
-        assert(config_path);
-        assert(same_name_link);
 
         d = fdopendir(fd);
         if (!d) {
@@ -750,21 +844,25 @@ static int find_symlinks_fd(
                 return -errno;
         }
 
+        r = symlink_index_add_dir(x, path, dirfd(d), now);
+        if (r < 0)
+                return r;
+
         FOREACH_DIRENT(de, d, return -errno) {
 
                 dirent_ensure_type(d, de);
 
                 if (de->d_type == DT_DIR) {
                         _cleanup_free_ char *p = NULL;
-                        int nfd, q;
+                        int nfd;
 
                         nfd = openat(fd, de->d_name, O_RDONLY|O_NONBLOCK|O_DIRECTORY|O_CLOEXEC|O_NOFOLLOW);
                         if (nfd < 0) {
                                 if (errno == ENOENT)
                                         continue;
 
-                                if (r == 0)
-                                        r = -errno;
+                                if (x->error == 0)
+                                        x->error = -errno;
                                 continue;
                         }
 
@@ -775,17 +873,14 @@ static int find_symlinks_fd(
                         }
 
                         /* This will close nfd, regardless whether it succeeds or not */
-                        q = find_symlinks_fd(root_dir, i, match_aliases, nfd,
-                                             p, config_path, same_name_link);
-                        if (q > 0)
-                                return 1;
-                        if (r == 0)
-                                r = q;
+                        r = symlink_index_walk(x, root_dir, nfd, p, now);
+                        if (r == -ENOMEM)
+                                return r;
+                        if (r < 0 && x->error == 0)
+                                x->error = r;
 
                 } else if (de->d_type == DT_LNK) {
                         _cleanup_free_ char *p = NULL, *dest = NULL;
-                        bool found_path, found_dest, b = false;
-                        int q;
 
                         /* Acquire symlink name */
                         p = path_make_absolute(de->d_name, path);
@@ -793,95 +888,208 @@ static int find_symlinks_fd(
                                 return -ENOMEM;
 
                         /* Acquire symlink destination */
-                        q = readlink_malloc(p, &dest);
-                        if (q == -ENOENT)
+                        r = readlink_malloc(p, &dest);
+                        if (r == -ENOENT)
                                 continue;
-                        if (q < 0) {
-                                if (r == 0)
-                                        r = q;
+                        if (r < 0) {
+                                if (x->error == 0)
+                                        x->error = r;
                                 continue;
                         }
 
                         /* Make absolute */
                         if (!path_is_absolute(dest)) {
-                                char *x;
+                                char *t;
 
-                                x = prefix_root(root_dir, dest);
-                                if (!x)
+                                t = prefix_root(root_dir, dest);
+                                if (!t)
                                         return -ENOMEM;
 
-                                free(dest);
-                                dest = x;
+                                free_and_replace(dest, t);
                         }
 
-                        /* Check if the symlink itself matches what we
-                         * are looking for */
-                        if (path_is_absolute(i->name))
-                                found_path = path_equal(p, i->name);
-                        else
-                                found_path = streq(de->d_name, i->name);
+                        if (!GREEDY_REALLOC(x->links, x->n_allocated_links, x->n_links + 1))
+                                return -ENOMEM;
 
-                        /* Check if what the symlink points to
-                         * matches what we are looking for */
-                        if (path_is_absolute(i->name))
-                                found_dest = path_equal(dest, i->name);
-                        else
-                                found_dest = streq(basename(dest), i->name);
+                        x->links[x->n_links++] = (SymlinkIndexLink) {
+                                .path = p,
+                                .dest = dest,
+                        };
+                        p = dest = NULL;
+                }
+        }
 
-                        if (found_path && found_dest) {
-                                _cleanup_free_ char *t = NULL;
+        return 0;
+}
 
-                                /* Filter out same name links in the main
-                                 * config path */
-                                t = path_make_absolute(i->name, config_path);
-                                if (!t)
-                                        return -ENOMEM;
+static bool symlink_index_is_valid(SymlinkIndex *x) {
+        size_t k;
 
-                                b = path_equal(t, p);
-                        }
+        assert(x);
 
-                        if (b)
-                                *same_name_link = true;
-                        else if (found_path || found_dest) {
-                                if (!match_aliases)
-                                        return 1;
-
-                                /* Check if symlink name is in the set of names used by [Install] */
-                                q = is_symlink_with_known_name(i, de->d_name);
-                                if (q < 0)
-                                        return q;
-                                if (q > 0)
-                                        return 1;
-                        }
+        if (symlink_index_batch && x->validated_epoch == symlink_index_epoch)
+                return true;
+
+        if (x->racy)
+                return false;
+
+        for (k = 0; k < x->n_dirs; k++) {
+                struct stat st;
+
+                if (stat(x->dirs[k].path, &st) < 0)
+                        return false;
+
+                if (st.st_dev != x->dirs[k].dev ||
+                    st.st_ino != x->dirs[k].ino ||
+                    st.st_mtim.tv_sec != x->dirs[k].mtime.tv_sec ||
+                    st.st_mtim.tv_nsec != x->dirs[k].mtime.tv_nsec)
+                        return false;
+        }
+
+        x->validated_epoch = symlink_index_epoch;
+        return true;
+}
+
+static int symlink_index_get(const char *root_dir, const char *config_path, SymlinkIndex **ret) {
+        SymlinkIndex *x;
+        int fd, r;
+
+        assert(config_path);
+        assert(ret);
+
+        x = hashmap_get(symlink_indexes, config_path);
+        if (x) {
+                if (streq_ptr(x->root_dir, root_dir) && symlink_index_is_valid(x)) {
+                        *ret = x;
+                        return 1;
                 }
+
+                hashmap_remove(symlink_indexes, config_path);
+                symlink_index_free(x);
         }
 
+        fd = open(config_path, O_RDONLY|O_NONBLOCK|O_DIRECTORY|O_CLOEXEC);
+        if (fd < 0) {
+                if (IN_SET(errno, ENOENT, ENOTDIR, EACCES))
+                        return 0;
+                return -errno;
+        }
+
+        r = hashmap_ensure_allocated(&symlink_indexes, &string_hash_ops);
+        if (r < 0) {
+                safe_close(fd);
+                return r;
+        }
+
+        x = new0(SymlinkIndex, 1);
+        if (!x) {
+                safe_close(fd);
+                return -ENOMEM;
+        }
+
+        x->validated_epoch = symlink_index_epoch;
+
+        x->config_path = strdup(config_path);
+        if (!x->config_path) {
+                safe_close(fd);
+                r = -ENOMEM;
+                goto fail;
+        }
+
+        if (root_dir) {
+                x->root_dir = strdup(root_dir);
+                if (!x->root_dir) {
+                        safe_close(fd);
+                        r = -ENOMEM;
+                        goto fail;
+                }
+        }
+
+        /* This takes possession of fd and closes it */
+        r = symlink_index_walk(x, root_dir, fd, config_path, now(CLOCK_REALTIME));
+        if (r < 0)
+                goto fail;
+
+        r = hashmap_put(symlink_indexes, x->config_path, x);
+        if (r < 0)
+                goto fail;
+
+        *ret = x;
+        return 1;
+
+fail:
+        symlink_index_free(x);
         return r;
 }
 
 static int find_symlinks(
                 const char *root_dir,
                 UnitFileInstallInfo *i,
-                bool match_name,
+                bool match_aliases,
                 const char *config_path,
                 bool *same_name_link) {
 
-        int fd;
+        SymlinkIndex *x;
+        size_t k;
+        int r;
 
         assert(i);
         assert(config_path);
         assert(same_name_link);
 
-        fd = open(config_path, O_RDONLY|O_NONBLOCK|O_DIRECTORY|O_CLOEXEC);
-        if (fd < 0) {
-                if (IN_SET(errno, ENOENT, ENOTDIR, EACCES))
-                        return 0;
-                return -errno;
+        r = symlink_index_get(root_dir, config_path, &x);
+        if (r <= 0)
+                return r;
+
+        for (k = 0; k < x->n_links; k++) {
+                const SymlinkIndexLink *l = x->links + k;
+                bool found_path, found_dest, b = false;
+                const char *name;
+
+                name = basename(l->path);
+
+                /* Check if the symlink itself matches what we
+                 * are looking for */
+                if (path_is_absolute(i->name))
+                        found_path = path_equal(l->path, i->name);
+                else
+                        found_path = streq(name, i->name);
+
+                /* Check if what the symlink points to
+                 * matches what we are looking for */
+                if (path_is_absolute(i->name))
+                        found_dest = path_equal(l->dest, i->name);
+                else
+                        found_dest = streq(basename(l->dest), i->name);
+
+                if (found_path && found_dest) {
+                        _cleanup_free_ char *t = NULL;
+
+                        /* Filter out same name links in the main
+                         * config path */
+                        t = path_make_absolute(i->name, config_path);
+                        if (!t)
+                                return -ENOMEM;
+
+                        b = path_equal(t, l->path);
+                }
+
+                if (b)
+                        *same_name_link = true;
+                else if (found_path || found_dest) {
+                        if (!match_aliases)
+                                return 1;
+
+                        /* Check if symlink name is in the set of names used by [Install] */
+                        r = is_symlink_with_known_name(i, name);
+                        if (r < 0)
+                                return r;
+                        if (r > 0)
+                                return 1;
+                }
         }
 
-        /* This takes possession of fd and closes it */
-        return find_symlinks_fd(root_dir, i, match_name, fd,
-                                config_path, config_path, same_name_link);
+        return x->error;
 }
 
 static int find_symlinks_in_scope(
@@ -2094,6 +2302,9 @@ int unit_file_unmask(
                 if (!path)
                         return -ENOMEM;
 
+                if (!dry_run)
+                        symlink_index_flush();
+
                 if (!dry_run && unlink(path) < 0) {
                         if (errno != ENOENT) {
                                 if (r >= 0)
@@ -2344,6 +2555,8 @@ int unit_file_revert(
 
                 (void) get_files_in_directory(*i, &fs);
 
+                symlink_index_flush();
+
                 q = rm_rf(*i, REMOVE_ROOT|REMOVE_PHYSICAL);
                 if (q < 0 && q != -ENOENT && r >= 0) {
                         r = q;
@@ -3136,26 +3349,20 @@ Hashmap* unit_file_list_free(Hashmap *h) {
 
 DEFINE_TRIVIAL_CLEANUP_FUNC(UnitFileList*, unit_file_list_free_one);
 
-int unit_file_get_list(
+static int unit_file_get_list_internal(
                 UnitFileScope scope,
-                const char *root_dir,
+                const LookupPaths *paths,
                 Hashmap *h,
                 char **states,
                 char **patterns) {
 
-        _cleanup_lookup_paths_free_ LookupPaths paths = {};
         char **i;
         int r;
 
-        assert(scope >= 0);
-        assert(scope < _UNIT_FILE_SCOPE_MAX);
+        assert(paths);
         assert(h);
 
-        r = lookup_paths_init(&paths, scope, 0, root_dir);
-        if (r < 0)
-                return r;
-
-        STRV_FOREACH(i, paths.search_path) {
+        STRV_FOREACH(i, paths->search_path) {
                 _cleanup_closedir_ DIR *d = NULL;
                 struct dirent *de;
 
@@ -3196,7 +3403,7 @@ int unit_file_get_list(
                         if (!f->path)
                                 return -ENOMEM;
 
-                        r = unit_file_lookup_state(scope, &paths, de->d_name, &f->state);
+                        r = unit_file_lookup_state(scope, paths, de->d_name, &f->state);
                         if (r < 0)
                                 f->state = UNIT_FILE_BAD;
 
@@ -3215,6 +3422,35 @@ int unit_file_get_list(
         return 0;
 }
 
+int unit_file_get_list(
+                UnitFileScope scope,
+                const char *root_dir,
+                Hashmap *h,
+                char **states,
+                char **patterns) {
+
+        _cleanup_lookup_paths_free_ LookupPaths paths = {};
+        int r;
+
+        assert(scope >= 0);
+        assert(scope < _UNIT_FILE_SCOPE_MAX);
+        assert(h);
+
+        r = lookup_paths_init(&paths, scope, 0, root_dir);
+        if (r < 0)
+                return r;
+
+        /* Nothing is modified while we look up the states, hence check the symlink indexes for changes only once */
+        symlink_index_epoch++;
+        symlink_index_batch = true;
+
+        r = unit_file_get_list_internal(scope, &paths, h, states, patterns);
+
+        symlink_index_batch = false;
+
+        return r;
+}
+
 static const char* const unit_file_state_table[_UNIT_FILE_STATE_MAX] = {
         [UNIT_FILE_ENABLED] = "enabled",
         [UNIT_FILE_ENABLED_RUNTIME] = "enabled-runtime",
@@ -181,6 +181,7 @@ static OutputMode arg_output = OUTPUT_SHORT;
 static bool arg_plain = false;
 static bool arg_firmware_setup = false;
 static bool arg_now = false;
+static bool arg_changed = false;
 static bool arg_jobs_before = false;
 static bool arg_jobs_after = false;
 
@@ -2622,7 +2623,7 @@ static int unit_find_paths(
 
                 if (dropin_paths) {
                         r = unit_file_find_dropin_conf_paths(arg_root, lp->search_path,
-                                                             NULL, names, &dropins);
+                                                             NULL, NULL, names, &dropins);
                         if (r < 0)
                                 return r;
                 }
@@ -5635,6 +5636,7 @@ static int daemon_reload(int argc, char *argv[], void *userdata) {
 
         case ACTION_SYSTEMCTL:
                 method = streq(argv[0], "daemon-reexec") ? "Reexecute" :
+                         arg_changed ? "ReloadIfChanged" :
                                      /* "daemon-reload" */ "Reload";
                 break;
 
@@ -5658,6 +5660,24 @@ static int daemon_reload(int argc, char *argv[], void *userdata) {
 
         r = sd_bus_call(bus, m, DEFAULT_TIMEOUT_USEC * 2, &error, NULL);
 
+        /* Older managers don't know ReloadIfChanged(), do a full reload then */
+        if (r < 0 && streq(method, "ReloadIfChanged") && sd_bus_error_has_name(&error, SD_BUS_ERROR_UNKNOWN_METHOD)) {
+                sd_bus_error_free(&error);
+                m = sd_bus_message_unref(m);
+
+                r = sd_bus_message_new_method_call(
+                                bus,
+                                &m,
+                                "org.freedesktop.systemd1",
+                                "/org/freedesktop/systemd1",
+                                "org.freedesktop.systemd1.Manager",
+                                "Reload");
+                if (r < 0)
+                        return bus_log_create_error(r);
+
+                r = sd_bus_call(bus, m, DEFAULT_TIMEOUT_USEC * 2, &error, NULL);
+        }
+
         /* On reexecution, we expect a disconnect, not a reply */
         if (IN_SET(r, -ETIMEDOUT, -ECONNRESET) && streq(method, "Reexecute"))
                 r = 0;
@@ -7201,6 +7221,7 @@ static void systemctl_help(void) {
                "     --kill-who=WHO   Who to send signal to\n"
                "  -s --signal=SIGNAL  Which signal to send\n"
                "     --now            Start or stop unit in addition to enabling or disabling it\n"
+               "     --changed        On daemon-reload, only reload if unit files changed\n"
                "     --dry-run        Only print what would be done\n"
                "  -q --quiet          Suppress output\n"
                "     --wait           For (re)start, wait until service stopped again\n"
@@ -7476,6 +7497,7 @@ static int systemctl_parse_argv(int argc, char *argv[]) {
                 ARG_NOW,
                 ARG_MESSAGE,
                 ARG_WAIT,
+                ARG_CHANGED,
         };
 
         static const struct option options[] = {
@@ -7523,6 +7545,7 @@ static int systemctl_parse_argv(int argc, char *argv[]) {
                 { "preset-mode",         required_argument, NULL, ARG_PRESET_MODE         },
                 { "firmware-setup",      no_argument,       NULL, ARG_FIRMWARE_SETUP      },
                 { "now",                 no_argument,       NULL, ARG_NOW                 },
+                { "changed",             no_argument,       NULL, ARG_CHANGED             },
                 { "message",             required_argument, NULL, ARG_MESSAGE             },
                 {}
         };
@@ -7842,6 +7865,10 @@ static int systemctl_parse_argv(int argc, char *argv[]) {
                         arg_now = true;
                         break;
 
+                case ARG_CHANGED:
+                        arg_changed = true;
+                        break;
+
                 case ARG_MESSAGE:
                         if (strv_extend(&arg_wall, optarg) < 0)
                                 return log_oom();
@@ -0,0 +1,97 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include "cgroup.h"
+#include "log.h"
+#include "manager.h"
+#include "rm-rf.h"
+#include "service.h"
+#include "test-helper.h"
+#include "tests.h"
+
+static void test_history(Manager *m) {
+        Unit *u;
+        unsigned i;
+
+        assert_se(u = unit_new(m, sizeof(Service)));
+        assert_se(unit_add_name(u, "accounting-sample.service") >= 0);
+
+        /* Only the latest sample is kept as long as nobody asked for more */
+        unit_sample_accounting(u, 1);
+        unit_sample_accounting(u, 2);
+        assert_se(u->accounting_sample.timestamp == 2);
+        assert_se(!u->accounting_samples);
+        assert_se(u->n_accounting_samples == 0);
+
+        /* The history starts with the latest sample */
+        assert_se(unit_enable_accounting_history(u) > 0);
+        assert_se(u->accounting_samples);
+        assert_se(u->n_accounting_samples == 1);
+        assert_se(u->accounting_samples[0].timestamp == 2);
+        assert_se(unit_enable_accounting_history(u) == 0);
+
+        for (i = 3; i < 3 + CGROUP_ACCOUNTING_SAMPLES_MAX; i++)
+                unit_sample_accounting(u, i);
+
+        /* The ring is full, and the oldest entry is overwritten next */
+        assert_se(u->n_accounting_samples == CGROUP_ACCOUNTING_SAMPLES_MAX);
+        assert_se(u->accounting_samples[u->accounting_samples_next].timestamp == 3);
+        assert_se(u->accounting_sample.timestamp == 2 + CGROUP_ACCOUNTING_SAMPLES_MAX);
+
+        /* Starting the unit again forgets everything about the previous runtime */
+        (void) unit_reset_cpu_accounting(u);
+        assert_se(u->accounting_sample.timestamp == 0);
+        assert_se(u->n_accounting_samples == 0);
+        assert_se(u->accounting_samples);
+
+        unit_sample_accounting(u, 100);
+        assert_se(u->n_accounting_samples == 1);
+        assert_se(u->accounting_samples[0].timestamp == 100);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL;
+        Manager *m = NULL;
+        int r;
+
+        log_parse_environment();
+        log_open();
+
+        r = enter_cgroup_subroot();
+        if (r == -ENOMEDIUM) {
+                log_notice_errno(r, "Skipping test: cgroupfs not available");
+                return EXIT_TEST_SKIP;
+        }
+
+        assert_se(set_unit_path(get_testdata_dir("")) >= 0);
+        assert_se(runtime_dir = setup_fake_runtime_dir());
+
+        r = manager_new(UNIT_FILE_USER, MANAGER_TEST_RUN_MINIMAL, &m);
+        if (MANAGER_SKIP_TEST(r)) {
+                log_notice_errno(r, "Skipping test: manager_new: %m");
+                return EXIT_TEST_SKIP;
+        }
+        assert_se(r >= 0);
+        assert_se(manager_startup(m, NULL, NULL) >= 0);
+
+        test_history(m);
+
+        manager_free(m);
+
+        return 0;
+}
@@ -22,6 +22,7 @@
 
 #include "alloc-util.h"
 #include "calendarspec.h"
+#include "env-util.h"
 #include "string-util.h"
 #include "util.h"
 
@@ -134,8 +135,62 @@ static void test_hourly_bug_4031(void) {
         calendar_spec_free(c);
 }
 
+static void test_next_performance(bool slow) {
+        static const char *specs[] = {
+                "*-*-* *:*:*",
+                "hourly",
+                "Mon..Fri 9..17/2:00",
+                "*-*~1",
+                "Sun *-*~7/1 03:30",
+                "*-02-29 00:00:00",
+                "*-*-31 23:59:59",
+                "*:0/7:13.5",
+        };
+        char buf[FORMAT_TIMESPAN_MAX], buf2[FORMAT_TIMESTAMP_MAX];
+        unsigned i, k, n;
+        int r;
+
+        /* Walks through a series of elapse times for a couple of specs in a zone with DST, and makes sure they are
+         * strictly increasing. Also prints how long this took, to spot regressions. */
+
+        assert_se(setenv("TZ", "Europe/Berlin", 1) >= 0);
+        tzset();
+
+        n = slow ? 100000 : 2000;
+
+        for (i = 0; i < ELEMENTSOF(specs); i++) {
+                CalendarSpec *c;
+                usec_t start, u, w;
+
+                assert_se(calendar_spec_from_string(specs[i], &c) >= 0);
+
+                start = now(CLOCK_MONOTONIC);
+
+                u = 1483228800000000; /* 2017-01-01 00:00:00 UTC */
+                for (k = 0; k < n; k++) {
+                        r = calendar_spec_next_usec(c, u, &w);
+                        if (r == -ENOENT) /* Ran out of years */
+                                break;
+                        assert_se(r >= 0);
+                        assert_se(w > u);
+                        u = w;
+                }
+
+                printf("\"%s\": %u iterations in %s, last %s\n",
+                       specs[i], k,
+                       format_timespan(buf, sizeof buf, now(CLOCK_MONOTONIC) - start, USEC_PER_MSEC),
+                       format_timestamp(buf2, sizeof buf2, u));
+
+                calendar_spec_free(c);
+        }
+
+        assert_se(unsetenv("TZ") >= 0);
+        tzset();
+}
+
 int main(int argc, char* argv[]) {
         CalendarSpec *c;
+        int r;
 
         test_one("Sat,Thu,Mon-Wed,Sat-Sun", "Mon..Thu,Sat,Sun *-*-* 00:00:00");
         test_one("Sat,Thu,Mon..Wed,Sat..Sun", "Mon..Thu,Sat,Sun *-*-* 00:00:00");
@@ -232,6 +287,20 @@ int main(int argc, char* argv[]) {
         // Confirm that timezones in the Spec work regardless of current timezone
         test_next("2017-09-09 20:42:00 Pacific/Auckland", "", 12345, 1504946520000000);
         test_next("2017-09-09 20:42:00 Pacific/Auckland", "EET", 12345, 1504946520000000);
+        // Times falling back twice resolve to the first occurrence, unless the DST state is specified
+        test_next("2017-10-29 02:30:00", "CET", 12345, 1509237000000000);
+        test_next("2017-10-29 02:30:00 CET", "CET", 12345, 1509240600000000);
+        test_next("2017-10-29 02:30:00 CEST", "CET", 12345, 1509237000000000);
+        // Inside the repeated hour, its first pass is over already
+        test_next("2017-10-29 02:30:00", "CET", 1509239400000000, 1509240600000000);
+        test_next("*:20", "Europe/Berlin", 1792887000000000, 1792887600000000);
+        test_next("*:20", "Europe/Berlin", 1792890600000000, 1792891200000000);
+        test_next("*-*-* 02:05", "Europe/Berlin", 1792890600000000, 1792976700000000);
+        // Lord Howe Island shifts by half an hour only
+        test_next("2017-10-01 02:15:00 Australia/Lord_Howe", "", 12345, -1);
+        test_next("2017-10-01 02:45:00 Australia/Lord_Howe", "", 12345, 1506786300000000);
+        // DST started at midnight here, on the day before
+        test_next("Sun 1986-10~07/1 America/Sao_Paulo", "", 528606000000000, 530676000000000);
 
         assert_se(calendar_spec_from_string("test", &c) < 0);
         assert_se(calendar_spec_from_string(" utc", &c) < 0);
@@ -263,5 +332,8 @@ int main(int argc, char* argv[]) {
         test_timestamp();
         test_hourly_bug_4031();
 
+        r = getenv_bool("SYSTEMD_SLOW_TESTS");
+        test_next_performance(r >= 0 ? r : SYSTEMD_SLOW_TESTS_DEFAULT);
+
         return 0;
 }
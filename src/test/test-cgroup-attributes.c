@@ -0,0 +1,114 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+
+#include "cgroup.h"
+#include "macro.h"
+#include "manager.h"
+#include "rm-rf.h"
+#include "test-helper.h"
+#include "tests.h"
+#include "unit.h"
+
+static int test_cgroup_attribute_cache(void) {
+        _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL;
+        uint64_t writes, skipped;
+        Manager *m = NULL;
+        CGroupContext *c;
+        Unit *son;
+        int r;
+
+        r = enter_cgroup_subroot();
+        if (r == -ENOMEDIUM) {
+                puts("Skipping test: cgroupfs not available");
+                return EXIT_TEST_SKIP;
+        }
+
+        assert_se(set_unit_path(get_testdata_dir("")) >= 0);
+        assert_se(runtime_dir = setup_fake_runtime_dir());
+        r = manager_new(UNIT_FILE_USER, MANAGER_TEST_RUN_MINIMAL, &m);
+        if (IN_SET(r, -EPERM, -EACCES)) {
+                puts("manager_new: Permission denied. Skipping test.");
+                return EXIT_TEST_SKIP;
+        }
+        assert_se(r >= 0);
+
+        /* Only son.service's CPUShares= shall result in attribute writes */
+        m->default_cpu_accounting =
+                m->default_memory_accounting =
+                m->default_blockio_accounting =
+                m->default_io_accounting =
+                m->default_tasks_accounting = false;
+        m->default_tasks_max = (uint64_t) -1;
+
+        assert_se(manager_startup(m, NULL, NULL) >= 0);
+
+        assert_se(manager_load_unit(m, "son.service", NULL, NULL, &son) >= 0);
+        assert_se(son->load_state == UNIT_LOADED);
+        assert_se(c = unit_get_cgroup_context(son));
+
+        if (!(m->cgroup_supported & CGROUP_MASK_CPU)) {
+                puts("Skipping test: cpu controller not available");
+                manager_free(m);
+                return EXIT_TEST_SKIP;
+        }
+
+        r = unit_realize_cgroup(son);
+        if (r < 0 || hashmap_isempty(son->cgroup_attributes)) {
+                puts("Skipping test: cannot set up cgroup attributes");
+                manager_free(m);
+                return EXIT_TEST_SKIP;
+        }
+
+        writes = m->n_cgroup_attribute_writes;
+        skipped = m->n_cgroup_attribute_writes_skipped;
+
+        /* Invalidating the cgroup makes us apply all attributes again, but nothing changed */
+        unit_invalidate_cgroup(son, CGROUP_MASK_CPU);
+        assert_se(manager_dispatch_cgroup_realize_queue(m) > 0);
+        assert_se(m->n_cgroup_attribute_writes == writes);
+        assert_se(m->n_cgroup_attribute_writes_skipped > skipped);
+        assert_se(!hashmap_isempty(son->cgroup_attributes));
+
+        /* A new value is written, and only that */
+        c->cpu_shares = 200;
+        unit_invalidate_cgroup(son, CGROUP_MASK_CPU);
+        assert_se(manager_dispatch_cgroup_realize_queue(m) > 0);
+        assert_se(m->n_cgroup_attribute_writes == writes + 1);
+
+        /* Removing the cgroup forgets everything */
+        unit_prune_cgroup(son);
+        assert_se(!son->cgroup_realized);
+        assert_se(hashmap_isempty(son->cgroup_attributes));
+
+        manager_free(m);
+
+        return 0;
+}
+
+int main(int argc, char* argv[]) {
+        int rc = 0;
+
+        log_parse_environment();
+        log_open();
+
+        TEST_REQ_RUNNING_SYSTEMD(rc = test_cgroup_attribute_cache());
+
+        return rc;
+}
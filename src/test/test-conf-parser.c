@@ -19,10 +19,15 @@
 ***/
 
 #include "conf-parser.h"
+#include "dropin.h"
+#include "env-util.h"
 #include "fd-util.h"
 #include "fileio.h"
 #include "log.h"
 #include "macro.h"
+#include "rm-rf.h"
+#include "set.h"
+#include "stdio-util.h"
 #include "string-util.h"
 #include "strv.h"
 #include "util.h"
@@ -274,6 +279,18 @@ static const char* const config_file[] = {
         "[Section]\n"
         "setting1="          /* many continuation lines, together above the limit */
         x1000(x1000("x") x10("abcde") "\\\n") "xxx",
+
+        "[Section]\n"
+        "setting1=1\\\n"     /* continuation, then another one */
+        "2\n"
+        "setting1=3\\\n"
+        "4\\\n"
+        "5\n",
+
+        "\xef\xbb\xbf"       /* BOM */
+        "[Section]\n"
+        "setting1=1\n"
+        "setting1=2",
 };
 
 static void test_config_parse(unsigned i, const char *s) {
@@ -344,11 +361,151 @@ static void test_config_parse(unsigned i, const char *s) {
                 assert_se(r == -ENOBUFS);
                 assert_se(setting1 == NULL);
                 break;
+
+        case 10:
+                assert_se(r == 0);
+                assert_se(streq(setting1, "3 4 5"));
+                break;
+
+        case 11:
+                assert_se(r == 0);
+                assert_se(streq(setting1, "2"));
+                break;
         }
 }
 
+static void test_config_parse_benchmark(bool slow) {
+        static const char unit_contents[] =
+                "# A synthetic unit\n"
+                "[Unit]\n"
+                "Description=Benchmark unit\n"
+                "\n"
+                "[Service]\n"
+                "ExecStart=/bin/true --some-option \\\n"
+                "          --another-option \\\n"
+                "          --last-option\n";
+        static const char dropin_contents[] =
+                "[Service]\n"
+                "Environment=FOO=bar \\\n"
+                "    BAR=baz\n";
+
+        char dir[] = "/tmp/test-conf-parser-benchmark.XXXXXX";
+        _cleanup_free_ char *description = NULL, *exec_start = NULL, *environment = NULL;
+        char buf[FORMAT_TIMESPAN_MAX];
+        usec_t ts, elapsed;
+        const char *p;
+        unsigned i, n, pass;
+
+        const ConfigTableItem items[] = {
+                { "Unit",    "Description", config_parse_string, 0, &description },
+                { "Service", "ExecStart",   config_parse_string, 0, &exec_start  },
+                { "Service", "Environment", config_parse_string, 0, &environment },
+                {}
+        };
+
+        /* Parses instances of one template, with continuation lines and three drop-ins each, once with
+         * each unit listing the drop-in directory itself and once through a shared cache, and logs the
+         * rate of both. Then parses the same contents from memory, which is all a cache of parsed unit
+         * files could save us, as long as the settings parsers still have to run. Only with
+         * SYSTEMD_SLOW_TESTS=1 there are enough units for the rates to mean something. */
+
+        n = slow ? 20000 : 100;
+
+        assert_se(mkdtemp(dir));
+
+        p = strjoina(dir, "/bench@.service.d");
+        assert_se(mkdir(p, 0755) >= 0);
+        for (i = 0; i < 3; i++) {
+                char name[STRLEN("/00-dropin.conf") + 1];
+
+                xsprintf(name, "/%u0-dropin.conf", i);
+                assert_se(write_string_file(strjoina(p, name), dropin_contents, WRITE_STRING_FILE_CREATE) >= 0);
+        }
+
+        for (i = 0; i < n; i++) {
+                char path[sizeof(dir) + STRLEN("/bench@.service") + DECIMAL_STR_MAX(unsigned)];
+
+                xsprintf(path, "%s/bench@%u.service", dir, i);
+                assert_se(write_string_file(path, unit_contents, WRITE_STRING_FILE_CREATE) >= 0);
+        }
+
+        for (pass = 0; pass < 2; pass++) {
+                char *search_path[] = { dir, NULL };
+                Hashmap *cache = NULL;
+                unsigned n_dropins = 0;
+
+                if (pass > 0)
+                        assert_se(cache = dropin_dir_cache_new());
+
+                ts = now(CLOCK_MONOTONIC);
+                for (i = 0; i < n; i++) {
+                        _cleanup_strv_free_ char **dropins = NULL;
+                        _cleanup_set_free_ Set *names = NULL;
+                        char path[sizeof(dir) + STRLEN("/bench@.service") + DECIMAL_STR_MAX(unsigned)];
+                        const char *name;
+                        char **d;
+
+                        /* No strjoina() in here, as the stack wouldn't be released before the loop ends */
+                        xsprintf(path, "%s/bench@%u.service", dir, i);
+                        name = path + strlen(dir) + 1;
+                        assert_se(config_parse(name, path, NULL,
+                                               "Unit\0Service\0",
+                                               config_item_table_lookup, items,
+                                               0, NULL) == 0);
+
+                        assert_se(names = set_new(&string_hash_ops));
+                        assert_se(set_put(names, name) >= 0);
+                        assert_se(unit_file_find_dropin_conf_paths(NULL, search_path, NULL, cache, names, &dropins) > 0);
+
+                        STRV_FOREACH(d, dropins) {
+                                assert_se(config_parse(name, *d, NULL,
+                                                       "Unit\0Service\0",
+                                                       config_item_table_lookup, items,
+                                                       0, NULL) == 0);
+                                n_dropins++;
+                        }
+                }
+                elapsed = usec_sub_unsigned(now(CLOCK_MONOTONIC), ts);
+
+                assert_se(streq(exec_start, "/bin/true --some-option            --another-option            --last-option"));
+                assert_se(streq(environment, "FOO=bar      BAR=baz"));
+                assert_se(n_dropins == 3 * n);
+
+                log_info("Parsed %u units and %u drop-ins %s drop-in directory cache in %s, %.1f units/s",
+                         n, n_dropins, cache ? "with" : "without",
+                         format_timespan(buf, sizeof(buf), elapsed, USEC_PER_MSEC),
+                         elapsed > 0 ? (double) n * USEC_PER_SEC / elapsed : 0.0);
+
+                dropin_dir_cache_free(cache);
+        }
+
+        ts = now(CLOCK_MONOTONIC);
+        for (i = 0; i < 4 * n; i++) {
+                _cleanup_fclose_ FILE *f = NULL;
+
+                /* One unit file for every three drop-ins, like above */
+                f = fmemopen((void*) (i % 4 == 0 ? unit_contents : dropin_contents),
+                             i % 4 == 0 ? strlen(unit_contents) : strlen(dropin_contents), "re");
+                assert_se(f);
+
+                assert_se(config_parse("bench@0.service", "bench@0.service", f,
+                                       "Unit\0Service\0",
+                                       config_item_table_lookup, items,
+                                       0, NULL) == 0);
+        }
+        elapsed = usec_sub_unsigned(now(CLOCK_MONOTONIC), ts);
+
+        log_info("Parsed %u units and %u drop-ins from memory in %s, %.1f units/s",
+                 n, 3 * n,
+                 format_timespan(buf, sizeof(buf), elapsed, USEC_PER_MSEC),
+                 elapsed > 0 ? (double) n * USEC_PER_SEC / elapsed : 0.0);
+
+        assert_se(rm_rf(dir, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+}
+
 int main(int argc, char **argv) {
         unsigned i;
+        int r;
 
         log_parse_environment();
         log_open();
@@ -369,5 +526,8 @@ int main(int argc, char **argv) {
         for (i = 0; i < ELEMENTSOF(config_file); i++)
                 test_config_parse(i, config_file[i]);
 
+        r = getenv_bool("SYSTEMD_SLOW_TESTS");
+        test_config_parse_benchmark(r >= 0 ? r : SYSTEMD_SLOW_TESTS_DEFAULT);
+
         return 0;
 }
@@ -22,12 +22,304 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "alloc-util.h"
 #include "bus-util.h"
+#include "dbus-manager.h"
+#include "env-util.h"
+#include "fd-util.h"
+#include "fdset.h"
+#include "fileio.h"
 #include "manager.h"
 #include "rm-rf.h"
+#include "service.h"
+#include "stdio-util.h"
 #include "test-helper.h"
 #include "tests.h"
 
+static void test_large_transaction(Manager *m, unsigned n) {
+        _cleanup_free_ Unit **units = NULL;
+        char buf[FORMAT_TIMESPAN_MAX];
+        usec_t ts;
+        unsigned i;
+        Job *j;
+
+        /* Builds a binary tree of n services, each wanted by and ordered after its parent, and starts
+         * the root. All n jobs need to survive garbage collection of the transaction. With large n, the
+         * time this takes shows whether dropping jobs got quadratic again. */
+
+        assert_se(units = new0(Unit*, n));
+
+        for (i = 0; i < n; i++) {
+                char name[STRLEN("bench-") + DECIMAL_STR_MAX(unsigned) + STRLEN(".service")];
+
+                xsprintf(name, "bench-%u.service", i);
+                assert_se(unit_new_for_name(m, sizeof(Service), name, &units[i]) >= 0);
+                units[i]->load_state = UNIT_LOADED;
+
+                if (i > 0) {
+                        Unit *parent = units[(i - 1) / 2];
+
+                        assert_se(unit_add_two_dependencies(parent, UNIT_WANTS, UNIT_BEFORE, units[i], true, UNIT_DEPENDENCY_FILE) >= 0);
+                }
+        }
+
+        ts = now(CLOCK_MONOTONIC);
+        assert_se(manager_add_job(m, JOB_START, units[0], JOB_REPLACE, NULL, &j) >= 0);
+        log_info("Transaction with %u units took %s.",
+                 n, format_timespan(buf, sizeof(buf), now(CLOCK_MONOTONIC) - ts, 1));
+        assert_se(hashmap_size(m->jobs) == n);
+
+        manager_clear_jobs(m);
+
+        ts = now(CLOCK_MONOTONIC);
+        assert_se(manager_add_job(m, JOB_START, units[0], JOB_FAIL, NULL, &j) >= 0);
+        log_info("Transaction with %u units in fail mode took %s.",
+                 n, format_timespan(buf, sizeof(buf), now(CLOCK_MONOTONIC) - ts, 1));
+        assert_se(hashmap_size(m->jobs) == n);
+
+        manager_clear_jobs(m);
+}
+
+static void test_merge_overlapping_dependencies(Manager *m) {
+        UnitDependencyInfo di;
+        Unit *a, *b, *x, *y;
+
+        /* Both units want and are ordered before x, hence merging them needs to combine these dependencies */
+
+        assert_se(unit_new_for_name(m, sizeof(Service), "merge-a.service", &a) >= 0);
+        assert_se(unit_new_for_name(m, sizeof(Service), "merge-b.service", &b) >= 0);
+        assert_se(unit_new_for_name(m, sizeof(Service), "merge-x.service", &x) >= 0);
+        assert_se(unit_new_for_name(m, sizeof(Service), "merge-y.service", &y) >= 0);
+
+        assert_se(unit_add_dependency(a, UNIT_WANTS, x, true, UNIT_DEPENDENCY_FILE) >= 0);
+        assert_se(unit_add_dependency(b, UNIT_WANTS, x, true, UNIT_DEPENDENCY_UDEV) >= 0);
+        assert_se(unit_add_dependency(b, UNIT_WANTS, y, true, UNIT_DEPENDENCY_FILE) >= 0);
+        assert_se(unit_add_dependency(x, UNIT_AFTER, a, false, UNIT_DEPENDENCY_IMPLICIT) >= 0);
+        assert_se(unit_add_dependency(x, UNIT_AFTER, b, false, UNIT_DEPENDENCY_FILE) >= 0);
+
+        assert_se(unit_merge(a, b) >= 0);
+        assert_se(b->load_state == UNIT_MERGED);
+        assert_se(unit_follow_merge(b) == a);
+
+        assert_se(unit_dependency_set_size(a->dependencies[UNIT_WANTS]) == 2);
+        assert_se(unit_dependency_set_contains(a->dependencies[UNIT_WANTS], y));
+        di.data = unit_dependency_set_get(a->dependencies[UNIT_WANTS], x);
+        assert_se(di.origin_mask == (UNIT_DEPENDENCY_FILE|UNIT_DEPENDENCY_UDEV));
+        di.data = unit_dependency_set_get(a->dependencies[UNIT_BEFORE], x);
+        assert_se(di.destination_mask == (UNIT_DEPENDENCY_FILE|UNIT_DEPENDENCY_IMPLICIT));
+
+        /* The back pointers were moved over to a too */
+        assert_se(unit_dependency_set_size(x->dependencies[UNIT_WANTED_BY]) == 1);
+        di.data = unit_dependency_set_get(x->dependencies[UNIT_WANTED_BY], a);
+        assert_se(di.destination_mask == (UNIT_DEPENDENCY_FILE|UNIT_DEPENDENCY_UDEV));
+        di.data = unit_dependency_set_get(x->dependencies[UNIT_AFTER], a);
+        assert_se(di.origin_mask == (UNIT_DEPENDENCY_FILE|UNIT_DEPENDENCY_IMPLICIT));
+        assert_se(!unit_dependency_set_contains(x->dependencies[UNIT_AFTER], b));
+        assert_se(unit_dependency_set_contains(y->dependencies[UNIT_WANTED_BY], a));
+}
+
+static void test_list_units_paged(Manager *m, Unit *b) {
+        _cleanup_free_ Unit **all = NULL, **units = NULL;
+        char header[] = "unit-change-generation=1000000\n\n";
+        _cleanup_fclose_ FILE *f = NULL;
+        const char *after = NULL;
+        unsigned k = 0;
+        uint64_t gen;
+        bool more;
+        int n, n_all;
+
+        n_all = bus_manager_list_units_paged(m, NULL, NULL, 0, NULL, 0, &all, &more);
+        assert_se(n_all > 2);
+        assert_se(!more);
+
+        /* Paging through the units two at a time yields the same list */
+        for (;;) {
+                _cleanup_free_ Unit **page = NULL;
+                int i;
+
+                n = bus_manager_list_units_paged(m, NULL, NULL, 0, after, 2, &page, &more);
+                assert_se(n >= 0 && n <= 2);
+
+                for (i = 0; i < n; i++)
+                        assert_se(page[i] == all[k++]);
+
+                if (!more)
+                        break;
+
+                assert_se(n == 2);
+                after = page[n - 1]->id;
+        }
+        assert_se(k == (unsigned) n_all);
+
+        /* Only what changed after the token is returned */
+        gen = m->unit_change_generation;
+        assert_se(bus_manager_list_units_paged(m, NULL, NULL, gen, NULL, 0, &units, &more) == 0);
+        units = mfree(units);
+
+        unit_add_to_dbus_queue(b);
+        assert_se(bus_manager_list_units_paged(m, NULL, NULL, gen, NULL, 0, &units, &more) == 1);
+        assert_se(units[0] == b);
+        units = mfree(units);
+
+        /* After deserializing a newer generation, tokens from before remain valid, and every unit counts as
+         * changed, as it would after reexecution */
+        assert_se(f = fmemopen(header, strlen(header), "r"));
+        assert_se(manager_deserialize(m, f, NULL) >= 0);
+        assert_se(m->unit_change_generation > 1000000);
+        assert_se(bus_manager_list_units_paged(m, NULL, NULL, gen, NULL, 0, &units, &more) == n_all);
+        units = mfree(units);
+        assert_se(bus_manager_list_units_paged(m, NULL, NULL, 1000000, NULL, 0, &units, &more) == n_all);
+}
+
+static void test_serialize_benchmark(Manager *m) {
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_fdset_free_ FDSet *fds = NULL;
+        char buf[FORMAT_TIMESPAN_MAX];
+        usec_t ts, elapsed;
+        unsigned n;
+        off_t size;
+
+        /* Serializes the state of all units loaded so far, as daemon-reload and daemon-reexec do, and
+         * deserializes it into the same manager again, and logs how long each direction took. Test11 loaded
+         * enough units for this to mean something only with SYSTEMD_SLOW_TESTS=1. */
+
+        manager_clear_jobs(m);
+        n = hashmap_size(m->units);
+
+        assert_se(manager_open_serialization(m, &f) >= 0);
+        assert_se(fds = fdset_new());
+
+        ts = now(CLOCK_MONOTONIC);
+        assert_se(manager_serialize(m, f, fds, false) >= 0);
+        assert_se(fflush_and_check(f) >= 0);
+        elapsed = now(CLOCK_MONOTONIC) - ts;
+
+        size = ftello(f);
+        assert_se(size > 0);
+        log_info("Serialized %u units into %" PRIu64 " bytes in %s.",
+                 n, (uint64_t) size, format_timespan(buf, sizeof(buf), elapsed, USEC_PER_MSEC));
+
+        assert_se(fseeko(f, 0, SEEK_SET) == 0);
+
+        ts = now(CLOCK_MONOTONIC);
+        assert_se(manager_deserialize(m, f, fds) >= 0);
+        elapsed = now(CLOCK_MONOTONIC) - ts;
+
+        log_info("Deserialized %u units in %s.",
+                 n, format_timespan(buf, sizeof(buf), elapsed, USEC_PER_MSEC));
+
+        assert_se(hashmap_size(m->units) == n);
+}
+
+static void write_unit(const char *dir, const char *name, const char *contents) {
+        const char *p;
+
+        p = strjoina(dir, "/", name);
+        assert_se(write_string_file(p, contents, WRITE_STRING_FILE_CREATE|WRITE_STRING_FILE_ATOMIC) >= 0);
+}
+
+static void reload_unit(Manager *m, const char *name, Unit **ret) {
+        _cleanup_set_free_ Set *units = NULL;
+        Unit *u;
+
+        assert_se(u = manager_get_unit(m, name));
+        assert_se(units = set_new(NULL));
+        assert_se(set_put(units, u) > 0);
+
+        assert_se(manager_reload_units(m, units) >= 0);
+        assert_se(*ret = manager_get_unit(m, name));
+        assert_se((*ret)->load_state == UNIT_LOADED);
+}
+
+static void test_reload_units(void) {
+        _cleanup_(rm_rf_physical_and_freep) char *dir = NULL;
+        Unit *a, *b, *c, *t;
+        UnitDependencyInfo di;
+        Manager *m = NULL;
+        int r;
+
+        /* reload-a.service is pulled in by reload.target and ordered after reload-c.service by the latter, and
+         * wants and is ordered after reload-b.service itself. Reloading it after it dropped its own dependencies
+         * must drop them on both ends, and keep what the other units configured. */
+
+        assert_se(mkdtemp_malloc("/tmp/test-engine-reload-XXXXXX", &dir) >= 0);
+
+        write_unit(dir, "reload.target",
+                   "[Unit]\n"
+                   "Wants=reload-a.service reload-c.service\n");
+        write_unit(dir, "reload-a.service",
+                   "[Unit]\n"
+                   "Wants=reload-b.service\n"
+                   "After=reload-b.service\n"
+                   "[Service]\n"
+                   "ExecStart=/bin/true\n");
+        write_unit(dir, "reload-b.service",
+                   "[Service]\n"
+                   "ExecStart=/bin/true\n");
+        write_unit(dir, "reload-c.service",
+                   "[Unit]\n"
+                   "Before=reload-a.service\n"
+                   "[Service]\n"
+                   "ExecStart=/bin/true\n");
+
+        assert_se(set_unit_path(dir) >= 0);
+        r = manager_new(UNIT_FILE_USER, MANAGER_TEST_RUN_MINIMAL, &m);
+        if (MANAGER_SKIP_TEST(r)) {
+                log_notice_errno(r, "Skipping %s: manager_new: %m", __func__);
+                return;
+        }
+        assert_se(r >= 0);
+        assert_se(manager_startup(m, NULL, NULL) >= 0);
+
+        assert_se(manager_load_unit(m, "reload.target", NULL, NULL, &t) >= 0);
+        assert_se(a = manager_get_unit(m, "reload-a.service"));
+        assert_se(b = manager_get_unit(m, "reload-b.service"));
+        assert_se(c = manager_get_unit(m, "reload-c.service"));
+
+        assert_se(unit_dependency_set_contains(b->dependencies[UNIT_WANTED_BY], a));
+        assert_se(unit_dependency_set_contains(b->dependencies[UNIT_BEFORE], a));
+        assert_se(unit_dependency_set_contains(t->dependencies[UNIT_AFTER], a));
+
+        write_unit(dir, "reload-a.service",
+                   "[Service]\n"
+                   "ExecStart=/bin/true\n");
+        reload_unit(m, "reload-a.service", &a);
+
+        /* What a asked for is gone on both ends */
+        assert_se(!unit_dependency_set_contains(a->dependencies[UNIT_WANTS], b));
+        assert_se(!unit_dependency_set_contains(a->dependencies[UNIT_AFTER], b));
+        assert_se(!unit_dependency_set_contains(b->dependencies[UNIT_WANTED_BY], a));
+        assert_se(!unit_dependency_set_contains(b->dependencies[UNIT_BEFORE], a));
+        assert_se(!unit_dependency_set_contains(b->dependencies[UNIT_REFERENCED_BY], a));
+
+        /* What the others asked for is still there, with the same origin */
+        di.data = unit_dependency_set_get(c->dependencies[UNIT_BEFORE], a);
+        assert_se(di.origin_mask == UNIT_DEPENDENCY_FILE);
+        di.data = unit_dependency_set_get(a->dependencies[UNIT_AFTER], c);
+        assert_se(di.destination_mask == UNIT_DEPENDENCY_FILE);
+        di.data = unit_dependency_set_get(t->dependencies[UNIT_WANTS], a);
+        assert_se(di.origin_mask == UNIT_DEPENDENCY_FILE);
+        assert_se(unit_dependency_set_contains(a->dependencies[UNIT_WANTED_BY], t));
+        di.data = unit_dependency_set_get(t->dependencies[UNIT_AFTER], a);
+        assert_se(di.origin_mask == UNIT_DEPENDENCY_DEFAULT);
+
+        /* The ordering of the target after a was added by a's loading, hence it goes away with a's default
+         * dependencies */
+        write_unit(dir, "reload-a.service",
+                   "[Unit]\n"
+                   "DefaultDependencies=no\n"
+                   "[Service]\n"
+                   "ExecStart=/bin/true\n");
+        reload_unit(m, "reload-a.service", &a);
+
+        assert_se(unit_dependency_set_contains(t->dependencies[UNIT_WANTS], a));
+        assert_se(!unit_dependency_set_contains(t->dependencies[UNIT_AFTER], a));
+        assert_se(!unit_dependency_set_contains(a->dependencies[UNIT_BEFORE], t));
+        assert_se(unit_dependency_set_contains(c->dependencies[UNIT_BEFORE], a));
+
+        manager_free(m);
+}
+
 int main(int argc, char *argv[]) {
         _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL;
         _cleanup_(sd_bus_error_free) sd_bus_error err = SD_BUS_ERROR_NULL;
@@ -116,34 +408,51 @@ int main(int argc, char *argv[]) {
         assert_se(manager_add_job(m, JOB_START, h, JOB_FAIL, NULL, &j) == 0);
         manager_dump_jobs(m, stdout, "\t");
 
-        assert_se(!hashmap_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], b));
-        assert_se(!hashmap_get(b->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
-        assert_se(!hashmap_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], c));
-        assert_se(!hashmap_get(c->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
+        assert_se(!unit_dependency_set_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], b));
+        assert_se(!unit_dependency_set_get(b->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
+        assert_se(!unit_dependency_set_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], c));
+        assert_se(!unit_dependency_set_get(c->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
 
         assert_se(unit_add_dependency(a, UNIT_PROPAGATES_RELOAD_TO, b, true, UNIT_DEPENDENCY_UDEV) == 0);
         assert_se(unit_add_dependency(a, UNIT_PROPAGATES_RELOAD_TO, c, true, UNIT_DEPENDENCY_PROC_SWAP) == 0);
 
-        assert_se(hashmap_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], b));
-        assert_se(hashmap_get(b->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
-        assert_se(hashmap_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], c));
-        assert_se(hashmap_get(c->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
+        assert_se(unit_dependency_set_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], b));
+        assert_se(unit_dependency_set_get(b->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
+        assert_se(unit_dependency_set_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], c));
+        assert_se(unit_dependency_set_get(c->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
 
         unit_remove_dependencies(a, UNIT_DEPENDENCY_UDEV);
 
-        assert_se(!hashmap_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], b));
-        assert_se(!hashmap_get(b->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
-        assert_se(hashmap_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], c));
-        assert_se(hashmap_get(c->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
+        assert_se(!unit_dependency_set_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], b));
+        assert_se(!unit_dependency_set_get(b->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
+        assert_se(unit_dependency_set_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], c));
+        assert_se(unit_dependency_set_get(c->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
 
         unit_remove_dependencies(a, UNIT_DEPENDENCY_PROC_SWAP);
 
-        assert_se(!hashmap_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], b));
-        assert_se(!hashmap_get(b->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
-        assert_se(!hashmap_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], c));
-        assert_se(!hashmap_get(c->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
+        assert_se(!unit_dependency_set_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], b));
+        assert_se(!unit_dependency_set_get(b->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
+        assert_se(!unit_dependency_set_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], c));
+        assert_se(!unit_dependency_set_get(c->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
+
+        printf("Test11: (Large transaction)\n");
+        manager_clear_jobs(m);
+        r = getenv_bool("SYSTEMD_SLOW_TESTS");
+        test_large_transaction(m, (r >= 0 ? r : SYSTEMD_SLOW_TESTS_DEFAULT) ? 10000 : 100);
+
+        printf("Test12: (Merging units with overlapping dependencies)\n");
+        test_merge_overlapping_dependencies(m);
+
+        printf("Test13: (Listing units paged and by change)\n");
+        test_list_units_paged(m, b);
+
+        printf("Test14: (Serializing and deserializing all units)\n");
+        test_serialize_benchmark(m);
 
         manager_free(m);
 
+        printf("Test15: (Reloading units on their own)\n");
+        test_reload_units();
+
         return 0;
 }
@@ -36,6 +36,7 @@
 #include "log.h"
 #include "macro.h"
 #include "rm-rf.h"
+#include "stdio-util.h"
 #include "string-util.h"
 #include "strv.h"
 
@@ -210,6 +211,103 @@ static void test_execution_order(void) {
         (void) rm_rf(template_hi, REMOVE_ROOT|REMOVE_PHYSICAL);
 }
 
+static int bounded_prepare(const char *path, char ***ret_argv, void *userdata) {
+        if (endswith(path, "/skipped"))
+                return 0;
+
+        if (endswith(path, "/args")) {
+                *ret_argv = strv_new(path, "hello", NULL);
+                assert_se(*ret_argv);
+        }
+
+        return 1;
+}
+
+static void bounded_finish(const char *path, int status, usec_t duration, void *userdata) {
+        int *fd = userdata;
+
+        assert_se(status == EXIT_SUCCESS);
+        assert_se(dprintf(*fd, "%s\n", basename(path)) > 0);
+}
+
+static void test_execution_bounded(void) {
+        char template[] = "/tmp/test-exec-util.XXXXXXX";
+        const char *dirs[] = {template, NULL};
+        _cleanup_free_ char *contents = NULL, *report = NULL;
+        _cleanup_strv_free_ char **lines = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_close_ int fd = -1;
+        const char *output, *t, *p;
+        int running = 0, max_running = 0;
+        char **l;
+        unsigned i;
+
+        assert_se(mkdtemp(template));
+
+        output = strjoina(template, "/output");
+
+        log_info("/* %s >>%s */", __func__, output);
+
+        /* Each binary logs its start and end, so that we can reconstruct how many were running at any time */
+        t = strjoina("#!/bin/sh\necho s >>", output, "\nsleep 0.1\necho e >>", output);
+        for (i = 0; i < 6; i++) {
+                char name[STRLEN("/10-sleep") + DECIMAL_STR_MAX(unsigned) + 1];
+
+                xsprintf(name, "/%u-sleep", i);
+                p = strjoina(template, name);
+                assert_se(write_string_file(p, t, WRITE_STRING_FILE_CREATE) == 0);
+                assert_se(chmod(p, 0755) == 0);
+        }
+
+        p = strjoina(template, "/skipped");
+        t = strjoina("#!/bin/sh\necho SKIPPED >>", output);
+        assert_se(write_string_file(p, t, WRITE_STRING_FILE_CREATE) == 0);
+        assert_se(chmod(p, 0755) == 0);
+
+        p = strjoina(template, "/args");
+        t = strjoina("#!/bin/sh\necho $1 >>", output);
+        assert_se(write_string_file(p, t, WRITE_STRING_FILE_CREATE) == 0);
+        assert_se(chmod(p, 0755) == 0);
+
+        fd = open_serialization_fd("test-exec-util");
+        assert_se(fd >= 0);
+
+        assert_se(execute_directories_full(dirs, DEFAULT_TIMEOUT_USEC, 2, NULL, NULL, NULL,
+                                           bounded_prepare, bounded_finish, &fd) >= 0);
+
+        assert_se(read_full_file(output, &contents, NULL) >= 0);
+        assert_se(!strstr(contents, "SKIPPED"));
+        assert_se(strstr(contents, "hello\n"));
+
+        lines = strv_split_newlines(contents);
+        assert_se(lines);
+
+        STRV_FOREACH(l, lines)
+                if (streq(*l, "s")) {
+                        running++;
+                        max_running = MAX(max_running, running);
+                } else if (streq(*l, "e"))
+                        running--;
+
+        log_info("At most %i binaries were running at the same time.", max_running);
+        assert_se(max_running <= 2);
+        assert_se(running == 0);
+
+        assert_se(lseek(fd, 0, SEEK_SET) == 0);
+        assert_se(f = fdopen(fd, "r"));
+        fd = -1;
+        assert_se(read_full_stream(f, &report, NULL) >= 0);
+
+        lines = strv_free(lines);
+        lines = strv_split_newlines(report);
+        assert_se(lines);
+        assert_se(strv_length(lines) == 7);
+        assert_se(strv_contains(lines, "args"));
+        assert_se(!strv_contains(lines, "skipped"));
+
+        (void) rm_rf(template, REMOVE_ROOT|REMOVE_PHYSICAL);
+}
+
 static int gather_stdout_one(int fd, void *arg) {
         char ***s = arg, *t;
         char buf[128] = {};
@@ -361,6 +459,7 @@ int main(int argc, char *argv[]) {
         test_execute_directory(true);
         test_execute_directory(false);
         test_execution_order();
+        test_execution_bounded();
         test_stdout_gathering();
         test_environment_gathering();
 
@@ -25,6 +25,7 @@
 #include <sys/types.h>
 
 #include "cpu-set-util.h"
+#include "env-util.h"
 #include "errno-list.h"
 #include "fileio.h"
 #include "fs-util.h"
@@ -45,6 +46,8 @@
 
 typedef void (*test_function_t)(Manager *m);
 
+static bool arg_slow = false;
+
 static void check(Manager *m, Unit *unit, int status_expected, int code_expected) {
         Service *service = NULL;
         usec_t ts;
@@ -519,6 +522,40 @@ static void test_exec_standardinput(Manager *m) {
         test(m, "exec-standardinput-file.service", 0, CLD_EXITED);
 }
 
+static void test_exec_spawn_rate(Manager *m) {
+        char buf[FORMAT_TIMESPAN_MAX];
+        unsigned i, n = 200;
+        usec_t ts, elapsed;
+        Unit *unit;
+
+        /* Starts a trivial service over and over again and reports how many spawns per second the manager
+         * manages, to spot regressions in the cost of exec_spawn(). */
+
+        if (!arg_slow) {
+                log_info("Skipping %s, set SYSTEMD_SLOW_TESTS=1 to run it.", __func__);
+                return;
+        }
+
+        assert_se(manager_load_unit(m, "exec-spawn-rate.service", NULL, NULL, &unit) >= 0);
+
+        ts = now(CLOCK_MONOTONIC);
+        for (i = 0; i < n; i++) {
+                Service *service = SERVICE(unit);
+
+                assert_se(UNIT_VTABLE(unit)->start(unit) >= 0);
+                while (!IN_SET(service->state, SERVICE_DEAD, SERVICE_FAILED))
+                        assert_se(sd_event_run(m->event, 100 * USEC_PER_MSEC) >= 0);
+
+                assert_se(service->main_exec_status.code == CLD_EXITED);
+                assert_se(service->main_exec_status.status == 0);
+        }
+        elapsed = usec_sub_unsigned(now(CLOCK_MONOTONIC), ts);
+
+        log_info("Spawned %u processes in %s, %.1f spawns/s",
+                 n, format_timespan(buf, sizeof(buf), elapsed, USEC_PER_MSEC),
+                 elapsed > 0 ? (double) n * USEC_PER_SEC / elapsed : 0.0);
+}
+
 static int run_tests(UnitFileScope scope, const test_function_t *tests) {
         const test_function_t *test = NULL;
         Manager *m = NULL;
@@ -565,6 +602,7 @@ int main(int argc, char *argv[]) {
                 test_exec_readwritepaths,
                 test_exec_restrictnamespaces,
                 test_exec_runtimedirectory,
+                test_exec_spawn_rate,
                 test_exec_standardinput,
                 test_exec_supplementarygroups,
                 test_exec_systemcallerrornumber,
@@ -587,6 +625,9 @@ int main(int argc, char *argv[]) {
         log_parse_environment();
         log_open();
 
+        r = getenv_bool("SYSTEMD_SLOW_TESTS");
+        arg_slow = r >= 0 ? r : SYSTEMD_SLOW_TESTS_DEFAULT;
+
         (void) unsetenv("USER");
         (void) unsetenv("LOGNAME");
 
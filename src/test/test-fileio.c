@@ -742,6 +742,20 @@ static void test_read_line3(void) {
         assert_se(read_line(f, LINE_MAX, NULL) == 0);
 }
 
+static void test_read_full_stream(void) {
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *contents = NULL;
+        size_t size;
+
+        /* A memory stream has no fd to fstat() */
+        f = fmemopen((void*) buffer, sizeof(buffer), "re");
+        assert_se(f);
+
+        assert_se(read_full_stream(f, &contents, &size) == 0);
+        assert_se(size == sizeof(buffer));
+        assert_se(memcmp(contents, buffer, size) == 0);
+}
+
 int main(int argc, char *argv[]) {
         log_set_max_level(LOG_DEBUG);
         log_parse_environment();
@@ -766,6 +780,7 @@ int main(int argc, char *argv[]) {
         test_read_line();
         test_read_line2();
         test_read_line3();
+        test_read_full_stream();
 
         return 0;
 }
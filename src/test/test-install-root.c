@@ -18,6 +18,9 @@
   along with systemd; If not, see <http://www.gnu.org/licenses/>.
 ***/
 
+#include <fcntl.h>
+#include <sys/stat.h>
+
 #include "alloc-util.h"
 #include "fileio.h"
 #include "install.h"
@@ -1001,6 +1004,74 @@ static void test_with_dropin_template(const char *root) {
         assert_se(unit_file_get_state(UNIT_FILE_SYSTEM, root, "with-dropin-3@instance-2.service", &state) >= 0 && state == UNIT_FILE_ENABLED);
 }
 
+static void backdate(const char *root, const char *path) {
+        static const struct timespec ts[2] = {
+                { .tv_sec = 1000000000 },
+                { .tv_sec = 1000000000 },
+        };
+
+        assert_se(utimensat(AT_FDCWD, strjoina(root, path), ts, 0) >= 0);
+}
+
+static void test_symlink_index(void) {
+        char root[] = "/tmp/rootXXXXXX";
+        UnitFileState state;
+        const char *p, *wants;
+
+        /* The symlinks below the search path are cached, together with the identity and modification time of
+         * every directory walked. Directories which were modified just before they were walked are never
+         * trusted, hence make all of them look old, so that only the checks of the cached identity and
+         * modification time can notice what changed. */
+
+        assert_se(mkdtemp(root));
+
+        wants = SYSTEM_CONFIG_UNIT_PATH "/multi-user.target.wants";
+
+        p = strjoina(root, "/usr/lib/systemd/system/");
+        assert_se(mkdir_p(p, 0755) >= 0);
+
+        p = strjoina(root, wants);
+        assert_se(mkdir_p(p, 0755) >= 0);
+
+        p = strjoina(root, "/usr/lib/systemd/system/symlink-index.service");
+        assert_se(write_string_file(p,
+                                    "[Install]\n"
+                                    "WantedBy=multi-user.target\n", WRITE_STRING_FILE_CREATE) >= 0);
+
+        p = strjoina(root, wants, "/symlink-index.service");
+        assert_se(symlink("/usr/lib/systemd/system/symlink-index.service", p) >= 0);
+
+        backdate(root, SYSTEM_CONFIG_UNIT_PATH);
+        backdate(root, wants);
+
+        assert_se(unit_file_get_state(UNIT_FILE_SYSTEM, root, "symlink-index.service", &state) >= 0 && state == UNIT_FILE_ENABLED);
+        assert_se(unit_file_get_state(UNIT_FILE_SYSTEM, root, "symlink-index.service", &state) >= 0 && state == UNIT_FILE_ENABLED);
+
+        /* Removing the symlink behind our back changes the modification time of the directory */
+        p = strjoina(root, wants, "/symlink-index.service");
+        assert_se(unlink(p) >= 0);
+
+        assert_se(unit_file_get_state(UNIT_FILE_SYSTEM, root, "symlink-index.service", &state) >= 0 && state == UNIT_FILE_DISABLED);
+
+        backdate(root, wants);
+
+        assert_se(unit_file_get_state(UNIT_FILE_SYSTEM, root, "symlink-index.service", &state) >= 0 && state == UNIT_FILE_DISABLED);
+
+        /* Replace the directory by one with the symlink and the same modification time. Only its inode
+         * number tells that it is a different one now. */
+        p = strjoina(root, wants, ".new");
+        assert_se(mkdir(p, 0755) >= 0);
+        assert_se(symlink("/usr/lib/systemd/system/symlink-index.service", strjoina(p, "/symlink-index.service")) >= 0);
+        assert_se(rename(p, strjoina(root, wants)) >= 0);
+
+        backdate(root, SYSTEM_CONFIG_UNIT_PATH);
+        backdate(root, wants);
+
+        assert_se(unit_file_get_state(UNIT_FILE_SYSTEM, root, "symlink-index.service", &state) >= 0 && state == UNIT_FILE_ENABLED);
+
+        assert_se(rm_rf(root, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+}
+
 int main(int argc, char *argv[]) {
         char root[] = "/tmp/rootXXXXXX";
         const char *p;
@@ -1037,5 +1108,7 @@ int main(int argc, char *argv[]) {
 
         assert_se(rm_rf(root, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
 
+        test_symlink_index();
+
         return 0;
 }
@@ -0,0 +1,178 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "env-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "log.h"
+#include "mount-snapshot.h"
+#include "string-util.h"
+#include "time-util.h"
+#include "util.h"
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(struct libmnt_table*, mnt_free_table);
+
+static struct libmnt_table *parse_table(const char *contents) {
+        char name[] = "/tmp/test-mount-snapshot.XXXXXX";
+        _cleanup_fclose_ FILE *f = NULL;
+        struct libmnt_table *t;
+        int fd;
+
+        fd = mkostemp_safe(name);
+        assert_se(fd >= 0);
+        assert_se(f = fdopen(fd, "w"));
+        assert_se(fputs(contents, f) >= 0);
+        assert_se(fflush_and_check(f) >= 0);
+
+        assert_se(t = mnt_new_table());
+        assert_se(mnt_table_parse_file(t, name) >= 0);
+
+        assert_se(unlink(name) >= 0);
+
+        return t;
+}
+
+static void test_snapshot(void) {
+        _cleanup_(mount_info_snapshot_freep) MountInfoSnapshot *a = NULL, *b = NULL;
+        _cleanup_(mnt_free_tablep) struct libmnt_table *ta = NULL, *tb = NULL;
+        _cleanup_set_free_free_ Set *changed = NULL;
+        MountInfoEntry *e;
+
+        ta = parse_table("20 1 8:1 / / rw,relatime - ext4 /dev/sda1 rw\n"
+                         "21 20 0:5 / /dev rw,nosuid - devtmpfs devtmpfs rw\n"
+                         "22 20 8:2 / /home rw,relatime - ext4 /dev/sda2 rw\n"
+                         "23 20 8:3 / /srv rw,relatime - ext4 /dev/sda3 rw\n"
+                         "24 22 8:2 /shared /home/with\\040space rw,relatime - ext4 /dev/sda2 rw\n");
+
+        /* Without an old snapshot, there is nothing to compare with */
+        assert_se(mount_info_snapshot_new(ta, NULL, &a, &changed) >= 0);
+        assert_se(!changed);
+        assert_se(hashmap_size(a->entries) == 5);
+
+        assert_se(e = mount_info_snapshot_get(a, 24));
+        assert_se(streq(e->where, "/home/with space"));
+        assert_se(streq(e->what, "/dev/sda2"));
+        assert_se(!mount_info_snapshot_get(a, 25));
+
+        assert_se(mount_info_snapshot_has_what(a, "/dev/sda3"));
+        assert_se(!mount_info_snapshot_has_what(a, "/dev/sda4"));
+
+        /* /srv and the bind mount are gone, /home was remounted read-only, and /var appeared */
+        tb = parse_table("20 1 8:1 / / rw,relatime - ext4 /dev/sda1 rw\n"
+                         "21 20 0:5 / /dev rw,nosuid - devtmpfs devtmpfs rw\n"
+                         "22 20 8:2 / /home ro,relatime - ext4 /dev/sda2 ro\n"
+                         "25 20 8:4 / /var rw,relatime - xfs /dev/sda4 rw\n");
+
+        assert_se(mount_info_snapshot_new(tb, a, &b, &changed) >= 0);
+        assert_se(set_size(changed) == 4);
+        assert_se(set_contains(changed, "/srv"));
+        assert_se(set_contains(changed, "/home/with space"));
+        assert_se(set_contains(changed, "/home"));
+        assert_se(set_contains(changed, "/var"));
+
+        /* The unchanged entries were moved over, the removed ones remain in the old snapshot */
+        assert_se(hashmap_size(b->entries) == 4);
+        assert_se(hashmap_size(a->entries) == 2);
+        assert_se(mount_info_snapshot_get(a, 23));
+        assert_se(mount_info_snapshot_get(a, 24));
+
+        /* /dev/sda2 is still mounted on /home, even though the bind mount of it is gone */
+        assert_se(mount_info_snapshot_has_what(b, "/dev/sda2"));
+        assert_se(!mount_info_snapshot_has_what(b, "/dev/sda3"));
+        assert_se(mount_info_snapshot_has_what(b, "/dev/sda4"));
+
+        /* Nothing changes, nothing to do */
+        a = mount_info_snapshot_free(a);
+        changed = set_free_free(changed);
+        assert_se(mount_info_snapshot_new(tb, b, &a, &changed) >= 0);
+        assert_se(set_isempty(changed));
+        assert_se(hashmap_size(a->entries) == 4);
+}
+
+static void test_snapshot_performance(bool slow) {
+        _cleanup_(mount_info_snapshot_freep) MountInfoSnapshot *s = NULL;
+        _cleanup_(mnt_free_tablep) struct libmnt_table *t = NULL, *t2 = NULL;
+        _cleanup_free_ char *contents = NULL, *contents2 = NULL;
+        _cleanup_fclose_ FILE *f = NULL, *f2 = NULL;
+        char buf[FORMAT_TIMESPAN_MAX];
+        size_t size = 0, size2 = 0;
+        unsigned i, n, n_rounds;
+        Set *changed;
+        usec_t ts;
+
+        /* Simulates a container host with thousands of mounts, where a single mount changes between two
+         * notifications, and prints how long comparing the tables took. */
+
+        n = slow ? 20000 : 2000;
+        n_rounds = slow ? 100 : 10;
+
+        assert_se(f = open_memstream(&contents, &size));
+        assert_se(f2 = open_memstream(&contents2, &size2));
+
+        /* The second table differs in the options of the last mount only */
+        for (i = 0; i < n; i++) {
+                fprintf(f, "%u 20 0:%u / /var/lib/containers/%u/rootfs rw,relatime - overlay overlay rw\n",
+                        100 + i, 100 + i, i);
+                fprintf(f2, "%u 20 0:%u / /var/lib/containers/%u/rootfs %s,relatime - overlay overlay rw\n",
+                        100 + i, 100 + i, i, i == n - 1 ? "ro" : "rw");
+        }
+
+        assert_se(fflush_and_check(f) >= 0);
+        assert_se(fflush_and_check(f2) >= 0);
+
+        t = parse_table(contents);
+        t2 = parse_table(contents2);
+
+        assert_se(mount_info_snapshot_new(t, NULL, &s, &changed) >= 0);
+        assert_se(!changed);
+
+        ts = now(CLOCK_MONOTONIC);
+
+        for (i = 0; i < n_rounds; i++) {
+                MountInfoSnapshot *next;
+
+                assert_se(mount_info_snapshot_new(i % 2 ? t : t2, s, &next, &changed) >= 0);
+                assert_se(set_size(changed) == 1);
+                assert_se(mount_info_snapshot_has_what(next, "overlay"));
+
+                set_free_free(changed);
+                mount_info_snapshot_free(s);
+                s = next;
+        }
+
+        log_info("Compared %u tables of %u mounts in %s", n_rounds, n,
+                 format_timespan(buf, sizeof(buf), usec_sub_unsigned(now(CLOCK_MONOTONIC), ts), USEC_PER_MSEC));
+}
+
+int main(int argc, char *argv[]) {
+        int r;
+
+        log_parse_environment();
+        log_open();
+
+        test_snapshot();
+
+        r = getenv_bool("SYSTEMD_SLOW_TESTS");
+        test_snapshot_performance(r >= 0 ? r : SYSTEMD_SLOW_TESTS_DEFAULT);
+
+        return 0;
+}
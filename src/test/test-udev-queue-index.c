@@ -0,0 +1,181 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "alloc-util.h"
+#include "env-util.h"
+#include "log.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "time-util.h"
+#include "udev.h"
+
+static unsigned long long int seqnum = 0;
+
+static struct queue_entry *entry_new(struct queue_index *q, const char *devpath, dev_t devnum, bool is_block, int ifindex) {
+        struct queue_entry *e;
+
+        assert_se(e = new0(struct queue_entry, 1));
+        e->seqnum = ++seqnum;
+        e->devpath = devpath;
+        e->devnum = devnum;
+        e->is_block = is_block;
+        e->ifindex = ifindex;
+
+        assert_se(queue_index_add(q, e) >= 0);
+
+        return e;
+}
+
+static void entry_free(struct queue_index *q, struct queue_entry *e) {
+        queue_index_remove(q, e);
+        free(e);
+}
+
+static void test_queue_index(void) {
+        struct queue_index *q;
+        struct queue_entry *parent, *child, *other, *same, *sibling, *blk, *blk2, *net, *net2, *renamed;
+
+        assert_se(q = queue_index_new());
+
+        parent = entry_new(q, "/devices/pci0000:00/0000:00:1f.2", 0, false, 0);
+        child = entry_new(q, "/devices/pci0000:00/0000:00:1f.2/ata1/host0", 0, false, 0);
+        other = entry_new(q, "/devices/pci0000:00/0000:00:1f.20", 0, false, 0);
+        same = entry_new(q, "/devices/pci0000:00/0000:00:1f.2", 0, false, 0);
+
+        /* the first event is never blocked */
+        assert_se(!queue_index_is_busy(q, parent));
+        /* children wait for their parents */
+        assert_se(queue_index_is_busy(q, child));
+        /* a common prefix of the name doesn't make a parent */
+        assert_se(!queue_index_is_busy(q, other));
+        /* later events for the same device wait for the earlier ones, and parents for their children */
+        assert_se(queue_index_is_busy(q, same));
+
+        entry_free(q, parent);
+        assert_se(!queue_index_is_busy(q, child));
+        assert_se(queue_index_is_busy(q, same));
+
+        /* a sibling added later is not blocked by the child */
+        sibling = entry_new(q, "/devices/pci0000:00/0000:00:1f.2/ata2", 0, false, 0);
+        assert_se(queue_index_is_busy(q, sibling));
+        entry_free(q, same);
+        assert_se(!queue_index_is_busy(q, sibling));
+
+        entry_free(q, child);
+        assert_se(!queue_index_is_busy(q, sibling));
+        entry_free(q, sibling);
+        entry_free(q, other);
+
+        /* device numbers, block and character devices are distinct */
+        blk = entry_new(q, "/devices/virtual/block/loop0", makedev(7, 0), true, 0);
+        blk2 = entry_new(q, "/devices/virtual/block/loop0-renamed", makedev(7, 0), true, 0);
+        other = entry_new(q, "/devices/virtual/misc/foo", makedev(7, 0), false, 0);
+        assert_se(queue_index_is_busy(q, blk2));
+        assert_se(!queue_index_is_busy(q, other));
+        entry_free(q, blk);
+        assert_se(!queue_index_is_busy(q, blk2));
+        entry_free(q, blk2);
+        entry_free(q, other);
+
+        /* identical devpath with a different device number is not blocked */
+        blk = entry_new(q, "/devices/virtual/block/loop0", makedev(7, 0), true, 0);
+        blk2 = entry_new(q, "/devices/virtual/block/loop0", makedev(7, 1), true, 0);
+        assert_se(!queue_index_is_busy(q, blk2));
+        entry_free(q, blk);
+        entry_free(q, blk2);
+
+        /* network interfaces */
+        net = entry_new(q, "/devices/virtual/net/eth0", 0, false, 2);
+        net2 = entry_new(q, "/devices/virtual/net/eth1", 0, false, 2);
+        assert_se(queue_index_is_busy(q, net2));
+        entry_free(q, net);
+        assert_se(!queue_index_is_busy(q, net2));
+
+        /* renamed devices wait for events on their old name */
+        net = entry_new(q, "/devices/virtual/net/eth1", 0, false, 3);
+        renamed = entry_new(q, "/devices/virtual/net/lan0", 0, false, 4);
+        renamed->devpath_old = "/devices/virtual/net/eth1";
+        assert_se(queue_index_is_busy(q, renamed));
+        entry_free(q, net);
+        entry_free(q, net2);
+        assert_se(!queue_index_is_busy(q, renamed));
+        entry_free(q, renamed);
+
+        queue_index_free(q);
+}
+
+static void test_queue_index_benchmark(bool slow) {
+        char buf[FORMAT_TIMESPAN_MAX];
+        struct queue_entry **entries;
+        struct queue_index *q;
+        unsigned i, n, n_busy = 0;
+        usec_t ts, elapsed;
+
+        /* A coldplug of a storage server: disks spread over eight controllers, none of which waits for
+         * another. Timing the whole queue, check and removal cycle only tells something with enough
+         * disks, hence the full run is left to SYSTEMD_SLOW_TESTS=1. */
+
+        n = slow ? 50000 : 500;
+
+        assert_se(q = queue_index_new());
+        assert_se(entries = new0(struct queue_entry*, n));
+
+        ts = now(CLOCK_MONOTONIC);
+
+        for (i = 0; i < n; i++) {
+                char *devpath;
+
+                assert_se(asprintf(&devpath, "/devices/pci0000:00/0000:00:%02x.0/host%u/target%u:0:0/%u:0:0:%u/block/sd%u",
+                                   i % 8, i % 8, i % 8, i % 8, i / 8, i) >= 0);
+                entries[i] = entry_new(q, devpath, makedev(8, i), true, 0);
+        }
+
+        for (i = 0; i < n; i++)
+                if (queue_index_is_busy(q, entries[i]))
+                        n_busy++;
+
+        for (i = 0; i < n; i++) {
+                char *devpath = (char*) entries[i]->devpath;
+
+                entry_free(q, entries[i]);
+                free(devpath);
+        }
+
+        elapsed = usec_sub_unsigned(now(CLOCK_MONOTONIC), ts);
+
+        assert_se(n_busy == 0);
+
+        log_info("Queued, checked and removed %u events in %s, %.1f events/s",
+                 n, format_timespan(buf, sizeof(buf), elapsed, USEC_PER_MSEC),
+                 elapsed > 0 ? (double) n * USEC_PER_SEC / elapsed : 0.0);
+
+        free(entries);
+        queue_index_free(q);
+}
+
+int main(int argc, char *argv[]) {
+        int r;
+
+        log_parse_environment();
+        log_open();
+
+        test_queue_index();
+
+        r = getenv_bool("SYSTEMD_SLOW_TESTS");
+        test_queue_index_benchmark(r >= 0 ? r : SYSTEMD_SLOW_TESTS_DEFAULT);
+
+        return 0;
+}
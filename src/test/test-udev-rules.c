@@ -0,0 +1,91 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <sys/mman.h>
+
+#include "fd-util.h"
+#include "io-util.h"
+#include "log.h"
+#include "memfd-util.h"
+#include "udev.h"
+
+static void assert_images_equal(int a, int b) {
+        uint64_t size_a, size_b;
+        void *p, *q;
+
+        assert_se(memfd_get_size(a, &size_a) >= 0);
+        assert_se(memfd_get_size(b, &size_b) >= 0);
+        assert_se(size_a == size_b);
+
+        assert_se(memfd_map(a, 0, size_a, &p) >= 0);
+        assert_se(memfd_map(b, 0, size_b, &q) >= 0);
+
+        assert_se(memcmp(p, q, size_a) == 0);
+
+        assert_se(munmap(p, size_a) >= 0);
+        assert_se(munmap(q, size_b) >= 0);
+}
+
+static void test_rules_serialize(struct udev *udev) {
+        _cleanup_close_ int fd = -1, fd2 = -1;
+        struct udev_rules *rules, *rules2;
+
+        /* Whatever rules are installed on the host, their tokens and strings have to come back identical,
+         * which is the case if the deserialized rules serialize to the same image again */
+
+        assert_se(rules = udev_rules_new(udev, 1));
+        assert_se(udev_rules_serialize(rules, &fd) >= 0);
+
+        assert_se(rules2 = udev_rules_new_from_fd(udev, fd));
+        assert_se(udev_rules_serialize(rules2, &fd2) >= 0);
+
+        assert_images_equal(fd, fd2);
+
+        udev_rules_unref(rules2);
+        udev_rules_unref(rules);
+}
+
+static void test_rules_new_from_fd_invalid(struct udev *udev) {
+        const uint64_t header[2] = { 1, 1 };
+        _cleanup_close_ int fd = -1, fd2 = -1;
+
+        /* A header only */
+        assert_se((fd = memfd_new("udev-rules")) >= 0);
+        assert_se(loop_write(fd, header, sizeof(header) - 1, false) >= 0);
+        assert_se(!udev_rules_new_from_fd(udev, fd));
+
+        /* A header announcing more than there is */
+        assert_se((fd2 = memfd_new("udev-rules")) >= 0);
+        assert_se(loop_write(fd2, header, sizeof(header), false) >= 0);
+        assert_se(!udev_rules_new_from_fd(udev, fd2));
+}
+
+int main(int argc, char *argv[]) {
+        struct udev *udev;
+
+        log_parse_environment();
+        log_open();
+
+        assert_se(udev = udev_new());
+
+        test_rules_serialize(udev);
+        test_rules_new_from_fd_invalid(udev);
+
+        udev_unref(udev);
+
+        return 0;
+}
@@ -0,0 +1,138 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include "unit-dependency-set.h"
+
+/* The set never dereferences its keys, hence fake unit pointers suffice */
+#define UNIT_N(n) ((Unit*) UINT_TO_PTR((n) + 1))
+#define DATA_N(n) UINT_TO_PTR(((n) + 1) * 16)
+
+static void test_put_get_remove(unsigned n) {
+        UnitDependencySet *s = NULL;
+        unsigned k;
+
+        assert_se(unit_dependency_set_isempty(s));
+        assert_se(!unit_dependency_set_get(s, UNIT_N(0)));
+
+        for (k = 0; k < n; k++)
+                assert_se(unit_dependency_set_put(&s, UNIT_N(k), DATA_N(k)) == 1);
+
+        assert_se(unit_dependency_set_size(s) == n);
+        assert_se(!!s->index == (n >= UNIT_DEPENDENCY_SET_INDEX_MIN));
+
+        assert_se(unit_dependency_set_put(&s, UNIT_N(0), DATA_N(0)) == 0);
+        assert_se(unit_dependency_set_put(&s, UNIT_N(0), DATA_N(1)) == -EEXIST);
+        assert_se(unit_dependency_set_update(s, UNIT_N(n), DATA_N(0)) == -ENOENT);
+
+        for (k = 0; k < n; k++) {
+                assert_se(unit_dependency_set_get(s, UNIT_N(k)) == DATA_N(k));
+                assert_se(unit_dependency_set_update(s, UNIT_N(k), DATA_N(k + 1)) == 0);
+                assert_se(unit_dependency_set_get(s, UNIT_N(k)) == DATA_N(k + 1));
+        }
+
+        assert_se(!unit_dependency_set_contains(s, UNIT_N(n)));
+
+        /* Remove every other entry, the rest must stay reachable */
+        for (k = 0; k < n; k += 2)
+                assert_se(unit_dependency_set_remove(&s, UNIT_N(k)) == DATA_N(k + 1));
+        assert_se(!unit_dependency_set_remove(&s, UNIT_N(0)));
+
+        for (k = 0; k < n; k++)
+                assert_se(unit_dependency_set_contains(s, UNIT_N(k)) == (k % 2 == 1));
+
+        for (k = 1; k < n; k += 2)
+                assert_se(unit_dependency_set_remove(&s, UNIT_N(k)));
+
+        /* Empty sets are freed */
+        assert_se(!s);
+}
+
+static void test_iterate_remove(unsigned n) {
+        UnitDependencySet *s = NULL;
+        unsigned k, seen = 0;
+        Iterator i;
+        Unit *u;
+        void *v;
+
+        for (k = 0; k < n; k++)
+                assert_se(unit_dependency_set_put(&s, UNIT_N(k), DATA_N(k)) == 1);
+
+        /* Dropping the current entry while iterating must neither skip nor repeat entries */
+        UNIT_DEPENDENCY_SET_FOREACH(v, u, s, i) {
+                assert_se(v == DATA_N(PTR_TO_UINT(u) - 1));
+                assert_se(unit_dependency_set_remove(&s, u) == v);
+                seen++;
+        }
+
+        assert_se(seen == n);
+        assert_se(!s);
+}
+
+static void test_replace_and_move(void) {
+        UnitDependencySet *s = NULL, *t = NULL;
+        unsigned k;
+
+        for (k = 0; k < 20; k++)
+                assert_se(unit_dependency_set_put(&s, UNIT_N(k), DATA_N(k)) == 1);
+
+        assert_se(unit_dependency_set_remove_and_replace(&s, UNIT_N(100), UNIT_N(101), DATA_N(0)) == -ENOENT);
+
+        /* Replacing by a unit not in the set yet */
+        assert_se(unit_dependency_set_remove_and_replace(&s, UNIT_N(0), UNIT_N(50), DATA_N(50)) == 0);
+        assert_se(!unit_dependency_set_contains(s, UNIT_N(0)));
+        assert_se(unit_dependency_set_get(s, UNIT_N(50)) == DATA_N(50));
+        assert_se(unit_dependency_set_size(s) == 20);
+
+        /* Replacing by a unit already in the set drops the old entry of that unit */
+        assert_se(unit_dependency_set_remove_and_replace(&s, UNIT_N(1), UNIT_N(19), DATA_N(60)) == 0);
+        assert_se(!unit_dependency_set_contains(s, UNIT_N(1)));
+        assert_se(unit_dependency_set_get(s, UNIT_N(19)) == DATA_N(60));
+        assert_se(unit_dependency_set_size(s) == 19);
+
+        for (k = 200; k < 205; k++)
+                assert_se(unit_dependency_set_put(&t, UNIT_N(k), DATA_N(k)) == 1);
+
+        /* An entry for a unit already in the set is merged into the existing one */
+        assert_se(unit_dependency_set_put(&t, UNIT_N(2), DATA_N(7)) == 1);
+        assert_se(unit_dependency_set_reserve(&s, unit_dependency_set_size(t)) >= 0);
+        assert_se(unit_dependency_set_complete_move(&s, &t) == 0);
+        assert_se(!t);
+        assert_se(unit_dependency_set_size(s) == 24);
+
+        for (k = 200; k < 205; k++)
+                assert_se(unit_dependency_set_get(s, UNIT_N(k)) == DATA_N(k));
+
+        assert_se(unit_dependency_set_get(s, UNIT_N(2)) == UINT_TO_PTR(PTR_TO_UINT(DATA_N(2)) | PTR_TO_UINT(DATA_N(7))));
+
+        /* Moving into an empty set hands over the whole set */
+        assert_se(unit_dependency_set_complete_move(&t, &s) == 0);
+        assert_se(!s);
+        assert_se(unit_dependency_set_size(t) == 24);
+
+        unit_dependency_set_free(t);
+}
+
+int main(int argc, char *argv[]) {
+        test_put_get_remove(5);
+        test_put_get_remove(100);
+        test_iterate_remove(3);
+        test_iterate_remove(100);
+        test_replace_and_move();
+
+        return 0;
+}
@@ -1,11 +1,84 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "fd-util.h"
+#include "io-util.h"
 #include "log.h"
 #include "manager.h"
+#include "process-util.h"
 #include "rm-rf.h"
 #include "test-helper.h"
 #include "tests.h"
 
+static void test_watch_foreign(Manager *m, Unit *u) {
+        _cleanup_close_pair_ int pair[2] = { -1, -1 };
+        pid_t child, grandchild;
+        siginfo_t si;
+        unsigned i;
+
+        /* Our own children are left to SIGCHLD */
+        child = fork();
+        assert_se(child >= 0);
+        if (child == 0) {
+                (void) pause();
+                _exit(EXIT_SUCCESS);
+        }
+
+        assert_se(unit_watch_pid(u, child) >= 0);
+        assert_se(manager_get_unit_by_pid(m, child) == u);
+        assert_se(!hashmap_contains(m->watch_pidfds, PID_TO_PTR(child)));
+        assert_se(!set_contains(m->watch_pids_unreliable, PID_TO_PTR(child)));
+
+        assert_se(kill(child, SIGKILL) >= 0);
+        assert_se(wait_for_terminate(child, &si) >= 0);
+        unit_unwatch_pid(u, child);
+
+        /* Processes we are not the parent of are watched via a pidfd, and dropped once they exit */
+        assert_se(pipe2(pair, O_CLOEXEC) >= 0);
+
+        child = fork();
+        assert_se(child >= 0);
+        if (child == 0) {
+                grandchild = fork();
+                if (grandchild == 0) {
+                        (void) pause();
+                        _exit(EXIT_SUCCESS);
+                }
+
+                (void) loop_write(pair[1], &grandchild, sizeof(grandchild), false);
+                _exit(grandchild < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+        }
+
+        assert_se(wait_for_terminate_and_check("child", child, WAIT_LOG) == EXIT_SUCCESS);
+        assert_se(loop_read_exact(pair[0], &grandchild, sizeof(grandchild), false) >= 0);
+
+        assert_se(unit_watch_pid(u, grandchild) >= 0);
+        assert_se(manager_get_unit_by_pid(m, grandchild) == u);
+
+        if (!hashmap_contains(m->watch_pidfds, PID_TO_PTR(grandchild))) {
+                log_notice("pidfds not supported, skipping.");
+
+                /* It's still polled instead */
+                assert_se(set_contains(m->watch_pids_unreliable, PID_TO_PTR(grandchild)));
+                assert_se(kill(grandchild, SIGKILL) >= 0);
+                unit_unwatch_pid(u, grandchild);
+                return;
+        }
+
+        assert_se(!set_contains(m->watch_pids_unreliable, PID_TO_PTR(grandchild)));
+        assert_se(kill(grandchild, SIGKILL) >= 0);
+
+        for (i = 0; i < 100 && hashmap_contains(m->watch_pidfds, PID_TO_PTR(grandchild)); i++)
+                assert_se(sd_event_run(m->event, 100 * USEC_PER_MSEC) >= 0);
+
+        assert_se(!hashmap_contains(m->watch_pidfds, PID_TO_PTR(grandchild)));
+        assert_se(!manager_get_unit_by_pid(m, grandchild));
+        assert_se(!set_contains(u->pids, PID_TO_PTR(grandchild)));
+}
+
 int main(int argc, char *argv[]) {
         _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL;
         Unit *a, *b, *c, *u;
@@ -90,6 +163,10 @@ int main(int argc, char *argv[]) {
         unit_unwatch_pid(c, 4711);
         assert_se(manager_get_unit_by_pid(m, 4711) == NULL);
 
+        assert_se(set_isempty(m->watch_pids_unreliable));
+
+        test_watch_foreign(m, a);
+
         manager_free(m);
 
         return 0;
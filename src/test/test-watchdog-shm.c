@@ -0,0 +1,204 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "sd-daemon.h"
+
+#include "fd-util.h"
+#include "fileio.h"
+#include "log.h"
+#include "memfd-util.h"
+#include "missing.h"
+#include "rm-rf.h"
+#include "socket-util.h"
+#include "string-util.h"
+#include "util.h"
+#include "watchdog-shm.h"
+
+static int new_page(uint64_t size, uint64_t magic, int seals) {
+        WatchdogShm *shm;
+        int fd;
+
+        fd = memfd_new("test-watchdog-shm");
+        assert_se(fd >= 0);
+        assert_se(memfd_set_size(fd, size) >= 0);
+
+        if (size >= sizeof(WatchdogShm)) {
+                shm = mmap(NULL, sizeof(WatchdogShm), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+                assert_se(shm != MAP_FAILED);
+                shm->magic = magic;
+                assert_se(munmap(shm, sizeof(WatchdogShm)) >= 0);
+        }
+
+        if (seals != 0)
+                assert_se(fcntl(fd, F_ADD_SEALS, seals) >= 0);
+
+        return fd;
+}
+
+static void test_map(void) {
+        WatchdogShm *shm, *page;
+        int fd;
+
+        /* Pages which might be truncated under our feet, too small or not meant for us are refused */
+        fd = new_page(page_size(), WATCHDOG_SHM_MAGIC, 0);
+        assert_se(watchdog_shm_map(fd, &shm) == -EPERM);
+        safe_close(fd);
+
+        fd = new_page(sizeof(uint64_t), 0, F_SEAL_SHRINK|F_SEAL_GROW);
+        assert_se(watchdog_shm_map(fd, &shm) == -EBADMSG);
+        safe_close(fd);
+
+        fd = new_page(page_size(), 0, F_SEAL_SHRINK);
+        assert_se(watchdog_shm_map(fd, &shm) == -EBADMSG);
+        safe_close(fd);
+
+        /* We couldn't acknowledge this one */
+        fd = new_page(page_size(), WATCHDOG_SHM_MAGIC, F_SEAL_SHRINK|F_SEAL_WRITE);
+        assert_se(watchdog_shm_map(fd, &shm) < 0);
+        safe_close(fd);
+
+        fd = new_page(page_size(), WATCHDOG_SHM_MAGIC, F_SEAL_SHRINK);
+        page = mmap(NULL, sizeof(WatchdogShm), PROT_READ, MAP_SHARED, fd, 0);
+        assert_se(page != MAP_FAILED);
+        assert_se(page->acked == 0);
+
+        assert_se(watchdog_shm_map(fd, &shm) >= 0);
+        assert_se(page->acked != 0);
+
+        watchdog_shm_set_acked(shm, false);
+        assert_se(page->acked == 0);
+        watchdog_shm_set_acked(shm, true);
+        assert_se(page->acked != 0);
+
+        assert_se(!watchdog_shm_unmap(shm));
+        assert_se(page->acked == 0);
+
+        assert_se(munmap(page, sizeof(WatchdogShm)) >= 0);
+        safe_close(fd);
+}
+
+/* Returns the number of bytes received, or -EAGAIN if nothing is queued */
+static int receive(int fd, char *buf, size_t size, int *ret_fd) {
+        union {
+                struct cmsghdr cmsghdr;
+                uint8_t buf[CMSG_SPACE(sizeof(int))];
+        } control = {};
+        struct iovec iovec = {
+                .iov_base = buf,
+                .iov_len = size - 1,
+        };
+        struct msghdr msghdr = {
+                .msg_iov = &iovec,
+                .msg_iovlen = 1,
+                .msg_control = &control,
+                .msg_controllen = sizeof(control),
+        };
+        struct cmsghdr *cmsg;
+        ssize_t n;
+
+        n = recvmsg(fd, &msghdr, MSG_DONTWAIT|MSG_CMSG_CLOEXEC);
+        if (n < 0)
+                return -errno;
+
+        buf[n] = 0;
+
+        *ret_fd = -1;
+        cmsg = CMSG_FIRSTHDR(&msghdr);
+        if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+                *ret_fd = *(int*) CMSG_DATA(cmsg);
+
+        return (int) n;
+}
+
+static void test_notify(void) {
+        _cleanup_(rm_rf_physical_and_freep) char *dir = NULL;
+        union sockaddr_union sa = {
+                .un.sun_family = AF_UNIX,
+        };
+        _cleanup_close_ int fd = -1, page_fd = -1;
+        WatchdogShm *shm;
+        char buf[128];
+        uint64_t ts;
+        int r, k;
+
+        assert_se(mkdtemp_malloc("/tmp/test-watchdog-shm-XXXXXX", &dir) >= 0);
+        strncpy(sa.un.sun_path, dir, sizeof(sa.un.sun_path) - STRLEN("/notify") - 1);
+        strcat(sa.un.sun_path, "/notify");
+
+        fd = socket(AF_UNIX, SOCK_DGRAM|SOCK_CLOEXEC, 0);
+        assert_se(fd >= 0);
+        assert_se(bind(fd, &sa.sa, SOCKADDR_UN_LEN(sa.un)) >= 0);
+
+        assert_se(setenv("NOTIFY_SOCKET", sa.un.sun_path, 1) >= 0);
+        assert_se(setenv("WATCHDOG_USEC", "10000000", 1) >= 0);
+        assert_se(setenv("WATCHDOG_SHM", "1", 1) >= 0);
+        assert_se(unsetenv("WATCHDOG_PID") >= 0);
+
+        /* The first ping passes the page */
+        assert_se(sd_notify(false, "WATCHDOG=1") > 0);
+        r = receive(fd, buf, sizeof(buf), &page_fd);
+        assert_se(r > 0);
+        assert_se(strstr(buf, "WATCHDOG_SHM=1"));
+        assert_se(page_fd >= 0);
+
+        /* Nobody acknowledged it yet, hence datagrams are still sent */
+        assert_se(sd_notify(false, "WATCHDOG=1") > 0);
+        assert_se(receive(fd, buf, sizeof(buf), &k) > 0);
+        assert_se(streq(buf, "WATCHDOG=1"));
+        assert_se(k < 0);
+
+        /* Once the manager watches the page, pings only go there */
+        assert_se(watchdog_shm_map(page_fd, &shm) >= 0);
+        ts = shm->timestamp;
+        assert_se(sd_notify(false, "WATCHDOG=1") > 0);
+        assert_se(receive(fd, buf, sizeof(buf), &k) == -EAGAIN);
+        assert_se(shm->timestamp > ts);
+
+        /* The manager is about to reexecute, and the new one might not pick up the page */
+        watchdog_shm_set_acked(shm, false);
+        assert_se(sd_notify(false, "WATCHDOG=1") > 0);
+        assert_se(receive(fd, buf, sizeof(buf), &k) > 0);
+        assert_se(streq(buf, "WATCHDOG=1"));
+
+        /* Other messages are never affected */
+        watchdog_shm_set_acked(shm, true);
+        assert_se(sd_notify(false, "STATUS=Fine") > 0);
+        assert_se(receive(fd, buf, sizeof(buf), &k) > 0);
+        assert_se(streq(buf, "STATUS=Fine"));
+
+        assert_se(!watchdog_shm_unmap(shm));
+        assert_se(sd_notify(false, "WATCHDOG=1") > 0);
+        assert_se(receive(fd, buf, sizeof(buf), &k) > 0);
+        assert_se(streq(buf, "WATCHDOG=1"));
+}
+
+int main(int argc, char *argv[]) {
+        log_parse_environment();
+        log_open();
+
+        test_map();
+        test_notify();
+
+        return 0;
+}
@@ -0,0 +1,376 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc-util.h"
+#include "hashmap.h"
+#include "list.h"
+#include "udev.h"
+
+/*
+ * Indexes the queued events by the properties that make one event wait for an earlier one: the devpath
+ * (identical, parent or child devices), the device number and the network interface index. This way,
+ * checking whether an event is blocked does not need to look at the whole queue.
+ *
+ * Devpaths are kept in a prefix tree: each node stands for a devpath, and exists as long as there are
+ * events for it or for any devpath below it. Each node lists the events for exactly its devpath, and,
+ * through one link per event and ancestor, all events below it. All lists are in the order the events
+ * were added, i.e. ordered by sequence number, hence their heads are the earliest events.
+ */
+
+struct queue_index_node {
+        char *path;
+        struct queue_index_node *parent;
+        unsigned n_ref;
+
+        LIST_HEAD(struct queue_entry, entries);
+        struct queue_entry *entries_tail;
+
+        LIST_HEAD(struct queue_index_link, below);
+        struct queue_index_link *below_tail;
+};
+
+struct queue_index_link {
+        struct queue_index_node *node;
+        struct queue_entry *entry;
+        LIST_FIELDS(struct queue_index_link, below);
+};
+
+struct queue_index_bucket {
+        uint64_t key;
+        struct queue_entry *head, *tail;
+};
+
+struct queue_index {
+        Hashmap *nodes;
+        Hashmap *devnums[2];    /* character and block devices */
+        Hashmap *ifindexes;
+};
+
+#define LIST_APPEND_TAIL(name, head, tail, item)                        \
+        do {                                                            \
+                LIST_INSERT_AFTER(name, head, tail, item);              \
+                (tail) = (item);                                        \
+        } while (false)
+
+#define LIST_REMOVE_TAIL(name, head, tail, item)                        \
+        do {                                                            \
+                if ((tail) == (item))                                   \
+                        (tail) = (item)->name##_prev;                   \
+                LIST_REMOVE(name, head, item);                          \
+        } while (false)
+
+struct queue_index *queue_index_new(void) {
+        struct queue_index *q;
+
+        q = new0(struct queue_index, 1);
+        if (!q)
+                return NULL;
+
+        q->nodes = hashmap_new(&string_hash_ops);
+        q->devnums[false] = hashmap_new(&uint64_hash_ops);
+        q->devnums[true] = hashmap_new(&uint64_hash_ops);
+        q->ifindexes = hashmap_new(&uint64_hash_ops);
+        if (!q->nodes || !q->devnums[false] || !q->devnums[true] || !q->ifindexes)
+                return queue_index_free(q);
+
+        return q;
+}
+
+struct queue_index *queue_index_free(struct queue_index *q) {
+        if (!q)
+                return NULL;
+
+        /* All entries need to be removed first */
+        assert(hashmap_isempty(q->nodes));
+
+        hashmap_free(q->nodes);
+        hashmap_free(q->devnums[false]);
+        hashmap_free(q->devnums[true]);
+        hashmap_free(q->ifindexes);
+
+        return mfree(q);
+}
+
+static void queue_index_node_unref(struct queue_index *q, struct queue_index_node *n) {
+        while (n) {
+                struct queue_index_node *parent;
+
+                assert(n->n_ref > 0);
+
+                if (--n->n_ref > 0)
+                        return;
+
+                assert(!n->entries);
+                assert(!n->below);
+
+                assert_se(hashmap_remove(q->nodes, n->path) == n);
+
+                /* Drop the reference the node held on its parent */
+                parent = n->parent;
+                free(n->path);
+                free(n);
+                n = parent;
+        }
+}
+
+/* Returns the node for the first len characters of path, with a reference taken */
+static int queue_index_node_get(struct queue_index *q, const char *path, size_t len, struct queue_index_node **ret) {
+        struct queue_index_node *n, *parent = NULL;
+        const char *p;
+        char *key;
+        int r;
+
+        key = strndupa(path, len);
+
+        n = hashmap_get(q->nodes, key);
+        if (n) {
+                n->n_ref++;
+                *ret = n;
+                return 0;
+        }
+
+        /* The parent is everything before the last slash, unless that's the leading one */
+        p = memrchr(path, '/', len);
+        if (p && p > path) {
+                r = queue_index_node_get(q, path, p - path, &parent);
+                if (r < 0)
+                        return r;
+        }
+
+        n = new0(struct queue_index_node, 1);
+        if (!n) {
+                r = -ENOMEM;
+                goto fail;
+        }
+
+        n->path = strdup(key);
+        if (!n->path) {
+                r = -ENOMEM;
+                goto fail;
+        }
+
+        r = hashmap_put(q->nodes, n->path, n);
+        if (r < 0)
+                goto fail;
+
+        n->parent = parent;
+        n->n_ref = 1;
+
+        *ret = n;
+        return 0;
+
+fail:
+        if (n)
+                free(n->path);
+        free(n);
+        queue_index_node_unref(q, parent);
+        return r;
+}
+
+static int queue_index_bucket_get(Hashmap *h, uint64_t key, struct queue_index_bucket **ret) {
+        struct queue_index_bucket *b;
+        int r;
+
+        b = hashmap_get(h, &key);
+        if (!b) {
+                b = new0(struct queue_index_bucket, 1);
+                if (!b)
+                        return -ENOMEM;
+
+                b->key = key;
+
+                r = hashmap_put(h, &b->key, b);
+                if (r < 0) {
+                        free(b);
+                        return r;
+                }
+        }
+
+        *ret = b;
+        return 0;
+}
+
+static void queue_index_bucket_maybe_free(Hashmap *h, struct queue_index_bucket *b) {
+        if (!b || b->head)
+                return;
+
+        assert_se(hashmap_remove(h, &b->key) == b);
+        free(b);
+}
+
+int queue_index_add(struct queue_index *q, struct queue_entry *e) {
+        struct queue_index_node *node, *n;
+        size_t i;
+        int r;
+
+        assert(q);
+        assert(e);
+        assert(e->devpath);
+        assert(!e->node);
+
+        r = queue_index_node_get(q, e->devpath, strlen(e->devpath), &node);
+        if (r < 0)
+                return r;
+
+        for (n = node->parent; n; n = n->parent)
+                e->n_links++;
+
+        if (e->n_links > 0) {
+                e->links = new0(struct queue_index_link, e->n_links);
+                if (!e->links) {
+                        r = -ENOMEM;
+                        goto fail;
+                }
+        }
+
+        if (major(e->devnum) != 0) {
+                r = queue_index_bucket_get(q->devnums[e->is_block], e->devnum, &e->devnum_bucket);
+                if (r < 0)
+                        goto fail;
+        }
+
+        if (e->ifindex != 0) {
+                r = queue_index_bucket_get(q->ifindexes, e->ifindex, &e->ifindex_bucket);
+                if (r < 0)
+                        goto fail;
+        }
+
+        /* Nothing can fail anymore, link the entry in everywhere */
+
+        e->node = node;
+        LIST_APPEND_TAIL(same_devpath, node->entries, node->entries_tail, e);
+
+        for (i = 0, n = node->parent; n; n = n->parent, i++) {
+                struct queue_index_link *l = e->links + i;
+
+                l->node = n;
+                l->entry = e;
+                n->n_ref++;
+                LIST_APPEND_TAIL(below, n->below, n->below_tail, l);
+        }
+
+        if (e->devnum_bucket)
+                LIST_APPEND_TAIL(same_devnum, e->devnum_bucket->head, e->devnum_bucket->tail, e);
+
+        if (e->ifindex_bucket)
+                LIST_APPEND_TAIL(same_ifindex, e->ifindex_bucket->head, e->ifindex_bucket->tail, e);
+
+        return 0;
+
+fail:
+        if (e->devnum_bucket) {
+                queue_index_bucket_maybe_free(q->devnums[e->is_block], e->devnum_bucket);
+                e->devnum_bucket = NULL;
+        }
+
+        e->links = mfree(e->links);
+        e->n_links = 0;
+        queue_index_node_unref(q, node);
+        return r;
+}
+
+void queue_index_remove(struct queue_index *q, struct queue_entry *e) {
+        size_t i;
+
+        assert(q);
+        assert(e);
+
+        if (!e->node)
+                return;
+
+        if (e->ifindex_bucket) {
+                LIST_REMOVE_TAIL(same_ifindex, e->ifindex_bucket->head, e->ifindex_bucket->tail, e);
+                queue_index_bucket_maybe_free(q->ifindexes, e->ifindex_bucket);
+                e->ifindex_bucket = NULL;
+        }
+
+        if (e->devnum_bucket) {
+                LIST_REMOVE_TAIL(same_devnum, e->devnum_bucket->head, e->devnum_bucket->tail, e);
+                queue_index_bucket_maybe_free(q->devnums[e->is_block], e->devnum_bucket);
+                e->devnum_bucket = NULL;
+        }
+
+        for (i = 0; i < e->n_links; i++) {
+                struct queue_index_link *l = e->links + i;
+
+                LIST_REMOVE_TAIL(below, l->node->below, l->node->below_tail, l);
+        }
+
+        LIST_REMOVE_TAIL(same_devpath, e->node->entries, e->node->entries_tail, e);
+
+        /* Drop the references of the links first, their nodes are ancestors of ours */
+        for (i = 0; i < e->n_links; i++)
+                queue_index_node_unref(q, e->links[i].node);
+        queue_index_node_unref(q, e->node);
+
+        e->node = NULL;
+        e->links = mfree(e->links);
+        e->n_links = 0;
+}
+
+/* Returns true if an event added before e still blocks it: one for the same, a parent or a child device */
+bool queue_index_is_busy(struct queue_index *q, struct queue_entry *e) {
+        struct queue_index_node *n;
+        struct queue_entry *i;
+
+        assert(q);
+        assert(e);
+        assert(e->node);
+
+        /* check major/minor */
+        if (e->devnum_bucket && e->devnum_bucket->head->seqnum < e->seqnum)
+                return true;
+
+        /* check network device ifindex */
+        if (e->ifindex_bucket && e->ifindex_bucket->head->seqnum < e->seqnum)
+                return true;
+
+        /* check our old name */
+        if (e->devpath_old) {
+                n = hashmap_get(q->nodes, e->devpath_old);
+                if (n && n->entries && n->entries->seqnum < e->seqnum)
+                        return true;
+        }
+
+        /* identical device event found */
+        LIST_FOREACH(same_devpath, i, e->node->entries) {
+                if (i->seqnum >= e->seqnum)
+                        break;
+
+                /* devices names might have changed/swapped in the meantime */
+                if (major(e->devnum) != 0 && (e->devnum != i->devnum || e->is_block != i->is_block))
+                        continue;
+                if (e->ifindex != 0 && e->ifindex != i->ifindex)
+                        continue;
+
+                return true;
+        }
+
+        /* parent device event found */
+        for (n = e->node->parent; n; n = n->parent)
+                if (n->entries && n->entries->seqnum < e->seqnum)
+                        return true;
+
+        /* child device event found */
+        if (e->node->below && e->node->below->entry->seqnum < e->seqnum)
+                return true;
+
+        return false;
+}
@@ -26,6 +26,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -36,6 +37,9 @@
 #include "fd-util.h"
 #include "fs-util.h"
 #include "glob-util.h"
+#include "hashmap.h"
+#include "io-util.h"
+#include "memfd-util.h"
 #include "path-util.h"
 #include "proc-cmdline.h"
 #include "stat-util.h"
@@ -85,6 +89,28 @@ struct udev_rules {
         struct uid_gid *gids;
         unsigned int gids_cur;
         unsigned int gids_max;
+
+        /* lists of the rules which may match an event, by action and subsystem, built on demand */
+        Hashmap *rule_lists;
+
+        /* time spent in each rule, indexed by the rule token, if enabled */
+        usec_t *rule_usec;
+};
+
+/* The action and subsystem of a device do not change while the rules are applied, and neither does the
+ * result of the ACTION and SUBSYSTEM keys for it. Rules which can not match are left out of the list. Neither
+ * does the kernel name change, but there are too many of them to keep a list for each. Instead, the literal
+ * prefix of a rule's KERNEL key is kept next to it, so that rules for other devices are skipped with a
+ * comparison of that prefix, without looking at the rule itself. */
+struct rule_list_entry {
+        unsigned int token;
+        unsigned int kernel_off;
+        unsigned int kernel_len;
+};
+
+struct rule_list {
+        unsigned int n_rules;
+        struct rule_list_entry rules[];
 };
 
 static char *rules_str(struct udev_rules *rules, unsigned int off) {
@@ -116,6 +142,7 @@ enum string_glob_type {
         GL_SPLIT,                       /* multi-value A|B */
         GL_SPLIT_GLOB,                  /* multi-value with glob A*|B* */
         GL_SOMETHING,                   /* commonly used "?*" */
+        GL_PREFIX,                      /* literal prefix with a single trailing "*" */
 };
 
 enum string_subst_type {
@@ -256,6 +283,7 @@ static const char *string_glob_str(enum string_glob_type type) {
                 [GL_SPLIT] =            "split",
                 [GL_SPLIT_GLOB] =       "split-glob",
                 [GL_SOMETHING] =        "split-glob",
+                [GL_PREFIX] =           "prefix",
         };
 
         return string_glob_strs[type];
@@ -943,6 +971,8 @@ static void rule_add_key(struct rule_tmp *rule_tmp, enum token_type type,
                 } else if (has_glob) {
                         if (streq(value, "?*"))
                                 glob = GL_SOMETHING;
+                        else if (!strpbrk(value, "?[\\") && strchr(value, '*') == value + strlen(value) - 1)
+                                glob = GL_PREFIX;
                         else
                                 glob = GL_GLOB;
                 } else {
@@ -1604,9 +1634,120 @@ struct udev_rules *udev_rules_unref(struct udev_rules *rules) {
         strbuf_cleanup(rules->strbuf);
         free(rules->uids);
         free(rules->gids);
+        hashmap_free_free_free(rules->rule_lists);
+        free(rules->rule_usec);
         return mfree(rules);
 }
 
+/* The tokens and the string buffer of parsed rules only refer to each other by offset, so they can be
+ * handed to another process as they are, with this header in front of them. */
+struct rules_image_header {
+        uint64_t n_tokens;
+        uint64_t strings_size;
+};
+
+int udev_rules_serialize(struct udev_rules *rules, int *ret_fd) {
+        struct rules_image_header h = {
+                .n_tokens = rules->token_cur,
+                .strings_size = rules->strbuf->len,
+        };
+        _cleanup_close_ int fd = -1;
+        int r;
+
+        assert(rules);
+        assert(ret_fd);
+
+        fd = memfd_new("udev-rules");
+        if (fd < 0)
+                return fd;
+
+        r = loop_write(fd, &h, sizeof(h), false);
+        if (r < 0)
+                return r;
+
+        r = loop_write(fd, rules->tokens, rules->token_cur * sizeof(struct token), false);
+        if (r < 0)
+                return r;
+
+        r = loop_write(fd, rules->strbuf->buf, rules->strbuf->len, false);
+        if (r < 0)
+                return r;
+
+        r = memfd_set_sealed(fd);
+        if (r < 0)
+                return r;
+
+        *ret_fd = fd;
+        fd = -1;
+
+        return 0;
+}
+
+struct udev_rules *udev_rules_new_from_fd(struct udev *udev, int fd) {
+        const struct rules_image_header *h;
+        struct udev_rules *rules;
+        const uint8_t *p;
+        uint64_t size;
+        void *m;
+        int r;
+
+        r = memfd_get_size(fd, &size);
+        if (r < 0) {
+                log_error_errno(r, "failed to get size of rules image: %m");
+                return NULL;
+        }
+
+        if (size < sizeof(struct rules_image_header)) {
+                log_error("rules image is truncated");
+                return NULL;
+        }
+
+        r = memfd_map(fd, 0, size, &m);
+        if (r < 0) {
+                log_error_errno(r, "failed to map rules image: %m");
+                return NULL;
+        }
+
+        h = m;
+        p = (const uint8_t*) m + sizeof(struct rules_image_header);
+        if (h->n_tokens == 0 || h->n_tokens > UINT_MAX || h->strings_size == 0 ||
+            h->n_tokens > (size - sizeof(struct rules_image_header)) / sizeof(struct token) ||
+            h->strings_size != size - sizeof(struct rules_image_header) - h->n_tokens * sizeof(struct token)) {
+                log_error("rules image is invalid");
+                rules = NULL;
+                goto finish;
+        }
+
+        rules = new0(struct udev_rules, 1);
+        if (!rules)
+                goto finish;
+        rules->udev = udev;
+
+        rules->tokens = newdup(struct token, p, h->n_tokens);
+        if (!rules->tokens) {
+                rules = udev_rules_unref(rules);
+                goto finish;
+        }
+        rules->token_cur = rules->token_max = h->n_tokens;
+
+        rules->strbuf = new0(struct strbuf, 1);
+        if (!rules->strbuf) {
+                rules = udev_rules_unref(rules);
+                goto finish;
+        }
+
+        rules->strbuf->buf = memdup(p + h->n_tokens * sizeof(struct token), h->strings_size);
+        if (!rules->strbuf->buf) {
+                rules = udev_rules_unref(rules);
+                goto finish;
+        }
+        rules->strbuf->len = h->strings_size;
+
+finish:
+        (void) munmap(m, size);
+        return rules;
+}
+
 bool udev_rules_check_timestamp(struct udev_rules *rules) {
         if (!rules)
                 return false;
@@ -1676,6 +1817,9 @@ static int match_key(struct udev_rules *rules, struct token *token, const char *
         case GL_SOMETHING:
                 match = (val[0] != '\0');
                 break;
+        case GL_PREFIX:
+                match = strneq(key_value, val, strlen(key_value) - 1);
+                break;
         case GL_UNSET:
                 return -1;
         }
@@ -1735,6 +1879,167 @@ static int match_attr(struct udev_rules *rules, struct udev_device *dev, struct
         return match_key(rules, cur, value);
 }
 
+/* Returns the length of the literal text every value matching the key has to start with */
+static unsigned int token_literal_prefix(struct udev_rules *rules, struct token *token) {
+        const char *value = rules_str(rules, token->key.value_off);
+
+        if (token->key.op != OP_MATCH)
+                return 0;
+
+        switch (token->key.glob) {
+        case GL_PLAIN:
+                return strlen(value);
+        case GL_PREFIX:
+                return strlen(value) - 1;
+        case GL_GLOB:
+                return strcspn(value, "*?[\\");
+        default:
+                return 0;
+        }
+}
+
+static bool rule_list_entry_may_match(struct udev_rules *rules, struct rule_list_entry *e, const char *sysname, size_t len) {
+        return e->kernel_len <= len && memcmp(rules_str(rules, e->kernel_off), sysname, e->kernel_len) == 0;
+}
+
+static struct rule_list *rules_get_rule_list(struct udev_rules *rules, const char *action, const char *subsystem, bool can_set_name) {
+        _cleanup_free_ struct rule_list *list = NULL;
+        _cleanup_free_ char *key = NULL;
+        struct rule_list *l;
+        unsigned int i;
+        int r;
+
+        key = strjoin(can_set_name ? "+" : "-", strempty(action), "/", strempty(subsystem));
+        if (!key)
+                return NULL;
+
+        l = hashmap_get(rules->rule_lists, key);
+        if (l)
+                return l;
+
+        r = hashmap_ensure_allocated(&rules->rule_lists, &string_hash_ops);
+        if (r < 0)
+                return NULL;
+
+        list = malloc(offsetof(struct rule_list, rules) + rules->token_cur * sizeof(struct rule_list_entry));
+        if (!list)
+                return NULL;
+        list->n_rules = 0;
+
+        for (i = 0; i < rules->token_cur && rules->tokens[i].type == TK_RULE; i += rules->tokens[i].rule.token_count) {
+                struct token *rule = &rules->tokens[i];
+                struct rule_list_entry *e;
+                struct token *cur;
+                bool match = true;
+
+                if (!can_set_name && rule->rule.can_set_name)
+                        continue;
+
+                e = &list->rules[list->n_rules];
+                *e = (struct rule_list_entry) {
+                        .token = i,
+                };
+
+                /* the keys of a rule are sorted by type, ACTION, KERNEL and SUBSYSTEM come early */
+                for (cur = rule + 1; match && cur < rule + rule->rule.token_count && cur->type <= TK_M_SUBSYSTEM; cur++)
+                        if (cur->type == TK_M_ACTION)
+                                match = match_key(rules, cur, action) == 0;
+                        else if (cur->type == TK_M_SUBSYSTEM)
+                                match = match_key(rules, cur, subsystem) == 0;
+                        else if (cur->type == TK_M_KERNEL) {
+                                unsigned int len;
+
+                                len = token_literal_prefix(rules, cur);
+                                if (len > e->kernel_len) {
+                                        e->kernel_off = cur->key.value_off;
+                                        e->kernel_len = len;
+                                }
+                        }
+
+                if (match)
+                        list->n_rules++;
+        }
+
+        l = realloc(list, offsetof(struct rule_list, rules) + list->n_rules * sizeof(struct rule_list_entry));
+        if (l)
+                list = l;
+
+        r = hashmap_put(rules->rule_lists, key, list);
+        if (r < 0)
+                return NULL;
+        key = NULL;
+
+        log_debug("%u of the rules may match action '%s' on subsystem '%s'",
+                  list->n_rules, strempty(action), strempty(subsystem));
+
+        l = list;
+        list = NULL;
+        return l;
+}
+
+int udev_rules_enable_timing(struct udev_rules *rules) {
+        assert(rules);
+
+        if (rules->rule_usec)
+                return 0;
+
+        rules->rule_usec = new0(usec_t, rules->token_cur);
+        if (!rules->rule_usec)
+                return -ENOMEM;
+
+        return 0;
+}
+
+struct rule_timing {
+        unsigned int rule;
+        usec_t usec;
+};
+
+static int rule_timing_compare(const void *a, const void *b) {
+        const struct rule_timing *x = a, *y = b;
+
+        if (x->usec > y->usec)
+                return -1;
+        if (x->usec < y->usec)
+                return 1;
+
+        return x->rule < y->rule ? -1 : x->rule > y->rule;
+}
+
+void udev_rules_dump_timing(struct udev_rules *rules, FILE *f) {
+        _cleanup_free_ struct rule_timing *timings = NULL;
+        unsigned int i, n = 0;
+
+        assert(rules);
+
+        if (!rules->rule_usec)
+                return;
+
+        timings = new(struct rule_timing, rules->token_cur);
+        if (!timings) {
+                log_oom();
+                return;
+        }
+
+        for (i = 0; i < rules->token_cur; i++)
+                if (rules->rule_usec[i] > 0)
+                        timings[n++] = (struct rule_timing) {
+                                .rule = i,
+                                .usec = rules->rule_usec[i],
+                        };
+
+        qsort_safe(timings, n, sizeof(struct rule_timing), rule_timing_compare);
+
+        for (i = 0; i < n; i++) {
+                struct token *rule = &rules->tokens[timings[i].rule];
+                char buf[FORMAT_TIMESPAN_MAX];
+
+                fprintf(f, "%10s %s:%u\n",
+                        format_timespan(buf, sizeof(buf), timings[i].usec, 1),
+                        rules_str(rules, rule->rule.filename_off), rule->rule.filename_line);
+        }
+}
+
 enum escape_type {
         ESCAPE_UNSET,
         ESCAPE_NONE,
@@ -1748,21 +2053,62 @@ void udev_rules_apply_to_event(struct udev_rules *rules,
                                struct udev_list *properties_list) {
         struct token *cur;
         struct token *rule;
+        struct rule_list *list;
         enum escape_type esc = ESCAPE_UNSET;
+        unsigned int candidate = 0;
+        const char *sysname;
+        size_t sysname_len;
+        usec_t ts = 0;
         bool can_set_name;
         int r;
 
         if (rules->tokens == NULL)
                 return;
 
+        sysname = strempty(udev_device_get_sysname(event->dev));
+        sysname_len = strlen(sysname);
+
         can_set_name = ((!streq(udev_device_get_action(event->dev), "remove")) &&
                         (major(udev_device_get_devnum(event->dev)) > 0 ||
                          udev_device_get_ifindex(event->dev) > 0));
 
+        /* only look at the rules which may match, if we can't get the list, look at all of them */
+        list = rules_get_rule_list(rules, udev_device_get_action(event->dev), udev_device_get_subsystem(event->dev), can_set_name);
+
+        if (rules->rule_usec)
+                ts = now(CLOCK_MONOTONIC);
+
         /* loop through token list, match, run actions or forward to next rule */
         cur = &rules->tokens[0];
         rule = cur;
         for (;;) {
+                if (rules->rule_usec && IN_SET(cur->type, TK_RULE, TK_END)) {
+                        usec_t n = now(CLOCK_MONOTONIC);
+
+                        rules->rule_usec[rule - rules->tokens] += n - ts;
+                        ts = n;
+                }
+
+                /* rules only ever move forward, skip ahead to the next one in the list */
+                if (list && cur->type == TK_RULE) {
+                        unsigned int idx = cur - rules->tokens;
+
+                        while (candidate < list->n_rules &&
+                               (list->rules[candidate].token < idx ||
+                                !rule_list_entry_may_match(rules, &list->rules[candidate], sysname, sysname_len)))
+                                candidate++;
+
+                        if (candidate >= list->n_rules) {
+                                cur = &rules->tokens[rules->token_cur - 1];
+                                continue;
+                        }
+
+                        if (list->rules[candidate].token != idx) {
+                                cur = &rules->tokens[list->rules[candidate].token];
+                                continue;
+                        }
+                }
+
                 dump_token(rules, cur);
                 switch (cur->type) {
                 case TK_RULE:
@@ -26,8 +26,10 @@
 #include "libudev.h"
 #include "sd-netlink.h"
 
+#include "hashmap.h"
 #include "label.h"
 #include "libudev-private.h"
+#include "list.h"
 #include "macro.h"
 #include "strv.h"
 #include "util.h"
@@ -68,15 +70,44 @@ struct udev_watch {
         char *name;
 };
 
+struct queue_index_node;
+struct queue_index_link;
+struct queue_index_bucket;
+
+/* An event as far as the queue index is concerned. Entries must be added to the index in the order of their
+ * sequence numbers. */
+struct queue_entry {
+        unsigned long long int seqnum;
+        const char *devpath;
+        const char *devpath_old;
+        dev_t devnum;
+        int ifindex;
+        bool is_block;
+
+        /* Private to udev-queue-index.c */
+        struct queue_index_node *node;
+        struct queue_index_link *links;
+        size_t n_links;
+        struct queue_index_bucket *devnum_bucket;
+        struct queue_index_bucket *ifindex_bucket;
+        LIST_FIELDS(struct queue_entry, same_devpath);
+        LIST_FIELDS(struct queue_entry, same_devnum);
+        LIST_FIELDS(struct queue_entry, same_ifindex);
+};
+
 /* udev-rules.c */
 struct udev_rules;
 struct udev_rules *udev_rules_new(struct udev *udev, int resolve_names);
 struct udev_rules *udev_rules_unref(struct udev_rules *rules);
+int udev_rules_serialize(struct udev_rules *rules, int *ret_fd);
+struct udev_rules *udev_rules_new_from_fd(struct udev *udev, int fd);
 bool udev_rules_check_timestamp(struct udev_rules *rules);
 void udev_rules_apply_to_event(struct udev_rules *rules, struct udev_event *event,
                                usec_t timeout_usec, usec_t timeout_warn_usec,
                                struct udev_list *properties_list);
 int udev_rules_apply_static_dev_perms(struct udev_rules *rules);
+int udev_rules_enable_timing(struct udev_rules *rules);
+void udev_rules_dump_timing(struct udev_rules *rules, FILE *f);
 
 /* udev-event.c */
 struct udev_event *udev_event_new(struct udev_device *dev);
@@ -105,6 +136,14 @@ void udev_watch_begin(struct udev *udev, struct udev_device *dev);
 void udev_watch_end(struct udev *udev, struct udev_device *dev);
 struct udev_device *udev_watch_lookup(struct udev *udev, int wd);
 
+/* udev-queue-index.c */
+struct queue_index;
+struct queue_index *queue_index_new(void);
+struct queue_index *queue_index_free(struct queue_index *q);
+int queue_index_add(struct queue_index *q, struct queue_entry *e);
+void queue_index_remove(struct queue_index *q, struct queue_entry *e);
+bool queue_index_is_busy(struct queue_index *q, struct queue_entry *e);
+
 /* udev-node.c */
 void udev_node_add(struct udev_device *dev, bool apply,
                    mode_t mode, uid_t uid, gid_t gid,
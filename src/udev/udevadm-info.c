@@ -225,6 +225,8 @@ static void cleanup_db(struct udev *udev) {
 
         (void) unlink("/run/udev/queue.bin");
 
+        (void) udev_device_cleanup_db_binary();
+
         dir1 = opendir("/run/udev/data");
         if (dir1 != NULL)
                 cleanup_dir(dir1, S_ISVTX, 1);
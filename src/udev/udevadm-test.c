@@ -39,6 +39,7 @@ static void help(void) {
                "  -V --version                         Show package version\n"
                "  -a --action=ACTION                   Set action string\n"
                "  -N --resolve-names=early|late|never  When to resolve names\n"
+               "  -t --timing                          Show the time spent in each rule\n"
                , program_invocation_short_name);
 }
 
@@ -47,6 +48,7 @@ static int adm_test(struct udev *udev, int argc, char *argv[]) {
         char filename[UTIL_PATH_SIZE];
         const char *action = "add";
         const char *syspath = NULL;
+        bool timing = false;
         struct udev_list_entry *entry;
         _cleanup_udev_rules_unref_ struct udev_rules *rules = NULL;
         _cleanup_udev_device_unref_ struct udev_device *dev = NULL;
@@ -57,6 +59,7 @@ static int adm_test(struct udev *udev, int argc, char *argv[]) {
         static const struct option options[] = {
                 { "action",        required_argument, NULL, 'a' },
                 { "resolve-names", required_argument, NULL, 'N' },
+                { "timing",        no_argument,       NULL, 't' },
                 { "version",       no_argument,       NULL, 'V' },
                 { "help",          no_argument,       NULL, 'h' },
                 {}
@@ -64,7 +67,7 @@ static int adm_test(struct udev *udev, int argc, char *argv[]) {
 
         log_debug("version %s", PACKAGE_VERSION);
 
-        while ((c = getopt_long(argc, argv, "a:N:Vh", options, NULL)) >= 0)
+        while ((c = getopt_long(argc, argv, "a:N:tVh", options, NULL)) >= 0)
                 switch (c) {
                 case 'a':
                         action = optarg;
@@ -82,6 +85,9 @@ static int adm_test(struct udev *udev, int argc, char *argv[]) {
                                 exit(EXIT_FAILURE);
                         }
                         break;
+                case 't':
+                        timing = true;
+                        break;
                 case 'V':
                         print_version();
                         exit(EXIT_SUCCESS);
@@ -117,6 +123,12 @@ static int adm_test(struct udev *udev, int argc, char *argv[]) {
                 goto out;
         }
 
+        if (timing && udev_rules_enable_timing(rules) < 0) {
+                log_oom();
+                rc = 3;
+                goto out;
+        }
+
         /* add /sys if needed */
         if (!startswith(syspath, "/sys"))
                 strscpyl(filename, sizeof(filename), "/sys", syspath, NULL);
@@ -153,6 +165,11 @@ static int adm_test(struct udev *udev, int argc, char *argv[]) {
                 udev_event_apply_format(event, udev_list_entry_get_name(entry), program, sizeof(program), false);
                 printf("run: '%s'\n", program);
         }
+
+        if (timing) {
+                printf("\nTime spent in rules:\n");
+                udev_rules_dump_timing(rules, stdout);
+        }
 out:
         udev_builtin_exit(udev);
         return rc;
@@ -71,22 +71,31 @@
 static bool arg_debug = false;
 static int arg_daemonize = false;
 static int arg_resolve_names = 1;
+static bool arg_binary_db = false;
 static unsigned arg_children_max;
 static int arg_exec_delay;
 static usec_t arg_event_timeout_usec = 180 * USEC_PER_SEC;
 static usec_t arg_event_timeout_warn_usec = 180 * USEC_PER_SEC / 3;
 
+/* idle workers are kept around for a while, events tend to come in bursts */
+#define WORKER_IDLE_TIMEOUT_USEC (3 * USEC_PER_SEC)
+
 typedef struct Manager {
         struct udev *udev;
         sd_event *event;
         Hashmap *workers;
         LIST_HEAD(struct event, events);
+        struct queue_index *queue_index;
         const char *cgroup;
         pid_t pid; /* the process that originally allocated the manager object */
 
         struct udev_rules *rules;
         struct udev_list properties;
 
+        /* the current rules as a sealed memfd, handed to workers forked with older ones */
+        int rules_fd;
+        unsigned rules_generation;
+
         struct udev_monitor *monitor;
         struct udev_ctrl *ctrl;
         struct udev_ctrl_connection *ctrl_conn_blocking;
@@ -96,9 +105,14 @@ typedef struct Manager {
         sd_event_source *ctrl_event;
         sd_event_source *uevent_event;
         sd_event_source *inotify_event;
+        sd_event_source *kill_workers_event;
 
         usec_t last_usec;
 
+        unsigned n_workers_spawned;
+        unsigned n_events_reused;
+        usec_t spawn_usec;
+
         bool stop_exec_queue:1;
         bool exit:1;
 } Manager;
@@ -117,14 +131,7 @@ struct event {
         struct udev_device *dev_kernel;
         struct worker *worker;
         enum event_state state;
-        unsigned long long int delaying_seqnum;
-        unsigned long long int seqnum;
-        const char *devpath;
-        size_t devpath_len;
-        const char *devpath_old;
-        dev_t devnum;
-        int ifindex;
-        bool is_block;
+        struct queue_entry entry;
         sd_event_source *timeout_warning;
         sd_event_source *timeout;
 };
@@ -143,6 +150,8 @@ struct worker {
         int refcount;
         pid_t pid;
         struct udev_monitor *monitor;
+        int control_fd;
+        unsigned rules_generation;
         enum worker_state state;
         struct event *event;
 };
@@ -159,6 +168,7 @@ static void event_free(struct event *event) {
         assert(event->manager);
 
         LIST_REMOVE(event, event->manager->events, event);
+        queue_index_remove(event->manager->queue_index, &event->entry);
         udev_device_unref(event->dev);
         udev_device_unref(event->dev_kernel);
 
@@ -188,6 +198,7 @@ static void worker_free(struct worker *worker) {
 
         hashmap_remove(worker->manager->workers, PID_TO_PTR(worker->pid));
         udev_monitor_unref(worker->monitor);
+        safe_close(worker->control_fd);
         event_free(worker->event);
 
         free(worker);
@@ -205,7 +216,7 @@ static void manager_workers_free(Manager *manager) {
         manager->workers = hashmap_free(manager->workers);
 }
 
-static int worker_new(struct worker **ret, Manager *manager, struct udev_monitor *worker_monitor, pid_t pid) {
+static int worker_new(struct worker **ret, Manager *manager, struct udev_monitor *worker_monitor, int control_fd, pid_t pid) {
         _cleanup_free_ struct worker *worker = NULL;
         int r;
 
@@ -224,6 +235,8 @@ static int worker_new(struct worker **ret, Manager *manager, struct udev_monitor
         udev_monitor_disconnect(worker_monitor);
         worker->monitor = udev_monitor_ref(worker_monitor);
         worker->pid = pid;
+        worker->control_fd = -1;
+        worker->rules_generation = manager->rules_generation;
 
         r = hashmap_ensure_allocated(&manager->workers, NULL);
         if (r < 0)
@@ -233,6 +246,8 @@ static int worker_new(struct worker **ret, Manager *manager, struct udev_monitor
         if (r < 0)
                 return r;
 
+        worker->control_fd = control_fd;
+
         *ret = worker;
         worker = NULL;
 
@@ -248,7 +263,7 @@ static int on_event_timeout(sd_event_source *s, uint64_t usec, void *userdata) {
         kill_and_sigcont(event->worker->pid, SIGKILL);
         event->worker->state = WORKER_KILLED;
 
-        log_error("seq %llu '%s' killed", udev_device_get_seqnum(event->dev), event->devpath);
+        log_error("seq %llu '%s' killed", udev_device_get_seqnum(event->dev), event->entry.devpath);
 
         return 1;
 }
@@ -258,7 +273,7 @@ static int on_event_timeout_warning(sd_event_source *s, uint64_t usec, void *use
 
         assert(event);
 
-        log_warning("seq %llu '%s' is taking a long time", udev_device_get_seqnum(event->dev), event->devpath);
+        log_warning("seq %llu '%s' is taking a long time", udev_device_get_seqnum(event->dev), event->entry.devpath);
 
         return 1;
 }
@@ -298,11 +313,13 @@ static void manager_free(Manager *manager) {
         sd_event_source_unref(manager->ctrl_event);
         sd_event_source_unref(manager->uevent_event);
         sd_event_source_unref(manager->inotify_event);
+        sd_event_source_unref(manager->kill_workers_event);
 
         udev_unref(manager->udev);
         sd_event_unref(manager->event);
         manager_workers_free(manager);
         event_queue_cleanup(manager, EVENT_UNDEF);
+        queue_index_free(manager->queue_index);
 
         udev_monitor_unref(manager->monitor);
         udev_ctrl_unref(manager->ctrl);
@@ -310,6 +327,7 @@ static void manager_free(Manager *manager) {
 
         udev_list_cleanup(&manager->properties);
         udev_rules_unref(manager->rules);
+        safe_close(manager->rules_fd);
 
         safe_close(manager->fd_inotify);
         safe_close_pair(manager->worker_watch);
@@ -325,9 +343,42 @@ static int worker_send_message(int fd) {
         return loop_write(fd, &message, sizeof(message), false);
 }
 
+static int worker_receive_rules(Manager *manager, int fd) {
+        assert(manager);
+
+        /* take whatever the main daemon sent, only the last rules are used */
+        for (;;) {
+                _cleanup_close_ int rules_fd = -1;
+                struct udev_rules *rules;
+
+                rules_fd = receive_one_fd(fd, MSG_DONTWAIT);
+                if (rules_fd == -EAGAIN)
+                        return 0;
+                if (rules_fd == -EINTR)
+                        continue;
+                if (rules_fd < 0)
+                        return log_error_errno(rules_fd, "worker: failed to receive rules: %m");
+
+                rules = udev_rules_new_from_fd(manager->udev, rules_fd);
+                if (!rules)
+                        return -EINVAL;
+
+                udev_rules_unref(manager->rules);
+                manager->rules = rules;
+
+                /* the main daemon reloaded, which also covers changed builtin configuration */
+                udev_builtin_exit(manager->udev);
+                udev_builtin_init(manager->udev);
+
+                log_debug("worker: switched to new rules");
+        }
+}
+
 static void worker_spawn(Manager *manager, struct event *event) {
         struct udev *udev = event->udev;
         _cleanup_udev_monitor_unref_ struct udev_monitor *worker_monitor = NULL;
+        _cleanup_close_pair_ int control[2] = { -1, -1 };
+        usec_t ts;
         pid_t pid;
         int r = 0;
 
@@ -341,15 +392,24 @@ static void worker_spawn(Manager *manager, struct event *event) {
         if (r < 0)
                 log_error_errno(r, "worker: could not enable receiving of device: %m");
 
+        /* unnamed socket from the main daemon to the worker, to hand over new rules */
+        if (socketpair(AF_LOCAL, SOCK_DGRAM|SOCK_CLOEXEC, 0, control) < 0) {
+                log_error_errno(errno, "worker: could not create control socket: %m");
+                return;
+        }
+
+        ts = now(CLOCK_MONOTONIC);
+
         pid = fork();
         switch (pid) {
         case 0: {
                 struct udev_device *dev = NULL;
                 _cleanup_(sd_netlink_unrefp) sd_netlink *rtnl = NULL;
-                int fd_monitor;
+                int fd_monitor, fd_control;
                 _cleanup_close_ int fd_signal = -1, fd_ep = -1;
                 struct epoll_event ep_signal = { .events = EPOLLIN };
                 struct epoll_event ep_monitor = { .events = EPOLLIN };
+                struct epoll_event ep_control = { .events = EPOLLIN };
                 sigset_t mask;
 
                 /* take initial device from queue */
@@ -365,10 +425,15 @@ static void worker_spawn(Manager *manager, struct event *event) {
                 manager->ctrl_conn_blocking = udev_ctrl_connection_unref(manager->ctrl_conn_blocking);
                 manager->ctrl = udev_ctrl_unref(manager->ctrl);
                 manager->worker_watch[READ_END] = safe_close(manager->worker_watch[READ_END]);
+                manager->rules_fd = safe_close(manager->rules_fd);
+
+                control[WRITE_END] = safe_close(control[WRITE_END]);
+                fd_control = control[READ_END];
 
                 manager->ctrl_event = sd_event_source_unref(manager->ctrl_event);
                 manager->uevent_event = sd_event_source_unref(manager->uevent_event);
                 manager->inotify_event = sd_event_source_unref(manager->inotify_event);
+                manager->kill_workers_event = sd_event_source_unref(manager->kill_workers_event);
 
                 manager->event = sd_event_unref(manager->event);
 
@@ -382,6 +447,7 @@ static void worker_spawn(Manager *manager, struct event *event) {
 
                 fd_monitor = udev_monitor_get_fd(worker_monitor);
                 ep_monitor.data.fd = fd_monitor;
+                ep_control.data.fd = fd_control;
 
                 fd_ep = epoll_create1(EPOLL_CLOEXEC);
                 if (fd_ep < 0) {
@@ -390,7 +456,8 @@ static void worker_spawn(Manager *manager, struct event *event) {
                 }
 
                 if (epoll_ctl(fd_ep, EPOLL_CTL_ADD, fd_signal, &ep_signal) < 0 ||
-                    epoll_ctl(fd_ep, EPOLL_CTL_ADD, fd_monitor, &ep_monitor) < 0) {
+                    epoll_ctl(fd_ep, EPOLL_CTL_ADD, fd_monitor, &ep_monitor) < 0 ||
+                    epoll_ctl(fd_ep, EPOLL_CTL_ADD, fd_control, &ep_control) < 0) {
                         r = log_error_errno(errno, "fail to add fds to epoll: %m");
                         goto out;
                 }
@@ -502,8 +569,17 @@ skip:
 
                                 for (i = 0; i < fdcount; i++) {
                                         if (ev[i].data.fd == fd_monitor && ev[i].events & EPOLLIN) {
+                                                /* new rules are always sent before the event which needs them */
+                                                r = worker_receive_rules(manager, fd_control);
+                                                if (r < 0)
+                                                        goto out;
+
                                                 dev = udev_monitor_receive_device(worker_monitor);
                                                 break;
+                                        } else if (ev[i].data.fd == fd_control && ev[i].events & EPOLLIN) {
+                                                r = worker_receive_rules(manager, fd_control);
+                                                if (r < 0)
+                                                        goto out;
                                         } else if (ev[i].data.fd == fd_signal && ev[i].events & EPOLLIN) {
                                                 struct signalfd_siginfo fdsi;
                                                 ssize_t size;
@@ -533,9 +609,15 @@ out:
         {
                 struct worker *worker;
 
-                r = worker_new(&worker, manager, worker_monitor, pid);
+                control[READ_END] = safe_close(control[READ_END]);
+
+                r = worker_new(&worker, manager, worker_monitor, control[WRITE_END], pid);
                 if (r < 0)
                         return;
+                control[WRITE_END] = -1;
+
+                manager->n_workers_spawned++;
+                manager->spawn_usec += now(CLOCK_MONOTONIC) - ts;
 
                 worker_attach_event(worker, event);
 
@@ -545,6 +627,31 @@ out:
         }
 }
 
+static int worker_send_rules(Manager *manager, struct worker *worker) {
+        int r;
+
+        assert(manager);
+        assert(manager->rules);
+        assert(worker);
+
+        if (worker->rules_generation == manager->rules_generation)
+                return 0;
+
+        if (manager->rules_fd < 0) {
+                r = udev_rules_serialize(manager->rules, &manager->rules_fd);
+                if (r < 0)
+                        return log_error_errno(r, "failed to serialize rules: %m");
+        }
+
+        r = send_one_fd(worker->control_fd, manager->rules_fd, MSG_DONTWAIT);
+        if (r < 0)
+                return log_error_errno(r, "failed to send rules to worker ["PID_FMT"]: %m", worker->pid);
+
+        worker->rules_generation = manager->rules_generation;
+
+        return 0;
+}
+
 static void event_run(Manager *manager, struct event *event) {
         struct worker *worker;
         Iterator i;
@@ -558,6 +665,12 @@ static void event_run(Manager *manager, struct event *event) {
                 if (worker->state != WORKER_IDLE)
                         continue;
 
+                if (worker_send_rules(manager, worker) < 0) {
+                        kill(worker->pid, SIGKILL);
+                        worker->state = WORKER_KILLED;
+                        continue;
+                }
+
                 count = udev_monitor_send_device(manager->monitor, worker->monitor, event->dev);
                 if (count < 0) {
                         log_error_errno(errno, "worker ["PID_FMT"] did not accept message %zi (%m), kill it",
@@ -567,6 +680,7 @@ static void event_run(Manager *manager, struct event *event) {
                         continue;
                 }
                 worker_attach_event(worker, event);
+                manager->n_events_reused++;
                 return;
         }
 
@@ -602,13 +716,19 @@ static int event_queue_insert(Manager *manager, struct udev_device *dev) {
         event->dev = dev;
         event->dev_kernel = udev_device_shallow_clone(dev);
         udev_device_copy_properties(event->dev_kernel, dev);
-        event->seqnum = udev_device_get_seqnum(dev);
-        event->devpath = udev_device_get_devpath(dev);
-        event->devpath_len = strlen(event->devpath);
-        event->devpath_old = udev_device_get_devpath_old(dev);
-        event->devnum = udev_device_get_devnum(dev);
-        event->is_block = streq("block", udev_device_get_subsystem(dev));
-        event->ifindex = udev_device_get_ifindex(dev);
+        event->entry.seqnum = udev_device_get_seqnum(dev);
+        event->entry.devpath = udev_device_get_devpath(dev);
+        event->entry.devpath_old = udev_device_get_devpath_old(dev);
+        event->entry.devnum = udev_device_get_devnum(dev);
+        event->entry.is_block = streq("block", udev_device_get_subsystem(dev));
+        event->entry.ifindex = udev_device_get_ifindex(dev);
+
+        r = queue_index_add(manager->queue_index, &event->entry);
+        if (r < 0) {
+                udev_device_unref(event->dev_kernel);
+                free(event);
+                return r;
+        }
 
         log_debug("seq %llu queued, '%s' '%s'", udev_device_get_seqnum(dev),
              udev_device_get_action(dev), udev_device_get_subsystem(dev));
@@ -641,74 +761,57 @@ static void manager_kill_workers(Manager *manager) {
         }
 }
 
-/* lookup event for identical, parent, child device */
-static bool is_devpath_busy(Manager *manager, struct event *event) {
-        struct event *loop_event;
-        size_t common;
-
-        /* check if queue contains events we depend on */
-        LIST_FOREACH(event, loop_event, manager->events) {
-                /* we already found a later event, earlier can not block us, no need to check again */
-                if (loop_event->seqnum < event->delaying_seqnum)
-                        continue;
+static int on_kill_workers_event(sd_event_source *s, uint64_t usec, void *userdata) {
+        Manager *manager = userdata;
+        char buf[FORMAT_TIMESPAN_MAX];
 
-                /* event we checked earlier still exists, no need to check again */
-                if (loop_event->seqnum == event->delaying_seqnum)
-                        return true;
+        assert(manager);
 
-                /* found ourself, no later event can block us */
-                if (loop_event->seqnum >= event->seqnum)
-                        break;
+        log_debug("cleanup idle workers");
+        manager_kill_workers(manager);
 
-                /* check major/minor */
-                if (major(event->devnum) != 0 && event->devnum == loop_event->devnum && event->is_block == loop_event->is_block)
-                        return true;
+        log_debug("%u workers spawned in %s, %u events handled by already running workers",
+                  manager->n_workers_spawned, format_timespan(buf, sizeof(buf), manager->spawn_usec, 1),
+                  manager->n_events_reused);
 
-                /* check network device ifindex */
-                if (event->ifindex != 0 && event->ifindex == loop_event->ifindex)
-                        return true;
+        sd_notifyf(false,
+                   "STATUS=Processing with %u children at max, %u workers spawned, %u events handled by running workers",
+                   arg_children_max, manager->n_workers_spawned, manager->n_events_reused);
 
-                /* check our old name */
-                if (event->devpath_old != NULL && streq(loop_event->devpath, event->devpath_old)) {
-                        event->delaying_seqnum = loop_event->seqnum;
-                        return true;
-                }
+        return 1;
+}
 
-                /* compare devpath */
-                common = MIN(loop_event->devpath_len, event->devpath_len);
+static void manager_arm_kill_workers(Manager *manager) {
+        usec_t usec;
+        int r;
 
-                /* one devpath is contained in the other? */
-                if (memcmp(loop_event->devpath, event->devpath, common) != 0)
-                        continue;
+        assert(manager);
 
-                /* identical device event found */
-                if (loop_event->devpath_len == event->devpath_len) {
-                        /* devices names might have changed/swapped in the meantime */
-                        if (major(event->devnum) != 0 && (event->devnum != loop_event->devnum || event->is_block != loop_event->is_block))
-                                continue;
-                        if (event->ifindex != 0 && event->ifindex != loop_event->ifindex)
-                                continue;
-                        event->delaying_seqnum = loop_event->seqnum;
-                        return true;
-                }
+        /* We are called after every iteration of the event loop while there are idle workers. Don't push the
+         * timeout further out each time, it counts from when we became idle. event_queue_start() disables the
+         * timer again as soon as there is work. */
+        if (manager->kill_workers_event) {
+                int enabled;
 
-                /* parent device event found */
-                if (event->devpath[common] == '/') {
-                        event->delaying_seqnum = loop_event->seqnum;
-                        return true;
-                }
+                r = sd_event_source_get_enabled(manager->kill_workers_event, &enabled);
+                if (r >= 0 && enabled == SD_EVENT_ONESHOT)
+                        return;
+        }
 
-                /* child device event found */
-                if (loop_event->devpath[common] == '/') {
-                        event->delaying_seqnum = loop_event->seqnum;
-                        return true;
-                }
+        assert_se(sd_event_now(manager->event, CLOCK_MONOTONIC, &usec) >= 0);
+        usec += WORKER_IDLE_TIMEOUT_USEC;
 
-                /* no matching device */
-                continue;
+        if (manager->kill_workers_event) {
+                r = sd_event_source_set_time(manager->kill_workers_event, usec);
+                if (r >= 0)
+                        r = sd_event_source_set_enabled(manager->kill_workers_event, SD_EVENT_ONESHOT);
+        } else
+                r = sd_event_add_time(manager->event, &manager->kill_workers_event, CLOCK_MONOTONIC,
+                                      usec, USEC_PER_SEC, on_kill_workers_event, manager);
+        if (r < 0) {
+                log_debug_errno(r, "failed to arm timer for idle workers, killing them right away: %m");
+                manager_kill_workers(manager);
         }
-
-        return false;
 }
 
 static int on_exit_timeout(sd_event_source *s, uint64_t usec, void *userdata) {
@@ -766,8 +869,10 @@ static void manager_reload(Manager *manager) {
                   "RELOADING=1\n"
                   "STATUS=Flushing configuration...");
 
-        manager_kill_workers(manager);
+        /* workers are kept, they are handed the new rules before their next event */
         manager->rules = udev_rules_unref(manager->rules);
+        manager->rules_fd = safe_close(manager->rules_fd);
+        manager->rules_generation++;
         udev_builtin_exit(manager->udev);
 
         sd_notifyf(false,
@@ -785,6 +890,9 @@ static void event_queue_start(Manager *manager) {
             manager->exit || manager->stop_exec_queue)
                 return;
 
+        if (manager->kill_workers_event)
+                (void) sd_event_source_set_enabled(manager->kill_workers_event, SD_EVENT_OFF);
+
         assert_se(sd_event_now(manager->event, CLOCK_MONOTONIC, &usec) >= 0);
         /* check for changed config, every 3 seconds at most */
         if (manager->last_usec == 0 ||
@@ -809,7 +917,7 @@ static void event_queue_start(Manager *manager) {
                         continue;
 
                 /* do not start event if parent or child event is still running */
-                if (is_devpath_busy(manager, event))
+                if (queue_index_is_busy(manager->queue_index, &event->entry))
                         continue;
 
                 event_run(manager, event);
@@ -1212,7 +1320,7 @@ static int on_sigchld(sd_event_source *s, const struct signalfd_siginfo *si, voi
 
                 if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
                         if (worker->event) {
-                                log_error("worker ["PID_FMT"] failed while handling '%s'", pid, worker->event->devpath);
+                                log_error("worker ["PID_FMT"] failed while handling '%s'", pid, worker->event->entry.devpath);
                                 /* delete state from disk */
                                 udev_device_delete_db(worker->event->dev);
                                 udev_device_tag_index(worker->event->dev, NULL, false);
@@ -1240,8 +1348,7 @@ static int on_post(sd_event_source *s, void *userdata) {
                 /* no pending events */
                 if (!hashmap_isempty(manager->workers)) {
                         /* there are idle workers */
-                        log_debug("cleanup idle workers");
-                        manager_kill_workers(manager);
+                        manager_arm_kill_workers(manager);
                 } else {
                         /* we are idle */
                         if (manager->exit) {
@@ -1351,6 +1458,7 @@ static int listen_fds(int *rctrl, int *rnetlink) {
  *   udev.children_max=<number of workers>     events are fully serialized if set to 1
  *   udev.exec_delay=<number of seconds>       delay execution of every executed program
  *   udev.event_timeout=<number of seconds>    seconds to wait before terminating an event
+ *   udev.binary_db=<boolean>                  keep the device database in a single file
  */
 static int parse_proc_cmdline_item(const char *key, const char *value, void *data) {
         int r = 0;
@@ -1394,6 +1502,14 @@ static int parse_proc_cmdline_item(const char *key, const char *value, void *dat
 
                 r = safe_atoi(value, &arg_exec_delay);
 
+        } else if (proc_cmdline_key_streq(key, "udev.binary_db")) {
+
+                r = parse_boolean(value);
+                if (r >= 0) {
+                        arg_binary_db = r;
+                        r = 0;
+                }
+
         } else if (startswith(key, "udev."))
                 log_warning("Unknown udev kernel command line option \"%s\"", key);
 
@@ -1415,6 +1531,7 @@ static void help(void) {
                "  -t --event-timeout=SECONDS  Seconds to wait before terminating an event\n"
                "  -N --resolve-names=early|late|never\n"
                "                              When to resolve users and groups\n"
+               "  -B --binary-db              Keep the device database in a single file\n"
                , program_invocation_short_name);
 }
 
@@ -1426,6 +1543,7 @@ static int parse_argv(int argc, char *argv[]) {
                 { "exec-delay",         required_argument,      NULL, 'e' },
                 { "event-timeout",      required_argument,      NULL, 't' },
                 { "resolve-names",      required_argument,      NULL, 'N' },
+                { "binary-db",          no_argument,            NULL, 'B' },
                 { "help",               no_argument,            NULL, 'h' },
                 { "version",            no_argument,            NULL, 'V' },
                 {}
@@ -1436,7 +1554,7 @@ static int parse_argv(int argc, char *argv[]) {
         assert(argc >= 0);
         assert(argv);
 
-        while ((c = getopt_long(argc, argv, "c:de:Dt:N:hV", options, NULL)) >= 0) {
+        while ((c = getopt_long(argc, argv, "c:de:Dt:N:BhV", options, NULL)) >= 0) {
                 int r;
 
                 switch (c) {
@@ -1478,6 +1596,9 @@ static int parse_argv(int argc, char *argv[]) {
                                 return 0;
                         }
                         break;
+                case 'B':
+                        arg_binary_db = true;
+                        break;
                 case 'h':
                         help();
                         return 0;
@@ -1508,6 +1629,7 @@ static int manager_new(Manager **ret, int fd_ctrl, int fd_uevent, const char *cg
                 return log_oom();
 
         manager->fd_inotify = -1;
+        manager->rules_fd = -1;
         manager->worker_watch[WRITE_END] = -1;
         manager->worker_watch[READ_END] = -1;
 
@@ -1522,6 +1644,11 @@ static int manager_new(Manager **ret, int fd_ctrl, int fd_uevent, const char *cg
                 return log_error_errno(ENOMEM, "error reading rules");
 
         LIST_HEAD_INIT(manager->events);
+
+        manager->queue_index = queue_index_new();
+        if (!manager->queue_index)
+                return log_oom();
+
         udev_list_init(manager->udev, &manager->properties, true);
 
         manager->cgroup = cgroup;
@@ -1670,6 +1797,8 @@ int main(int argc, char *argv[]) {
                 log_set_max_level(LOG_DEBUG);
         }
 
+        udev_device_set_db_binary(arg_binary_db);
+
         r = must_be_root();
         if (r < 0)
                 goto exit;
@@ -1294,6 +1294,54 @@ EOF
 KERNEL=="sda1", GOTO="does-not-exist"
 KERNEL=="sda1", SYMLINK+="right",
 LABEL="exists"
+EOF
+        },
+        {
+                desc            => "GOTO to a rule of another subsystem",
+                devpath         => "/devices/pci0000:00/0000:00:1f.2/host0/target0:0:0/0:0:0:0/block/sda/sda1",
+                exp_name        => "right",
+                not_exp_name    => "wrong",
+                rules           => <<EOF
+KERNEL=="sda1", GOTO="net"
+KERNEL=="sda1", SYMLINK+="wrong"
+SUBSYSTEM=="net", SYMLINK+="wrong", LABEL="net"
+KERNEL=="sda1", SYMLINK+="right"
+EOF
+        },
+        {
+                desc            => "GOTO to a rule of another kernel name",
+                devpath         => "/devices/pci0000:00/0000:00:1f.2/host0/target0:0:0/0:0:0:0/block/sda/sda1",
+                exp_name        => "right",
+                not_exp_name    => "wrong",
+                rules           => <<EOF
+KERNEL=="sda1", GOTO="tty"
+KERNEL=="sd*", SYMLINK+="wrong"
+KERNEL=="tty*", SYMLINK+="wrong", LABEL="tty"
+KERNEL=="sd*", GOTO="end"
+KERNEL=="sda1", SYMLINK+="wrong"
+LABEL="end"
+KERNEL=="sda1", SYMLINK+="right"
+EOF
+        },
+        {
+                desc            => "KERNEL prefix patterns match like globs",
+                devpath         => "/devices/pci0000:00/0000:00:1f.2/host0/target0:0:0/0:0:0:0/block/sda/sda1",
+                exp_name        => "prefix-111111",
+                not_exp_name    => "wrong",
+                rules           => <<EOF
+KERNEL=="sda1*", ENV{A}="1"
+KERNEL=="sd*", ENV{B}="1"
+KERNEL=="s?a*", ENV{C}="1"
+KERNEL=="*", ENV{D}="1"
+KERNEL!="tty*", ENV{E}="1"
+KERNEL=="sda1|tty*", ENV{F}="1"
+KERNEL=="sda1?*", ENV{A}="0"
+KERNEL=="sda", ENV{B}="0"
+KERNEL=="sdb*", ENV{B}="0"
+KERNEL=="sd?2", ENV{C}="0"
+KERNEL!="sd*", ENV{E}="0"
+KERNEL=="sda", SYMLINK+="wrong"
+KERNEL=="sda1", SYMLINK+="prefix-\$env{A}\$env{B}\$env{C}\$env{D}\$env{E}\$env{F}"
 EOF
         },
         {